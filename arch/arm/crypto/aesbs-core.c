@@ -0,0 +1,459 @@
+/*
+ * Bit-sliced AES for ARM NEON
+ *
+ * Eight blocks are processed at a time in the representation of Käsper
+ * and Schwabe ("Faster and Timing-Attack Resistant AES-GCM", CHES 2009):
+ * the blocks are transposed into eight 128-bit registers, register i
+ * holding bit i of each of the 8 x 16 state bytes, with byte k of every
+ * register standing for state byte k of all eight blocks.  SubBytes then
+ * becomes a boolean circuit evaluated on whole registers, the one of
+ * Boyar and Peralta ("A new combinational logic minimization technique
+ * with applications to cryptology", SEA 2010), and ShiftRows and
+ * MixColumns become byte shuffles within the registers.  Nothing depends
+ * on the data, so unlike table based AES this leaks no timing through
+ * the caches.
+ *
+ * The file is built with -mfpu=neon and must only be entered between
+ * kernel_neon_begin() and kernel_neon_end().  It includes no kernel
+ * headers; see aesbs.h for the interface.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include <arm_neon.h>
+
+#include "aesbs.h"
+
+typedef uint8x16_t bs_t;
+
+/* Byte shuffles within a register: out[i] = in[idx[i]] */
+static const unsigned char aesbs_sr[16] = {	/* ShiftRows */
+	0, 5, 10, 15, 4, 9, 14, 3, 8, 13, 2, 7, 12, 1, 6, 11,
+};
+static const unsigned char aesbs_isr[16] = {	/* InvShiftRows */
+	0, 13, 10, 7, 4, 1, 14, 11, 8, 5, 2, 15, 12, 9, 6, 3,
+};
+static const unsigned char aesbs_rot1[16] = {	/* row r <- row r + 1 */
+	1, 2, 3, 0, 5, 6, 7, 4, 9, 10, 11, 8, 13, 14, 15, 12,
+};
+static const unsigned char aesbs_rot2[16] = {	/* row r <- row r + 2 */
+	2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13,
+};
+
+static inline bs_t bs_shuffle(bs_t x, bs_t idx)
+{
+	uint8x8x2_t t = { { vget_low_u8(x), vget_high_u8(x) } };
+
+	return vcombine_u8(vtbl2_u8(t, vget_low_u8(idx)),
+			   vtbl2_u8(t, vget_high_u8(idx)));
+}
+
+#define SWAPMOVE(a, b, n, m)						\
+do {									\
+	bs_t __t = vandq_u8(veorq_u8(vshrq_n_u8(b, n), a), m);		\
+	a = veorq_u8(a, __t);						\
+	b = veorq_u8(b, vshlq_n_u8(__t, n));				\
+} while (0)
+
+/*
+ * Transpose the 8x8 bit matrix formed by byte k of x[0..7], for every k:
+ * afterwards bit j of byte k of x[i] is bit i of byte k of the old x[j].
+ * The transpose is its own inverse.
+ */
+static inline void bs_transpose(bs_t x[8])
+{
+	const bs_t m1 = vdupq_n_u8(0x55);
+	const bs_t m2 = vdupq_n_u8(0x33);
+	const bs_t m4 = vdupq_n_u8(0x0f);
+
+	SWAPMOVE(x[0], x[1], 1, m1);
+	SWAPMOVE(x[2], x[3], 1, m1);
+	SWAPMOVE(x[4], x[5], 1, m1);
+	SWAPMOVE(x[6], x[7], 1, m1);
+
+	SWAPMOVE(x[0], x[2], 2, m2);
+	SWAPMOVE(x[1], x[3], 2, m2);
+	SWAPMOVE(x[4], x[6], 2, m2);
+	SWAPMOVE(x[5], x[7], 2, m2);
+
+	SWAPMOVE(x[0], x[4], 4, m4);
+	SWAPMOVE(x[1], x[5], 4, m4);
+	SWAPMOVE(x[2], x[6], 4, m4);
+	SWAPMOVE(x[3], x[7], 4, m4);
+}
+
+/*
+ * Load eight blocks as bit planes: after the transpose x[7 - i] holds
+ * bit i of every state byte, so that is plane q[i].
+ */
+static inline void bs_load(bs_t q[8], const unsigned char *in)
+{
+	bs_t x[8];
+	int i;
+
+	for (i = 0; i < 8; i++)
+		x[i] = vld1q_u8(in + 16 * i);
+	bs_transpose(x);
+	for (i = 0; i < 8; i++)
+		q[i] = x[7 - i];
+}
+
+static inline void bs_store(unsigned char *out, const bs_t q[8])
+{
+	bs_t x[8];
+	int i;
+
+	for (i = 0; i < 8; i++)
+		x[7 - i] = q[i];
+	bs_transpose(x);
+	for (i = 0; i < 8; i++)
+		vst1q_u8(out + 16 * i, x[i]);
+}
+
+static inline void bs_add_round_key(bs_t q[8], const unsigned char rk[8][16])
+{
+	int i;
+
+	for (i = 0; i < 8; i++)
+		q[i] = veorq_u8(q[i], vld1q_u8(rk[i]));
+}
+
+static inline void bs_shuffle_all(bs_t q[8], const unsigned char *idx)
+{
+	bs_t perm = vld1q_u8(idx);
+	int i;
+
+	for (i = 0; i < 8; i++)
+		q[i] = bs_shuffle(q[i], perm);
+}
+
+/* Multiply every byte by x in GF(2^8) */
+static inline void bs_xtime(bs_t q[8])
+{
+	bs_t hi = q[7];
+
+	q[7] = q[6];
+	q[6] = q[5];
+	q[5] = q[4];
+	q[4] = veorq_u8(q[3], hi);
+	q[3] = veorq_u8(q[2], hi);
+	q[2] = q[1];
+	q[1] = veorq_u8(q[0], hi);
+	q[0] = hi;
+}
+
+/*
+ * MixColumns: out = 2a ^ 3a1 ^ a2 ^ a3 where aN is row r + N of the same
+ * column, rewritten as 2(a ^ a1) ^ a1 ^ rot2(a ^ a1).
+ */
+static inline void bs_mix_columns(bs_t q[8])
+{
+	bs_t rot1 = vld1q_u8(aesbs_rot1);
+	bs_t rot2 = vld1q_u8(aesbs_rot2);
+	bs_t a1[8], t[8];
+	int i;
+
+	for (i = 0; i < 8; i++) {
+		a1[i] = bs_shuffle(q[i], rot1);
+		t[i] = veorq_u8(q[i], a1[i]);
+	}
+	for (i = 0; i < 8; i++)
+		q[i] = veorq_u8(a1[i], bs_shuffle(t[i], rot2));
+	bs_xtime(t);
+	for (i = 0; i < 8; i++)
+		q[i] = veorq_u8(q[i], t[i]);
+}
+
+/*
+ * InvMixColumns is MixColumns applied after a ^= 4(a ^ a2), since
+ * 0e 0b 0d 09 = (02 03 01 01) * (05 00 04 00) in the circulant ring.
+ */
+static inline void bs_inv_mix_columns(bs_t q[8])
+{
+	bs_t rot2 = vld1q_u8(aesbs_rot2);
+	bs_t t[8];
+	int i;
+
+	for (i = 0; i < 8; i++)
+		t[i] = veorq_u8(q[i], bs_shuffle(q[i], rot2));
+	bs_xtime(t);
+	bs_xtime(t);
+	for (i = 0; i < 8; i++)
+		q[i] = veorq_u8(q[i], t[i]);
+	bs_mix_columns(q);
+}
+
+/*
+ * The S-box circuit of Boyar and Peralta.  Inputs x0..x7 and outputs
+ * s0..s7 are numbered from the most significant bit down.
+ */
+static inline void bs_sbox(bs_t q[8])
+{
+	bs_t x0, x1, x2, x3, x4, x5, x6, x7;
+	bs_t y1, y2, y3, y4, y5, y6, y7, y8, y9;
+	bs_t y10, y11, y12, y13, y14, y15, y16, y17, y18, y19;
+	bs_t y20, y21;
+	bs_t z0, z1, z2, z3, z4, z5, z6, z7, z8, z9;
+	bs_t z10, z11, z12, z13, z14, z15, z16, z17;
+	bs_t t0, t1, t2, t3, t4, t5, t6, t7, t8, t9;
+	bs_t t10, t11, t12, t13, t14, t15, t16, t17, t18, t19;
+	bs_t t20, t21, t22, t23, t24, t25, t26, t27, t28, t29;
+	bs_t t30, t31, t32, t33, t34, t35, t36, t37, t38, t39;
+	bs_t t40, t41, t42, t43, t44, t45, t46, t47, t48, t49;
+	bs_t t50, t51, t52, t53, t54, t55, t56, t57, t58, t59;
+	bs_t t60, t61, t62, t63, t64, t65, t66, t67;
+
+	x0 = q[7];
+	x1 = q[6];
+	x2 = q[5];
+	x3 = q[4];
+	x4 = q[3];
+	x5 = q[2];
+	x6 = q[1];
+	x7 = q[0];
+
+	/* Top linear transformation */
+	y14 = veorq_u8(x3, x5);
+	y13 = veorq_u8(x0, x6);
+	y9 = veorq_u8(x0, x3);
+	y8 = veorq_u8(x0, x5);
+	t0 = veorq_u8(x1, x2);
+	y1 = veorq_u8(t0, x7);
+	y4 = veorq_u8(y1, x3);
+	y12 = veorq_u8(y13, y14);
+	y2 = veorq_u8(y1, x0);
+	y5 = veorq_u8(y1, x6);
+	y3 = veorq_u8(y5, y8);
+	t1 = veorq_u8(x4, y12);
+	y15 = veorq_u8(t1, x5);
+	y20 = veorq_u8(t1, x1);
+	y6 = veorq_u8(y15, x7);
+	y10 = veorq_u8(y15, t0);
+	y11 = veorq_u8(y20, y9);
+	y7 = veorq_u8(x7, y11);
+	y17 = veorq_u8(y10, y11);
+	y19 = veorq_u8(y10, y8);
+	y16 = veorq_u8(t0, y11);
+	y21 = veorq_u8(y13, y16);
+	y18 = veorq_u8(x0, y16);
+
+	/* Non-linear section */
+	t2 = vandq_u8(y12, y15);
+	t3 = vandq_u8(y3, y6);
+	t4 = veorq_u8(t3, t2);
+	t5 = vandq_u8(y4, x7);
+	t6 = veorq_u8(t5, t2);
+	t7 = vandq_u8(y13, y16);
+	t8 = vandq_u8(y5, y1);
+	t9 = veorq_u8(t8, t7);
+	t10 = vandq_u8(y2, y7);
+	t11 = veorq_u8(t10, t7);
+	t12 = vandq_u8(y9, y11);
+	t13 = vandq_u8(y14, y17);
+	t14 = veorq_u8(t13, t12);
+	t15 = vandq_u8(y8, y10);
+	t16 = veorq_u8(t15, t12);
+	t17 = veorq_u8(t4, t14);
+	t18 = veorq_u8(t6, t16);
+	t19 = veorq_u8(t9, t14);
+	t20 = veorq_u8(t11, t16);
+	t21 = veorq_u8(t17, y20);
+	t22 = veorq_u8(t18, y19);
+	t23 = veorq_u8(t19, y21);
+	t24 = veorq_u8(t20, y18);
+
+	t25 = veorq_u8(t21, t22);
+	t26 = vandq_u8(t21, t23);
+	t27 = veorq_u8(t24, t26);
+	t28 = vandq_u8(t25, t27);
+	t29 = veorq_u8(t28, t22);
+	t30 = veorq_u8(t23, t24);
+	t31 = veorq_u8(t22, t26);
+	t32 = vandq_u8(t31, t30);
+	t33 = veorq_u8(t32, t24);
+	t34 = veorq_u8(t23, t33);
+	t35 = veorq_u8(t27, t33);
+	t36 = vandq_u8(t24, t35);
+	t37 = veorq_u8(t36, t34);
+	t38 = veorq_u8(t27, t36);
+	t39 = vandq_u8(t29, t38);
+	t40 = veorq_u8(t25, t39);
+
+	t41 = veorq_u8(t40, t37);
+	t42 = veorq_u8(t29, t33);
+	t43 = veorq_u8(t29, t40);
+	t44 = veorq_u8(t33, t37);
+	t45 = veorq_u8(t42, t41);
+	z0 = vandq_u8(t44, y15);
+	z1 = vandq_u8(t37, y6);
+	z2 = vandq_u8(t33, x7);
+	z3 = vandq_u8(t43, y16);
+	z4 = vandq_u8(t40, y1);
+	z5 = vandq_u8(t29, y7);
+	z6 = vandq_u8(t42, y11);
+	z7 = vandq_u8(t45, y17);
+	z8 = vandq_u8(t41, y10);
+	z9 = vandq_u8(t44, y12);
+	z10 = vandq_u8(t37, y3);
+	z11 = vandq_u8(t33, y4);
+	z12 = vandq_u8(t43, y13);
+	z13 = vandq_u8(t40, y5);
+	z14 = vandq_u8(t29, y2);
+	z15 = vandq_u8(t42, y9);
+	z16 = vandq_u8(t45, y14);
+	z17 = vandq_u8(t41, y8);
+
+	/* Bottom linear transformation */
+	t46 = veorq_u8(z15, z16);
+	t47 = veorq_u8(z10, z11);
+	t48 = veorq_u8(z5, z13);
+	t49 = veorq_u8(z9, z10);
+	t50 = veorq_u8(z2, z12);
+	t51 = veorq_u8(z2, z5);
+	t52 = veorq_u8(z7, z8);
+	t53 = veorq_u8(z0, z3);
+	t54 = veorq_u8(z6, z7);
+	t55 = veorq_u8(z16, z17);
+	t56 = veorq_u8(z12, t48);
+	t57 = veorq_u8(t50, t53);
+	t58 = veorq_u8(z4, t46);
+	t59 = veorq_u8(z3, t54);
+	t60 = veorq_u8(t46, t57);
+	t61 = veorq_u8(z14, t57);
+	t62 = veorq_u8(t52, t58);
+	t63 = veorq_u8(t49, t58);
+	t64 = veorq_u8(z4, t59);
+	t65 = veorq_u8(t61, t62);
+	t66 = veorq_u8(z1, t63);
+	t67 = veorq_u8(t64, t65);
+
+	q[7] = veorq_u8(t59, t63);			/* s0 */
+	q[1] = vmvnq_u8(veorq_u8(t56, t62));		/* s6 */
+	q[0] = vmvnq_u8(veorq_u8(t48, t60));		/* s7 */
+	q[4] = veorq_u8(t53, t66);			/* s3 */
+	q[3] = veorq_u8(t51, t66);			/* s4 */
+	q[2] = veorq_u8(t47, t65);			/* s5 */
+	q[6] = vmvnq_u8(veorq_u8(t64, q[4]));		/* s1 */
+	q[5] = vmvnq_u8(veorq_u8(t55, t67));		/* s2 */
+}
+
+/*
+ * The inverse S-box reuses the forward circuit: with S(x) = A(I(x)) ^ 63,
+ * A the affine map and I inversion, InvS(x) = B(S(B(x ^ 63)) ^ 63) for
+ * B the inverse of A.  bs_inv_affine() computes B(x ^ 63).
+ */
+static inline void bs_inv_affine(bs_t q[8])
+{
+	bs_t q0, q1, q2, q3, q4, q5, q6, q7;
+
+	q0 = vmvnq_u8(q[0]);
+	q1 = vmvnq_u8(q[1]);
+	q2 = q[2];
+	q3 = q[3];
+	q4 = q[4];
+	q5 = vmvnq_u8(q[5]);
+	q6 = vmvnq_u8(q[6]);
+	q7 = q[7];
+
+	q[7] = veorq_u8(veorq_u8(q1, q4), q6);
+	q[6] = veorq_u8(veorq_u8(q0, q3), q5);
+	q[5] = veorq_u8(veorq_u8(q7, q2), q4);
+	q[4] = veorq_u8(veorq_u8(q6, q1), q3);
+	q[3] = veorq_u8(veorq_u8(q5, q0), q2);
+	q[2] = veorq_u8(veorq_u8(q4, q7), q1);
+	q[1] = veorq_u8(veorq_u8(q3, q6), q0);
+	q[0] = veorq_u8(veorq_u8(q2, q5), q7);
+}
+
+static inline void bs_inv_sbox(bs_t q[8])
+{
+	bs_inv_affine(q);
+	bs_sbox(q);
+	bs_inv_affine(q);
+}
+
+void aesbs_convert_key(struct aesbs_key *key, const unsigned int *key_enc,
+		       int rounds)
+{
+	int r, i, k;
+
+	key->rounds = rounds;
+	for (r = 0; r <= rounds; r++) {
+		for (k = 0; k < 16; k++) {
+			/* key_enc holds the round keys as little endian words */
+			unsigned int b = key_enc[4 * r + k / 4] >> (8 * (k % 4));
+
+			for (i = 0; i < 8; i++)
+				key->rk[r][i][k] = (b >> i) & 1 ? 0xff : 0;
+		}
+	}
+}
+
+static void aesbs_encrypt_bs(const struct aesbs_key *key, bs_t q[8])
+{
+	int r;
+
+	bs_add_round_key(q, key->rk[0]);
+	for (r = 1; r < key->rounds; r++) {
+		bs_sbox(q);
+		bs_shuffle_all(q, aesbs_sr);
+		bs_mix_columns(q);
+		bs_add_round_key(q, key->rk[r]);
+	}
+	bs_sbox(q);
+	bs_shuffle_all(q, aesbs_sr);
+	bs_add_round_key(q, key->rk[r]);
+}
+
+static void aesbs_decrypt_bs(const struct aesbs_key *key, bs_t q[8])
+{
+	int r;
+
+	bs_add_round_key(q, key->rk[key->rounds]);
+	for (r = key->rounds - 1; r > 0; r--) {
+		bs_shuffle_all(q, aesbs_isr);
+		bs_inv_sbox(q);
+		bs_add_round_key(q, key->rk[r]);
+		bs_inv_mix_columns(q);
+	}
+	bs_shuffle_all(q, aesbs_isr);
+	bs_inv_sbox(q);
+	bs_add_round_key(q, key->rk[0]);
+}
+
+static void aesbs_crypt8(const struct aesbs_key *key, unsigned char *out,
+			 const unsigned char *in, int blocks,
+			 void (*fn)(const struct aesbs_key *, bs_t *))
+{
+	unsigned char buf[AESBS_BLOCKS * 16];
+	bs_t q[8];
+	int i;
+
+	if (blocks == AESBS_BLOCKS) {
+		bs_load(q, in);
+		fn(key, q);
+		bs_store(out, q);
+		return;
+	}
+
+	for (i = 0; i < blocks * 16; i++)
+		buf[i] = in[i];
+	bs_load(q, buf);
+	fn(key, q);
+	bs_store(buf, q);
+	for (i = 0; i < blocks * 16; i++)
+		out[i] = buf[i];
+}
+
+void aesbs_encrypt8(const struct aesbs_key *key, unsigned char *out,
+		    const unsigned char *in, int blocks)
+{
+	aesbs_crypt8(key, out, in, blocks, aesbs_encrypt_bs);
+}
+
+void aesbs_decrypt8(const struct aesbs_key *key, unsigned char *out,
+		    const unsigned char *in, int blocks)
+{
+	aesbs_crypt8(key, out, in, blocks, aesbs_decrypt_bs);
+}
@@ -0,0 +1,503 @@
+/*
+ * Bit-sliced AES for ARM NEON: ECB, CBC, CTR and XTS glue
+ *
+ * The NEON core in aesbs-core.c works on eight blocks at a time, so the
+ * modes that can encrypt or decrypt blocks independently are done here:
+ * ECB, CBC decryption, CTR and XTS.  CBC encryption is inherently serial
+ * and uses the scalar AES cipher, as does everything when NEON cannot be
+ * used in the calling context (hard interrupts).
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include <linux/crypto.h>
+#include <linux/err.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/string.h>
+#include <crypto/aes.h>
+#include <crypto/algapi.h>
+#include <crypto/b128ops.h>
+#include <crypto/gf128mul.h>
+
+#include <asm/neon.h>
+
+#include "aesbs.h"
+
+#define AESBS_BATCH	(AESBS_BLOCKS * AES_BLOCK_SIZE)
+
+struct aesbs_ctx {
+	struct aesbs_key	key;
+	struct crypto_cipher	*fallback;	/* scalar AES, same key */
+};
+
+struct aesbs_xts_ctx {
+	struct aesbs_ctx	crypt;
+	struct crypto_cipher	*tweak;
+};
+
+static int aesbs_set_key(struct aesbs_ctx *ctx, u32 *flags, const u8 *in_key,
+			 unsigned int key_len)
+{
+	struct crypto_aes_ctx rk;
+	int err;
+
+	err = crypto_aes_expand_key(&rk, in_key, key_len);
+	if (err) {
+		*flags |= CRYPTO_TFM_RES_BAD_KEY_LEN;
+		return err;
+	}
+	aesbs_convert_key(&ctx->key, rk.key_enc, 6 + key_len / 4);
+	memset(&rk, 0, sizeof(rk));
+
+	return crypto_cipher_setkey(ctx->fallback, in_key, key_len);
+}
+
+static int aesbs_setkey(struct crypto_tfm *tfm, const u8 *in_key,
+			unsigned int key_len)
+{
+	return aesbs_set_key(crypto_tfm_ctx(tfm), &tfm->crt_flags, in_key,
+			     key_len);
+}
+
+static int aesbs_xts_setkey(struct crypto_tfm *tfm, const u8 *in_key,
+			    unsigned int key_len)
+{
+	struct aesbs_xts_ctx *ctx = crypto_tfm_ctx(tfm);
+	int err;
+
+	if (key_len % 2) {
+		tfm->crt_flags |= CRYPTO_TFM_RES_BAD_KEY_LEN;
+		return -EINVAL;
+	}
+	key_len /= 2;
+
+	err = aesbs_set_key(&ctx->crypt, &tfm->crt_flags, in_key, key_len);
+	if (err)
+		return err;
+	return crypto_cipher_setkey(ctx->tweak, in_key + key_len, key_len);
+}
+
+/*
+ * Encrypt or decrypt @blocks independent blocks, with NEON if @neon, else
+ * one at a time with the scalar cipher.  @out may equal @in.
+ */
+static void aesbs_crypt(struct aesbs_ctx *ctx, u8 *out, const u8 *in,
+			unsigned int blocks, bool enc, bool neon)
+{
+	unsigned int n;
+
+	if (!neon) {
+		for (; blocks; blocks--) {
+			if (enc)
+				crypto_cipher_encrypt_one(ctx->fallback, out, in);
+			else
+				crypto_cipher_decrypt_one(ctx->fallback, out, in);
+			out += AES_BLOCK_SIZE;
+			in += AES_BLOCK_SIZE;
+		}
+		return;
+	}
+
+	for (; blocks; blocks -= n) {
+		n = min_t(unsigned int, blocks, AESBS_BLOCKS);
+		if (enc)
+			aesbs_encrypt8(&ctx->key, out, in, n);
+		else
+			aesbs_decrypt8(&ctx->key, out, in, n);
+		out += n * AES_BLOCK_SIZE;
+		in += n * AES_BLOCK_SIZE;
+	}
+}
+
+/*
+ * Start a walk over the request, in chunks of at least @bsize bytes where
+ * the scatterlists allow it, and claim NEON for the duration if the
+ * context allows it.  The walk must not sleep from here on.
+ */
+static bool aesbs_walk_start(struct blkcipher_desc *desc,
+			     struct blkcipher_walk *walk, unsigned int bsize,
+			     int *err)
+{
+	bool neon = may_use_neon();
+
+	*err = blkcipher_walk_virt_block(desc, walk, bsize);
+	desc->flags &= ~CRYPTO_TFM_REQ_MAY_SLEEP;
+	if (neon)
+		kernel_neon_begin();
+	return neon;
+}
+
+static void aesbs_walk_end(bool neon)
+{
+	if (neon)
+		kernel_neon_end();
+}
+
+static int aesbs_ecb_crypt(struct blkcipher_desc *desc,
+			   struct scatterlist *dst, struct scatterlist *src,
+			   unsigned int nbytes, bool enc)
+{
+	struct aesbs_ctx *ctx = crypto_blkcipher_ctx(desc->tfm);
+	struct blkcipher_walk walk;
+	bool neon;
+	int err;
+
+	blkcipher_walk_init(&walk, dst, src, nbytes);
+	neon = aesbs_walk_start(desc, &walk, AESBS_BATCH, &err);
+
+	while ((nbytes = walk.nbytes)) {
+		aesbs_crypt(ctx, walk.dst.virt.addr, walk.src.virt.addr,
+			    nbytes / AES_BLOCK_SIZE, enc, neon);
+		err = blkcipher_walk_done(desc, &walk,
+					  nbytes % AES_BLOCK_SIZE);
+	}
+
+	aesbs_walk_end(neon);
+	return err;
+}
+
+static int aesbs_ecb_encrypt(struct blkcipher_desc *desc,
+			     struct scatterlist *dst, struct scatterlist *src,
+			     unsigned int nbytes)
+{
+	return aesbs_ecb_crypt(desc, dst, src, nbytes, true);
+}
+
+static int aesbs_ecb_decrypt(struct blkcipher_desc *desc,
+			     struct scatterlist *dst, struct scatterlist *src,
+			     unsigned int nbytes)
+{
+	return aesbs_ecb_crypt(desc, dst, src, nbytes, false);
+}
+
+/* Serial: no use for NEON */
+static int aesbs_cbc_encrypt(struct blkcipher_desc *desc,
+			     struct scatterlist *dst, struct scatterlist *src,
+			     unsigned int nbytes)
+{
+	struct aesbs_ctx *ctx = crypto_blkcipher_ctx(desc->tfm);
+	struct blkcipher_walk walk;
+	int err;
+
+	blkcipher_walk_init(&walk, dst, src, nbytes);
+	err = blkcipher_walk_virt(desc, &walk);
+
+	while ((nbytes = walk.nbytes)) {
+		u8 *src = walk.src.virt.addr;
+		u8 *dst = walk.dst.virt.addr;
+
+		for (; nbytes >= AES_BLOCK_SIZE; nbytes -= AES_BLOCK_SIZE) {
+			crypto_xor(walk.iv, src, AES_BLOCK_SIZE);
+			crypto_cipher_encrypt_one(ctx->fallback, dst, walk.iv);
+			memcpy(walk.iv, dst, AES_BLOCK_SIZE);
+			src += AES_BLOCK_SIZE;
+			dst += AES_BLOCK_SIZE;
+		}
+		err = blkcipher_walk_done(desc, &walk, nbytes);
+	}
+
+	return err;
+}
+
+static int aesbs_cbc_decrypt(struct blkcipher_desc *desc,
+			     struct scatterlist *dst, struct scatterlist *src,
+			     unsigned int nbytes)
+{
+	struct aesbs_ctx *ctx = crypto_blkcipher_ctx(desc->tfm);
+	struct blkcipher_walk walk;
+	u8 ct[AESBS_BATCH];
+	bool neon;
+	int err;
+
+	blkcipher_walk_init(&walk, dst, src, nbytes);
+	neon = aesbs_walk_start(desc, &walk, AESBS_BATCH, &err);
+
+	while ((nbytes = walk.nbytes)) {
+		u8 *src = walk.src.virt.addr;
+		u8 *dst = walk.dst.virt.addr;
+
+		while (nbytes >= AES_BLOCK_SIZE) {
+			unsigned int n = min_t(unsigned int, AESBS_BLOCKS,
+					       nbytes / AES_BLOCK_SIZE);
+			unsigned int len = n * AES_BLOCK_SIZE;
+
+			/* Keep the ciphertext: dst may overwrite it */
+			memcpy(ct, src, len);
+			aesbs_crypt(ctx, dst, ct, n, false, neon);
+			crypto_xor(dst, walk.iv, AES_BLOCK_SIZE);
+			crypto_xor(dst + AES_BLOCK_SIZE, ct,
+				   len - AES_BLOCK_SIZE);
+			memcpy(walk.iv, ct + len - AES_BLOCK_SIZE,
+			       AES_BLOCK_SIZE);
+
+			src += len;
+			dst += len;
+			nbytes -= len;
+		}
+		err = blkcipher_walk_done(desc, &walk, nbytes);
+	}
+
+	aesbs_walk_end(neon);
+	return err;
+}
+
+static int aesbs_ctr_crypt(struct blkcipher_desc *desc,
+			   struct scatterlist *dst, struct scatterlist *src,
+			   unsigned int nbytes)
+{
+	struct aesbs_ctx *ctx = crypto_blkcipher_ctx(desc->tfm);
+	struct blkcipher_walk walk;
+	u8 ks[AESBS_BATCH];
+	bool neon;
+	int err;
+
+	/* Whole blocks only until the end, so walk one block at a time */
+	blkcipher_walk_init(&walk, dst, src, nbytes);
+	neon = aesbs_walk_start(desc, &walk, AES_BLOCK_SIZE, &err);
+
+	while ((nbytes = walk.nbytes) >= AES_BLOCK_SIZE) {
+		u8 *src = walk.src.virt.addr;
+		u8 *dst = walk.dst.virt.addr;
+
+		while (nbytes >= AES_BLOCK_SIZE) {
+			unsigned int n = min_t(unsigned int, AESBS_BLOCKS,
+					       nbytes / AES_BLOCK_SIZE);
+			unsigned int len = n * AES_BLOCK_SIZE;
+			unsigned int i;
+
+			for (i = 0; i < n; i++) {
+				memcpy(ks + i * AES_BLOCK_SIZE, walk.iv,
+				       AES_BLOCK_SIZE);
+				crypto_inc(walk.iv, AES_BLOCK_SIZE);
+			}
+			aesbs_crypt(ctx, ks, ks, n, true, neon);
+			if (dst != src)
+				memcpy(dst, src, len);
+			crypto_xor(dst, ks, len);
+
+			src += len;
+			dst += len;
+			nbytes -= len;
+		}
+		err = blkcipher_walk_done(desc, &walk, nbytes);
+	}
+
+	/* Final partial block */
+	if (walk.nbytes) {
+		nbytes = walk.nbytes;
+		aesbs_crypt(ctx, ks, walk.iv, 1, true, neon);
+		crypto_xor(ks, walk.src.virt.addr, nbytes);
+		memcpy(walk.dst.virt.addr, ks, nbytes);
+		crypto_inc(walk.iv, AES_BLOCK_SIZE);
+		err = blkcipher_walk_done(desc, &walk, 0);
+	}
+
+	aesbs_walk_end(neon);
+	return err;
+}
+
+static int aesbs_xts_crypt(struct blkcipher_desc *desc,
+			   struct scatterlist *dst, struct scatterlist *src,
+			   unsigned int nbytes, bool enc)
+{
+	struct aesbs_xts_ctx *ctx = crypto_blkcipher_ctx(desc->tfm);
+	struct blkcipher_walk walk;
+	be128 t[AESBS_BLOCKS], tw;
+	u8 buf[AESBS_BATCH];
+	bool neon;
+	int err;
+
+	blkcipher_walk_init(&walk, dst, src, nbytes);
+	neon = aesbs_walk_start(desc, &walk, AESBS_BATCH, &err);
+
+	/* tw is the tweak for the next block */
+	crypto_cipher_encrypt_one(ctx->tweak, (u8 *)&tw, walk.iv);
+
+	while ((nbytes = walk.nbytes)) {
+		u8 *src = walk.src.virt.addr;
+		u8 *dst = walk.dst.virt.addr;
+
+		while (nbytes >= AES_BLOCK_SIZE) {
+			unsigned int n = min_t(unsigned int, AESBS_BLOCKS,
+					       nbytes / AES_BLOCK_SIZE);
+			unsigned int len = n * AES_BLOCK_SIZE;
+			unsigned int i;
+
+			for (i = 0; i < n; i++) {
+				t[i] = tw;
+				gf128mul_x_ble(&tw, &t[i]);
+			}
+			memcpy(buf, src, len);
+			crypto_xor(buf, (u8 *)t, len);
+			aesbs_crypt(&ctx->crypt, buf, buf, n, enc, neon);
+			crypto_xor(buf, (u8 *)t, len);
+			memcpy(dst, buf, len);
+
+			src += len;
+			dst += len;
+			nbytes -= len;
+		}
+		err = blkcipher_walk_done(desc, &walk, nbytes);
+	}
+
+	aesbs_walk_end(neon);
+	return err;
+}
+
+static int aesbs_xts_encrypt(struct blkcipher_desc *desc,
+			     struct scatterlist *dst, struct scatterlist *src,
+			     unsigned int nbytes)
+{
+	return aesbs_xts_crypt(desc, dst, src, nbytes, true);
+}
+
+static int aesbs_xts_decrypt(struct blkcipher_desc *desc,
+			     struct scatterlist *dst, struct scatterlist *src,
+			     unsigned int nbytes)
+{
+	return aesbs_xts_crypt(desc, dst, src, nbytes, false);
+}
+
+static int aesbs_init_tfm(struct crypto_tfm *tfm)
+{
+	struct aesbs_ctx *ctx = crypto_tfm_ctx(tfm);
+
+	ctx->fallback = crypto_alloc_cipher("aes", 0, 0);
+	if (IS_ERR(ctx->fallback))
+		return PTR_ERR(ctx->fallback);
+	return 0;
+}
+
+static void aesbs_exit_tfm(struct crypto_tfm *tfm)
+{
+	struct aesbs_ctx *ctx = crypto_tfm_ctx(tfm);
+
+	crypto_free_cipher(ctx->fallback);
+}
+
+static int aesbs_xts_init_tfm(struct crypto_tfm *tfm)
+{
+	struct aesbs_xts_ctx *ctx = crypto_tfm_ctx(tfm);
+	int err;
+
+	err = aesbs_init_tfm(tfm);
+	if (err)
+		return err;
+
+	ctx->tweak = crypto_alloc_cipher("aes", 0, 0);
+	if (IS_ERR(ctx->tweak)) {
+		aesbs_exit_tfm(tfm);
+		return PTR_ERR(ctx->tweak);
+	}
+	return 0;
+}
+
+static void aesbs_xts_exit_tfm(struct crypto_tfm *tfm)
+{
+	struct aesbs_xts_ctx *ctx = crypto_tfm_ctx(tfm);
+
+	crypto_free_cipher(ctx->tweak);
+	aesbs_exit_tfm(tfm);
+}
+
+static struct crypto_alg aesbs_algs[] = { {
+	.cra_name		= "ecb(aes)",
+	.cra_driver_name	= "ecb-aes-neonbs",
+	.cra_priority		= 300,
+	.cra_flags		= CRYPTO_ALG_TYPE_BLKCIPHER,
+	.cra_blocksize		= AES_BLOCK_SIZE,
+	.cra_ctxsize		= sizeof(struct aesbs_ctx),
+	.cra_type		= &crypto_blkcipher_type,
+	.cra_module		= THIS_MODULE,
+	.cra_init		= aesbs_init_tfm,
+	.cra_exit		= aesbs_exit_tfm,
+	.cra_blkcipher = {
+		.min_keysize	= AES_MIN_KEY_SIZE,
+		.max_keysize	= AES_MAX_KEY_SIZE,
+		.setkey		= aesbs_setkey,
+		.encrypt	= aesbs_ecb_encrypt,
+		.decrypt	= aesbs_ecb_decrypt,
+	},
+}, {
+	.cra_name		= "cbc(aes)",
+	.cra_driver_name	= "cbc-aes-neonbs",
+	.cra_priority		= 300,
+	.cra_flags		= CRYPTO_ALG_TYPE_BLKCIPHER,
+	.cra_blocksize		= AES_BLOCK_SIZE,
+	.cra_ctxsize		= sizeof(struct aesbs_ctx),
+	.cra_type		= &crypto_blkcipher_type,
+	.cra_module		= THIS_MODULE,
+	.cra_init		= aesbs_init_tfm,
+	.cra_exit		= aesbs_exit_tfm,
+	.cra_blkcipher = {
+		.min_keysize	= AES_MIN_KEY_SIZE,
+		.max_keysize	= AES_MAX_KEY_SIZE,
+		.ivsize		= AES_BLOCK_SIZE,
+		.setkey		= aesbs_setkey,
+		.encrypt	= aesbs_cbc_encrypt,
+		.decrypt	= aesbs_cbc_decrypt,
+	},
+}, {
+	.cra_name		= "ctr(aes)",
+	.cra_driver_name	= "ctr-aes-neonbs",
+	.cra_priority		= 300,
+	.cra_flags		= CRYPTO_ALG_TYPE_BLKCIPHER,
+	.cra_blocksize		= 1,
+	.cra_ctxsize		= sizeof(struct aesbs_ctx),
+	.cra_type		= &crypto_blkcipher_type,
+	.cra_module		= THIS_MODULE,
+	.cra_init		= aesbs_init_tfm,
+	.cra_exit		= aesbs_exit_tfm,
+	.cra_blkcipher = {
+		.min_keysize	= AES_MIN_KEY_SIZE,
+		.max_keysize	= AES_MAX_KEY_SIZE,
+		.ivsize		= AES_BLOCK_SIZE,
+		.setkey		= aesbs_setkey,
+		.encrypt	= aesbs_ctr_crypt,
+		.decrypt	= aesbs_ctr_crypt,
+	},
+}, {
+	.cra_name		= "xts(aes)",
+	.cra_driver_name	= "xts-aes-neonbs",
+	.cra_priority		= 300,
+	.cra_flags		= CRYPTO_ALG_TYPE_BLKCIPHER,
+	.cra_blocksize		= AES_BLOCK_SIZE,
+	.cra_ctxsize		= sizeof(struct aesbs_xts_ctx),
+	.cra_type		= &crypto_blkcipher_type,
+	.cra_module		= THIS_MODULE,
+	.cra_init		= aesbs_xts_init_tfm,
+	.cra_exit		= aesbs_xts_exit_tfm,
+	.cra_blkcipher = {
+		.min_keysize	= 2 * AES_MIN_KEY_SIZE,
+		.max_keysize	= 2 * AES_MAX_KEY_SIZE,
+		.ivsize		= AES_BLOCK_SIZE,
+		.setkey		= aesbs_xts_setkey,
+		.encrypt	= aesbs_xts_encrypt,
+		.decrypt	= aesbs_xts_decrypt,
+	},
+} };
+
+static int __init aesbs_mod_init(void)
+{
+	if (!cpu_has_neon())
+		return -ENODEV;
+
+	return crypto_register_algs(aesbs_algs, ARRAY_SIZE(aesbs_algs));
+}
+
+static void __exit aesbs_mod_exit(void)
+{
+	crypto_unregister_algs(aesbs_algs, ARRAY_SIZE(aesbs_algs));
+}
+
+module_init(aesbs_mod_init);
+module_exit(aesbs_mod_exit);
+
+MODULE_DESCRIPTION("Bit-sliced AES using NEON instructions");
+MODULE_LICENSE("GPL");
+MODULE_ALIAS("ecb(aes)");
+MODULE_ALIAS("cbc(aes)");
+MODULE_ALIAS("ctr(aes)");
+MODULE_ALIAS("xts(aes)");
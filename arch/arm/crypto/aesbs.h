@@ -0,0 +1,40 @@
+/*
+ * Bit-sliced AES for ARM NEON: interface between the glue code and the
+ * NEON core.  The core is built with -mfpu=neon and includes no kernel
+ * headers, so only plain C types are used here.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#ifndef __ARM_CRYPTO_AESBS_H
+#define __ARM_CRYPTO_AESBS_H
+
+#define AESBS_BLOCKS		8	/* blocks processed in parallel */
+#define AESBS_MAX_ROUNDS	14
+
+/* Bit-sliced round keys: eight 16-byte bit planes per round key */
+struct aesbs_key {
+	unsigned char	rk[AESBS_MAX_ROUNDS + 1][8][16];
+	int		rounds;
+};
+
+/*
+ * Convert the expanded encryption key (crypto_aes_ctx.key_enc, as built
+ * by crypto_aes_expand_key()) into bit-sliced round keys.  Plain C, no
+ * NEON required.
+ */
+void aesbs_convert_key(struct aesbs_key *key, const unsigned int *key_enc,
+		       int rounds);
+
+/*
+ * Encrypt or decrypt @blocks (1 to AESBS_BLOCKS) independent 16-byte
+ * blocks from @in to @out.  Must be called between kernel_neon_begin()
+ * and kernel_neon_end().
+ */
+void aesbs_encrypt8(const struct aesbs_key *key, unsigned char *out,
+		    const unsigned char *in, int blocks);
+void aesbs_decrypt8(const struct aesbs_key *key, unsigned char *out,
+		    const unsigned char *in, int blocks);
+
+#endif /* __ARM_CRYPTO_AESBS_H */
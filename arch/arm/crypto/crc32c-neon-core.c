@@ -0,0 +1,129 @@
+/*
+ * CRC32C folding for ARM NEON
+ *
+ * The message is folded sixty-four bytes at a time into four 128-bit
+ * accumulators: each accumulator is multiplied, as a polynomial, by
+ * x^n mod P for the distance it moves and the next block is xored in.
+ * The four are then folded into one 16-byte block with the same CRC as
+ * the whole input, which the caller finishes with the table code.
+ *
+ * ARMv7 has no 64-bit carry-less multiply, only VMULL.P8 (eight 8x8 ->
+ * 16 bit products), so pmull64() builds one out of nine of those.
+ *
+ * Data and constants are bit reflected; the constants are x^(n-1) mod P
+ * so that the product of two reflected values, one bit short of 128,
+ * needs no shift.  Little endian only.
+ *
+ * The file is built with -mfpu=neon and must only be entered between
+ * kernel_neon_begin() and kernel_neon_end().  It includes no kernel
+ * headers.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include <arm_neon.h>
+
+void crc32c_neon_fold(uint8_t *out, uint32_t crc, const uint8_t *data,
+		      unsigned int len);
+
+/* rev64(x^n mod P) for n = 575, 511 (64-byte stride), 191, 127 (16) */
+static const uint64_t crc32c_k[] = {
+	0x1c19243b00000000ULL, 0x75bba45b00000000ULL,
+	0x3743f7bd00000000ULL, 0x3171d43000000000ULL,
+};
+
+static inline uint64x2_t pmull8(uint8x8_t a, uint8x8_t b)
+{
+	return vreinterpretq_u64_p16(vmull_p8(vreinterpret_p8_u8(a),
+					      vreinterpret_p8_u8(b)));
+}
+
+/*
+ * The partial products of a byte-rotated operand land one lane too far
+ * in their top part; move that part down and keep @mask of it in the
+ * top half.
+ */
+static inline uint64x2_t fixup(uint64x2_t t, uint64x1_t mask)
+{
+	uint64x1_t lo = vget_low_u64(t), hi = vget_high_u64(t);
+
+	lo = veor_u64(lo, hi);
+	hi = vand_u64(hi, mask);
+	lo = veor_u64(lo, hi);
+	return vcombine_u64(lo, hi);
+}
+
+/*
+ * 64 x 64 -> 128 bit carry-less multiply, after Camara, Gouvea, Lopez
+ * and Dahab, "Fast Software Polynomial Multiplication on ARM Processors
+ * Using the NEON Engine".
+ */
+static inline uint64x2_t pmull64(uint64x1_t a64, uint64x1_t b64)
+{
+	uint8x8_t a = vreinterpret_u8_u64(a64), b = vreinterpret_u8_u64(b64);
+	uint64x2_t l, m, n, k, r;
+
+	l = veorq_u64(pmull8(vext_u8(a, a, 1), b), pmull8(a, vext_u8(b, b, 1)));
+	m = veorq_u64(pmull8(vext_u8(a, a, 2), b), pmull8(a, vext_u8(b, b, 2)));
+	n = veorq_u64(pmull8(vext_u8(a, a, 3), b), pmull8(a, vext_u8(b, b, 3)));
+	k = pmull8(a, vext_u8(b, b, 4));
+
+	l = fixup(l, vcreate_u64(0x0000ffffffffffffULL));
+	m = fixup(m, vcreate_u64(0x00000000ffffffffULL));
+	n = fixup(n, vcreate_u64(0x000000000000ffffULL));
+	k = fixup(k, vcreate_u64(0));
+
+	r = pmull8(a, b);
+	r = veorq_u64(r, vreinterpretq_u64_u8(vextq_u8(vreinterpretq_u8_u64(l),
+						      vreinterpretq_u8_u64(l), 15)));
+	r = veorq_u64(r, vreinterpretq_u64_u8(vextq_u8(vreinterpretq_u8_u64(m),
+						      vreinterpretq_u8_u64(m), 14)));
+	r = veorq_u64(r, vreinterpretq_u64_u8(vextq_u8(vreinterpretq_u8_u64(n),
+						      vreinterpretq_u8_u64(n), 13)));
+	r = veorq_u64(r, vreinterpretq_u64_u8(vextq_u8(vreinterpretq_u8_u64(k),
+						      vreinterpretq_u8_u64(k), 12)));
+	return r;
+}
+
+/* x * x^n mod P for the two halves of x, plus y */
+static inline uint64x2_t fold(uint64x2_t x, uint64x2_t y,
+			      uint64x1_t klo, uint64x1_t khi)
+{
+	return veorq_u64(veorq_u64(pmull64(vget_low_u64(x), klo),
+				   pmull64(vget_high_u64(x), khi)), y);
+}
+
+#define LOAD(p)		vreinterpretq_u64_u8(vld1q_u8(p))
+
+/*
+ * Fold @len bytes at @data, a non-zero multiple of 64, with initial value
+ * @crc into the 16 bytes at @out.  __crc32c_le(0, out, 16) then gives the
+ * CRC of the whole input.
+ */
+void crc32c_neon_fold(uint8_t *out, uint32_t crc, const uint8_t *data,
+		      unsigned int len)
+{
+	uint64x1_t k64lo = vld1_u64(&crc32c_k[0]), k64hi = vld1_u64(&crc32c_k[1]);
+	uint64x1_t k16lo = vld1_u64(&crc32c_k[2]), k16hi = vld1_u64(&crc32c_k[3]);
+	uint64x2_t x0, x1, x2, x3;
+
+	x0 = veorq_u64(LOAD(data),
+		       vcombine_u64(vcreate_u64(crc), vcreate_u64(0)));
+	x1 = LOAD(data + 16);
+	x2 = LOAD(data + 32);
+	x3 = LOAD(data + 48);
+
+	for (len -= 64, data += 64; len; len -= 64, data += 64) {
+		x0 = fold(x0, LOAD(data), k64lo, k64hi);
+		x1 = fold(x1, LOAD(data + 16), k64lo, k64hi);
+		x2 = fold(x2, LOAD(data + 32), k64lo, k64hi);
+		x3 = fold(x3, LOAD(data + 48), k64lo, k64hi);
+	}
+
+	x1 = fold(x0, x1, k16lo, k16hi);
+	x2 = fold(x1, x2, k16lo, k16hi);
+	x3 = fold(x2, x3, k16lo, k16hi);
+
+	vst1q_u8(out, vreinterpretq_u8_u64(x3));
+}
@@ -0,0 +1,205 @@
+/*
+ * Cryptographic API.
+ *
+ * CRC32C using the ARM NEON unit: whole 64-byte blocks are folded with
+ * crc32c-neon-core.c and the rest is left to the slice-by-8 code in
+ * lib/crc32.c, which also does short buffers and anything called where
+ * NEON cannot be used.
+ *
+ * This file is based on crypto/crc32c.c
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ */
+
+#include <crypto/internal/hash.h>
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/crc32.h>
+#include <linux/gfp.h>
+#include <linux/ktime.h>
+#include <asm/neon.h>
+
+#define CHKSUM_BLOCK_SIZE	1
+#define CHKSUM_DIGEST_SIZE	4
+
+/* Below this, setting up the four accumulators costs more than it saves */
+#define CRC32C_NEON_MIN		256
+
+/* In crc32c-neon-core.c; call between kernel_neon_begin() and _end() */
+void crc32c_neon_fold(u8 *out, u32 crc, const u8 *data, unsigned int len);
+
+struct chksum_ctx {
+	u32 key;
+};
+
+struct chksum_desc_ctx {
+	u32 crc;
+};
+
+static u32 crc32c_neon(u32 crc, const u8 *data, unsigned int len)
+{
+	unsigned int folded = round_down(len, 64);
+	u8 blk[16];
+
+	if (len < CRC32C_NEON_MIN || !may_use_neon())
+		return __crc32c_le(crc, data, len);
+
+	kernel_neon_begin();
+	crc32c_neon_fold(blk, crc, data, folded);
+	kernel_neon_end();
+
+	crc = __crc32c_le(0, blk, sizeof(blk));
+	return __crc32c_le(crc, data + folded, len - folded);
+}
+
+static int chksum_init(struct shash_desc *desc)
+{
+	struct chksum_ctx *mctx = crypto_shash_ctx(desc->tfm);
+	struct chksum_desc_ctx *ctx = shash_desc_ctx(desc);
+
+	ctx->crc = mctx->key;
+
+	return 0;
+}
+
+static int chksum_setkey(struct crypto_shash *tfm, const u8 *key,
+			 unsigned int keylen)
+{
+	struct chksum_ctx *mctx = crypto_shash_ctx(tfm);
+
+	if (keylen != sizeof(mctx->key)) {
+		crypto_shash_set_flags(tfm, CRYPTO_TFM_RES_BAD_KEY_LEN);
+		return -EINVAL;
+	}
+	mctx->key = le32_to_cpu(*(__le32 *)key);
+	return 0;
+}
+
+static int chksum_update(struct shash_desc *desc, const u8 *data,
+			 unsigned int length)
+{
+	struct chksum_desc_ctx *ctx = shash_desc_ctx(desc);
+
+	ctx->crc = crc32c_neon(ctx->crc, data, length);
+	return 0;
+}
+
+static int chksum_final(struct shash_desc *desc, u8 *out)
+{
+	struct chksum_desc_ctx *ctx = shash_desc_ctx(desc);
+
+	*(__le32 *)out = ~cpu_to_le32p(&ctx->crc);
+	return 0;
+}
+
+static int __chksum_finup(u32 *crcp, const u8 *data, unsigned int len, u8 *out)
+{
+	*(__le32 *)out = ~cpu_to_le32(crc32c_neon(*crcp, data, len));
+	return 0;
+}
+
+static int chksum_finup(struct shash_desc *desc, const u8 *data,
+			unsigned int len, u8 *out)
+{
+	struct chksum_desc_ctx *ctx = shash_desc_ctx(desc);
+
+	return __chksum_finup(&ctx->crc, data, len, out);
+}
+
+static int chksum_digest(struct shash_desc *desc, const u8 *data,
+			 unsigned int length, u8 *out)
+{
+	struct chksum_ctx *mctx = crypto_shash_ctx(desc->tfm);
+
+	return __chksum_finup(&mctx->key, data, length, out);
+}
+
+static int crc32c_cra_init(struct crypto_tfm *tfm)
+{
+	struct chksum_ctx *mctx = crypto_tfm_ctx(tfm);
+
+	mctx->key = ~0;
+	return 0;
+}
+
+static struct shash_alg alg = {
+	.digestsize		=	CHKSUM_DIGEST_SIZE,
+	.setkey			=	chksum_setkey,
+	.init			=	chksum_init,
+	.update			=	chksum_update,
+	.final			=	chksum_final,
+	.finup			=	chksum_finup,
+	.digest			=	chksum_digest,
+	.descsize		=	sizeof(struct chksum_desc_ctx),
+	.base			=	{
+		.cra_name		=	"crc32c",
+		.cra_driver_name	=	"crc32c-neon",
+		.cra_priority		=	200,
+		.cra_blocksize		=	CHKSUM_BLOCK_SIZE,
+		.cra_alignmask		=	3,
+		.cra_ctxsize		=	sizeof(struct chksum_ctx),
+		.cra_module		=	THIS_MODULE,
+		.cra_init		=	crc32c_cra_init,
+	}
+};
+
+/*
+ * VMULL.P8 only multiplies bytes, so how the folding compares with
+ * slice-by-8 depends on the core.  Time both over a page, the size that
+ * filesystem metadata checksums see, and stay out of the way if the
+ * table code is as fast.
+ */
+static bool __init crc32c_neon_is_faster(void)
+{
+	u8 *buf = (u8 *)__get_free_page(GFP_KERNEL);
+	s64 generic, neon;
+	ktime_t start;
+	u32 crc = ~0;
+	int i;
+
+	if (!buf)
+		return false;
+
+	preempt_disable();
+	start = ktime_get();
+	for (i = 0; i < 64; i++)
+		crc = __crc32c_le(crc, buf, PAGE_SIZE);
+	generic = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	start = ktime_get();
+	for (i = 0; i < 64; i++)
+		crc = crc32c_neon(crc, buf, PAGE_SIZE);
+	neon = ktime_to_ns(ktime_sub(ktime_get(), start));
+	preempt_enable();
+
+	free_page((unsigned long)buf);
+
+	pr_info("crc32c-neon: %lld ns per 256 KiB, generic %lld ns\n",
+		neon, generic);
+	return neon < generic;
+}
+
+static int __init crc32c_neon_mod_init(void)
+{
+	if (!cpu_has_neon() || !crc32c_neon_is_faster())
+		return -ENODEV;
+
+	return crypto_register_shash(&alg);
+}
+
+static void __exit crc32c_neon_mod_fini(void)
+{
+	crypto_unregister_shash(&alg);
+}
+
+module_init(crc32c_neon_mod_init);
+module_exit(crc32c_neon_mod_fini);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("CRC32c (Castagnoli) calculations using ARM NEON");
+MODULE_ALIAS("crc32c");
@@ -61,6 +61,16 @@
 #define PLD(code...)
 #endif
 
+/*
+ * How far ahead of the source, in bytes, the bulk copy loops preload.
+ * Only 128 or 256 are handled by copy_template.S and memmove.S.
+ */
+#ifdef CONFIG_ARM_STRINGOPS_CA15
+#define PLD_AHEAD	256
+#else
+#define PLD_AHEAD	128
+#endif
+
 /*
  * This can be used to enable code to cacheline align the destination
  * pointer when bulk writing to memory.  Experiments on StrongARM and
@@ -68,9 +78,11 @@
  * set to write-allocate (this would need further testing on XScale when WA
  * is used).
  *
- * On Feroceon there is much to gain however, regardless of cache mode.
+ * On Feroceon there is much to gain however, regardless of cache mode,
+ * and on Cortex-A15 line-sized stores to an aligned destination avoid
+ * merging partial lines in the store buffer.
  */
-#ifdef CONFIG_CPU_FEROCEON
+#if defined(CONFIG_CPU_FEROCEON) || defined(CONFIG_ARM_STRINGOPS_CA15)
 #define CALGN(code...) code
 #else
 #define CALGN(code...)
@@ -158,6 +170,23 @@
 	restore_irqs_notrace \oldcpsr
 	.endm
 
+/*
+ * Disable and re-enable softirqs, and with them preemption, by hand;
+ * pending softirqs are left for the next interrupt exit.
+ */
+	.macro	local_bh_disable, ti, tmp
+	ldr	\tmp, [\ti, #TI_PREEMPT]
+	add	\tmp, \tmp, #SOFTIRQ_DISABLE_OFFSET
+	str	\tmp, [\ti, #TI_PREEMPT]
+	.endm
+
+	.macro	local_bh_enable_ti, ti, tmp
+	get_thread_info \ti
+	ldr	\tmp, [\ti, #TI_PREEMPT]
+	sub	\tmp, \tmp, #SOFTIRQ_DISABLE_OFFSET
+	str	\tmp, [\ti, #TI_PREEMPT]
+	.endm
+
 #define USER(x...)				\
 9999:	x;					\
 	.pushsection __ex_table,"a";		\
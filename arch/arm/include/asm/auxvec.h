@@ -0,0 +1,9 @@
+#ifndef __ASMARM_AUXVEC_H
+#define __ASMARM_AUXVEC_H
+
+/* Location of the vDSO ELF header, if there is one */
+#define AT_SYSINFO_EHDR		33
+
+#define AT_VECTOR_SIZE_ARCH	1	/* entries in ARCH_DLINFO */
+
+#endif
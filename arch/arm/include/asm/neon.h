@@ -0,0 +1,53 @@
+/*
+ * linux/arch/arm/include/asm/neon.h
+ *
+ * Kernel mode NEON.  NEON code must live in its own compilation unit,
+ * built with -mfpu=neon, and be called from another unit between
+ * kernel_neon_begin() and kernel_neon_end().  The NEON registers are not
+ * preserved across that section, and it may not sleep.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef __ASM_NEON_H
+#define __ASM_NEON_H
+
+#include <linux/hardirq.h>
+#include <linux/irqflags.h>
+#include <asm/hwcap.h>
+
+#define cpu_has_neon()		(!!(elf_hwcap & HWCAP_NEON))
+
+#ifdef __ARM_NEON__
+
+/*
+ * If you are affected by the BUILD_BUG_ON below, it probably means that
+ * you are using NEON code /and/ calling kernel_neon_begin() from the same
+ * compilation unit.  GCC may generate NEON instructions anywhere in a
+ * unit built with -mfpu=neon, including outside of begin/end, so the only
+ * supported way is to keep NEON code in a separate unit.
+ */
+#define kernel_neon_begin()	BUILD_BUG_ON(1)
+
+#else
+void kernel_neon_begin(void);
+#endif
+void kernel_neon_end(void);
+
+/*
+ * Kernel mode NEON can be used in process context and in softirqs, but
+ * not from hardirq context or with interrupts disabled; callers that may
+ * run there need a scalar fallback.
+ */
+static inline bool may_use_neon(void)
+{
+#ifdef CONFIG_KERNEL_MODE_NEON
+	return cpu_has_neon() && !in_irq() && !irqs_disabled();
+#else
+	return false;
+#endif
+}
+
+#endif /* __ASM_NEON_H */
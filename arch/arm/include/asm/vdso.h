@@ -0,0 +1,35 @@
+/*
+ * arch/arm/include/asm/vdso.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#ifndef __ASMARM_VDSO_H
+#define __ASMARM_VDSO_H
+
+/*
+ * The page holding the clocksource counter, when the clocksource has one
+ * user space can read, is mapped read-only for user space here, next to
+ * the vectors page, in every address space.
+ */
+#define VDSO_COUNTER_BASE	0xffff1000
+
+#ifndef __ASSEMBLY__
+
+#include <linux/types.h>
+
+struct clocksource;
+
+#ifdef CONFIG_VDSO
+extern void vdso_register_counter(struct clocksource *cs, phys_addr_t phys);
+#else
+static inline void vdso_register_counter(struct clocksource *cs,
+					 phys_addr_t phys)
+{
+}
+#endif
+
+#endif /* __ASSEMBLY__ */
+
+#endif /* __ASMARM_VDSO_H */
@@ -0,0 +1,38 @@
+/*
+ * arch/arm/include/asm/vdso_datapage.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#ifndef __ASMARM_VDSO_DATAPAGE_H
+#define __ASMARM_VDSO_DATAPAGE_H
+
+#ifndef __ASSEMBLY__
+
+#include <linux/types.h>
+
+/*
+ * Timekeeping data the kernel shares with the vDSO.  The page is mapped
+ * read-only just below the vDSO text.  Readers retry while seq_count is
+ * odd or changes under them.
+ */
+struct vdso_data {
+	u64 cs_cycle_last;	/* clocksource counter at the last update */
+	u64 cs_mask;		/* clocksource counter mask */
+	u32 seq_count;		/* odd while an update is in progress */
+	u32 counter_valid;	/* counter page maps the current clocksource */
+	u32 counter_offset;	/* of the counter in the counter page */
+	u32 cs_mult;		/* clocksource multiplier */
+	u32 cs_shift;		/* clocksource shift */
+	u32 xtime_sec;		/* CLOCK_REALTIME at the last update */
+	u32 xtime_nsec;
+	s32 wtm_sec;		/* wall_to_monotonic */
+	u32 wtm_nsec;
+	s32 tz_minuteswest;	/* sys_tz */
+	s32 tz_dsttime;
+};
+
+#endif /* __ASSEMBLY__ */
+
+#endif /* __ASMARM_VDSO_DATAPAGE_H */
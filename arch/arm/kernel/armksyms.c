@@ -48,6 +48,12 @@ extern void __aeabi_ulcmp(void);
 
 extern void fpundefinstr(void);
 
+/* NEON xor_blocks() routines, used from <asm/xor.h> */
+extern void __xor_neon_2(void);
+extern void __xor_neon_3(void);
+extern void __xor_neon_4(void);
+extern void __xor_neon_5(void);
+
 	/* platform dependent support */
 EXPORT_SYMBOL(__udelay);
 EXPORT_SYMBOL(__const_udelay);
@@ -151,6 +157,13 @@ EXPORT_SYMBOL(_find_first_bit_be);
 EXPORT_SYMBOL(_find_next_bit_be);
 #endif
 
+#ifdef CONFIG_KERNEL_MODE_NEON
+EXPORT_SYMBOL(__xor_neon_2);
+EXPORT_SYMBOL(__xor_neon_3);
+EXPORT_SYMBOL(__xor_neon_4);
+EXPORT_SYMBOL(__xor_neon_5);
+#endif
+
 #ifdef CONFIG_FUNCTION_TRACER
 #ifdef CONFIG_OLD_MCOUNT
 EXPORT_SYMBOL(mcount);
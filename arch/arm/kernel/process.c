@@ -686,6 +686,16 @@ int in_gate_area_no_mm(unsigned long addr)
 
 const char *arch_vma_name(struct vm_area_struct *vma)
 {
-	return (vma == &gate_vma) ? "[vectors]" : NULL;
+	if (vma == &gate_vma)
+		return "[vectors]";
+#ifdef CONFIG_VDSO
+	if (vma->vm_mm && vma->vm_mm->context.vdso) {
+		if (vma->vm_start == vma->vm_mm->context.vdso)
+			return "[vdso]";
+		if (vma->vm_start == vma->vm_mm->context.vdso - PAGE_SIZE)
+			return "[vvar]";
+	}
+#endif
+	return NULL;
 }
 #endif
@@ -0,0 +1,196 @@
+/*
+ * vdso.c: the ARM vDSO, user space gettimeofday and clock_gettime
+ *
+ * The vDSO text is built in arch/arm/kernel/vdso and linked into the
+ * kernel image.  Every new process gets it mapped, together with a
+ * read-only page of timekeeping data kept up to date by update_vsyscall().
+ * If the clocksource counter can be mapped for user space as well (see
+ * vdso_register_counter()) the vDSO reads the time without entering the
+ * kernel; otherwise it falls back to the system call.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include <linux/clocksource.h>
+#include <linux/elf.h>
+#include <linux/err.h>
+#include <linux/init.h>
+#include <linux/io.h>
+#include <linux/kernel.h>
+#include <linux/mm.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/time.h>
+
+#include <asm/cacheflush.h>
+#include <asm/cachetype.h>
+#include <asm/page.h>
+#include <asm/pgtable.h>
+#include <asm/vdso.h>
+#include <asm/vdso_datapage.h>
+
+extern char vdso_start, vdso_end;
+
+static unsigned long vdso_pages;
+static struct page **vdso_pagelist;
+static struct page *vvar_pagelist[2];
+
+static union {
+	struct vdso_data	data;
+	u8			page[PAGE_SIZE];
+} vdso_data_store __page_aligned_data;
+static struct vdso_data *vdso_data = &vdso_data_store.data;
+
+/* The clocksource whose counter is mapped at VDSO_COUNTER_BASE */
+static struct clocksource *vdso_counter_cs;
+
+static int __init vdso_init(void)
+{
+	unsigned long i;
+
+	if (memcmp(&vdso_start, "\177ELF", 4)) {
+		pr_err("vdso: not a valid ELF object\n");
+		return -EINVAL;
+	}
+
+	vdso_pages = (&vdso_end - &vdso_start) >> PAGE_SHIFT;
+
+	/* Special mappings take NULL terminated page lists */
+	vdso_pagelist = kcalloc(vdso_pages + 1, sizeof(struct page *),
+				GFP_KERNEL);
+	if (!vdso_pagelist) {
+		vdso_pages = 0;
+		return -ENOMEM;
+	}
+	for (i = 0; i < vdso_pages; i++)
+		vdso_pagelist[i] = virt_to_page(&vdso_start + i * PAGE_SIZE);
+
+	vvar_pagelist[0] = virt_to_page(vdso_data);
+
+	pr_info("vdso: %lu text pages at %p, counter %s\n", vdso_pages,
+		&vdso_start, vdso_counter_cs ? vdso_counter_cs->name : "none");
+	return 0;
+}
+arch_initcall(vdso_init);
+
+/*
+ * Map the data page followed by the vDSO text.  AT_SYSINFO_EHDR points at
+ * the text, and the vDSO finds the data one page below itself.
+ */
+int arch_setup_additional_pages(struct linux_binprm *bprm, int uses_interp)
+{
+	struct mm_struct *mm = current->mm;
+	unsigned long addr, len;
+	int ret;
+
+	if (!vdso_pages)
+		return 0;
+
+	len = (vdso_pages + 1) << PAGE_SHIFT;
+
+	down_write(&mm->mmap_sem);
+	addr = get_unmapped_area(NULL, 0, len, 0, 0);
+	if (IS_ERR_VALUE(addr)) {
+		ret = addr;
+		goto out;
+	}
+
+	ret = install_special_mapping(mm, addr, PAGE_SIZE,
+				      VM_READ | VM_MAYREAD, vvar_pagelist);
+	if (ret)
+		goto out;
+
+	ret = install_special_mapping(mm, addr + PAGE_SIZE, len - PAGE_SIZE,
+				      VM_READ | VM_EXEC |
+				      VM_MAYREAD | VM_MAYWRITE | VM_MAYEXEC,
+				      vdso_pagelist);
+	if (ret) {
+		do_munmap(mm, addr, PAGE_SIZE);
+		goto out;
+	}
+
+	mm->context.vdso = addr + PAGE_SIZE;
+out:
+	up_write(&mm->mmap_sem);
+	return ret;
+}
+
+/**
+ * vdso_register_counter - let the vDSO read a clocksource directly
+ * @cs:		the clocksource
+ * @phys:	physical address of its counter
+ *
+ * The counter must be 64 bits wide and readable as two 32-bit words, low
+ * word first, with the high word re-read to detect a carry.  Its page is
+ * mapped read-only for user space at VDSO_COUNTER_BASE, so it should not
+ * share the page with registers that have side effects when read.  Only
+ * one counter can be registered; call it from the timer init code.
+ */
+void __init vdso_register_counter(struct clocksource *cs, phys_addr_t phys)
+{
+	unsigned long addr = VDSO_COUNTER_BASE;
+	int ret;
+
+	if (vdso_counter_cs)
+		return;
+
+	ret = ioremap_page_range(addr, addr + PAGE_SIZE, phys & PAGE_MASK,
+				 pgprot_noncached(__PAGE_READONLY));
+	if (ret) {
+		pr_warn("vdso: cannot map the %s counter: %d\n", cs->name, ret);
+		return;
+	}
+	flush_cache_vmap(addr, addr + PAGE_SIZE);
+
+	vdso_data->counter_offset = phys & ~PAGE_MASK;
+	vdso_counter_cs = cs;
+}
+
+static inline void vdso_write_begin(struct vdso_data *vdata)
+{
+	++vdata->seq_count;
+	smp_wmb();
+}
+
+static inline void vdso_write_end(struct vdso_data *vdata)
+{
+	smp_wmb();
+	++vdata->seq_count;
+}
+
+static inline void vdso_flush_data(void)
+{
+	/* User space reads the page through a different alias */
+	if (cache_is_vipt_aliasing())
+		flush_dcache_page(virt_to_page(vdso_data));
+}
+
+/* Called with the timekeeper write lock held */
+void update_vsyscall(struct timespec *ts, struct timespec *wtm,
+		     struct clocksource *clock, u32 mult)
+{
+	struct vdso_data *vdata = vdso_data;
+
+	vdso_write_begin(vdata);
+
+	vdata->counter_valid	= clock == vdso_counter_cs;
+	vdata->cs_cycle_last	= clock->cycle_last;
+	vdata->cs_mask		= clock->mask;
+	vdata->cs_mult		= mult;
+	vdata->cs_shift		= clock->shift;
+	vdata->xtime_sec	= ts->tv_sec;
+	vdata->xtime_nsec	= ts->tv_nsec;
+	vdata->wtm_sec		= wtm->tv_sec;
+	vdata->wtm_nsec		= wtm->tv_nsec;
+
+	vdso_write_end(vdata);
+	vdso_flush_data();
+}
+
+void update_vsyscall_tz(void)
+{
+	vdso_data->tz_minuteswest	= sys_tz.tz_minuteswest;
+	vdso_data->tz_dsttime		= sys_tz.tz_dsttime;
+	vdso_flush_data();
+}
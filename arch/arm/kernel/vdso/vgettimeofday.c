@@ -0,0 +1,212 @@
+/*
+ * User space gettimeofday and clock_gettime for the ARM vDSO.
+ *
+ * Runs in user space: no kernel functions can be called, and anything
+ * the vDSO cannot answer from its data page goes to the system call.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include <linux/compiler.h>
+#include <linux/time.h>
+#include <linux/types.h>
+
+#include <asm/barrier.h>
+#include <asm/unistd.h>
+#include <asm/vdso.h>
+#include <asm/vdso_datapage.h>
+
+extern const struct vdso_data *__get_datapage(void);
+
+static notrace u32 vdso_read_begin(const struct vdso_data *vdata)
+{
+	u32 seq;
+
+	while ((seq = ACCESS_ONCE(vdata->seq_count)) & 1)
+		;
+	smp_rmb();
+	return seq;
+}
+
+static notrace int vdso_read_retry(const struct vdso_data *vdata, u32 start)
+{
+	smp_rmb();
+	return ACCESS_ONCE(vdata->seq_count) != start;
+}
+
+static notrace long clock_gettime_fallback(clockid_t _clkid,
+					   struct timespec *_ts)
+{
+	register struct timespec *ts asm("r1") = _ts;
+	register clockid_t clkid asm("r0") = _clkid;
+	register long ret asm ("r0");
+	register long nr asm("r7") = __NR_clock_gettime;
+
+	asm volatile(
+	"	swi #0\n"
+	: "=r" (ret)
+	: "r" (clkid), "r" (ts), "r" (nr)
+	: "memory");
+
+	return ret;
+}
+
+static notrace long gettimeofday_fallback(struct timeval *_tv,
+					  struct timezone *_tz)
+{
+	register struct timezone *tz asm("r1") = _tz;
+	register struct timeval *tv asm("r0") = _tv;
+	register long ret asm ("r0");
+	register long nr asm("r7") = __NR_gettimeofday;
+
+	asm volatile(
+	"	swi #0\n"
+	: "=r" (ret)
+	: "r" (tv), "r" (tz), "r" (nr)
+	: "memory");
+
+	return ret;
+}
+
+/* Same carry handling as the kernel's read of the counter */
+static notrace u64 vdso_read_counter(const struct vdso_data *vdata)
+{
+	const volatile u32 *cnt;
+	u32 lo, hi, hi2;
+
+	cnt = (const volatile u32 *)(VDSO_COUNTER_BASE +
+				     vdata->counter_offset);
+	hi2 = cnt[1];
+	do {
+		hi = hi2;
+		lo = cnt[0];
+		hi2 = cnt[1];
+	} while (hi != hi2);
+
+	return ((u64)hi << 32) | lo;
+}
+
+static notrace u64 vdso_get_ns(const struct vdso_data *vdata)
+{
+	u64 cycle_delta;
+
+	cycle_delta = (vdso_read_counter(vdata) - vdata->cs_cycle_last) &
+		      vdata->cs_mask;
+	return (cycle_delta * vdata->cs_mult) >> vdata->cs_shift;
+}
+
+static notrace int do_realtime_coarse(struct timespec *ts,
+				      const struct vdso_data *vdata)
+{
+	u32 seq;
+
+	do {
+		seq = vdso_read_begin(vdata);
+		ts->tv_sec = vdata->xtime_sec;
+		ts->tv_nsec = vdata->xtime_nsec;
+	} while (vdso_read_retry(vdata, seq));
+
+	return 0;
+}
+
+static notrace int do_monotonic_coarse(struct timespec *ts,
+				       const struct vdso_data *vdata)
+{
+	u64 nsecs;
+	u32 seq;
+
+	do {
+		seq = vdso_read_begin(vdata);
+		ts->tv_sec = vdata->xtime_sec + vdata->wtm_sec;
+		nsecs = (u64)vdata->xtime_nsec + vdata->wtm_nsec;
+	} while (vdso_read_retry(vdata, seq));
+
+	ts->tv_nsec = 0;
+	timespec_add_ns(ts, nsecs);
+	return 0;
+}
+
+static notrace int do_realtime(struct timespec *ts,
+			       const struct vdso_data *vdata)
+{
+	u64 nsecs;
+	u32 seq;
+
+	do {
+		seq = vdso_read_begin(vdata);
+		if (!vdata->counter_valid)
+			return -1;
+		ts->tv_sec = vdata->xtime_sec;
+		nsecs = vdata->xtime_nsec + vdso_get_ns(vdata);
+	} while (vdso_read_retry(vdata, seq));
+
+	ts->tv_nsec = 0;
+	timespec_add_ns(ts, nsecs);
+	return 0;
+}
+
+static notrace int do_monotonic(struct timespec *ts,
+				const struct vdso_data *vdata)
+{
+	u64 nsecs;
+	u32 seq;
+
+	do {
+		seq = vdso_read_begin(vdata);
+		if (!vdata->counter_valid)
+			return -1;
+		ts->tv_sec = vdata->xtime_sec + vdata->wtm_sec;
+		nsecs = (u64)vdata->xtime_nsec + vdata->wtm_nsec +
+			vdso_get_ns(vdata);
+	} while (vdso_read_retry(vdata, seq));
+
+	ts->tv_nsec = 0;
+	timespec_add_ns(ts, nsecs);
+	return 0;
+}
+
+notrace int __vdso_clock_gettime(clockid_t clkid, struct timespec *ts)
+{
+	const struct vdso_data *vdata = __get_datapage();
+	int ret = -1;
+
+	switch (clkid) {
+	case CLOCK_REALTIME_COARSE:
+		ret = do_realtime_coarse(ts, vdata);
+		break;
+	case CLOCK_MONOTONIC_COARSE:
+		ret = do_monotonic_coarse(ts, vdata);
+		break;
+	case CLOCK_REALTIME:
+		ret = do_realtime(ts, vdata);
+		break;
+	case CLOCK_MONOTONIC:
+		ret = do_monotonic(ts, vdata);
+		break;
+	}
+
+	if (ret)
+		ret = clock_gettime_fallback(clkid, ts);
+
+	return ret;
+}
+
+notrace int __vdso_gettimeofday(struct timeval *tv, struct timezone *tz)
+{
+	const struct vdso_data *vdata = __get_datapage();
+	struct timespec ts;
+
+	if (tv) {
+		if (do_realtime(&ts, vdata))
+			return gettimeofday_fallback(tv, tz);
+		tv->tv_sec = ts.tv_sec;
+		tv->tv_usec = ts.tv_nsec / 1000;
+	}
+	if (tz) {
+		tz->tz_minuteswest = vdata->tz_minuteswest;
+		tz->tz_dsttime = vdata->tz_dsttime;
+	}
+
+	return 0;
+}
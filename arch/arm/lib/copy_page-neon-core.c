@@ -0,0 +1,43 @@
+/*
+ * linux/arch/arm/lib/copy_page-neon-core.c
+ *
+ * NEON inner loop for copy_page().  Each pass moves one 64-byte line
+ * through four Q registers, preloading four lines ahead of the source;
+ * both pages are page aligned, so every access is to a whole line.
+ *
+ * Built with -mfpu=neon and without kernel headers; only call this
+ * between kernel_neon_begin() and kernel_neon_end().
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include <arm_neon.h>
+
+void __copy_page_neon(void *to, const void *from, unsigned long bytes);
+
+#define PLD_AHEAD	256
+
+void __copy_page_neon(void *to, const void *from, unsigned long bytes)
+{
+	uint8_t *d = to;
+	const uint8_t *s = from;
+	const uint8_t *end = s + bytes;
+
+	while (s < end) {
+		uint8x16_t a, b, c, e;
+
+		if (s + PLD_AHEAD < end)
+			__builtin_prefetch(s + PLD_AHEAD);
+		a = vld1q_u8(s);
+		b = vld1q_u8(s + 16);
+		c = vld1q_u8(s + 32);
+		e = vld1q_u8(s + 48);
+		vst1q_u8(d, a);
+		vst1q_u8(d + 16, b);
+		vst1q_u8(d + 32, c);
+		vst1q_u8(d + 48, e);
+		s += 64;
+		d += 64;
+	}
+}
@@ -0,0 +1,30 @@
+/*
+ * linux/arch/arm/lib/copy_page-neon-glue.c
+ *
+ * copy_page() through the NEON unit, falling back to the integer routine
+ * in copy_page.S where kernel mode NEON cannot be used.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include <linux/linkage.h>
+#include <asm/neon.h>
+#include <asm/page.h>
+
+/* In copy_page.S */
+asmlinkage void __copy_page_arm(void *to, const void *from);
+/* In copy_page-neon-core.c; call between kernel_neon_begin() and _end() */
+void __copy_page_neon(void *to, const void *from, unsigned long bytes);
+
+void copy_page(void *to, const void *from)
+{
+	if (!may_use_neon()) {
+		__copy_page_arm(to, from);
+		return;
+	}
+
+	kernel_neon_begin();
+	__copy_page_neon(to, from, PAGE_SIZE);
+	kernel_neon_end();
+}
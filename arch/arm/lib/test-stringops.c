@@ -0,0 +1,343 @@
+/*
+ * arch/arm/lib/test-stringops.c
+ *
+ * Checks and times memcpy, memmove, memset, copy_page and
+ * copy_{to,from}_user.  Loading the module first checks each routine
+ * against a byte loop, over a range of sizes and of source and
+ * destination alignments, with guard bytes on both sides of the
+ * destination.  It then times each routine at a few sizes and
+ * alignments and reports MB/s, plus bytes per cycle when cpufreq knows
+ * the clock.  The module refuses to load if any check fails.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#define pr_fmt(fmt) "stringops: " fmt
+
+#include <linux/cpufreq.h>
+#include <linux/gfp.h>
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/mm.h>
+#include <linux/mman.h>
+#include <linux/module.h>
+#include <linux/sched.h>
+#include <linux/smp.h>
+#include <linux/string.h>
+#include <linux/uaccess.h>
+
+#include <asm/page.h>
+
+#define BUF_SIZE	(128 * 1024)
+#define GUARD		64
+#define GUARD_BYTE	0xa5
+
+/* Largest size timed; the buffers hold it at any alignment plus guards */
+#define BENCH_MAX	(64 * 1024)
+#define BENCH_BYTES	(32 << 20)
+
+static bool bench = true;
+module_param(bench, bool, 0);
+MODULE_PARM_DESC(bench, "Time the routines after checking them");
+
+static u8 *src, *dst, *ref;
+static u8 __user *ubuf;
+static int failures;
+
+static const unsigned int check_sizes[] = {
+	0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 11, 12, 15, 16, 17, 23, 24, 28, 31, 32,
+	33, 36, 47, 48, 63, 64, 65, 95, 96, 97, 127, 128, 129, 160, 191, 200,
+	255, 256, 257, 300, 511, 512, 513, 1000, 1023, 1024, 4095, 4096, 4100,
+};
+
+static void fill(u8 *p, unsigned int len, unsigned int seed)
+{
+	unsigned int i;
+
+	for (i = 0; i < len; i++)
+		p[i] = (i * 13 + seed * 7 + (i >> 8)) | 1;
+}
+
+static void report(const char *what, unsigned int n, unsigned int da,
+		   unsigned int sa)
+{
+	if (failures++ < 10)
+		pr_err("%s: size %u, dst align %u, src align %u: mismatch\n",
+		       what, n, da, sa);
+}
+
+/* @buf holds GUARD bytes, @n bytes expected to match @exp, GUARD bytes */
+static bool guarded_ok(const u8 *buf, const u8 *exp, unsigned int n)
+{
+	unsigned int i;
+
+	for (i = 0; i < GUARD; i++)
+		if (buf[i] != GUARD_BYTE || buf[GUARD + n + i] != GUARD_BYTE)
+			return false;
+	return !memcmp(buf + GUARD, exp, n);
+}
+
+static void check_memcpy(unsigned int n, unsigned int da, unsigned int sa)
+{
+	u8 *d = dst + da;
+
+	fill(src, n + sa, n);
+	memset(d, GUARD_BYTE, n + 2 * GUARD);
+	if (memcpy(d + GUARD, src + sa, n) != d + GUARD ||
+	    !guarded_ok(d, src + sa, n))
+		report("memcpy", n, da, sa);
+}
+
+/* Move @n bytes from offset @sa to offset @da in the same buffer */
+static void check_memmove(unsigned int n, unsigned int da, unsigned int sa)
+{
+	unsigned int i, len = max(da, sa) + n + 2 * GUARD;
+
+	fill(dst, len, n + da);
+	memcpy(ref, dst, len);
+	for (i = 0; i < n; i++)
+		ref[GUARD + da + i] = dst[GUARD + sa + i];
+	if (memmove(dst + GUARD + da, dst + GUARD + sa, n) !=
+	    dst + GUARD + da || memcmp(dst, ref, len))
+		report("memmove", n, da, sa);
+}
+
+static void check_memset(unsigned int n, unsigned int da, int c)
+{
+	u8 *d = dst + da;
+
+	memset(ref, c, n);
+	memset(d, GUARD_BYTE, n + 2 * GUARD);
+	if (c)
+		memset(d + GUARD, c, n);
+	else
+		memset(d + GUARD, 0, n);	/* __memzero */
+	if (!guarded_ok(d, ref, n))
+		report(c ? "memset" : "memzero", n, da, 0);
+}
+
+static void check_copy_to_user(unsigned int n, unsigned int da,
+			       unsigned int sa)
+{
+	u8 __user *d = ubuf + da;
+	unsigned int i;
+
+	fill(src, n + sa, n);
+	for (i = 0; i < n + 2 * GUARD; i++)
+		if (put_user(GUARD_BYTE, d + i))
+			goto bad;
+	if (copy_to_user(d + GUARD, src + sa, n))
+		goto bad;
+	for (i = 0; i < n + 2 * GUARD; i++)
+		if (get_user(ref[i], d + i))
+			goto bad;
+	if (guarded_ok(ref, src + sa, n))
+		return;
+bad:
+	report("copy_to_user", n, da, sa);
+}
+
+static void check_copy_from_user(unsigned int n, unsigned int da,
+				 unsigned int sa)
+{
+	u8 *d = dst + da;
+	unsigned int i;
+
+	fill(ref, n, n + sa);
+	for (i = 0; i < n; i++)
+		if (put_user(ref[i], ubuf + sa + i))
+			goto bad;
+	memset(d, GUARD_BYTE, n + 2 * GUARD);
+	if (!copy_from_user(d + GUARD, ubuf + sa, n) &&
+	    guarded_ok(d, ref, n))
+		return;
+bad:
+	report("copy_from_user", n, da, sa);
+}
+
+static void check_copy_page(void)
+{
+	u8 *d = dst + PAGE_SIZE - GUARD;
+
+	fill(src, PAGE_SIZE, 0);
+	memset(d, GUARD_BYTE, PAGE_SIZE + 2 * GUARD);
+	copy_page(d + GUARD, src);
+	if (!guarded_ok(d, src, PAGE_SIZE))
+		report("copy_page", PAGE_SIZE, 0, 0);
+}
+
+static void run_checks(void)
+{
+	unsigned int i, n, da, sa;
+
+	for (i = 0; i < ARRAY_SIZE(check_sizes); i++) {
+		n = check_sizes[i];
+		for (da = 0; da < 8; da++) {
+			for (sa = 0; sa < 8; sa++) {
+				check_memcpy(n, da, sa);
+				check_copy_to_user(n, da, sa);
+				check_copy_from_user(n, da, sa);
+			}
+			check_memset(n, da, 0x3c);
+			check_memset(n, da, 0);
+		}
+		for (da = 0; da < 72; da += 5)
+			for (sa = 0; sa < 72; sa += 7)
+				check_memmove(n, da, sa);
+		cond_resched();
+	}
+	check_copy_page();
+}
+
+enum bench_op {
+	BENCH_MEMCPY,
+	BENCH_MEMMOVE,
+	BENCH_MEMSET,
+	BENCH_COPY_PAGE,
+	BENCH_COPY_TO_USER,
+	BENCH_COPY_FROM_USER,
+};
+
+static const char * const bench_names[] = {
+	[BENCH_MEMCPY]		= "memcpy",
+	[BENCH_MEMMOVE]		= "memmove",
+	[BENCH_MEMSET]		= "memset",
+	[BENCH_COPY_PAGE]	= "copy_page",
+	[BENCH_COPY_TO_USER]	= "copy_to_user",
+	[BENCH_COPY_FROM_USER]	= "copy_from_user",
+};
+
+static const unsigned int bench_sizes[] = { 64, 512, 4096, BENCH_MAX };
+
+static const struct {
+	unsigned int da, sa;
+} bench_aligns[] = {
+	{ 0, 0 }, { 0, 1 }, { 3, 0 }, { 4, 4 },
+};
+
+static void bench_one(enum bench_op op, unsigned int n, unsigned int da,
+		      unsigned int sa)
+{
+	unsigned int loops = max(BENCH_BYTES / n, 1U), i, khz;
+	u32 frac;
+	u64 bytes = (u64)loops * n, ns, mbps, bpc;
+	u8 *d = dst + da, *s = src + sa;
+	unsigned long left = 0;
+	ktime_t start;
+
+	start = ktime_get();
+	for (i = 0; i < loops; i++) {
+		switch (op) {
+		case BENCH_MEMCPY:
+			memcpy(d, s, n);
+			break;
+		case BENCH_MEMMOVE:
+			/* Overlapping and backwards, memmove's own loop */
+			memmove(d + 32, d, n);
+			break;
+		case BENCH_MEMSET:
+			memset(d, i, n);
+			break;
+		case BENCH_COPY_PAGE:
+			copy_page(dst, src);
+			break;
+		case BENCH_COPY_TO_USER:
+			left |= copy_to_user(ubuf + da, s, n);
+			break;
+		case BENCH_COPY_FROM_USER:
+			left |= copy_from_user(d, ubuf + sa, n);
+			break;
+		}
+	}
+	ns = max_t(u64, ktime_to_ns(ktime_sub(ktime_get(), start)), 1);
+
+	if (left) {
+		report(bench_names[op], n, da, sa);
+		return;
+	}
+
+	/* bytes per ns is GB/s; MB/s is that times 1000 */
+	mbps = div64_u64(bytes * 1000, ns);
+	khz = cpufreq_quick_get(raw_smp_processor_id());
+	if (!khz) {
+		pr_info("%-14s %6u  %u/%u  %6llu MB/s\n", bench_names[op], n,
+			da, sa, mbps);
+		return;
+	}
+
+	/* Hundredths of a byte per cycle: bytes / (ns * khz / 10^6) * 100 */
+	bpc = div_u64_rem(div64_u64(bytes * 100000000, ns * khz), 100, &frac);
+	pr_info("%-14s %6u  %u/%u  %6llu MB/s  %llu.%02u bytes/cycle\n",
+		bench_names[op], n, da, sa, mbps, bpc, frac);
+}
+
+static void run_bench(void)
+{
+	enum bench_op op;
+	unsigned int i, j;
+
+	pr_info("routine          size  dst/src align\n");
+	for (op = BENCH_MEMCPY; op <= BENCH_COPY_FROM_USER; op++) {
+		if (op == BENCH_COPY_PAGE) {
+			bench_one(op, PAGE_SIZE, 0, 0);
+			continue;
+		}
+		for (i = 0; i < ARRAY_SIZE(bench_sizes); i++) {
+			for (j = 0; j < ARRAY_SIZE(bench_aligns); j++) {
+				bench_one(op, bench_sizes[i],
+					  bench_aligns[j].da,
+					  bench_aligns[j].sa);
+				cond_resched();
+			}
+		}
+	}
+}
+
+static int __init stringops_test_init(void)
+{
+	unsigned long uaddr;
+	int ret = -ENOMEM;
+
+	src = (u8 *)__get_free_pages(GFP_KERNEL, get_order(BUF_SIZE));
+	dst = (u8 *)__get_free_pages(GFP_KERNEL, get_order(BUF_SIZE));
+	ref = (u8 *)__get_free_pages(GFP_KERNEL, get_order(BUF_SIZE));
+	if (!src || !dst || !ref)
+		goto out;
+
+	/* A mapping in the address space of whoever loads the module */
+	uaddr = vm_mmap(NULL, 0, BUF_SIZE, PROT_READ | PROT_WRITE,
+			MAP_ANONYMOUS | MAP_PRIVATE, 0);
+	if (IS_ERR_VALUE(uaddr))
+		goto out;
+	ubuf = (u8 __user *)uaddr;
+
+	run_checks();
+	if (failures) {
+		pr_err("%d checks failed\n", failures);
+		ret = -EINVAL;
+	} else {
+		pr_info("all checks passed\n");
+		if (bench)
+			run_bench();
+		ret = failures ? -EINVAL : 0;
+	}
+
+	vm_munmap(uaddr, BUF_SIZE);
+out:
+	free_pages((unsigned long)ref, get_order(BUF_SIZE));
+	free_pages((unsigned long)dst, get_order(BUF_SIZE));
+	free_pages((unsigned long)src, get_order(BUF_SIZE));
+	return ret;
+}
+
+static void __exit stringops_test_exit(void)
+{
+}
+
+module_init(stringops_test_init);
+module_exit(stringops_test_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("ARM string and user copy routine checks and benchmark");
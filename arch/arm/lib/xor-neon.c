@@ -0,0 +1,98 @@
+/*
+ * linux/arch/arm/lib/xor-neon.c
+ *
+ * NEON inner loops for the xor_blocks() template in <asm/xor.h>.  Each
+ * line is 32 bytes, the same as the arm4regs template, so callers see no
+ * difference in the size they have to pass.
+ *
+ * Built with -mfpu=neon and without kernel headers; only call these
+ * between kernel_neon_begin() and kernel_neon_end().
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include <arm_neon.h>
+
+void __xor_neon_2(unsigned long bytes, unsigned long *p1, unsigned long *p2);
+void __xor_neon_3(unsigned long bytes, unsigned long *p1, unsigned long *p2,
+		  unsigned long *p3);
+void __xor_neon_4(unsigned long bytes, unsigned long *p1, unsigned long *p2,
+		  unsigned long *p3, unsigned long *p4);
+void __xor_neon_5(unsigned long bytes, unsigned long *p1, unsigned long *p2,
+		  unsigned long *p3, unsigned long *p4, unsigned long *p5);
+
+#define LD(p, i)	vld1q_u8((const uint8_t *)(p) + 16 * (i))
+#define ST(p, i, v)	vst1q_u8((uint8_t *)(p) + 16 * (i), v)
+
+void __xor_neon_2(unsigned long bytes, unsigned long *p1, unsigned long *p2)
+{
+	unsigned long lines = bytes / 32;
+
+	do {
+		ST(p1, 0, veorq_u8(LD(p1, 0), LD(p2, 0)));
+		ST(p1, 1, veorq_u8(LD(p1, 1), LD(p2, 1)));
+		p1 += 32 / sizeof(*p1);
+		p2 += 32 / sizeof(*p2);
+	} while (--lines);
+}
+
+void __xor_neon_3(unsigned long bytes, unsigned long *p1, unsigned long *p2,
+		  unsigned long *p3)
+{
+	unsigned long lines = bytes / 32;
+
+	do {
+		uint8x16_t v0 = veorq_u8(LD(p1, 0), LD(p2, 0));
+		uint8x16_t v1 = veorq_u8(LD(p1, 1), LD(p2, 1));
+
+		ST(p1, 0, veorq_u8(v0, LD(p3, 0)));
+		ST(p1, 1, veorq_u8(v1, LD(p3, 1)));
+		p1 += 32 / sizeof(*p1);
+		p2 += 32 / sizeof(*p2);
+		p3 += 32 / sizeof(*p3);
+	} while (--lines);
+}
+
+void __xor_neon_4(unsigned long bytes, unsigned long *p1, unsigned long *p2,
+		  unsigned long *p3, unsigned long *p4)
+{
+	unsigned long lines = bytes / 32;
+
+	do {
+		uint8x16_t v0 = veorq_u8(LD(p1, 0), LD(p2, 0));
+		uint8x16_t v1 = veorq_u8(LD(p1, 1), LD(p2, 1));
+
+		v0 = veorq_u8(v0, LD(p3, 0));
+		v1 = veorq_u8(v1, LD(p3, 1));
+		ST(p1, 0, veorq_u8(v0, LD(p4, 0)));
+		ST(p1, 1, veorq_u8(v1, LD(p4, 1)));
+		p1 += 32 / sizeof(*p1);
+		p2 += 32 / sizeof(*p2);
+		p3 += 32 / sizeof(*p3);
+		p4 += 32 / sizeof(*p4);
+	} while (--lines);
+}
+
+void __xor_neon_5(unsigned long bytes, unsigned long *p1, unsigned long *p2,
+		  unsigned long *p3, unsigned long *p4, unsigned long *p5)
+{
+	unsigned long lines = bytes / 32;
+
+	do {
+		uint8x16_t v0 = veorq_u8(LD(p1, 0), LD(p2, 0));
+		uint8x16_t v1 = veorq_u8(LD(p1, 1), LD(p2, 1));
+
+		v0 = veorq_u8(v0, LD(p3, 0));
+		v1 = veorq_u8(v1, LD(p3, 1));
+		v0 = veorq_u8(v0, LD(p4, 0));
+		v1 = veorq_u8(v1, LD(p4, 1));
+		ST(p1, 0, veorq_u8(v0, LD(p5, 0)));
+		ST(p1, 1, veorq_u8(v1, LD(p5, 1)));
+		p1 += 32 / sizeof(*p1);
+		p2 += 32 / sizeof(*p2);
+		p3 += 32 / sizeof(*p3);
+		p4 += 32 / sizeof(*p4);
+		p5 += 32 / sizeof(*p5);
+	} while (--lines);
+}
@@ -23,6 +23,7 @@
 #include <asm/sched_clock.h>
 #include <asm/hardware/gic.h>
 #include <asm/localtimer.h>
+#include <asm/vdso.h>
 
 #include <plat/cpu.h>
 
@@ -162,8 +163,15 @@ struct clocksource mct_frc = {
 
 static void __init exynos4_clocksource_init(void)
 {
+	phys_addr_t base = soc_is_exynos5250() ? EXYNOS5_PA_SYSTIMER :
+						 EXYNOS4_PA_SYSTIMER;
+
 	exynos4_mct_frc_start(0, 0);
 
+	/* MCT registers have no read side effects; let the vDSO read G_CNT */
+	vdso_register_counter(&mct_frc, base +
+			      ((u32)EXYNOS4_MCT_G_CNT_L - (u32)S5P_VA_SYSTIMER));
+
 	if (clocksource_register_hz(&mct_frc, clk_rate))
 		panic("%s: can't register clocksource\n", mct_frc.name);
 
@@ -0,0 +1,193 @@
+/*
+ *  linux/arch/arm/vfp/neon_test.c
+ *
+ * Kernel mode NEON stress test.  Writing N to <debugfs>/neon_test runs N
+ * rounds of kernel mode NEON in the writer's context while a timer on
+ * every online CPU does the same from softirq context.  Each round fills
+ * all NEON registers with a pattern, waits with interrupts enabled and
+ * checks that the pattern survived.  Reading the file reports the rounds
+ * run and the corruptions seen.  The user side of the test, which checks
+ * that user NEON state survives all this, is in
+ * tools/testing/selftests/neon.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include <linux/atomic.h>
+#include <linux/cpu.h>
+#include <linux/debugfs.h>
+#include <linux/delay.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/sched.h>
+#include <linux/seq_file.h>
+#include <linux/timer.h>
+#include <linux/uaccess.h>
+
+#include <asm/neon.h>
+
+static DEFINE_PER_CPU(struct timer_list, neon_test_timer);
+static DEFINE_MUTEX(neon_test_mutex);
+static struct dentry *neon_test_dentry;
+static bool neon_test_running;
+
+static atomic_long_t neon_test_task_rounds;
+static atomic_long_t neon_test_softirq_rounds;
+static atomic_long_t neon_test_errors;
+
+/* Fill q0-q15 with @pat, then check it is still there after @delay_us */
+static int neon_test_round(u32 pat, unsigned int delay_us)
+{
+	u32 regs[64], *p = regs;
+	int i, bad = 0;
+
+	asm volatile(
+	"	.fpu	neon\n"
+	"	vdup.32	q0, %0\n"
+	"	vmov	q1, q0\n"
+	"	vmov	q2, q0\n"
+	"	vmov	q3, q0\n"
+	"	vmov	q4, q0\n"
+	"	vmov	q5, q0\n"
+	"	vmov	q6, q0\n"
+	"	vmov	q7, q0\n"
+	"	vmov	q8, q0\n"
+	"	vmov	q9, q0\n"
+	"	vmov	q10, q0\n"
+	"	vmov	q11, q0\n"
+	"	vmov	q12, q0\n"
+	"	vmov	q13, q0\n"
+	"	vmov	q14, q0\n"
+	"	vmov	q15, q0\n"
+	: : "r" (pat));
+
+	udelay(delay_us);
+
+	asm volatile(
+	"	.fpu	neon\n"
+	"	vstmia	%0!, {d0-d15}\n"
+	"	vstmia	%0!, {d16-d31}\n"
+	: "+r" (p) : : "memory");
+
+	for (i = 0; i < ARRAY_SIZE(regs); i++)
+		if (regs[i] != pat)
+			bad = 1;
+	return bad;
+}
+
+static void neon_test_timer_fn(unsigned long data)
+{
+	struct timer_list *timer = &__get_cpu_var(neon_test_timer);
+
+	if (may_use_neon()) {
+		kernel_neon_begin();
+		if (neon_test_round(0xa5a50000 | smp_processor_id(), 5))
+			atomic_long_inc(&neon_test_errors);
+		kernel_neon_end();
+		atomic_long_inc(&neon_test_softirq_rounds);
+	}
+
+	if (ACCESS_ONCE(neon_test_running))
+		mod_timer_pinned(timer, jiffies + 1);
+}
+
+static void neon_test_run(unsigned long rounds)
+{
+	unsigned long i;
+	int cpu;
+
+	get_online_cpus();
+	neon_test_running = true;
+	for_each_online_cpu(cpu) {
+		struct timer_list *timer = &per_cpu(neon_test_timer, cpu);
+
+		timer->expires = jiffies + 1;
+		add_timer_on(timer, cpu);
+	}
+
+	for (i = 0; i < rounds && !signal_pending(current); i++) {
+		kernel_neon_begin();
+		/* Long enough for timer interrupts to hit the section */
+		if (neon_test_round(0x5a5a0000 | (i & 0xffff), 50))
+			atomic_long_inc(&neon_test_errors);
+		kernel_neon_end();
+		atomic_long_inc(&neon_test_task_rounds);
+		cond_resched();
+	}
+
+	neon_test_running = false;
+	for_each_online_cpu(cpu)
+		del_timer_sync(&per_cpu(neon_test_timer, cpu));
+	put_online_cpus();
+}
+
+static int neon_test_show(struct seq_file *m, void *unused)
+{
+	seq_printf(m, "task %ld softirq %ld errors %ld\n",
+		   atomic_long_read(&neon_test_task_rounds),
+		   atomic_long_read(&neon_test_softirq_rounds),
+		   atomic_long_read(&neon_test_errors));
+	return 0;
+}
+
+static int neon_test_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, neon_test_show, NULL);
+}
+
+static ssize_t neon_test_write(struct file *file, const char __user *buf,
+			       size_t count, loff_t *ppos)
+{
+	unsigned long rounds;
+	int ret;
+
+	ret = kstrtoul_from_user(buf, count, 0, &rounds);
+	if (ret)
+		return ret;
+
+	/* One run at a time drives the timers */
+	mutex_lock(&neon_test_mutex);
+	neon_test_run(rounds);
+	mutex_unlock(&neon_test_mutex);
+
+	return count;
+}
+
+static const struct file_operations neon_test_fops = {
+	.owner		= THIS_MODULE,
+	.open		= neon_test_open,
+	.read		= seq_read,
+	.write		= neon_test_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init neon_test_init(void)
+{
+	int cpu;
+
+	if (!cpu_has_neon())
+		return -ENODEV;
+
+	for_each_possible_cpu(cpu)
+		setup_timer(&per_cpu(neon_test_timer, cpu),
+			    neon_test_timer_fn, 0);
+
+	neon_test_dentry = debugfs_create_file("neon_test", 0600, NULL, NULL,
+					       &neon_test_fops);
+	if (!neon_test_dentry)
+		return -ENOMEM;
+	return 0;
+}
+
+static void __exit neon_test_exit(void)
+{
+	debugfs_remove(neon_test_dentry);
+}
+
+module_init(neon_test_init);
+module_exit(neon_test_exit);
+
+MODULE_DESCRIPTION("Kernel mode NEON stress test");
+MODULE_LICENSE("GPL");
@@ -41,7 +41,7 @@ struct hash_testvec {
 	char *plaintext;
 	char *digest;
 	unsigned char tap[MAX_TAP];
-	unsigned char psize;
+	unsigned short psize;
 	unsigned char np;
 	unsigned char ksize;
 };
@@ -6109,14 +6109,14 @@ static struct cipher_testvec cast6_dec_tv_template[] = {
  */
 #define AES_ENC_TEST_VECTORS 3
 #define AES_DEC_TEST_VECTORS 3
-#define AES_CBC_ENC_TEST_VECTORS 4
-#define AES_CBC_DEC_TEST_VECTORS 4
+#define AES_CBC_ENC_TEST_VECTORS 5
+#define AES_CBC_DEC_TEST_VECTORS 5
 #define AES_LRW_ENC_TEST_VECTORS 8
 #define AES_LRW_DEC_TEST_VECTORS 8
 #define AES_XTS_ENC_TEST_VECTORS 5
 #define AES_XTS_DEC_TEST_VECTORS 5
-#define AES_CTR_ENC_TEST_VECTORS 3
-#define AES_CTR_DEC_TEST_VECTORS 3
+#define AES_CTR_ENC_TEST_VECTORS 4
+#define AES_CTR_DEC_TEST_VECTORS 4
 #define AES_OFB_ENC_TEST_VECTORS 1
 #define AES_OFB_DEC_TEST_VECTORS 1
 #define AES_CTR_3686_ENC_TEST_VECTORS 7
@@ -6283,6 +6283,140 @@ static struct cipher_testvec aes_cbc_enc_tv_template[] = {
 			  "\xb2\xeb\x05\xe2\xc3\x9b\xe9\xfc"
 			  "\xda\x6c\x19\x07\x8c\x6a\x9d\x1b",
 		.rlen	= 64,
+	}, { /* Generated with OpenSSL; several batches of 8 blocks */
+		.key	= "\x4b\x68\x85\xa2\xbf\xdc\xf9\x16"
+			  "\x33\x50\x6d\x8a\xa7\xc4\xe1\xfe",
+		.klen	= 16,
+		.iv	= "\x11\x48\x7f\xb6\xed\x24\x5b\x92"
+			  "\xc9\x00\x37\x6e\xa5\xdc\x13\x4a",
+		.input	= "\x03\x64\xc5\x26\x87\xe8\x49\xaa"
+			  "\x0b\x6c\xcd\x2e\x8f\xf0\x51\xb2"
+			  "\x13\x74\xd5\x36\x97\xf8\x59\xba"
+			  "\x1b\x7c\xdd\x3e\x9f\x00\x61\xc2"
+			  "\x23\x84\xe5\x46\xa7\x08\x69\xca"
+			  "\x2b\x8c\xed\x4e\xaf\x10\x71\xd2"
+			  "\x33\x94\xf5\x56\xb7\x18\x79\xda"
+			  "\x3b\x9c\xfd\x5e\xbf\x20\x81\xe2"
+			  "\x43\xa4\x05\x66\xc7\x28\x89\xea"
+			  "\x4b\xac\x0d\x6e\xcf\x30\x91\xf2"
+			  "\x53\xb4\x15\x76\xd7\x38\x99\xfa"
+			  "\x5b\xbc\x1d\x7e\xdf\x40\xa1\x02"
+			  "\x63\xc4\x25\x86\xe7\x48\xa9\x0a"
+			  "\x6b\xcc\x2d\x8e\xef\x50\xb1\x12"
+			  "\x73\xd4\x35\x96\xf7\x58\xb9\x1a"
+			  "\x7b\xdc\x3d\x9e\xff\x60\xc1\x22"
+			  "\x83\xe4\x45\xa6\x07\x68\xc9\x2a"
+			  "\x8b\xec\x4d\xae\x0f\x70\xd1\x32"
+			  "\x93\xf4\x55\xb6\x17\x78\xd9\x3a"
+			  "\x9b\xfc\x5d\xbe\x1f\x80\xe1\x42"
+			  "\xa3\x04\x65\xc6\x27\x88\xe9\x4a"
+			  "\xab\x0c\x6d\xce\x2f\x90\xf1\x52"
+			  "\xb3\x14\x75\xd6\x37\x98\xf9\x5a"
+			  "\xbb\x1c\x7d\xde\x3f\xa0\x01\x62"
+			  "\xc3\x24\x85\xe6\x47\xa8\x09\x6a"
+			  "\xcb\x2c\x8d\xee\x4f\xb0\x11\x72"
+			  "\xd3\x34\x95\xf6\x57\xb8\x19\x7a"
+			  "\xdb\x3c\x9d\xfe\x5f\xc0\x21\x82"
+			  "\xe3\x44\xa5\x06\x67\xc8\x29\x8a"
+			  "\xeb\x4c\xad\x0e\x6f\xd0\x31\x92"
+			  "\xf3\x54\xb5\x16\x77\xd8\x39\x9a"
+			  "\xfb\x5c\xbd\x1e\x7f\xe0\x41\xa2"
+			  "\x0a\x6b\xcc\x2d\x8e\xef\x50\xb1"
+			  "\x12\x73\xd4\x35\x96\xf7\x58\xb9"
+			  "\x1a\x7b\xdc\x3d\x9e\xff\x60\xc1"
+			  "\x22\x83\xe4\x45\xa6\x07\x68\xc9"
+			  "\x2a\x8b\xec\x4d\xae\x0f\x70\xd1"
+			  "\x32\x93\xf4\x55\xb6\x17\x78\xd9"
+			  "\x3a\x9b\xfc\x5d\xbe\x1f\x80\xe1"
+			  "\x42\xa3\x04\x65\xc6\x27\x88\xe9"
+			  "\x4a\xab\x0c\x6d\xce\x2f\x90\xf1"
+			  "\x52\xb3\x14\x75\xd6\x37\x98\xf9"
+			  "\x5a\xbb\x1c\x7d\xde\x3f\xa0\x01"
+			  "\x62\xc3\x24\x85\xe6\x47\xa8\x09"
+			  "\x6a\xcb\x2c\x8d\xee\x4f\xb0\x11"
+			  "\x72\xd3\x34\x95\xf6\x57\xb8\x19"
+			  "\x7a\xdb\x3c\x9d\xfe\x5f\xc0\x21"
+			  "\x82\xe3\x44\xa5\x06\x67\xc8\x29"
+			  "\x8a\xeb\x4c\xad\x0e\x6f\xd0\x31"
+			  "\x92\xf3\x54\xb5\x16\x77\xd8\x39"
+			  "\x9a\xfb\x5c\xbd\x1e\x7f\xe0\x41"
+			  "\xa2\x03\x64\xc5\x26\x87\xe8\x49"
+			  "\xaa\x0b\x6c\xcd\x2e\x8f\xf0\x51"
+			  "\xb2\x13\x74\xd5\x36\x97\xf8\x59"
+			  "\xba\x1b\x7c\xdd\x3e\x9f\x00\x61"
+			  "\xc2\x23\x84\xe5\x46\xa7\x08\x69"
+			  "\xca\x2b\x8c\xed\x4e\xaf\x10\x71"
+			  "\xd2\x33\x94\xf5\x56\xb7\x18\x79"
+			  "\xda\x3b\x9c\xfd\x5e\xbf\x20\x81"
+			  "\xe2\x43\xa4\x05\x66\xc7\x28\x89"
+			  "\xea\x4b\xac\x0d\x6e\xcf\x30\x91"
+			  "\xf2\x53\xb4\x15\x76\xd7\x38\x99",
+		.ilen	= 496,
+		.result	= "\xbc\xec\xd0\x0a\x24\x83\x9d\x49"
+			  "\x90\x39\xae\xb5\xab\xb8\xdc\x6a"
+			  "\x3e\x33\x70\x8a\x53\x2c\xd1\xbe"
+			  "\x6b\xab\x6b\xc7\x21\xf2\xc1\xfc"
+			  "\xf9\xbe\x67\x81\x66\x0c\x7b\xb3"
+			  "\xaf\xe6\x62\x30\xd9\xe6\x5e\x4c"
+			  "\x7f\xb0\x6d\xab\x94\x89\xe7\xe2"
+			  "\x9e\xfb\x2a\xbf\x85\xa3\x58\xbe"
+			  "\x39\xd1\x3c\x81\x11\x8c\x28\xea"
+			  "\xf8\xa4\xd2\xf2\x36\xfe\x1e\x4c"
+			  "\x55\x91\x61\x77\x8d\x23\xe6\x28"
+			  "\x88\x47\x77\x86\x35\x81\xa9\x55"
+			  "\x13\x03\x21\xd1\xfd\x16\x9b\x63"
+			  "\xed\x11\xed\xf0\x91\x32\xf8\xd2"
+			  "\xb3\x71\x7f\x88\xcc\x64\xa5\xb5"
+			  "\xc3\x58\x04\x8b\x8a\x77\xff\xb7"
+			  "\x9c\x22\xd7\xcd\xaf\x35\x96\xbf"
+			  "\x0d\x59\xc6\x8a\x20\xe6\x00\xf9"
+			  "\x9e\x58\xa0\x7b\x44\x3b\x5a\x3f"
+			  "\xc3\xa2\x47\xd7\xe2\xb0\x4a\x4b"
+			  "\x0b\x5e\x0b\x3c\x77\xaf\xe9\xe7"
+			  "\x2c\x68\x4f\xaf\xf2\xd5\x08\x50"
+			  "\x2f\x0f\x77\xab\xcc\x18\xd5\x8e"
+			  "\x94\x53\x8f\xec\x6a\x80\x25\x0e"
+			  "\x14\x50\x65\x87\x80\xcb\x93\xb5"
+			  "\x6c\x75\x04\xef\x51\xce\x61\xe1"
+			  "\x52\x86\x8d\x6e\x4f\x3f\x34\x50"
+			  "\xa3\x5a\x17\x64\xab\xfa\x51\xcd"
+			  "\x9c\x8f\xc3\xcc\x09\x5b\x67\xf8"
+			  "\x50\x8e\xfa\xf9\xd2\x62\xcf\x8f"
+			  "\xcb\x56\xea\x71\xc9\x4d\x7b\x6d"
+			  "\xb5\xb5\x73\x0f\xfe\x60\x10\x0a"
+			  "\x8f\x83\xe6\xaf\x5d\x9e\x7c\xbe"
+			  "\x4e\x6a\x6c\xf0\x11\x13\xcf\x78"
+			  "\x50\x6c\x35\x1b\x6a\xc4\x74\xb0"
+			  "\x8c\x6d\x78\xdf\x75\x59\x42\x8e"
+			  "\xd2\x92\x66\xd1\x49\x17\xc6\xc0"
+			  "\x7e\xc3\x66\xd6\x3a\xb0\x11\xb2"
+			  "\x7a\xae\x74\x5b\x81\x56\xea\x21"
+			  "\x6a\xfa\xde\x5e\x53\xee\xff\x5c"
+			  "\xc5\x6f\x85\x81\xa0\x87\xff\xee"
+			  "\x74\x4f\x91\x41\x70\xda\xec\xae"
+			  "\x20\x13\x8e\xdd\x30\x94\x8e\x09"
+			  "\x1f\x76\xc4\x1c\x9d\x27\x03\x25"
+			  "\xb8\x8e\xc8\xe6\x4a\xec\x97\x23"
+			  "\xc8\x94\xfe\x67\x20\xe6\xe5\x1d"
+			  "\x3a\x1d\x2a\x9d\x95\xf2\x72\xf0"
+			  "\xc6\x37\xba\x94\x3e\x6f\x79\x2a"
+			  "\xae\x87\x18\x7d\xe0\x9f\x18\xba"
+			  "\xdf\x83\x80\xba\x48\xf6\x17\xd6"
+			  "\x85\xa9\x9d\x6f\x52\xee\x37\xb8"
+			  "\x02\x73\xb5\x96\x8d\xe0\x49\x75"
+			  "\xc8\x02\x05\xd7\x50\x2d\x5a\xc9"
+			  "\xb6\xa5\x83\x06\xc9\x30\xef\x01"
+			  "\x89\xd0\x01\x29\x8a\x3d\x17\x3f"
+			  "\x40\x48\xe1\x4b\xd5\xe2\xf1\xf1"
+			  "\x12\x23\x80\x94\x95\xea\x46\x51"
+			  "\xba\xc2\x02\xe4\x1d\xbf\xca\xa8"
+			  "\x0d\xa0\xa5\xa1\xe1\x7e\xda\x98"
+			  "\x40\xc8\x53\x3c\x1b\xfc\x91\x26"
+			  "\xac\x67\xec\xf4\x70\x6f\xb0\xda"
+			  "\xdb\x5a\xa5\x77\x6a\x09\x52\xb2",
+		.rlen	= 496,
+		.np	= 3,
+		.tap	= { 496 - 20, 4, 16 },
 	},
 };
 
@@ -6365,6 +6499,140 @@ static struct cipher_testvec aes_cbc_dec_tv_template[] = {
 			  "\xf6\x9f\x24\x45\xdf\x4f\x9b\x17"
 			  "\xad\x2b\x41\x7b\xe6\x6c\x37\x10",
 		.rlen	= 64,
+	}, { /* Generated with OpenSSL; several batches of 8 blocks */
+		.key	= "\x4b\x68\x85\xa2\xbf\xdc\xf9\x16"
+			  "\x33\x50\x6d\x8a\xa7\xc4\xe1\xfe",
+		.klen	= 16,
+		.iv	= "\x11\x48\x7f\xb6\xed\x24\x5b\x92"
+			  "\xc9\x00\x37\x6e\xa5\xdc\x13\x4a",
+		.input	= "\xbc\xec\xd0\x0a\x24\x83\x9d\x49"
+			  "\x90\x39\xae\xb5\xab\xb8\xdc\x6a"
+			  "\x3e\x33\x70\x8a\x53\x2c\xd1\xbe"
+			  "\x6b\xab\x6b\xc7\x21\xf2\xc1\xfc"
+			  "\xf9\xbe\x67\x81\x66\x0c\x7b\xb3"
+			  "\xaf\xe6\x62\x30\xd9\xe6\x5e\x4c"
+			  "\x7f\xb0\x6d\xab\x94\x89\xe7\xe2"
+			  "\x9e\xfb\x2a\xbf\x85\xa3\x58\xbe"
+			  "\x39\xd1\x3c\x81\x11\x8c\x28\xea"
+			  "\xf8\xa4\xd2\xf2\x36\xfe\x1e\x4c"
+			  "\x55\x91\x61\x77\x8d\x23\xe6\x28"
+			  "\x88\x47\x77\x86\x35\x81\xa9\x55"
+			  "\x13\x03\x21\xd1\xfd\x16\x9b\x63"
+			  "\xed\x11\xed\xf0\x91\x32\xf8\xd2"
+			  "\xb3\x71\x7f\x88\xcc\x64\xa5\xb5"
+			  "\xc3\x58\x04\x8b\x8a\x77\xff\xb7"
+			  "\x9c\x22\xd7\xcd\xaf\x35\x96\xbf"
+			  "\x0d\x59\xc6\x8a\x20\xe6\x00\xf9"
+			  "\x9e\x58\xa0\x7b\x44\x3b\x5a\x3f"
+			  "\xc3\xa2\x47\xd7\xe2\xb0\x4a\x4b"
+			  "\x0b\x5e\x0b\x3c\x77\xaf\xe9\xe7"
+			  "\x2c\x68\x4f\xaf\xf2\xd5\x08\x50"
+			  "\x2f\x0f\x77\xab\xcc\x18\xd5\x8e"
+			  "\x94\x53\x8f\xec\x6a\x80\x25\x0e"
+			  "\x14\x50\x65\x87\x80\xcb\x93\xb5"
+			  "\x6c\x75\x04\xef\x51\xce\x61\xe1"
+			  "\x52\x86\x8d\x6e\x4f\x3f\x34\x50"
+			  "\xa3\x5a\x17\x64\xab\xfa\x51\xcd"
+			  "\x9c\x8f\xc3\xcc\x09\x5b\x67\xf8"
+			  "\x50\x8e\xfa\xf9\xd2\x62\xcf\x8f"
+			  "\xcb\x56\xea\x71\xc9\x4d\x7b\x6d"
+			  "\xb5\xb5\x73\x0f\xfe\x60\x10\x0a"
+			  "\x8f\x83\xe6\xaf\x5d\x9e\x7c\xbe"
+			  "\x4e\x6a\x6c\xf0\x11\x13\xcf\x78"
+			  "\x50\x6c\x35\x1b\x6a\xc4\x74\xb0"
+			  "\x8c\x6d\x78\xdf\x75\x59\x42\x8e"
+			  "\xd2\x92\x66\xd1\x49\x17\xc6\xc0"
+			  "\x7e\xc3\x66\xd6\x3a\xb0\x11\xb2"
+			  "\x7a\xae\x74\x5b\x81\x56\xea\x21"
+			  "\x6a\xfa\xde\x5e\x53\xee\xff\x5c"
+			  "\xc5\x6f\x85\x81\xa0\x87\xff\xee"
+			  "\x74\x4f\x91\x41\x70\xda\xec\xae"
+			  "\x20\x13\x8e\xdd\x30\x94\x8e\x09"
+			  "\x1f\x76\xc4\x1c\x9d\x27\x03\x25"
+			  "\xb8\x8e\xc8\xe6\x4a\xec\x97\x23"
+			  "\xc8\x94\xfe\x67\x20\xe6\xe5\x1d"
+			  "\x3a\x1d\x2a\x9d\x95\xf2\x72\xf0"
+			  "\xc6\x37\xba\x94\x3e\x6f\x79\x2a"
+			  "\xae\x87\x18\x7d\xe0\x9f\x18\xba"
+			  "\xdf\x83\x80\xba\x48\xf6\x17\xd6"
+			  "\x85\xa9\x9d\x6f\x52\xee\x37\xb8"
+			  "\x02\x73\xb5\x96\x8d\xe0\x49\x75"
+			  "\xc8\x02\x05\xd7\x50\x2d\x5a\xc9"
+			  "\xb6\xa5\x83\x06\xc9\x30\xef\x01"
+			  "\x89\xd0\x01\x29\x8a\x3d\x17\x3f"
+			  "\x40\x48\xe1\x4b\xd5\xe2\xf1\xf1"
+			  "\x12\x23\x80\x94\x95\xea\x46\x51"
+			  "\xba\xc2\x02\xe4\x1d\xbf\xca\xa8"
+			  "\x0d\xa0\xa5\xa1\xe1\x7e\xda\x98"
+			  "\x40\xc8\x53\x3c\x1b\xfc\x91\x26"
+			  "\xac\x67\xec\xf4\x70\x6f\xb0\xda"
+			  "\xdb\x5a\xa5\x77\x6a\x09\x52\xb2",
+		.ilen	= 496,
+		.result	= "\x03\x64\xc5\x26\x87\xe8\x49\xaa"
+			  "\x0b\x6c\xcd\x2e\x8f\xf0\x51\xb2"
+			  "\x13\x74\xd5\x36\x97\xf8\x59\xba"
+			  "\x1b\x7c\xdd\x3e\x9f\x00\x61\xc2"
+			  "\x23\x84\xe5\x46\xa7\x08\x69\xca"
+			  "\x2b\x8c\xed\x4e\xaf\x10\x71\xd2"
+			  "\x33\x94\xf5\x56\xb7\x18\x79\xda"
+			  "\x3b\x9c\xfd\x5e\xbf\x20\x81\xe2"
+			  "\x43\xa4\x05\x66\xc7\x28\x89\xea"
+			  "\x4b\xac\x0d\x6e\xcf\x30\x91\xf2"
+			  "\x53\xb4\x15\x76\xd7\x38\x99\xfa"
+			  "\x5b\xbc\x1d\x7e\xdf\x40\xa1\x02"
+			  "\x63\xc4\x25\x86\xe7\x48\xa9\x0a"
+			  "\x6b\xcc\x2d\x8e\xef\x50\xb1\x12"
+			  "\x73\xd4\x35\x96\xf7\x58\xb9\x1a"
+			  "\x7b\xdc\x3d\x9e\xff\x60\xc1\x22"
+			  "\x83\xe4\x45\xa6\x07\x68\xc9\x2a"
+			  "\x8b\xec\x4d\xae\x0f\x70\xd1\x32"
+			  "\x93\xf4\x55\xb6\x17\x78\xd9\x3a"
+			  "\x9b\xfc\x5d\xbe\x1f\x80\xe1\x42"
+			  "\xa3\x04\x65\xc6\x27\x88\xe9\x4a"
+			  "\xab\x0c\x6d\xce\x2f\x90\xf1\x52"
+			  "\xb3\x14\x75\xd6\x37\x98\xf9\x5a"
+			  "\xbb\x1c\x7d\xde\x3f\xa0\x01\x62"
+			  "\xc3\x24\x85\xe6\x47\xa8\x09\x6a"
+			  "\xcb\x2c\x8d\xee\x4f\xb0\x11\x72"
+			  "\xd3\x34\x95\xf6\x57\xb8\x19\x7a"
+			  "\xdb\x3c\x9d\xfe\x5f\xc0\x21\x82"
+			  "\xe3\x44\xa5\x06\x67\xc8\x29\x8a"
+			  "\xeb\x4c\xad\x0e\x6f\xd0\x31\x92"
+			  "\xf3\x54\xb5\x16\x77\xd8\x39\x9a"
+			  "\xfb\x5c\xbd\x1e\x7f\xe0\x41\xa2"
+			  "\x0a\x6b\xcc\x2d\x8e\xef\x50\xb1"
+			  "\x12\x73\xd4\x35\x96\xf7\x58\xb9"
+			  "\x1a\x7b\xdc\x3d\x9e\xff\x60\xc1"
+			  "\x22\x83\xe4\x45\xa6\x07\x68\xc9"
+			  "\x2a\x8b\xec\x4d\xae\x0f\x70\xd1"
+			  "\x32\x93\xf4\x55\xb6\x17\x78\xd9"
+			  "\x3a\x9b\xfc\x5d\xbe\x1f\x80\xe1"
+			  "\x42\xa3\x04\x65\xc6\x27\x88\xe9"
+			  "\x4a\xab\x0c\x6d\xce\x2f\x90\xf1"
+			  "\x52\xb3\x14\x75\xd6\x37\x98\xf9"
+			  "\x5a\xbb\x1c\x7d\xde\x3f\xa0\x01"
+			  "\x62\xc3\x24\x85\xe6\x47\xa8\x09"
+			  "\x6a\xcb\x2c\x8d\xee\x4f\xb0\x11"
+			  "\x72\xd3\x34\x95\xf6\x57\xb8\x19"
+			  "\x7a\xdb\x3c\x9d\xfe\x5f\xc0\x21"
+			  "\x82\xe3\x44\xa5\x06\x67\xc8\x29"
+			  "\x8a\xeb\x4c\xad\x0e\x6f\xd0\x31"
+			  "\x92\xf3\x54\xb5\x16\x77\xd8\x39"
+			  "\x9a\xfb\x5c\xbd\x1e\x7f\xe0\x41"
+			  "\xa2\x03\x64\xc5\x26\x87\xe8\x49"
+			  "\xaa\x0b\x6c\xcd\x2e\x8f\xf0\x51"
+			  "\xb2\x13\x74\xd5\x36\x97\xf8\x59"
+			  "\xba\x1b\x7c\xdd\x3e\x9f\x00\x61"
+			  "\xc2\x23\x84\xe5\x46\xa7\x08\x69"
+			  "\xca\x2b\x8c\xed\x4e\xaf\x10\x71"
+			  "\xd2\x33\x94\xf5\x56\xb7\x18\x79"
+			  "\xda\x3b\x9c\xfd\x5e\xbf\x20\x81"
+			  "\xe2\x43\xa4\x05\x66\xc7\x28\x89"
+			  "\xea\x4b\xac\x0d\x6e\xcf\x30\x91"
+			  "\xf2\x53\xb4\x15\x76\xd7\x38\x99",
+		.rlen	= 496,
+		.np	= 3,
+		.tap	= { 496 - 20, 4, 16 },
 	},
 };
 
@@ -7629,6 +7897,144 @@ static struct cipher_testvec aes_ctr_enc_tv_template[] = {
 			  "\xdf\xc9\xc5\x8d\xb6\x7a\xad\xa6"
 			  "\x13\xc2\xdd\x08\x45\x79\x41\xa6",
 		.rlen	= 64,
+	}, { /* Generated with OpenSSL; counter carry and a partial final block */
+		.key	= "\x90\xbb\xe6\x11\x3c\x67\x92\xbd"
+			  "\xe8\x13\x3e\x69\x94\xbf\xea\x15"
+			  "\x40\x6b\x96\xc1\xec\x17\x42\x6d"
+			  "\x98\xc3\xee\x19\x44\x6f\x9a\xc5",
+		.klen	= 32,
+		.iv	= "\x01\x23\x45\x67\x89\xab\xcd\xef"
+			  "\xff\xff\xff\xff\xff\xff\xff\xf8",
+		.input	= "\x55\xa4\xf3\x42\x91\xe0\x2f\x7e"
+			  "\xcd\x1c\x6b\xba\x09\x58\xa7\xf6"
+			  "\x45\x94\xe3\x32\x81\xd0\x1f\x6e"
+			  "\xbd\x0c\x5b\xaa\xf9\x48\x97\xe6"
+			  "\x35\x84\xd3\x22\x71\xc0\x0f\x5e"
+			  "\xad\xfc\x4b\x9a\xe9\x38\x87\xd6"
+			  "\x25\x74\xc3\x12\x61\xb0\xff\x4e"
+			  "\x9d\xec\x3b\x8a\xd9\x28\x77\xc6"
+			  "\x15\x64\xb3\x02\x51\xa0\xef\x3e"
+			  "\x8d\xdc\x2b\x7a\xc9\x18\x67\xb6"
+			  "\x05\x54\xa3\xf2\x41\x90\xdf\x2e"
+			  "\x7d\xcc\x1b\x6a\xb9\x08\x57\xa6"
+			  "\xf5\x44\x93\xe2\x31\x80\xcf\x1e"
+			  "\x6d\xbc\x0b\x5a\xa9\xf8\x47\x96"
+			  "\xe5\x34\x83\xd2\x21\x70\xbf\x0e"
+			  "\x5d\xac\xfb\x4a\x99\xe8\x37\x86"
+			  "\xd5\x24\x73\xc2\x11\x60\xaf\xfe"
+			  "\x4d\x9c\xeb\x3a\x89\xd8\x27\x76"
+			  "\xc5\x14\x63\xb2\x01\x50\x9f\xee"
+			  "\x3d\x8c\xdb\x2a\x79\xc8\x17\x66"
+			  "\xb5\x04\x53\xa2\xf1\x40\x8f\xde"
+			  "\x2d\x7c\xcb\x1a\x69\xb8\x07\x56"
+			  "\xa5\xf4\x43\x92\xe1\x30\x7f\xce"
+			  "\x1d\x6c\xbb\x0a\x59\xa8\xf7\x46"
+			  "\x95\xe4\x33\x82\xd1\x20\x6f\xbe"
+			  "\x0d\x5c\xab\xfa\x49\x98\xe7\x36"
+			  "\x85\xd4\x23\x72\xc1\x10\x5f\xae"
+			  "\xfd\x4c\x9b\xea\x39\x88\xd7\x26"
+			  "\x75\xc4\x13\x62\xb1\x00\x4f\x9e"
+			  "\xed\x3c\x8b\xda\x29\x78\xc7\x16"
+			  "\x65\xb4\x03\x52\xa1\xf0\x3f\x8e"
+			  "\xdd\x2c\x7b\xca\x19\x68\xb7\x06"
+			  "\x58\xa7\xf6\x45\x94\xe3\x32\x81"
+			  "\xd0\x1f\x6e\xbd\x0c\x5b\xaa\xf9"
+			  "\x48\x97\xe6\x35\x84\xd3\x22\x71"
+			  "\xc0\x0f\x5e\xad\xfc\x4b\x9a\xe9"
+			  "\x38\x87\xd6\x25\x74\xc3\x12\x61"
+			  "\xb0\xff\x4e\x9d\xec\x3b\x8a\xd9"
+			  "\x28\x77\xc6\x15\x64\xb3\x02\x51"
+			  "\xa0\xef\x3e\x8d\xdc\x2b\x7a\xc9"
+			  "\x18\x67\xb6\x05\x54\xa3\xf2\x41"
+			  "\x90\xdf\x2e\x7d\xcc\x1b\x6a\xb9"
+			  "\x08\x57\xa6\xf5\x44\x93\xe2\x31"
+			  "\x80\xcf\x1e\x6d\xbc\x0b\x5a\xa9"
+			  "\xf8\x47\x96\xe5\x34\x83\xd2\x21"
+			  "\x70\xbf\x0e\x5d\xac\xfb\x4a\x99"
+			  "\xe8\x37\x86\xd5\x24\x73\xc2\x11"
+			  "\x60\xaf\xfe\x4d\x9c\xeb\x3a\x89"
+			  "\xd8\x27\x76\xc5\x14\x63\xb2\x01"
+			  "\x50\x9f\xee\x3d\x8c\xdb\x2a\x79"
+			  "\xc8\x17\x66\xb5\x04\x53\xa2\xf1"
+			  "\x40\x8f\xde\x2d\x7c\xcb\x1a\x69"
+			  "\xb8\x07\x56\xa5\xf4\x43\x92\xe1"
+			  "\x30\x7f\xce\x1d\x6c\xbb\x0a\x59"
+			  "\xa8\xf7\x46\x95\xe4\x33\x82\xd1"
+			  "\x20\x6f\xbe\x0d\x5c\xab\xfa\x49"
+			  "\x98\xe7\x36\x85\xd4\x23\x72\xc1"
+			  "\x10\x5f\xae\xfd\x4c\x9b\xea\x39"
+			  "\x88\xd7\x26\x75\xc4\x13\x62\xb1"
+			  "\x00\x4f\x9e\xed\x3c\x8b\xda\x29"
+			  "\x78\xc7\x16\x65\xb4\x03\x52\xa1"
+			  "\xf0\x3f\x8e\xdd\x2c\x7b\xca\x19"
+			  "\x68\xb7\x06",
+		.ilen	= 499,
+		.result	= "\xc3\x4e\xc2\x86\xc8\x91\xc9\x72"
+			  "\x88\x57\x4c\xaa\xda\xef\x16\x4a"
+			  "\x88\xa5\x69\x96\x79\xa6\x9b\x2e"
+			  "\x80\xc5\xfa\xb2\x3d\xdc\x3e\xd3"
+			  "\x4d\x71\x3d\x94\x97\x02\xd5\x86"
+			  "\x14\x28\xfb\x27\xed\x77\x1b\xad"
+			  "\x5a\xe2\xf6\x3e\x16\x8a\x08\x42"
+			  "\x21\xdf\x36\x72\x3b\xd3\xd9\x89"
+			  "\x8b\x5d\x88\x40\xb6\xcc\xd3\xbb"
+			  "\xaf\x30\x02\x82\x01\x74\x4e\xd0"
+			  "\x8e\xb7\xbb\x5d\xba\xea\x15\x0f"
+			  "\xc9\x70\x42\xd4\x64\xc9\x16\x3a"
+			  "\x78\x10\xab\xb0\xf7\x20\x2e\x83"
+			  "\xe9\x58\x99\xa4\xcf\xde\x34\xaa"
+			  "\xe0\x33\xe9\x19\x92\xdf\x17\x6d"
+			  "\x9a\x02\x37\x89\xf3\xc7\x34\x97"
+			  "\x31\x82\xb7\x52\x72\x6f\xff\x93"
+			  "\xb3\xc5\x96\x5a\xf9\xc8\x64\x1d"
+			  "\xed\xcf\xb5\x98\xf9\x9b\xbd\xf8"
+			  "\x1b\xb3\x67\xeb\x5e\x38\x5f\x60"
+			  "\xf9\x7e\x48\x81\x91\x23\xe8\x12"
+			  "\x4b\x40\xd5\xc8\x7d\x85\x91\x71"
+			  "\xd6\xca\xda\xd0\x16\x1a\x31\xf4"
+			  "\x46\x5d\x65\x8f\xf4\xbe\xa1\xad"
+			  "\x5f\x79\x8c\x24\x61\x55\x2c\x82"
+			  "\x00\x68\x10\x5e\xf7\xba\x35\xdb"
+			  "\x28\xe1\xed\xb6\x53\x2f\x85\x25"
+			  "\x2f\x6d\xe0\x44\xa6\x44\xf5\xda"
+			  "\x06\xef\xf4\x08\xa1\x34\x9c\x9b"
+			  "\x21\xed\x83\x20\x12\x73\xca\xbf"
+			  "\x8d\xa6\x87\x5e\x5e\x26\xea\x59"
+			  "\xaa\x8d\x5f\x9d\x77\xb7\xb2\xb9"
+			  "\x7e\x16\x8b\x9c\x91\x26\x0d\xba"
+			  "\x8f\x4a\x75\x43\xcf\x6e\xa6\xd3"
+			  "\x8e\xb6\xd5\x0e\x24\x84\x61\x83"
+			  "\x0a\x30\x58\x6f\x6d\x04\x68\x67"
+			  "\x8d\x04\x81\xea\xd6\xe3\xea\x14"
+			  "\x1d\x8f\xe9\x30\x64\x1f\xb9\xa1"
+			  "\xdf\x03\xbb\xf0\x24\x05\xcf\xea"
+			  "\x84\xeb\x39\x4d\x0c\x43\x47\x6e"
+			  "\x6f\x84\x48\x66\xfa\x64\x21\x83"
+			  "\x5b\x13\x99\x37\x02\xa4\x69\x96"
+			  "\xe0\xd5\xe8\x46\xed\xee\x91\xbf"
+			  "\x36\x57\xd5\x26\xba\x9f\x93\x68"
+			  "\xff\x74\x74\x85\x2c\x87\x03\xc8"
+			  "\x04\xed\x06\x09\x18\xa8\xf9\x1f"
+			  "\xd4\x95\x31\x12\x98\x23\x10\xbf"
+			  "\x0c\x32\x58\xbd\xbe\xd3\x7d\x65"
+			  "\xb5\x80\x5b\x1f\xe7\xc3\x8f\xd1"
+			  "\xe6\x75\xfe\x3d\x2c\xb5\x45\x07"
+			  "\x6c\xb9\xd5\x20\x18\x2e\x22\xbc"
+			  "\xf7\xdc\xf6\x3b\x5d\x33\x15\xae"
+			  "\x39\x44\x06\xd1\x26\x57\x87\x61"
+			  "\xb4\x9e\x8d\xd8\x84\x06\x5f\xec"
+			  "\x10\xeb\x50\x50\x4e\x5b\xd7\xa4"
+			  "\x80\xdd\xe6\x67\x7b\xbd\x21\x9f"
+			  "\x4b\x6a\x01\x48\xd4\x41\x11\x3d"
+			  "\xa1\x0f\x7d\x6a\xc2\xc6\xf0\xde"
+			  "\x31\x38\xd2\x39\xbb\xd5\x8b\x45"
+			  "\x77\x15\x5c\xc6\xb8\x8e\xa7\x52"
+			  "\x5e\x96\xd1\x80\x52\x0b\x41\xb8"
+			  "\x86\x0a\x6c\x96\x2c\x21\x0b\x6f"
+			  "\x9f\x9c\x67",
+		.rlen	= 499,
+		.np	= 3,
+		.tap	= { 499 - 15, 8, 7 },
 	}
 };
 
@@ -7708,6 +8114,144 @@ static struct cipher_testvec aes_ctr_dec_tv_template[] = {
 			  "\xf6\x9f\x24\x45\xdf\x4f\x9b\x17"
 			  "\xad\x2b\x41\x7b\xe6\x6c\x37\x10",
 		.rlen	= 64,
+	}, { /* Generated with OpenSSL; counter carry and a partial final block */
+		.key	= "\x90\xbb\xe6\x11\x3c\x67\x92\xbd"
+			  "\xe8\x13\x3e\x69\x94\xbf\xea\x15"
+			  "\x40\x6b\x96\xc1\xec\x17\x42\x6d"
+			  "\x98\xc3\xee\x19\x44\x6f\x9a\xc5",
+		.klen	= 32,
+		.iv	= "\x01\x23\x45\x67\x89\xab\xcd\xef"
+			  "\xff\xff\xff\xff\xff\xff\xff\xf8",
+		.input	= "\xc3\x4e\xc2\x86\xc8\x91\xc9\x72"
+			  "\x88\x57\x4c\xaa\xda\xef\x16\x4a"
+			  "\x88\xa5\x69\x96\x79\xa6\x9b\x2e"
+			  "\x80\xc5\xfa\xb2\x3d\xdc\x3e\xd3"
+			  "\x4d\x71\x3d\x94\x97\x02\xd5\x86"
+			  "\x14\x28\xfb\x27\xed\x77\x1b\xad"
+			  "\x5a\xe2\xf6\x3e\x16\x8a\x08\x42"
+			  "\x21\xdf\x36\x72\x3b\xd3\xd9\x89"
+			  "\x8b\x5d\x88\x40\xb6\xcc\xd3\xbb"
+			  "\xaf\x30\x02\x82\x01\x74\x4e\xd0"
+			  "\x8e\xb7\xbb\x5d\xba\xea\x15\x0f"
+			  "\xc9\x70\x42\xd4\x64\xc9\x16\x3a"
+			  "\x78\x10\xab\xb0\xf7\x20\x2e\x83"
+			  "\xe9\x58\x99\xa4\xcf\xde\x34\xaa"
+			  "\xe0\x33\xe9\x19\x92\xdf\x17\x6d"
+			  "\x9a\x02\x37\x89\xf3\xc7\x34\x97"
+			  "\x31\x82\xb7\x52\x72\x6f\xff\x93"
+			  "\xb3\xc5\x96\x5a\xf9\xc8\x64\x1d"
+			  "\xed\xcf\xb5\x98\xf9\x9b\xbd\xf8"
+			  "\x1b\xb3\x67\xeb\x5e\x38\x5f\x60"
+			  "\xf9\x7e\x48\x81\x91\x23\xe8\x12"
+			  "\x4b\x40\xd5\xc8\x7d\x85\x91\x71"
+			  "\xd6\xca\xda\xd0\x16\x1a\x31\xf4"
+			  "\x46\x5d\x65\x8f\xf4\xbe\xa1\xad"
+			  "\x5f\x79\x8c\x24\x61\x55\x2c\x82"
+			  "\x00\x68\x10\x5e\xf7\xba\x35\xdb"
+			  "\x28\xe1\xed\xb6\x53\x2f\x85\x25"
+			  "\x2f\x6d\xe0\x44\xa6\x44\xf5\xda"
+			  "\x06\xef\xf4\x08\xa1\x34\x9c\x9b"
+			  "\x21\xed\x83\x20\x12\x73\xca\xbf"
+			  "\x8d\xa6\x87\x5e\x5e\x26\xea\x59"
+			  "\xaa\x8d\x5f\x9d\x77\xb7\xb2\xb9"
+			  "\x7e\x16\x8b\x9c\x91\x26\x0d\xba"
+			  "\x8f\x4a\x75\x43\xcf\x6e\xa6\xd3"
+			  "\x8e\xb6\xd5\x0e\x24\x84\x61\x83"
+			  "\x0a\x30\x58\x6f\x6d\x04\x68\x67"
+			  "\x8d\x04\x81\xea\xd6\xe3\xea\x14"
+			  "\x1d\x8f\xe9\x30\x64\x1f\xb9\xa1"
+			  "\xdf\x03\xbb\xf0\x24\x05\xcf\xea"
+			  "\x84\xeb\x39\x4d\x0c\x43\x47\x6e"
+			  "\x6f\x84\x48\x66\xfa\x64\x21\x83"
+			  "\x5b\x13\x99\x37\x02\xa4\x69\x96"
+			  "\xe0\xd5\xe8\x46\xed\xee\x91\xbf"
+			  "\x36\x57\xd5\x26\xba\x9f\x93\x68"
+			  "\xff\x74\x74\x85\x2c\x87\x03\xc8"
+			  "\x04\xed\x06\x09\x18\xa8\xf9\x1f"
+			  "\xd4\x95\x31\x12\x98\x23\x10\xbf"
+			  "\x0c\x32\x58\xbd\xbe\xd3\x7d\x65"
+			  "\xb5\x80\x5b\x1f\xe7\xc3\x8f\xd1"
+			  "\xe6\x75\xfe\x3d\x2c\xb5\x45\x07"
+			  "\x6c\xb9\xd5\x20\x18\x2e\x22\xbc"
+			  "\xf7\xdc\xf6\x3b\x5d\x33\x15\xae"
+			  "\x39\x44\x06\xd1\x26\x57\x87\x61"
+			  "\xb4\x9e\x8d\xd8\x84\x06\x5f\xec"
+			  "\x10\xeb\x50\x50\x4e\x5b\xd7\xa4"
+			  "\x80\xdd\xe6\x67\x7b\xbd\x21\x9f"
+			  "\x4b\x6a\x01\x48\xd4\x41\x11\x3d"
+			  "\xa1\x0f\x7d\x6a\xc2\xc6\xf0\xde"
+			  "\x31\x38\xd2\x39\xbb\xd5\x8b\x45"
+			  "\x77\x15\x5c\xc6\xb8\x8e\xa7\x52"
+			  "\x5e\x96\xd1\x80\x52\x0b\x41\xb8"
+			  "\x86\x0a\x6c\x96\x2c\x21\x0b\x6f"
+			  "\x9f\x9c\x67",
+		.ilen	= 499,
+		.result	= "\x55\xa4\xf3\x42\x91\xe0\x2f\x7e"
+			  "\xcd\x1c\x6b\xba\x09\x58\xa7\xf6"
+			  "\x45\x94\xe3\x32\x81\xd0\x1f\x6e"
+			  "\xbd\x0c\x5b\xaa\xf9\x48\x97\xe6"
+			  "\x35\x84\xd3\x22\x71\xc0\x0f\x5e"
+			  "\xad\xfc\x4b\x9a\xe9\x38\x87\xd6"
+			  "\x25\x74\xc3\x12\x61\xb0\xff\x4e"
+			  "\x9d\xec\x3b\x8a\xd9\x28\x77\xc6"
+			  "\x15\x64\xb3\x02\x51\xa0\xef\x3e"
+			  "\x8d\xdc\x2b\x7a\xc9\x18\x67\xb6"
+			  "\x05\x54\xa3\xf2\x41\x90\xdf\x2e"
+			  "\x7d\xcc\x1b\x6a\xb9\x08\x57\xa6"
+			  "\xf5\x44\x93\xe2\x31\x80\xcf\x1e"
+			  "\x6d\xbc\x0b\x5a\xa9\xf8\x47\x96"
+			  "\xe5\x34\x83\xd2\x21\x70\xbf\x0e"
+			  "\x5d\xac\xfb\x4a\x99\xe8\x37\x86"
+			  "\xd5\x24\x73\xc2\x11\x60\xaf\xfe"
+			  "\x4d\x9c\xeb\x3a\x89\xd8\x27\x76"
+			  "\xc5\x14\x63\xb2\x01\x50\x9f\xee"
+			  "\x3d\x8c\xdb\x2a\x79\xc8\x17\x66"
+			  "\xb5\x04\x53\xa2\xf1\x40\x8f\xde"
+			  "\x2d\x7c\xcb\x1a\x69\xb8\x07\x56"
+			  "\xa5\xf4\x43\x92\xe1\x30\x7f\xce"
+			  "\x1d\x6c\xbb\x0a\x59\xa8\xf7\x46"
+			  "\x95\xe4\x33\x82\xd1\x20\x6f\xbe"
+			  "\x0d\x5c\xab\xfa\x49\x98\xe7\x36"
+			  "\x85\xd4\x23\x72\xc1\x10\x5f\xae"
+			  "\xfd\x4c\x9b\xea\x39\x88\xd7\x26"
+			  "\x75\xc4\x13\x62\xb1\x00\x4f\x9e"
+			  "\xed\x3c\x8b\xda\x29\x78\xc7\x16"
+			  "\x65\xb4\x03\x52\xa1\xf0\x3f\x8e"
+			  "\xdd\x2c\x7b\xca\x19\x68\xb7\x06"
+			  "\x58\xa7\xf6\x45\x94\xe3\x32\x81"
+			  "\xd0\x1f\x6e\xbd\x0c\x5b\xaa\xf9"
+			  "\x48\x97\xe6\x35\x84\xd3\x22\x71"
+			  "\xc0\x0f\x5e\xad\xfc\x4b\x9a\xe9"
+			  "\x38\x87\xd6\x25\x74\xc3\x12\x61"
+			  "\xb0\xff\x4e\x9d\xec\x3b\x8a\xd9"
+			  "\x28\x77\xc6\x15\x64\xb3\x02\x51"
+			  "\xa0\xef\x3e\x8d\xdc\x2b\x7a\xc9"
+			  "\x18\x67\xb6\x05\x54\xa3\xf2\x41"
+			  "\x90\xdf\x2e\x7d\xcc\x1b\x6a\xb9"
+			  "\x08\x57\xa6\xf5\x44\x93\xe2\x31"
+			  "\x80\xcf\x1e\x6d\xbc\x0b\x5a\xa9"
+			  "\xf8\x47\x96\xe5\x34\x83\xd2\x21"
+			  "\x70\xbf\x0e\x5d\xac\xfb\x4a\x99"
+			  "\xe8\x37\x86\xd5\x24\x73\xc2\x11"
+			  "\x60\xaf\xfe\x4d\x9c\xeb\x3a\x89"
+			  "\xd8\x27\x76\xc5\x14\x63\xb2\x01"
+			  "\x50\x9f\xee\x3d\x8c\xdb\x2a\x79"
+			  "\xc8\x17\x66\xb5\x04\x53\xa2\xf1"
+			  "\x40\x8f\xde\x2d\x7c\xcb\x1a\x69"
+			  "\xb8\x07\x56\xa5\xf4\x43\x92\xe1"
+			  "\x30\x7f\xce\x1d\x6c\xbb\x0a\x59"
+			  "\xa8\xf7\x46\x95\xe4\x33\x82\xd1"
+			  "\x20\x6f\xbe\x0d\x5c\xab\xfa\x49"
+			  "\x98\xe7\x36\x85\xd4\x23\x72\xc1"
+			  "\x10\x5f\xae\xfd\x4c\x9b\xea\x39"
+			  "\x88\xd7\x26\x75\xc4\x13\x62\xb1"
+			  "\x00\x4f\x9e\xed\x3c\x8b\xda\x29"
+			  "\x78\xc7\x16\x65\xb4\x03\x52\xa1"
+			  "\xf0\x3f\x8e\xdd\x2c\x7b\xca\x19"
+			  "\x68\xb7\x06",
+		.rlen	= 499,
+		.np	= 3,
+		.tap	= { 499 - 15, 8, 7 },
 	}
 };
 
@@ -14549,6 +15093,166 @@ static struct pcomp_testvec zlib_decomp_tv_template[] = {
 	},
 };
 
+/*
+ * LZ4 test vectors (null-terminated strings).
+ */
+#define LZ4_COMP_TEST_VECTORS 2
+#define LZ4_DECOMP_TEST_VECTORS 2
+
+static struct comp_testvec lz4_comp_tv_template[] = {
+	{
+		.inlen	= 70,
+		.outlen	= 45,
+		.input	= "Join us now and share the software "
+			"Join us now and share the software ",
+		.output	= "\xf0\x10\x4a\x6f\x69\x6e\x20\x75"
+			  "\x73\x20\x6e\x6f\x77\x20\x61\x6e"
+			  "\x64\x20\x73\x68\x61\x72\x65\x20"
+			  "\x74\x68\x65\x20\x73\x6f\x66\x74"
+			  "\x77\x0d\x00\x0f\x23\x00\x0b\x50"
+			  "\x77\x61\x72\x65\x20",
+	}, {
+		.inlen	= 159,
+		.outlen	= 125,
+		.input	= "This document describes a compression method based on the LZ4 "
+			"compression algorithm.  This document defines the application of "
+			"the LZ4 algorithm used in UBIFS.",
+		.output	= "\xf9\x2e\x54\x68\x69\x73\x20\x64"
+			  "\x6f\x63\x75\x6d\x65\x6e\x74\x20"
+			  "\x64\x65\x73\x63\x72\x69\x62\x65"
+			  "\x73\x20\x61\x20\x63\x6f\x6d\x70"
+			  "\x72\x65\x73\x73\x69\x6f\x6e\x20"
+			  "\x6d\x65\x74\x68\x6f\x64\x20\x62"
+			  "\x61\x73\x65\x64\x20\x6f\x6e\x20"
+			  "\x74\x68\x65\x20\x4c\x5a\x34\x24"
+			  "\x00\xcc\x61\x6c\x67\x6f\x72\x69"
+			  "\x74\x68\x6d\x2e\x20\x20\x56\x00"
+			  "\x51\x66\x69\x6e\x65\x73\x36\x00"
+			  "\x80\x61\x70\x70\x6c\x69\x63\x61"
+			  "\x74\x56\x00\x21\x6f\x66\x13\x00"
+			  "\x00\x49\x00\x05\x3d\x00\x20\x20"
+			  "\x75\x63\x00\x90\x69\x6e\x20\x55"
+			  "\x42\x49\x46\x53\x2e",
+	},
+};
+
+static struct comp_testvec lz4_decomp_tv_template[] = {
+	{
+		.inlen	= 125,
+		.outlen	= 159,
+		.input	= "\xf9\x2e\x54\x68\x69\x73\x20\x64"
+			  "\x6f\x63\x75\x6d\x65\x6e\x74\x20"
+			  "\x64\x65\x73\x63\x72\x69\x62\x65"
+			  "\x73\x20\x61\x20\x63\x6f\x6d\x70"
+			  "\x72\x65\x73\x73\x69\x6f\x6e\x20"
+			  "\x6d\x65\x74\x68\x6f\x64\x20\x62"
+			  "\x61\x73\x65\x64\x20\x6f\x6e\x20"
+			  "\x74\x68\x65\x20\x4c\x5a\x34\x24"
+			  "\x00\xcc\x61\x6c\x67\x6f\x72\x69"
+			  "\x74\x68\x6d\x2e\x20\x20\x56\x00"
+			  "\x51\x66\x69\x6e\x65\x73\x36\x00"
+			  "\x80\x61\x70\x70\x6c\x69\x63\x61"
+			  "\x74\x56\x00\x21\x6f\x66\x13\x00"
+			  "\x00\x49\x00\x05\x3d\x00\x20\x20"
+			  "\x75\x63\x00\x90\x69\x6e\x20\x55"
+			  "\x42\x49\x46\x53\x2e",
+		.output	= "This document describes a compression method based on the LZ4 "
+			"compression algorithm.  This document defines the application of "
+			"the LZ4 algorithm used in UBIFS.",
+	}, {
+		.inlen	= 45,
+		.outlen	= 70,
+		.input	= "\xf0\x10\x4a\x6f\x69\x6e\x20\x75"
+			  "\x73\x20\x6e\x6f\x77\x20\x61\x6e"
+			  "\x64\x20\x73\x68\x61\x72\x65\x20"
+			  "\x74\x68\x65\x20\x73\x6f\x66\x74"
+			  "\x77\x0d\x00\x0f\x23\x00\x0b\x50"
+			  "\x77\x61\x72\x65\x20",
+		.output	= "Join us now and share the software "
+			"Join us now and share the software ",
+	},
+};
+
+/*
+ * LZ4HC test vectors (null-terminated strings).
+ */
+#define LZ4HC_COMP_TEST_VECTORS 2
+#define LZ4HC_DECOMP_TEST_VECTORS 2
+
+static struct comp_testvec lz4hc_comp_tv_template[] = {
+	{
+		.inlen	= 70,
+		.outlen	= 45,
+		.input	= "Join us now and share the software "
+			"Join us now and share the software ",
+		.output	= "\xf0\x10\x4a\x6f\x69\x6e\x20\x75"
+			  "\x73\x20\x6e\x6f\x77\x20\x61\x6e"
+			  "\x64\x20\x73\x68\x61\x72\x65\x20"
+			  "\x74\x68\x65\x20\x73\x6f\x66\x74"
+			  "\x77\x0d\x00\x0f\x23\x00\x0b\x50"
+			  "\x77\x61\x72\x65\x20",
+	}, {
+		.inlen	= 159,
+		.outlen	= 122,
+		.input	= "This document describes a compression method based on the LZ4 "
+			"compression algorithm.  This document defines the application of "
+			"the LZ4 algorithm used in UBIFS.",
+		.output	= "\xf9\x2e\x54\x68\x69\x73\x20\x64"
+			  "\x6f\x63\x75\x6d\x65\x6e\x74\x20"
+			  "\x64\x65\x73\x63\x72\x69\x62\x65"
+			  "\x73\x20\x61\x20\x63\x6f\x6d\x70"
+			  "\x72\x65\x73\x73\x69\x6f\x6e\x20"
+			  "\x6d\x65\x74\x68\x6f\x64\x20\x62"
+			  "\x61\x73\x65\x64\x20\x6f\x6e\x20"
+			  "\x74\x68\x65\x20\x4c\x5a\x34\x24"
+			  "\x00\xcc\x61\x6c\x67\x6f\x72\x69"
+			  "\x74\x68\x6d\x2e\x20\x20\x56\x00"
+			  "\x51\x66\x69\x6e\x65\x73\x36\x00"
+			  "\x80\x61\x70\x70\x6c\x69\x63\x61"
+			  "\x74\x32\x00\x25\x6f\x66\x49\x00"
+			  "\x05\x3d\x00\x20\x20\x75\x63\x00"
+			  "\x90\x69\x6e\x20\x55\x42\x49\x46"
+			  "\x53\x2e",
+	},
+};
+
+static struct comp_testvec lz4hc_decomp_tv_template[] = {
+	{
+		.inlen	= 122,
+		.outlen	= 159,
+		.input	= "\xf9\x2e\x54\x68\x69\x73\x20\x64"
+			  "\x6f\x63\x75\x6d\x65\x6e\x74\x20"
+			  "\x64\x65\x73\x63\x72\x69\x62\x65"
+			  "\x73\x20\x61\x20\x63\x6f\x6d\x70"
+			  "\x72\x65\x73\x73\x69\x6f\x6e\x20"
+			  "\x6d\x65\x74\x68\x6f\x64\x20\x62"
+			  "\x61\x73\x65\x64\x20\x6f\x6e\x20"
+			  "\x74\x68\x65\x20\x4c\x5a\x34\x24"
+			  "\x00\xcc\x61\x6c\x67\x6f\x72\x69"
+			  "\x74\x68\x6d\x2e\x20\x20\x56\x00"
+			  "\x51\x66\x69\x6e\x65\x73\x36\x00"
+			  "\x80\x61\x70\x70\x6c\x69\x63\x61"
+			  "\x74\x32\x00\x25\x6f\x66\x49\x00"
+			  "\x05\x3d\x00\x20\x20\x75\x63\x00"
+			  "\x90\x69\x6e\x20\x55\x42\x49\x46"
+			  "\x53\x2e",
+		.output	= "This document describes a compression method based on the LZ4 "
+			"compression algorithm.  This document defines the application of "
+			"the LZ4 algorithm used in UBIFS.",
+	}, {
+		.inlen	= 45,
+		.outlen	= 70,
+		.input	= "\xf0\x10\x4a\x6f\x69\x6e\x20\x75"
+			  "\x73\x20\x6e\x6f\x77\x20\x61\x6e"
+			  "\x64\x20\x73\x68\x61\x72\x65\x20"
+			  "\x74\x68\x65\x20\x73\x6f\x66\x74"
+			  "\x77\x0d\x00\x0f\x23\x00\x0b\x50"
+			  "\x77\x61\x72\x65\x20",
+		.output	= "Join us now and share the software "
+			"Join us now and share the software ",
+	},
+};
+
 /*
  * LZO test vectors (null-terminated strings).
  */
@@ -14684,7 +15388,7 @@ static struct hash_testvec michael_mic_tv_template[] = {
 /*
  * CRC32C test vectors
  */
-#define CRC32C_TEST_VECTORS 14
+#define CRC32C_TEST_VECTORS 15
 
 static struct hash_testvec crc32c_tv_template[] = {
 	{
@@ -14856,6 +15560,138 @@ static struct hash_testvec crc32c_tv_template[] = {
 		.np = 2,
 		.tap = { 31, 209 }
 	},
+	{
+		.key = "\xff\xff\xff\xff",
+		.ksize = 4,
+		.plaintext = "\x73\x6e\xe1\xc4\x4f\xe3\x5b\x59"
+			     "\xd6\xf3\x8e\xce\xc8\x0c\x77\xbc"
+			     "\xd9\x51\xf7\xc5\x40\x36\x3b\x98"
+			     "\xfe\xde\xed\xa2\xef\x34\x1c\x95"
+			     "\x92\xcb\xec\x9a\x98\x76\xfd\x55"
+			     "\x2e\xa7\x9c\x9c\x0a\x88\xac\xf7"
+			     "\x37\xdb\x52\xd7\xa1\x92\x63\x97"
+			     "\x60\x2d\x8f\x33\xc4\xd8\x4a\xcb"
+			     "\x25\x40\x7e\xd6\x67\x39\xf2\x25"
+			     "\x4f\x11\x78\x9e\x89\xb1\xd9\xb6"
+			     "\x75\x79\x81\xab\xb5\xd9\xeb\x87"
+			     "\x77\xb0\xca\xd5\x83\x65\xfc\x20"
+			     "\x04\xc6\x30\x2f\x16\xa3\x51\x03"
+			     "\x13\x29\xb9\x8d\x9d\x00\x17\x2f"
+			     "\x6b\x24\x1c\xf9\xd5\x84\xe8\xa0"
+			     "\x1d\x5c\x38\x3d\x83\x53\x4c\xcc"
+			     "\x07\x54\x99\x5f\xfc\x2c\x33\x25"
+			     "\x51\xe8\xf9\x1e\x9f\xec\x7e\x9c"
+			     "\xf2\xd4\xba\x79\x57\x0b\x75\x1a"
+			     "\x2a\x2c\x6f\x26\x1c\x1b\x50\x06"
+			     "\x06\xe2\x52\x1d\x71\x4d\xb0\xc4"
+			     "\xe1\x46\xce\x0c\xe6\xee\x25\x33"
+			     "\xe0\x7f\xf4\xe2\x95\xe4\xa8\x2c"
+			     "\x74\x15\x08\x47\xa6\x34\x20\x08"
+			     "\xda\x69\xf3\x20\xcd\x7e\xe0\x19"
+			     "\x9c\x39\xd0\x0e\xc9\x7d\x25\x2d"
+			     "\x0f\x1f\x62\xee\xe6\x89\x9a\x10"
+			     "\xd4\x11\x9a\x58\x7a\x17\xd6\x09"
+			     "\x5a\xe1\x14\x22\x69\x36\xda\x5a"
+			     "\x58\xbc\x98\xdc\xa2\x12\x96\xc2"
+			     "\x56\xac\x9c\x53\xa2\x72\x63\xfd"
+			     "\x23\x18\xbe\x11\xee\x3b\x88\x41"
+			     "\x5e\x41\x4c\xd9\x9c\xed\xb7\xc0"
+			     "\xef\xc4\xbe\x2e\xc9\x23\x8f\x2a"
+			     "\x8d\x1d\x39\xcb\x21\x16\x1a\x2b"
+			     "\x38\x21\x0c\x29\x5c\x19\x4f\xe7"
+			     "\xbe\x81\x34\xff\xbe\x1c\x8f\x83"
+			     "\x38\x4c\xda\xbb\x94\x2b\x29\x9e"
+			     "\x8c\x6b\xd2\x0c\xbc\xee\xd8\xd1"
+			     "\xeb\x24\x1c\x5a\x1b\x28\x42\x35"
+			     "\x52\x9a\x64\x4a\x27\x3a\x79\xdb"
+			     "\x0b\x49\x83\x3d\x5d\xa0\x7c\x54"
+			     "\x2c\x8d\xfe\xcf\xc9\x70\xb5\x29"
+			     "\x14\x1a\x85\x5b\x84\xe1\x7a\x61"
+			     "\xf3\x83\x73\x73\x2f\xc0\x8e\x00"
+			     "\x41\xb5\x52\x6a\x7b\xfa\x9f\x85"
+			     "\x43\x7b\x56\xcd\xa2\x17\xc8\x69"
+			     "\x8c\xfa\xe0\xe3\xed\xbb\x0f\xa5"
+			     "\x78\x34\xfa\x33\x2e\x25\xe6\x2a"
+			     "\xb0\x88\xdf\xfc\x46\xb2\xac\x68"
+			     "\xab\x2e\x72\xbc\x9e\x59\x2a\xca"
+			     "\x29\xbd\xc4\xac\xb0\x2e\x18\x37"
+			     "\xb9\xa6\x91\x40\x7d\xe1\x98\x91"
+			     "\x32\xb8\xc2\xa9\x16\x3f\xb8\x37"
+			     "\x3b\x9d\xea\x55\x16\xae\xf3\x85"
+			     "\xc5\x5a\xca\x6c\x23\xb3\xae\x50"
+			     "\x8e\xd1\xd0\x53\x73\x6d\xbd\x6d"
+			     "\x9e\x40\x92\x2b\x43\x19\xde\x29"
+			     "\xcb\xc1\x55\x50\x60\x8f\x3a\xd0"
+			     "\x37\xc9\x8a\xdc\xa0\xc1\xe9\x28"
+			     "\xcf\xac\x4e\x24\x68\x41\x6d\xf5"
+			     "\xcc\x16\xe8\x38\x26\xb9\x34\x76"
+			     "\x34\x91\x4c\x65\xd6\x73\x19\xe4"
+			     "\x58\x03\x9c\xb4\x7f\xd1\xe1\xf8"
+			     "\x55\x2f\xa4\x6b\xb4\xd4\xc0\x63"
+			     "\x94\x32\x5b\x89\x16\x97\xd3\x55"
+			     "\x4c\x05\x67\x4c\xce\xd2\xa5\xf9"
+			     "\xfe\x00\x97\xad\x16\x5a\xad\xf6"
+			     "\xf6\x53\x69\xe0\xb0\x9e\xcd\xee"
+			     "\xcf\x8c\x84\xd6\x6b\x2a\xd2\x00"
+			     "\xed\x16\x3d\xbd\xa2\x25\xf9\x47"
+			     "\x02\xb7\x14\x7d\xbe\xd5\x66\x5b"
+			     "\x8c\x0f\x36\x3b\xb2\x17\xad\xcd"
+			     "\x54\x1d\xfb\xd7\x7d\xea\x4b\xad"
+			     "\xee\xbc\x67\x70\xaa\xe4\x2b\x06"
+			     "\x3d\x20\xab\xdd\xd0\xb9\x24\x5f"
+			     "\xee\x5c\xa3\x33\x14\xb9\x77\x3a"
+			     "\xfa\xdd\x58\x44\xa4\x50\x54\x96"
+			     "\x27\xee\x7d\x1c\x3c\x85\x54\x6e"
+			     "\x86\x34\xf4\x85\xa3\x7e\xfe\x3a"
+			     "\xf4\x31\x48\x82\x2d\xf9\x44\x6b"
+			     "\x9c\xc3\x32\xd5\x39\xd3\x05\xf1"
+			     "\x71\xa4\x16\x7b\xb2\x83\x8b\xb7"
+			     "\xb5\xea\x86\x2d\x8f\x9d\x0d\x24"
+			     "\x77\x86\xbc\xdf\x55\x51\x2c\x99"
+			     "\x0f\xc7\x22\x42\x92\xeb\x78\xf8"
+			     "\xa2\xd7\xcb\x44\x62\x54\xea\x19"
+			     "\xa3\x3a\xf9\x8d\xed\x8d\x69\x54"
+			     "\x4e\x54\x98\x01\xe4\x39\x47\xfd"
+			     "\x2c\xe2\xbf\x43\x09\x12\xc3\xe1"
+			     "\x94\x7e\x34\x2e\xa6\x70\x87\xcc"
+			     "\x26\x1d\xe7\x5c\x13\xc7\x29\x04"
+			     "\x50\x93\x74\xa2\x33\x28\xac\xcd"
+			     "\xcc\x0b\xa3\x90\xf5\xbd\xfe\xe5"
+			     "\x1e\x91\xe9\xf3\xd5\x4f\x7a\x07"
+			     "\x18\x8b\xe6\x54\x5b\xc2\x66\x6b"
+			     "\x57\x39\xe7\x78\x99\x96\x74\x42"
+			     "\xc6\x3b\x64\xe0\xae\x66\x43\x3c"
+			     "\x18\x0a\x81\x49\x48\x6a\xdd\x04"
+			     "\x50\x7b\x8f\x2c\x1c\xf7\x38\xc0"
+			     "\x3b\x41\x8a\x3d\x6d\xfc\xb7\x94"
+			     "\xf2\x69\x9a\xed\x8d\x84\xa8\x1e"
+			     "\x5a\xde\x95\xea\x55\x39\xc6\xfa"
+			     "\xa6\xe5\x79\x9b\xae\xdd\xb6\x3d"
+			     "\xd2\xa0\xf5\xa7\x0a\xd1\x8c\xfb"
+			     "\x28\x8e\xdf\x6e\xe9\x90\x46\xc3"
+			     "\xbd\x07\xbc\x8c\x56\x33\x4d\x20"
+			     "\xf2\xc2\x3e\x5b\x69\xed\xf9\x18"
+			     "\xf6\x51\xbf\x6f\xc5\x8d\x0c\xaf"
+			     "\x40\xa1\xc9\x1a\x19\x01\x34\x63"
+			     "\x17\x7c\x8f\xe8\xa2\xd0\x8c\xaf"
+			     "\x0d\x09\x73\x22\xa5\x9e\x19\x8b"
+			     "\x7d\x49\x81\x4e\xf7\xaa\x4f\xe8"
+			     "\x13\x9a\xf1\xab\x77\x50\x8b\x36"
+			     "\x42\x36\xa6\xb6\x91\x89\x99\xe0"
+			     "\xcd\xb3\xb3\xaa\xbb\x68\x2d\xcc"
+			     "\x41\x82\xd3\xfa\xf9\x9d\x6c\xde"
+			     "\x77\x72\xee\xd7\x5b\xf4\x63\x74"
+			     "\x15\x2c\x99\xaf\x7b\xd5\x8c\xe9"
+			     "\x0c\xb7\x94\xa9\x02\xc4\x4f\x14"
+			     "\x19\xf4\x4c\x2c\x22\xe0\x7c\xc9"
+			     "\x46\x20\x59\x57\x1b\x66\xd3\x55"
+			     "\x68\x57\xff\x89\xb8\x2d\x7f\x03"
+			     "\xa1\x0d\xaf\xd9\xd2\x29\x95\x9c"
+			     "\xde\x96\x85\x9c\xca\xea\x97\xe0"
+			     "\x57",
+		.psize = 1001,
+		.digest = "\x53\xe6\x45\x6b",
+	},
 };
 
 #endif	/* _CRYPTO_TESTMGR_H */
@@ -19,6 +19,7 @@
 #include <linux/cpu.h>
 #include <linux/cpumask.h>
 #include <linux/cpufreq.h>
+#include <linux/hrtimer.h>
 #include <linux/module.h>
 #include <linux/moduleparam.h>
 #include <linux/rwsem.h>
@@ -53,6 +54,27 @@ struct cpufreq_interactive_cpuinfo {
 	u64 hispeed_validate_time;
 	struct rw_semaphore enable_sem;
 	int governor_enabled;
+	int cpu;
+	/*
+	 * Scheduler-driven mode: busy time accumulated from scheduler
+	 * events since sched_window_start, under load_lock.
+	 */
+	struct update_util_data update_util;
+	struct hrtimer sched_kick;
+	int sched_hooked;
+	unsigned int sched_nr_running;
+	u64 sched_time;
+	u64 sched_window_start;
+	u64 sched_speedadj;
+	unsigned int sched_loadadjfreq;
+	/*
+	 * Evaluations following a task migration to or from this CPU, and
+	 * how many of them this CPU's load history alone would have sent
+	 * below or above the speed chosen with the tasks' demand.
+	 */
+	unsigned long migration_evals;
+	unsigned long migration_under;
+	unsigned long migration_over;
 };
 
 static DEFINE_PER_CPU(struct cpufreq_interactive_cpuinfo, cpuinfo);
@@ -116,6 +138,31 @@ static int timer_slack_val = DEFAULT_TIMER_SLACK;
 
 static bool io_is_busy;
 
+/*
+ * Evaluate load on scheduler enqueue, dequeue and tick events rather than
+ * sampling idle time every timer_rate.
+ */
+static bool sched_driven;
+
+/*
+ * The minimum time over which load is measured in scheduler-driven mode.
+ */
+#define DEFAULT_SCHED_RATE (2 * USEC_PER_MSEC)
+static unsigned long sched_rate = DEFAULT_SCHED_RATE;
+
+/*
+ * Scheduler events arrive with the runqueue locked, when neither the
+ * speed change thread nor anything else can be woken; the load is then
+ * evaluated from an hrtimer this far in the future.
+ */
+#define SCHED_KICK_DELAY_NS (10 * NSEC_PER_USEC)
+
+/*
+ * Take into account the demand of the tasks runnable on a CPU, which
+ * the scheduler carries with them when they migrate.
+ */
+static bool task_demand = true;
+
 static int cpufreq_governor_interactive(struct cpufreq_policy *policy,
 		unsigned int event);
 
@@ -363,36 +410,58 @@ static u64 update_load(int cpu)
 	return now;
 }
 
-static void cpufreq_interactive_timer(unsigned long data)
+/*
+ * A task that just migrated has its history on another CPU: raise the
+ * load to what the tasks runnable here need, and drop the demand of the
+ * tasks that left from the load they caused here.
+ */
+static unsigned int demand_adjusted_load(int cpu,
+	struct cpufreq_interactive_cpuinfo *pcpu, unsigned int loadadjfreq)
+{
+	unsigned int demand, in, out;
+	unsigned int max = pcpu->policy->max;
+	unsigned int adj = loadadjfreq;
+	unsigned int freq, adjfreq;
+
+	demand = min(sched_cpu_demand(cpu, &in, &out), max) * 100;
+	out = min(out, max) * 100;
+
+	adj = adj > out ? adj - out : 0;
+	adj = max(adj, demand);
+	if (!in && !out)
+		return adj;
+
+	pcpu->migration_evals++;
+	if (adj != loadadjfreq) {
+		freq = choose_freq(pcpu, loadadjfreq);
+		adjfreq = choose_freq(pcpu, adj);
+		if (freq < adjfreq)
+			pcpu->migration_under++;
+		else if (freq > adjfreq)
+			pcpu->migration_over++;
+	}
+	return adj;
+}
+
+/*
+ * Choose a new target speed for @cpu given its load, scaled by speed, since
+ * the last evaluation.  Returns 1 if the speed change thread must be woken
+ * to apply a new target, 0 if the target is unchanged and -EAGAIN if a
+ * change was held back and load should be evaluated again later.
+ */
+static int cpufreq_interactive_eval(int cpu,
+	struct cpufreq_interactive_cpuinfo *pcpu, u64 now,
+	unsigned int loadadjfreq)
 {
-	u64 now;
-	unsigned int delta_time;
-	u64 cputime_speedadj;
 	int cpu_load;
-	struct cpufreq_interactive_cpuinfo *pcpu =
-		&per_cpu(cpuinfo, data);
 	unsigned int new_freq;
-	unsigned int loadadjfreq;
 	unsigned int index;
 	unsigned long flags;
 	bool boosted;
 
-	if (!down_read_trylock(&pcpu->enable_sem))
-		return;
-	if (!pcpu->governor_enabled)
-		goto exit;
-
-	spin_lock_irqsave(&pcpu->load_lock, flags);
-	now = update_load(data);
-	delta_time = (unsigned int)(now - pcpu->cputime_speedadj_timestamp);
-	cputime_speedadj = pcpu->cputime_speedadj;
-	spin_unlock_irqrestore(&pcpu->load_lock, flags);
-
-	if (WARN_ON_ONCE(!delta_time))
-		goto rearm;
+	if (task_demand)
+		loadadjfreq = demand_adjusted_load(cpu, pcpu, loadadjfreq);
 
-	do_div(cputime_speedadj, delta_time);
-	loadadjfreq = (unsigned int)cputime_speedadj * 100;
 	cpu_load = loadadjfreq / pcpu->target_freq;
 	boosted = boost_val || now < boostpulse_endtime;
 
@@ -414,9 +483,9 @@ static void cpufreq_interactive_timer(unsigned long data)
 	    now - pcpu->hispeed_validate_time <
 	    freq_to_above_hispeed_delay(pcpu->target_freq)) {
 		trace_cpufreq_interactive_notyet(
-			data, cpu_load, pcpu->target_freq,
+			cpu, cpu_load, pcpu->target_freq,
 			pcpu->policy->cur, new_freq);
-		goto rearm;
+		return -EAGAIN;
 	}
 
 	pcpu->hispeed_validate_time = now;
@@ -424,7 +493,7 @@ static void cpufreq_interactive_timer(unsigned long data)
 	if (cpufreq_frequency_table_target(pcpu->policy, pcpu->freq_table,
 					   new_freq, CPUFREQ_RELATION_L,
 					   &index))
-		goto rearm;
+		return -EAGAIN;
 
 	new_freq = pcpu->freq_table[index].frequency;
 
@@ -435,9 +504,9 @@ static void cpufreq_interactive_timer(unsigned long data)
 	if (new_freq < pcpu->floor_freq) {
 		if (now - pcpu->floor_validate_time < min_sample_time) {
 			trace_cpufreq_interactive_notyet(
-				data, cpu_load, pcpu->target_freq,
+				cpu, cpu_load, pcpu->target_freq,
 				pcpu->policy->cur, new_freq);
-			goto rearm;
+			return -EAGAIN;
 		}
 	}
 
@@ -456,21 +525,166 @@ static void cpufreq_interactive_timer(unsigned long data)
 
 	if (pcpu->target_freq == new_freq) {
 		trace_cpufreq_interactive_already(
-			data, cpu_load, pcpu->target_freq,
+			cpu, cpu_load, pcpu->target_freq,
 			pcpu->policy->cur, new_freq);
-		goto rearm_if_notmax;
+		return 0;
 	}
 
-	trace_cpufreq_interactive_target(data, cpu_load, pcpu->target_freq,
+	trace_cpufreq_interactive_target(cpu, cpu_load, pcpu->target_freq,
 					 pcpu->policy->cur, new_freq);
 
 	pcpu->target_freq = new_freq;
 	spin_lock_irqsave(&speedchange_cpumask_lock, flags);
-	cpumask_set_cpu(data, &speedchange_cpumask);
+	cpumask_set_cpu(cpu, &speedchange_cpumask);
 	spin_unlock_irqrestore(&speedchange_cpumask_lock, flags);
-	wake_up_process(speedchange_task);
+	return 1;
+}
+
+/*
+ * Scheduler-driven mode.  Time during which anything was runnable counts
+ * as busy, weighted by speed as in update_load(); the load over a window
+ * of at least sched_rate is evaluated when a scheduler event closes it.
+ * Called with load_lock held; returns the time accounted up to, which
+ * never goes backwards.
+ */
+static u64 sched_update_load(struct cpufreq_interactive_cpuinfo *pcpu,
+			     u64 time, unsigned int nr_running)
+{
+	if (time > pcpu->sched_time) {
+		if (pcpu->sched_nr_running)
+			pcpu->sched_speedadj += (time - pcpu->sched_time) *
+				pcpu->policy->cur;
+		pcpu->sched_time = time;
+	}
+
+	pcpu->sched_nr_running = nr_running;
+	return pcpu->sched_time;
+}
+
+/* Close the current window; returns its load as in the timer. */
+static unsigned int sched_window_load(struct cpufreq_interactive_cpuinfo *pcpu,
+				      u64 time)
+{
+	u64 delta = time - pcpu->sched_window_start;
+	u64 speedadj = pcpu->sched_speedadj;
+
+	pcpu->sched_window_start = time;
+	pcpu->sched_speedadj = 0;
+
+	if (!delta)
+		return 0;
+	return (unsigned int)div64_u64(speedadj, delta) * 100;
+}
+
+static void cpufreq_interactive_update_util(struct update_util_data *data,
+					    u64 time, unsigned int nr_running)
+{
+	struct cpufreq_interactive_cpuinfo *pcpu =
+		container_of(data, struct cpufreq_interactive_cpuinfo,
+			     update_util);
+
+	spin_lock(&pcpu->load_lock);
+	time = sched_update_load(pcpu, time, nr_running);
+
+	/*
+	 * The kick timer can only be armed from its own CPU.  An update of
+	 * another CPU's runqueue, on a remote wakeup or a migration, leaves
+	 * the window open for that CPU's next own event, its tick at the
+	 * latest.
+	 */
+	if (pcpu->cpu == smp_processor_id() &&
+	    time - pcpu->sched_window_start >= sched_rate * NSEC_PER_USEC) {
+		pcpu->sched_loadadjfreq = sched_window_load(pcpu, time);
+		/* Runqueue lock held, see hrtick_start() */
+		__hrtimer_start_range_ns(&pcpu->sched_kick,
+					 ns_to_ktime(SCHED_KICK_DELAY_NS), 0,
+					 HRTIMER_MODE_REL_PINNED, 0);
+	}
+
+	spin_unlock(&pcpu->load_lock);
+}
+
+static enum hrtimer_restart cpufreq_interactive_sched_kick(
+	struct hrtimer *timer)
+{
+	struct cpufreq_interactive_cpuinfo *pcpu =
+		container_of(timer, struct cpufreq_interactive_cpuinfo,
+			     sched_kick);
+	unsigned long flags;
+	int ret;
+
+	spin_lock_irqsave(&pcpu->load_lock, flags);
+	ret = cpufreq_interactive_eval(pcpu->cpu, pcpu,
+				       ktime_to_us(ktime_get()),
+				       pcpu->sched_loadadjfreq);
+	spin_unlock_irqrestore(&pcpu->load_lock, flags);
+
+	if (ret > 0)
+		wake_up_process(speedchange_task);
+	return HRTIMER_NORESTART;
+}
+
+/*
+ * No scheduler events arrive while the CPU is idle, so the idle timers
+ * are still used to bring speed down; evaluate whatever the window holds.
+ */
+static void cpufreq_interactive_sched_timer(
+	struct cpufreq_interactive_cpuinfo *pcpu)
+{
+	unsigned long flags;
+	u64 time;
+	int ret;
+
+	spin_lock_irqsave(&pcpu->load_lock, flags);
+	time = sched_update_load(pcpu, local_clock(), pcpu->sched_nr_running);
+	ret = cpufreq_interactive_eval(pcpu->cpu, pcpu,
+				       ktime_to_us(ktime_get()),
+				       sched_window_load(pcpu, time));
+	spin_unlock_irqrestore(&pcpu->load_lock, flags);
+
+	if (ret > 0)
+		wake_up_process(speedchange_task);
+}
+
+static void cpufreq_interactive_timer(unsigned long data)
+{
+	u64 now;
+	unsigned int delta_time;
+	u64 cputime_speedadj;
+	struct cpufreq_interactive_cpuinfo *pcpu =
+		&per_cpu(cpuinfo, data);
+	unsigned int loadadjfreq;
+	unsigned long flags;
+	int ret;
+
+	if (!down_read_trylock(&pcpu->enable_sem))
+		return;
+	if (!pcpu->governor_enabled)
+		goto exit;
+
+	if (pcpu->sched_hooked) {
+		cpufreq_interactive_sched_timer(pcpu);
+		goto exit;
+	}
+
+	spin_lock_irqsave(&pcpu->load_lock, flags);
+	now = update_load(data);
+	delta_time = (unsigned int)(now - pcpu->cputime_speedadj_timestamp);
+	cputime_speedadj = pcpu->cputime_speedadj;
+	spin_unlock_irqrestore(&pcpu->load_lock, flags);
+
+	if (WARN_ON_ONCE(!delta_time))
+		goto rearm;
+
+	do_div(cputime_speedadj, delta_time);
+	loadadjfreq = (unsigned int)cputime_speedadj * 100;
+
+	ret = cpufreq_interactive_eval(data, pcpu, now, loadadjfreq);
+	if (ret < 0)
+		goto rearm;
+	if (ret > 0)
+		wake_up_process(speedchange_task);
 
-rearm_if_notmax:
 	/*
 	 * Already set max speed and don't see a need to change that,
 	 * wait until next idle to re-evaluate, don't need timer.
@@ -525,7 +739,7 @@ static void cpufreq_interactive_idle_end(void)
 
 	if (!down_read_trylock(&pcpu->enable_sem))
 		return;
-	if (!pcpu->governor_enabled) {
+	if (!pcpu->governor_enabled || pcpu->sched_hooked) {
 		up_read(&pcpu->enable_sem);
 		return;
 	}
@@ -668,7 +882,11 @@ static int cpufreq_interactive_notifier(
 				}
 			}
 			spin_lock_irqsave(&pjcpu->load_lock, flags);
-			update_load(cpu);
+			if (pjcpu->sched_hooked)
+				sched_update_load(pjcpu, local_clock(),
+						  pjcpu->sched_nr_running);
+			else
+				update_load(cpu);
 			spin_unlock_irqrestore(&pjcpu->load_lock, flags);
 			if (cpu != freq->cpu)
 				up_read(&pjcpu->enable_sem);
@@ -1022,6 +1240,109 @@ static ssize_t store_io_is_busy(struct kobject *kobj,
 static struct global_attr io_is_busy_attr = __ATTR(io_is_busy, 0644,
 		show_io_is_busy, store_io_is_busy);
 
+static ssize_t show_task_demand(struct kobject *kobj,
+			struct attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", task_demand);
+}
+
+static ssize_t store_task_demand(struct kobject *kobj,
+			struct attribute *attr, const char *buf, size_t count)
+{
+	int ret;
+	unsigned long val;
+
+	ret = kstrtoul(buf, 0, &val);
+	if (ret < 0)
+		return ret;
+	task_demand = val;
+	return count;
+}
+
+static struct global_attr task_demand_attr = __ATTR(task_demand, 0644,
+		show_task_demand, store_task_demand);
+
+static ssize_t show_migration_stats(struct kobject *kobj,
+			struct attribute *attr, char *buf)
+{
+	struct cpufreq_interactive_cpuinfo *pcpu;
+	ssize_t ret = 0;
+	unsigned int cpu;
+
+	for_each_possible_cpu(cpu) {
+		pcpu = &per_cpu(cpuinfo, cpu);
+		ret += scnprintf(buf + ret, PAGE_SIZE - ret,
+				 "cpu%u %lu %lu %lu\n", cpu,
+				 pcpu->migration_evals, pcpu->migration_under,
+				 pcpu->migration_over);
+	}
+	return ret;
+}
+
+static struct global_attr migration_stats_attr = __ATTR(migration_stats,
+		0444, show_migration_stats, NULL);
+
+static void cpufreq_interactive_start(int cpu);
+static void cpufreq_interactive_stop(int cpu);
+
+static ssize_t show_sched_driven(struct kobject *kobj,
+			struct attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", sched_driven);
+}
+
+static ssize_t store_sched_driven(struct kobject *kobj,
+			struct attribute *attr, const char *buf, size_t count)
+{
+	int ret;
+	unsigned long val;
+	unsigned int cpu;
+	struct cpufreq_interactive_cpuinfo *pcpu;
+
+	ret = kstrtoul(buf, 0, &val);
+	if (ret < 0)
+		return ret;
+	sched_driven = val;
+
+	for_each_possible_cpu(cpu) {
+		pcpu = &per_cpu(cpuinfo, cpu);
+		down_write(&pcpu->enable_sem);
+		if (pcpu->governor_enabled &&
+		    pcpu->sched_hooked != sched_driven) {
+			cpufreq_interactive_stop(cpu);
+			cpufreq_interactive_start(cpu);
+		}
+		up_write(&pcpu->enable_sem);
+	}
+
+	return count;
+}
+
+static struct global_attr sched_driven_attr = __ATTR(sched_driven, 0644,
+		show_sched_driven, store_sched_driven);
+
+static ssize_t show_sched_rate(struct kobject *kobj,
+			struct attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", sched_rate);
+}
+
+static ssize_t store_sched_rate(struct kobject *kobj,
+			struct attribute *attr, const char *buf, size_t count)
+{
+	int ret;
+	unsigned long val;
+
+	ret = kstrtoul(buf, 0, &val);
+	if (ret < 0)
+		return ret;
+	sched_rate = val;
+	return count;
+}
+
+static struct global_attr sched_rate_attr = __ATTR(sched_rate, 0644,
+		show_sched_rate, store_sched_rate);
+
 static struct attribute *interactive_attributes[] = {
 	&target_loads_attr.attr,
 	&above_hispeed_delay_attr.attr,
@@ -1034,6 +1355,10 @@ static struct attribute *interactive_attributes[] = {
 	&boostpulse.attr,
 	&boostpulse_duration.attr,
 	&io_is_busy_attr.attr,
+	&sched_driven_attr.attr,
+	&sched_rate_attr.attr,
+	&task_demand_attr.attr,
+	&migration_stats_attr.attr,
 	NULL,
 };
 
@@ -1062,11 +1387,54 @@ static struct notifier_block cpufreq_interactive_idle_nb = {
 	.notifier_call = cpufreq_interactive_idle_notifier,
 };
 
+/*
+ * Start evaluating load on @cpu, from scheduler events or from the timers.
+ * The caller shall hold the enable_sem write semaphore.
+ */
+static void cpufreq_interactive_start(int cpu)
+{
+	struct cpufreq_interactive_cpuinfo *pcpu = &per_cpu(cpuinfo, cpu);
+	unsigned long flags;
+
+	if (!sched_driven) {
+		cpufreq_interactive_timer_start(cpu);
+		return;
+	}
+
+	spin_lock_irqsave(&pcpu->load_lock, flags);
+	pcpu->sched_time = local_clock();
+	pcpu->sched_window_start = pcpu->sched_time;
+	pcpu->sched_speedadj = 0;
+	pcpu->sched_nr_running = 0;
+	spin_unlock_irqrestore(&pcpu->load_lock, flags);
+
+	pcpu->sched_hooked = 1;
+	cpufreq_add_update_util_hook(cpu, &pcpu->update_util,
+				     cpufreq_interactive_update_util);
+}
+
+/* The caller shall hold the enable_sem write semaphore. */
+static void cpufreq_interactive_stop(int cpu)
+{
+	struct cpufreq_interactive_cpuinfo *pcpu = &per_cpu(cpuinfo, cpu);
+
+	if (pcpu->sched_hooked) {
+		cpufreq_remove_update_util_hook(cpu);
+		synchronize_sched();
+		hrtimer_cancel(&pcpu->sched_kick);
+		pcpu->sched_hooked = 0;
+	}
+
+	del_timer_sync(&pcpu->cpu_timer);
+	del_timer_sync(&pcpu->cpu_slack_timer);
+}
+
 static int cpufreq_governor_interactive(struct cpufreq_policy *policy,
 		unsigned int event)
 {
 	int rc;
 	unsigned int j;
+	unsigned long flags;
 	struct cpufreq_interactive_cpuinfo *pcpu;
 	struct cpufreq_frequency_table *freq_table;
 
@@ -1093,7 +1461,7 @@ static int cpufreq_governor_interactive(struct cpufreq_policy *policy,
 			pcpu->hispeed_validate_time =
 				pcpu->floor_validate_time;
 			down_write(&pcpu->enable_sem);
-			cpufreq_interactive_timer_start(j);
+			cpufreq_interactive_start(j);
 			pcpu->governor_enabled = 1;
 			up_write(&pcpu->enable_sem);
 		}
@@ -1126,8 +1494,7 @@ static int cpufreq_governor_interactive(struct cpufreq_policy *policy,
 			pcpu = &per_cpu(cpuinfo, j);
 			down_write(&pcpu->enable_sem);
 			pcpu->governor_enabled = 0;
-			del_timer_sync(&pcpu->cpu_timer);
-			del_timer_sync(&pcpu->cpu_slack_timer);
+			cpufreq_interactive_stop(j);
 			up_write(&pcpu->enable_sem);
 		}
 
@@ -1163,10 +1530,18 @@ static int cpufreq_governor_interactive(struct cpufreq_policy *policy,
 			}
 
 			/* update target_freq firstly */
+			spin_lock_irqsave(&pcpu->load_lock, flags);
 			if (policy->max < pcpu->target_freq)
 				pcpu->target_freq = policy->max;
 			else if (policy->min > pcpu->target_freq)
 				pcpu->target_freq = policy->min;
+			spin_unlock_irqrestore(&pcpu->load_lock, flags);
+
+			/* Scheduler events need no restarting */
+			if (pcpu->sched_hooked) {
+				up_write(&pcpu->enable_sem);
+				continue;
+			}
 
 			/* Reschedule timer.
 			 * Delete the timers, else the timer callback may
@@ -1174,9 +1549,8 @@ static int cpufreq_governor_interactive(struct cpufreq_policy *policy,
 			 * acquire the semaphore. This race may cause timer
 			 * stopped unexpectedly.
 			 */
-			del_timer_sync(&pcpu->cpu_timer);
-			del_timer_sync(&pcpu->cpu_slack_timer);
-			cpufreq_interactive_timer_start(j);
+			cpufreq_interactive_stop(j);
+			cpufreq_interactive_start(j);
 			up_write(&pcpu->enable_sem);
 		}
 		break;
@@ -1202,6 +1576,10 @@ static int __init cpufreq_interactive_init(void)
 		pcpu->cpu_timer.data = i;
 		init_timer(&pcpu->cpu_slack_timer);
 		pcpu->cpu_slack_timer.function = cpufreq_interactive_nop_timer;
+		hrtimer_init(&pcpu->sched_kick, CLOCK_MONOTONIC,
+			     HRTIMER_MODE_REL);
+		pcpu->sched_kick.function = cpufreq_interactive_sched_kick;
+		pcpu->cpu = i;
 		spin_lock_init(&pcpu->load_lock);
 		init_rwsem(&pcpu->enable_sem);
 	}
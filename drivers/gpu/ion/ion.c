@@ -23,6 +23,7 @@
 #include <linux/ion.h>
 #include <linux/kthread.h>
 #include <linux/list.h>
+#include <linux/math64.h>
 #include <linux/memblock.h>
 #include <linux/miscdevice.h>
 #include <linux/export.h>
@@ -1286,6 +1287,20 @@ static int ion_debug_heap_show(struct seq_file *s, void *unused)
 	seq_printf(s, "%16.s %16u\n", "total orphaned",
 		   total_orphaned_size);
 	seq_printf(s, "%16.s %16u\n", "total ", total_size);
+	if (heap->flags & ION_HEAP_FLAG_DEFER_FREE) {
+		seq_printf(s, "%16.s %16zu %u buffers\n", "deferred free",
+			   ion_heap_freelist_size(heap),
+			   heap->free_list_count);
+	}
+	if (atomic64_read(&heap->zeroed_bytes)) {
+		u64 bytes = atomic64_read(&heap->zeroed_bytes);
+		u64 ns = atomic64_read(&heap->zero_ns);
+
+		/* bytes per ns, times 1000, is MB/s */
+		seq_printf(s, "%16.s %16llu in %llu ms (%llu MB/s)\n", "zeroed",
+			   bytes, div_u64(ns, NSEC_PER_MSEC),
+			   div64_u64(bytes * 1000, max_t(u64, ns, 1)));
+	}
 	seq_printf(s, "----------------------------------------------------\n");
 
 	if (heap->debug_show)
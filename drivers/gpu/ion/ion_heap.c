@@ -18,6 +18,7 @@
 #include <linux/freezer.h>
 #include <linux/ion.h>
 #include <linux/kthread.h>
+#include <linux/ktime.h>
 #include <linux/mm.h>
 #include <linux/rtmutex.h>
 #include <linux/sched.h>
@@ -97,41 +98,65 @@ int ion_heap_map_user(struct ion_heap *heap, struct ion_buffer *buffer,
 	return 0;
 }
 
+/* Pages cleared through one mapping by ion_heap_buffer_zero() */
+#define ION_HEAP_ZERO_BATCH	32
+
+static int ion_heap_clear_pages(struct page **pages, int num, pgprot_t pgprot)
+{
+	void *addr = vmap(pages, num, VM_MAP, pgprot);
+
+	if (!addr)
+		return -ENOMEM;
+	memset(addr, 0, PAGE_SIZE * num);
+	vunmap(addr);
+
+	return 0;
+}
+
+/*
+ * Clears the buffer a batch of pages at a time: each batch is mapped
+ * once, cleared with a single memset and unmapped once, rather than
+ * paying for a map and a TLB flush per page.
+ */
 int ion_heap_buffer_zero(struct ion_buffer *buffer)
 {
 	struct sg_table *table = buffer->sg_table;
+	struct ion_heap *heap = buffer->heap;
+	struct page *pages[ION_HEAP_ZERO_BATCH];
 	pgprot_t pgprot;
 	struct scatterlist *sg;
-	struct vm_struct *vm_struct;
-	int i, j, ret = 0;
+	ktime_t start;
+	int i, j, p = 0, ret = 0;
 
 	if (buffer->flags & ION_FLAG_CACHED)
 		pgprot = PAGE_KERNEL;
 	else
 		pgprot = pgprot_writecombine(PAGE_KERNEL);
 
-	vm_struct = get_vm_area(PAGE_SIZE, VM_ALLOC);
-	if (!vm_struct)
-		return -ENOMEM;
-
+	start = ktime_get();
 	for_each_sg(table->sgl, sg, table->nents, i) {
 		struct page *page = sg_page(sg);
 		unsigned long len = sg_dma_len(sg);
 
 		for (j = 0; j < len / PAGE_SIZE; j++) {
-			struct page *sub_page = page + j;
-			struct page **pages = &sub_page;
-			ret = map_vm_area(vm_struct, pgprot, &pages);
-			if (ret)
-				goto end;
-			memset(vm_struct->addr, 0, PAGE_SIZE);
-			unmap_kernel_range((unsigned long)vm_struct->addr,
-					   PAGE_SIZE);
+			pages[p++] = page + j;
+			if (p == ARRAY_SIZE(pages)) {
+				ret = ion_heap_clear_pages(pages, p, pgprot);
+				if (ret)
+					return ret;
+				p = 0;
+			}
 		}
 	}
-end:
-	free_vm_area(vm_struct);
-	return ret;
+	if (p)
+		ret = ion_heap_clear_pages(pages, p, pgprot);
+	if (ret)
+		return ret;
+
+	atomic64_add(ktime_to_ns(ktime_sub(ktime_get(), start)),
+		     &heap->zero_ns);
+	atomic64_add(buffer->size, &heap->zeroed_bytes);
+	return 0;
 }
 
 struct page *ion_heap_alloc_pages(struct ion_buffer *buffer, gfp_t gfp_flags,
@@ -166,6 +191,7 @@ void ion_heap_freelist_add(struct ion_heap *heap, struct ion_buffer * buffer)
 	rt_mutex_lock(&heap->lock);
 	list_add(&buffer->list, &heap->free_list);
 	heap->free_list_size += buffer->size;
+	heap->free_list_count++;
 	rt_mutex_unlock(&heap->lock);
 	wake_up(&heap->waitqueue);
 }
@@ -181,31 +207,63 @@ size_t ion_heap_freelist_size(struct ion_heap *heap)
 	return size;
 }
 
-size_t ion_heap_freelist_drain(struct ion_heap *heap, size_t size)
+/*
+ * Take the oldest buffer off the free list.  Buffers are destroyed with
+ * the lock dropped, so that zeroing a large one does not hold up
+ * ion_heap_freelist_add() in the release path.
+ */
+static struct ion_buffer *ion_heap_freelist_pop(struct ion_heap *heap)
+{
+	struct ion_buffer *buffer = NULL;
+
+	rt_mutex_lock(&heap->lock);
+	if (!list_empty(&heap->free_list)) {
+		buffer = list_entry(heap->free_list.prev, struct ion_buffer,
+				    list);
+		list_del(&buffer->list);
+		heap->free_list_size -= buffer->size;
+		heap->free_list_count--;
+	}
+	rt_mutex_unlock(&heap->lock);
+
+	return buffer;
+}
+
+static size_t _ion_heap_freelist_drain(struct ion_heap *heap, size_t size,
+				       bool skip_pools)
 {
-	struct ion_buffer *buffer, *tmp;
+	struct ion_buffer *buffer;
 	size_t total_drained = 0;
 
 	if (ion_heap_freelist_size(heap) == 0)
 		return 0;
 
-	rt_mutex_lock(&heap->lock);
 	if (size == 0)
-		size = heap->free_list_size;
+		size = ion_heap_freelist_size(heap);
 
-	list_for_each_entry_safe(buffer, tmp, &heap->free_list, list) {
-		if (total_drained >= size)
+	while (total_drained < size) {
+		buffer = ion_heap_freelist_pop(heap);
+		if (!buffer)
 			break;
-		list_del(&buffer->list);
-		ion_buffer_destroy(buffer);
-		heap->free_list_size -= buffer->size;
+		if (skip_pools)
+			buffer->private_flags |= ION_PRIV_FLAG_SHRINKER_FREE;
 		total_drained += buffer->size;
+		ion_buffer_destroy(buffer);
 	}
-	rt_mutex_unlock(&heap->lock);
 
 	return total_drained;
 }
 
+size_t ion_heap_freelist_drain(struct ion_heap *heap, size_t size)
+{
+	return _ion_heap_freelist_drain(heap, size, false);
+}
+
+size_t ion_heap_freelist_shrink(struct ion_heap *heap, size_t size)
+{
+	return _ion_heap_freelist_drain(heap, size, true);
+}
+
 int ion_heap_deferred_free(void *data)
 {
 	struct ion_heap *heap = data;
@@ -216,17 +274,9 @@ int ion_heap_deferred_free(void *data)
 		wait_event_freezable(heap->waitqueue,
 				     ion_heap_freelist_size(heap) > 0);
 
-		rt_mutex_lock(&heap->lock);
-		if (list_empty(&heap->free_list)) {
-			rt_mutex_unlock(&heap->lock);
-			continue;
-		}
-		buffer = list_first_entry(&heap->free_list, struct ion_buffer,
-					  list);
-		list_del(&buffer->list);
-		heap->free_list_size -= buffer->size;
-		rt_mutex_unlock(&heap->lock);
-		ion_buffer_destroy(buffer);
+		buffer = ion_heap_freelist_pop(heap);
+		if (buffer)
+			ion_buffer_destroy(buffer);
 	}
 
 	return 0;
@@ -238,6 +288,7 @@ int ion_heap_init_deferred_free(struct ion_heap *heap)
 
 	INIT_LIST_HEAD(&heap->free_list);
 	heap->free_list_size = 0;
+	heap->free_list_count = 0;
 	rt_mutex_init(&heap->lock);
 	init_waitqueue_head(&heap->waitqueue);
 	heap->task = kthread_run(ion_heap_deferred_free, heap,
@@ -18,15 +18,31 @@
 #include <linux/dma-mapping.h>
 #include <linux/err.h>
 #include <linux/fs.h>
+#include <linux/jiffies.h>
+#include <linux/ktime.h>
 #include <linux/list.h>
 #include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/percpu.h>
+#include <linux/seq_file.h>
 #include <linux/slab.h>
+#include <linux/uaccess.h>
+#include <linux/workqueue.h>
 #include "ion_priv.h"
 
-struct ion_page_pool_item {
-	struct page *page;
-	struct list_head list;
-};
+/*
+ * Pages cached per cpu, in order-0 pages; pools of large orders cache
+ * at least one page.  Half of a full cache is moved to the shared pool
+ * at a time, and an empty one takes up to half as many back.
+ */
+#define ION_PAGE_POOL_CPU_PAGES	64
+
+/* Don't prefill a pool for this long after the shrinker took from it */
+#define ION_PAGE_POOL_BACKOFF	HZ
+
+/* All pools, for debugfs */
+static LIST_HEAD(ion_page_pools);
+static DEFINE_MUTEX(ion_page_pools_lock);
 
 static void *ion_page_pool_alloc_pages(struct ion_page_pool *pool)
 {
@@ -48,93 +64,201 @@ static void ion_page_pool_free_pages(struct ion_page_pool *pool,
 	__free_pages(page, pool->order);
 }
 
-static int ion_page_pool_add(struct ion_page_pool *pool, struct page *page)
+/*
+ * Pooled pages belong to us, so they are linked through page->lru and
+ * need no tracking structure of their own.  Called with pool->lock held.
+ */
+static void ion_page_pool_add(struct ion_page_pool *pool, struct page *page)
 {
-	struct ion_page_pool_item *item;
-
-	item = kmalloc(sizeof(struct ion_page_pool_item), GFP_KERNEL);
-	if (!item)
-		return -ENOMEM;
-
-	mutex_lock(&pool->mutex);
-	item->page = page;
 	if (PageHighMem(page)) {
-		list_add_tail(&item->list, &pool->high_items);
+		list_add_tail(&page->lru, &pool->high_items);
 		pool->high_count++;
 	} else {
-		list_add_tail(&item->list, &pool->low_items);
+		list_add_tail(&page->lru, &pool->low_items);
 		pool->low_count++;
 	}
-	mutex_unlock(&pool->mutex);
-	return 0;
 }
 
 static struct page *ion_page_pool_remove(struct ion_page_pool *pool, bool high)
 {
-	struct ion_page_pool_item *item;
 	struct page *page;
 
 	if (high) {
 		BUG_ON(!pool->high_count);
-		item = list_first_entry(&pool->high_items,
-					struct ion_page_pool_item, list);
+		page = list_first_entry(&pool->high_items, struct page, lru);
 		pool->high_count--;
 	} else {
 		BUG_ON(!pool->low_count);
-		item = list_first_entry(&pool->low_items,
-					struct ion_page_pool_item, list);
+		page = list_first_entry(&pool->low_items, struct page, lru);
 		pool->low_count--;
 	}
 
-	list_del(&item->list);
-	page = item->page;
-	kfree(item);
+	list_del(&page->lru);
 	return page;
 }
 
+/* Move up to @nr of the coldest pages of @pcp to the shared pool */
+static void ion_page_pool_flush_cpu(struct ion_page_pool *pool,
+				    struct ion_page_pool_cpu *pcp, int nr)
+{
+	struct page *page;
+
+	spin_lock(&pool->lock);
+	while (nr-- && pcp->count) {
+		page = list_entry(pcp->pages.prev, struct page, lru);
+		list_del(&page->lru);
+		pcp->count--;
+		ion_page_pool_add(pool, page);
+	}
+	spin_unlock(&pool->lock);
+}
+
+/* Take up to a batch of pages from the shared pool into @pcp */
+static void ion_page_pool_refill_cpu(struct ion_page_pool *pool,
+				     struct ion_page_pool_cpu *pcp)
+{
+	struct page *page;
+	int nr = pool->cpu_batch;
+
+	spin_lock(&pool->lock);
+	while (nr--) {
+		if (pool->high_count)
+			page = ion_page_pool_remove(pool, true);
+		else if (pool->low_count)
+			page = ion_page_pool_remove(pool, false);
+		else
+			break;
+		list_add_tail(&page->lru, &pcp->pages);
+		pcp->count++;
+	}
+	spin_unlock(&pool->lock);
+}
+
+static int ion_page_pool_count(struct ion_page_pool *pool)
+{
+	return pool->high_count + pool->low_count;
+}
+
+static void ion_page_pool_prefill(struct work_struct *work)
+{
+	struct ion_page_pool *pool = container_of(work, struct ion_page_pool,
+						  prefill_work);
+	struct page *page;
+
+	while (ion_page_pool_count(pool) < pool->watermark) {
+		if (time_before(jiffies,
+				pool->shrink_time + ION_PAGE_POOL_BACKOFF))
+			break;
+
+		page = ion_page_pool_alloc_pages(pool);
+		if (!page)
+			break;
+
+		spin_lock(&pool->lock);
+		ion_page_pool_add(pool, page);
+		pool->prefilled++;
+		spin_unlock(&pool->lock);
+	}
+}
+
 void *ion_page_pool_alloc(struct ion_page_pool *pool)
 {
+	struct ion_page_pool_cpu *pcp;
 	struct page *page = NULL;
+	ktime_t start;
+	u64 ns;
 
 	BUG_ON(!pool);
 
-	mutex_lock(&pool->mutex);
-	if (pool->high_count)
-		page = ion_page_pool_remove(pool, true);
-	else if (pool->low_count)
-		page = ion_page_pool_remove(pool, false);
-	mutex_unlock(&pool->mutex);
+	start = ktime_get();
+	pcp = get_cpu_ptr(pool->cpu);
+	spin_lock(&pcp->lock);
+	if (pcp->count) {
+		pcp->cpu_hits++;
+	} else {
+		ion_page_pool_refill_cpu(pool, pcp);
+		if (pcp->count)
+			pcp->hits++;
+	}
+	if (pcp->count) {
+		page = list_first_entry(&pcp->pages, struct page, lru);
+		list_del(&page->lru);
+		pcp->count--;
+		pcp->alloc_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
+	}
+	spin_unlock(&pcp->lock);
+	put_cpu_ptr(pool->cpu);
 
-	if (!page)
-		page = ion_page_pool_alloc_pages(pool);
+	if (ion_page_pool_count(pool) < pool->watermark)
+		queue_work(system_unbound_wq, &pool->prefill_work);
+
+	if (page)
+		return page;
+
+	page = ion_page_pool_alloc_pages(pool);
+	ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	pcp = get_cpu_ptr(pool->cpu);
+	spin_lock(&pcp->lock);
+	pcp->misses++;
+	pcp->alloc_ns += ns;
+	pcp->miss_ns += ns;
+	spin_unlock(&pcp->lock);
+	put_cpu_ptr(pool->cpu);
 
 	return page;
 }
 
 void ion_page_pool_free(struct ion_page_pool *pool, struct page* page)
 {
-	int ret;
+	struct ion_page_pool_cpu *pcp;
+
+	pcp = get_cpu_ptr(pool->cpu);
+	spin_lock(&pcp->lock);
+	list_add(&page->lru, &pcp->pages);
+	if (++pcp->count > pool->cpu_high)
+		ion_page_pool_flush_cpu(pool, pcp, pool->cpu_batch);
+	spin_unlock(&pcp->lock);
+	put_cpu_ptr(pool->cpu);
+}
 
-	ret = ion_page_pool_add(pool, page);
-	if (ret)
-		ion_page_pool_free_pages(pool, page);
+/* Move every cpu's cached pages to the shared pool */
+static void ion_page_pool_drain_cpus(struct ion_page_pool *pool)
+{
+	struct ion_page_pool_cpu *pcp;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		pcp = per_cpu_ptr(pool->cpu, cpu);
+		spin_lock(&pcp->lock);
+		ion_page_pool_flush_cpu(pool, pcp, pcp->count);
+		spin_unlock(&pcp->lock);
+	}
 }
 
 static int ion_page_pool_total(struct ion_page_pool *pool, bool high)
 {
+	struct ion_page_pool_cpu *pcp;
 	int total = 0;
+	int cpu;
 
-	total += high ? (pool->high_count + pool->low_count) *
-		(1 << pool->order) :
-			pool->low_count * (1 << pool->order);
-	return total;
+	/* per cpu caches hold either kind, count them for highmem only */
+	if (high) {
+		total += pool->high_count + pool->low_count;
+		for_each_possible_cpu(cpu) {
+			pcp = per_cpu_ptr(pool->cpu, cpu);
+			total += pcp->count;
+		}
+	} else {
+		total += pool->low_count;
+	}
+	return total * (1 << pool->order);
 }
 
 int ion_page_pool_shrink(struct ion_page_pool *pool, gfp_t gfp_mask,
 				int nr_to_scan)
 {
 	int nr_freed = 0;
-	int i;
 	bool high;
 
 	high = gfp_mask & __GFP_HIGHMEM;
@@ -142,19 +266,23 @@ int ion_page_pool_shrink(struct ion_page_pool *pool, gfp_t gfp_mask,
 	if (nr_to_scan == 0)
 		return ion_page_pool_total(pool, high);
 
-	for (i = 0; i < nr_to_scan; i++) {
+	/* Hold off prefill, or it would undo our work */
+	pool->shrink_time = jiffies;
+	ion_page_pool_drain_cpus(pool);
+
+	while (nr_freed < nr_to_scan) {
 		struct page *page;
 
-		mutex_lock(&pool->mutex);
+		spin_lock(&pool->lock);
 		if (high && pool->high_count) {
 			page = ion_page_pool_remove(pool, true);
 		} else if (pool->low_count) {
 			page = ion_page_pool_remove(pool, false);
 		} else {
-			mutex_unlock(&pool->mutex);
+			spin_unlock(&pool->lock);
 			break;
 		}
-		mutex_unlock(&pool->mutex);
+		spin_unlock(&pool->lock);
 		ion_page_pool_free_pages(pool, page);
 		nr_freed += (1 << pool->order);
 	}
@@ -162,29 +290,200 @@ int ion_page_pool_shrink(struct ion_page_pool *pool, gfp_t gfp_mask,
 	return nr_freed;
 }
 
+void ion_page_pool_set_watermark(struct ion_page_pool *pool, int watermark)
+{
+	pool->watermark = watermark;
+	if (ion_page_pool_count(pool) < watermark)
+		queue_work(system_unbound_wq, &pool->prefill_work);
+}
+
 struct ion_page_pool *ion_page_pool_create(gfp_t gfp_mask, unsigned int order)
 {
-	struct ion_page_pool *pool = kmalloc(sizeof(struct ion_page_pool),
+	struct ion_page_pool_cpu *pcp;
+	int cpu;
+	struct ion_page_pool *pool = kzalloc(sizeof(struct ion_page_pool),
 					     GFP_KERNEL);
 	if (!pool)
 		return NULL;
+	pool->cpu = alloc_percpu(struct ion_page_pool_cpu);
+	if (!pool->cpu) {
+		kfree(pool);
+		return NULL;
+	}
+	for_each_possible_cpu(cpu) {
+		pcp = per_cpu_ptr(pool->cpu, cpu);
+		spin_lock_init(&pcp->lock);
+		INIT_LIST_HEAD(&pcp->pages);
+	}
+	pool->cpu_high = max(ION_PAGE_POOL_CPU_PAGES >> order, 1);
+	pool->cpu_batch = max(pool->cpu_high / 2, 1);
 	pool->high_count = 0;
 	pool->low_count = 0;
 	INIT_LIST_HEAD(&pool->low_items);
 	INIT_LIST_HEAD(&pool->high_items);
 	pool->gfp_mask = gfp_mask;
 	pool->order = order;
-	mutex_init(&pool->mutex);
+	spin_lock_init(&pool->lock);
 	plist_node_init(&pool->list, order);
+	INIT_WORK(&pool->prefill_work, ion_page_pool_prefill);
+	pool->shrink_time = jiffies - ION_PAGE_POOL_BACKOFF;
+
+	mutex_lock(&ion_page_pools_lock);
+	list_add_tail(&pool->node, &ion_page_pools);
+	mutex_unlock(&ion_page_pools_lock);
 
 	return pool;
 }
 
 void ion_page_pool_destroy(struct ion_page_pool *pool)
 {
+	mutex_lock(&ion_page_pools_lock);
+	list_del(&pool->node);
+	mutex_unlock(&ion_page_pools_lock);
+
+	pool->watermark = 0;
+	cancel_work_sync(&pool->prefill_work);
+	ion_page_pool_drain_cpus(pool);
+	while (pool->high_count)
+		ion_page_pool_free_pages(pool,
+					 ion_page_pool_remove(pool, true));
+	while (pool->low_count)
+		ion_page_pool_free_pages(pool,
+					 ion_page_pool_remove(pool, false));
+	free_percpu(pool->cpu);
 	kfree(pool);
 }
 
+#ifdef CONFIG_DEBUG_FS
+static int ion_page_pool_stats_show(struct seq_file *s, void *unused)
+{
+	struct ion_page_pool *pool;
+	struct ion_page_pool_cpu *pcp;
+	unsigned long cpu_hits, hits, misses, cached;
+	u64 alloc_ns, miss_ns;
+	int cpu;
+
+	seq_printf(s, "%5s %8s %8s %10s %10s %10s %10s %10s %12s %12s\n",
+		   "order", "pooled", "percpu", "watermark", "prefilled",
+		   "cpu_hits", "hits", "misses", "avg_ns", "avg_miss_ns");
+
+	mutex_lock(&ion_page_pools_lock);
+	list_for_each_entry(pool, &ion_page_pools, node) {
+		cpu_hits = hits = misses = cached = 0;
+		alloc_ns = miss_ns = 0;
+		for_each_possible_cpu(cpu) {
+			pcp = per_cpu_ptr(pool->cpu, cpu);
+			spin_lock(&pcp->lock);
+			cached += pcp->count;
+			cpu_hits += pcp->cpu_hits;
+			hits += pcp->hits;
+			misses += pcp->misses;
+			alloc_ns += pcp->alloc_ns;
+			miss_ns += pcp->miss_ns;
+			spin_unlock(&pcp->lock);
+		}
+		if (cpu_hits + hits + misses)
+			do_div(alloc_ns, cpu_hits + hits + misses);
+		if (misses)
+			do_div(miss_ns, misses);
+
+		seq_printf(s, "%5u %8d %8lu %10d %10lu %10lu %10lu %10lu "
+			   "%12llu %12llu\n",
+			   pool->order, ion_page_pool_count(pool), cached,
+			   pool->watermark, pool->prefilled, cpu_hits, hits,
+			   misses, alloc_ns, miss_ns);
+	}
+	mutex_unlock(&ion_page_pools_lock);
+
+	return 0;
+}
+
+static int ion_page_pool_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, ion_page_pool_stats_show, inode->i_private);
+}
+
+static const struct file_operations ion_page_pool_stats_fops = {
+	.open = ion_page_pool_stats_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int ion_page_pool_watermark_show(struct seq_file *s, void *unused)
+{
+	struct ion_page_pool *pool;
+
+	mutex_lock(&ion_page_pools_lock);
+	list_for_each_entry(pool, &ion_page_pools, node)
+		seq_printf(s, "%u %d\n", pool->order, pool->watermark);
+	mutex_unlock(&ion_page_pools_lock);
+
+	return 0;
+}
+
+static int ion_page_pool_watermark_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, ion_page_pool_watermark_show,
+			   inode->i_private);
+}
+
+/* "<order> <pages>" sets the prefill watermark of the pools of that order */
+static ssize_t ion_page_pool_watermark_write(struct file *file,
+					     const char __user *ubuf,
+					     size_t count, loff_t *ppos)
+{
+	struct ion_page_pool *pool;
+	unsigned int order;
+	int watermark;
+	char buf[32];
+
+	if (count >= sizeof(buf))
+		return -EINVAL;
+	if (copy_from_user(buf, ubuf, count))
+		return -EFAULT;
+	buf[count] = '\0';
+
+	if (sscanf(buf, "%u %d", &order, &watermark) != 2 || watermark < 0)
+		return -EINVAL;
+
+	mutex_lock(&ion_page_pools_lock);
+	list_for_each_entry(pool, &ion_page_pools, node)
+		if (pool->order == order)
+			ion_page_pool_set_watermark(pool, watermark);
+	mutex_unlock(&ion_page_pools_lock);
+
+	return count;
+}
+
+static const struct file_operations ion_page_pool_watermark_fops = {
+	.open = ion_page_pool_watermark_open,
+	.read = seq_read,
+	.write = ion_page_pool_watermark_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static struct dentry *ion_page_pool_debug_root;
+
+static int __init ion_page_pool_init(void)
+{
+	ion_page_pool_debug_root = debugfs_create_dir("ion_page_pool", NULL);
+	if (IS_ERR_OR_NULL(ion_page_pool_debug_root))
+		return 0;
+
+	debugfs_create_file("stats", 0444, ion_page_pool_debug_root, NULL,
+			    &ion_page_pool_stats_fops);
+	debugfs_create_file("watermark", 0644, ion_page_pool_debug_root, NULL,
+			    &ion_page_pool_watermark_fops);
+	return 0;
+}
+
+static void __exit ion_page_pool_exit(void)
+{
+	debugfs_remove_recursive(ion_page_pool_debug_root);
+}
+#else
 static int __init ion_page_pool_init(void)
 {
 	return 0;
@@ -193,6 +492,7 @@ static int __init ion_page_pool_init(void)
 static void __exit ion_page_pool_exit(void)
 {
 }
+#endif
 
 module_init(ion_page_pool_init);
 module_exit(ion_page_pool_exit);
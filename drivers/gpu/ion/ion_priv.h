@@ -24,7 +24,9 @@
 #include <linux/rbtree.h>
 #include <linux/sched.h>
 #include <linux/shrinker.h>
+#include <linux/spinlock.h>
 #include <linux/types.h>
+#include <linux/workqueue.h>
 
 struct ion_buffer *ion_handle_buffer(struct ion_handle *handle);
 
@@ -35,6 +37,7 @@ struct ion_buffer *ion_handle_buffer(struct ion_handle *handle);
  * @dev:		back pointer to the ion_device
  * @heap:		back pointer to the heap the buffer came from
  * @flags:		buffer specific flags
+ * @private_flags:	internal buffer specific flags
  * @size:		size of the buffer
  * @priv_virt:		private data to the buffer representable as
  *			a void *
@@ -63,6 +66,7 @@ struct ion_buffer {
 	struct ion_device *dev;
 	struct ion_heap *heap;
 	unsigned long flags;
+	unsigned long private_flags;
 	size_t size;
 	union {
 		void *priv_virt;
@@ -115,6 +119,15 @@ struct ion_heap_ops {
  */
 #define ION_HEAP_FLAG_DEFER_FREE (1 << 0)
 
+/**
+ * private flags - flags internal to ion
+ */
+/*
+ * Buffer is being freed by the shrinker: its memory goes back to the
+ * system, so the heap need not zero or pool it.
+ */
+#define ION_PRIV_FLAG_SHRINKER_FREE (1 << 0)
+
 /**
  * struct ion_heap - represents a heap in the system
  * @node:		rb node to put the heap on the device's tree of heaps
@@ -132,9 +145,12 @@ struct ion_heap_ops {
  *			in the deferred free lists for heaps that support it
  * @free_list:		free list head if deferred free is used
  * @free_list_size	size of the deferred free list in bytes
+ * @free_list_count:	number of buffers on the deferred free list
  * @lock:		protects the free list
  * @waitqueue:		queue to wait on from deferred free thread
  * @task:		task struct of deferred free thread
+ * @zeroed_bytes:	bytes cleared by ion_heap_buffer_zero()
+ * @zero_ns:		time spent clearing them
  * @debug_show:		called when heap debug file is read to add any
  *			heap specific debug info to output
  *
@@ -154,9 +170,12 @@ struct ion_heap {
 	struct shrinker shrinker;
 	struct list_head free_list;
 	size_t free_list_size;
+	unsigned int free_list_count;
 	struct rt_mutex lock;
 	wait_queue_head_t waitqueue;
 	struct task_struct *task;
+	atomic64_t zeroed_bytes;
+	atomic64_t zero_ns;
 	int (*debug_show)(struct ion_heap *heap, struct seq_file *, void *);
 };
 
@@ -255,6 +274,17 @@ void ion_heap_freelist_add(struct ion_heap *heap, struct ion_buffer *buffer);
  */
 size_t ion_heap_freelist_drain(struct ion_heap *heap, size_t size);
 
+/**
+ * ion_heap_freelist_shrink - drain the deferred free list, for the shrinker
+ * @heap:		the heap
+ * @size:		ammount of memory to drain in bytes
+ *
+ * Like ion_heap_freelist_drain(), but the buffers are marked with
+ * ION_PRIV_FLAG_SHRINKER_FREE so the heap can return their memory to the
+ * system without zeroing it first.
+ */
+size_t ion_heap_freelist_shrink(struct ion_heap *heap, size_t size);
+
 /**
  * ion_heap_freelist_size - returns the size of the freelist in bytes
  * @heap:		the heap
@@ -305,43 +335,78 @@ void ion_carveout_free(struct ion_heap *heap, ion_phys_addr_t addr,
  * invalidated from the cache, provides a significant peformance benefit on
  * many systems */
 
+/**
+ * struct ion_page_pool_cpu - per cpu front cache of a page pool
+ * @lock:		protects this struct; nests outside the pool's lock
+ * @count:		number of pages cached
+ * @pages:		cached pages, linked through page->lru, hottest first
+ * @cpu_hits:		allocations served from this cache
+ * @hits:		allocations served from the shared pool
+ * @misses:		allocations that had to go to the page allocator
+ * @alloc_ns:		time spent in all allocations
+ * @miss_ns:		time spent in allocations that missed
+ */
+struct ion_page_pool_cpu {
+	spinlock_t lock;
+	int count;
+	struct list_head pages;
+	unsigned long cpu_hits;
+	unsigned long hits;
+	unsigned long misses;
+	u64 alloc_ns;
+	u64 miss_ns;
+};
+
 /**
  * struct ion_page_pool - pagepool struct
  * @high_count:		number of highmem items in the pool
  * @low_count:		number of lowmem items in the pool
  * @high_items:		list of highmem items
  * @low_items:		list of lowmem items
- * @shrinker:		a shrinker for the items
- * @mutex:		lock protecting this struct and especially the count
- *			item list
- * @alloc:		function to be used to allocate pageory when the pool
- *			is empty
- * @free:		function to be used to free pageory back to the system
- *			when the shrinker fires
+ * @lock:		lock protecting the shared item lists and counts
  * @gfp_mask:		gfp_mask to use from alloc
  * @order:		order of pages in the pool
  * @list:		plist node for list of pools
+ * @cpu:		per cpu caches in front of the shared lists
+ * @cpu_high:		pages a cpu cache holds before it spills
+ * @cpu_batch:		pages moved between a cpu cache and the shared lists
+ * @watermark:		the shared lists are refilled in the background
+ *			up to this many items, 0 disables prefill
+ * @prefill_work:	work item doing the refill
+ * @prefilled:		items added by prefill
+ * @shrink_time:	jiffies when the shrinker last took from the pool
+ * @node:		entry in the list of all pools
  *
  * Allows you to keep a pool of pre allocated pages to use from your heap.
  * Keeping a pool of pages that is ready for dma, ie any cached mapping have
  * been invalidated from the cache, provides a significant peformance benefit
- * on many systems
+ * on many systems.  Pooled pages are linked through page->lru, so adding
+ * to the pool never allocates and never fails.
  */
 struct ion_page_pool {
 	int high_count;
 	int low_count;
 	struct list_head high_items;
 	struct list_head low_items;
-	struct mutex mutex;
+	spinlock_t lock;
 	gfp_t gfp_mask;
 	unsigned int order;
 	struct plist_node list;
+	struct ion_page_pool_cpu __percpu *cpu;
+	int cpu_high;
+	int cpu_batch;
+	int watermark;
+	struct work_struct prefill_work;
+	unsigned long prefilled;
+	unsigned long shrink_time;
+	struct list_head node;
 };
 
 struct ion_page_pool *ion_page_pool_create(gfp_t gfp_mask, unsigned int order);
 void ion_page_pool_destroy(struct ion_page_pool *);
 void *ion_page_pool_alloc(struct ion_page_pool *);
 void ion_page_pool_free(struct ion_page_pool *, struct page *);
+void ion_page_pool_set_watermark(struct ion_page_pool *pool, int watermark);
 
 /** ion_page_pool_shrink - shrinks the size of the memory cached in the pool
  * @pool:		the pool
@@ -86,17 +86,23 @@ static struct page *alloc_buffer_page(struct ion_system_heap *heap,
 	return page;
 }
 
+/*
+ * Uncached pages go back to the pools only if @zeroed; the pools hand
+ * them out again as they are.
+ */
 static void free_buffer_page(struct ion_system_heap *heap,
 			     struct ion_buffer *buffer, struct page *page,
-			     unsigned int order)
+			     unsigned int order, bool zeroed)
 {
 	bool cached = ion_buffer_cached(buffer);
 	bool split_pages = ion_buffer_fault_user_mappings(buffer);
 	int i;
 
-	if (!cached) {
+	if (!cached && zeroed) {
 		struct ion_page_pool *pool = heap->pools[order_to_index(order)];
 		ion_page_pool_free(pool, page);
+	} else if (!cached) {
+		__free_pages(page, order);
 	} else if (split_pages) {
 		for (i = 0; i < (1 << order); i++)
 			__free_page(page + i);
@@ -184,7 +190,9 @@ err1:
 	kfree(table);
 err:
 	list_for_each_entry(info, &pages, list) {
-		free_buffer_page(sys_heap, buffer, info->page, info->order);
+		/* never handed out, so still as clean as the pool gave it */
+		free_buffer_page(sys_heap, buffer, info->page, info->order,
+				 true);
 		kfree(info);
 	}
 	return -ENOMEM;
@@ -198,18 +206,22 @@ void ion_system_heap_free(struct ion_buffer *buffer)
 							heap);
 	struct sg_table *table = buffer->sg_table;
 	bool cached = ion_buffer_cached(buffer);
+	bool zeroed = false;
 	struct scatterlist *sg;
 	LIST_HEAD(pages);
 	int i;
 
 	/* uncached pages come from the page pools, zero them before returning
-	   for security purposes (other allocations are zerod at alloc time */
-	if (!cached)
-		ion_heap_buffer_zero(buffer);
+	   for security purposes (other allocations are zerod at alloc time).
+	   This runs in the heap's deferred free thread.  Buffers the shrinker
+	   frees go back to the system instead, and so do pages we failed to
+	   clear: no page leaves the pools without having been zeroed */
+	if (!cached && !(buffer->private_flags & ION_PRIV_FLAG_SHRINKER_FREE))
+		zeroed = !ion_heap_buffer_zero(buffer);
 
 	for_each_sg(table->sgl, sg, table->nents, i)
 		free_buffer_page(sys_heap, buffer, sg_page(sg),
-				get_order(sg_dma_len(sg)));
+				get_order(sg_dma_len(sg)), zeroed);
 	sg_free_table(table);
 	kfree(table);
 }
@@ -253,7 +265,7 @@ static int ion_system_heap_shrink(struct shrinker *shrinker,
 
 	/* shrink the free list first, no point in zeroing the memory if
 	   we're just going to reclaim it */
-	nr_freed += ion_heap_freelist_drain(heap, sc->nr_to_scan * PAGE_SIZE) /
+	nr_freed += ion_heap_freelist_shrink(heap, sc->nr_to_scan * PAGE_SIZE) /
 		PAGE_SIZE;
 
 	if (nr_freed >= sc->nr_to_scan)
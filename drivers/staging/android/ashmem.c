@@ -27,7 +27,13 @@
 #include <linux/personality.h>
 #include <linux/bitops.h>
 #include <linux/mutex.h>
+#include <linux/spinlock.h>
 #include <linux/shmem_fs.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/wait.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 #include "ashmem.h"
 
 #define ASHMEM_NAME_PREFIX "dev/ashmem/"
@@ -37,7 +43,7 @@
 /*
  * ashmem_area - anonymous shared memory area
  * Lifecycle: From our parent file's open() until its release()
- * Locking: Protected by `ashmem_mutex'
+ * Locking: Protected by its `mutex'
  * Big Note: Mappings do NOT pin this structure; it dies on close()
  */
 struct ashmem_area {
@@ -46,12 +52,14 @@ struct ashmem_area {
 	struct file *file;		 /* the shmem-based backing file */
 	size_t size;			 /* size of the mapping, in bytes */
 	unsigned long prot_mask;	 /* allowed prot bits, as vm_flags */
+	struct mutex mutex;		 /* protects all of the above */
+	atomic_t purge_inflight;	 /* ranges the shrinker is purging */
 };
 
 /*
  * ashmem_range - represents an interval of unpinned (evictable) pages
  * Lifecycle: From unpin to pin
- * Locking: Protected by `ashmem_mutex'
+ * Locking: Protected by its area's `mutex'; `lru' by `ashmem_lru_lock'
  */
 struct ashmem_range {
 	struct list_head lru;		/* entry in LRU list */
@@ -62,18 +70,44 @@ struct ashmem_range {
 	unsigned int purged;		/* ASHMEM_NOT or ASHMEM_WAS_PURGED */
 };
 
-/* LRU list of unpinned pages, protected by ashmem_mutex */
+/* LRU list of unpinned pages, protected by ashmem_lru_lock */
 static LIST_HEAD(ashmem_lru_list);
 
-/* Count of pages on our LRU list, protected by ashmem_mutex */
+/* Count of pages on our LRU list, protected by ashmem_lru_lock */
 static unsigned long lru_count;
 
 /*
- * ashmem_mutex - protects the list of and each individual ashmem_area
+ * ashmem_lru_lock - protects the LRU list and count
  *
- * Lock Ordering: ashmex_mutex -> i_mutex -> i_alloc_sem
+ * Lock Ordering: asma->mutex -> ashmem_lru_lock
+ *		  asma->mutex -> i_mutex -> i_alloc_sem
+ *
+ * The shrinker only trylocks an area's mutex while holding the LRU lock,
+ * and truncates the pages it took off the LRU with neither held.  Pinning
+ * waits on ashmem_purge_wait for the area's in-flight purges to finish, so
+ * it can't hand back pages the shrinker is still truncating.
  */
-static DEFINE_MUTEX(ashmem_mutex);
+static DEFINE_SPINLOCK(ashmem_lru_lock);
+static DECLARE_WAIT_QUEUE_HEAD(ashmem_purge_wait);
+
+/* Ranges the shrinker takes off the LRU per trip through the lock */
+#define ASHMEM_PURGE_BATCH	8
+
+/* Statistics, in debugfs as "ashmem" */
+static struct ashmem_stats {
+	atomic64_t pins;		/* ASHMEM_PIN calls */
+	atomic64_t unpins;		/* ASHMEM_UNPIN calls */
+	atomic64_t lock_contended;	/* pin/unpin found the area locked */
+	atomic64_t lock_wait_ns;	/* time spent waiting for it */
+	atomic64_t purge_waits;		/* pins that waited for a purge */
+	atomic64_t purge_wait_ns;	/* time spent waiting for it */
+	atomic64_t purge_batches;	/* batches purged by the shrinker */
+	atomic64_t purged_ranges;	/* ranges purged */
+	atomic64_t purged_pages;	/* pages purged */
+	atomic64_t purge_ns;		/* time spent truncating */
+	atomic64_t purge_max_ns;	/* longest batch */
+	atomic64_t purge_busy;		/* ranges skipped, area locked */
+} ashmem_stats;
 
 static struct kmem_cache *ashmem_area_cachep __read_mostly;
 static struct kmem_cache *ashmem_range_cachep __read_mostly;
@@ -102,16 +136,25 @@ static struct kmem_cache *ashmem_range_cachep __read_mostly;
 
 #define PROT_MASK		(PROT_EXEC | PROT_READ | PROT_WRITE)
 
+static inline void __lru_del(struct ashmem_range *range)
+{
+	list_del(&range->lru);
+	lru_count -= range_size(range);
+}
+
 static inline void lru_add(struct ashmem_range *range)
 {
+	spin_lock(&ashmem_lru_lock);
 	list_add_tail(&range->lru, &ashmem_lru_list);
 	lru_count += range_size(range);
+	spin_unlock(&ashmem_lru_lock);
 }
 
 static inline void lru_del(struct ashmem_range *range)
 {
-	list_del(&range->lru);
-	lru_count -= range_size(range);
+	spin_lock(&ashmem_lru_lock);
+	__lru_del(range);
+	spin_unlock(&ashmem_lru_lock);
 }
 
 /*
@@ -123,7 +166,7 @@ static inline void lru_del(struct ashmem_range *range)
  * 'start' - starting page, inclusive
  * 'end' - ending page, inclusive
  *
- * Caller must hold ashmem_mutex.
+ * Caller must hold asma->mutex.
  */
 static int range_alloc(struct ashmem_area *asma,
 		       struct ashmem_range *prev_range, unsigned int purged,
@@ -159,7 +202,7 @@ static void range_del(struct ashmem_range *range)
 /*
  * range_shrink - shrinks a range
  *
- * Caller must hold ashmem_mutex.
+ * Caller must hold asma->mutex.
  */
 static inline void range_shrink(struct ashmem_range *range,
 				size_t start, size_t end)
@@ -169,8 +212,11 @@ static inline void range_shrink(struct ashmem_range *range,
 	range->pgstart = start;
 	range->pgend = end;
 
-	if (range_on_lru(range))
+	if (range_on_lru(range)) {
+		spin_lock(&ashmem_lru_lock);
 		lru_count -= pre - range_size(range);
+		spin_unlock(&ashmem_lru_lock);
+	}
 }
 
 static int ashmem_open(struct inode *inode, struct file *file)
@@ -187,6 +233,8 @@ static int ashmem_open(struct inode *inode, struct file *file)
 		return -ENOMEM;
 
 	INIT_LIST_HEAD(&asma->unpinned_list);
+	mutex_init(&asma->mutex);
+	atomic_set(&asma->purge_inflight, 0);
 	memcpy(asma->name, ASHMEM_NAME_PREFIX, ASHMEM_NAME_PREFIX_LEN);
 	asma->prot_mask = PROT_MASK;
 	file->private_data = asma;
@@ -199,10 +247,13 @@ static int ashmem_release(struct inode *ignored, struct file *file)
 	struct ashmem_area *asma = file->private_data;
 	struct ashmem_range *range, *next;
 
-	mutex_lock(&ashmem_mutex);
+	mutex_lock(&asma->mutex);
 	list_for_each_entry_safe(range, next, &asma->unpinned_list, unpinned)
 		range_del(range);
-	mutex_unlock(&ashmem_mutex);
+	mutex_unlock(&asma->mutex);
+
+	/* Nothing is left on the LRU; let the shrinker finish with us */
+	wait_event(ashmem_purge_wait, !atomic_read(&asma->purge_inflight));
 
 	if (asma->file)
 		fput(asma->file);
@@ -217,7 +268,7 @@ static ssize_t ashmem_read(struct file *file, char __user *buf,
 	struct ashmem_area *asma = file->private_data;
 	int ret = 0;
 
-	mutex_lock(&ashmem_mutex);
+	mutex_lock(&asma->mutex);
 
 	/* If size is not set, or set to 0, always return EOF. */
 	if (asma->size == 0)
@@ -228,7 +279,7 @@ static ssize_t ashmem_read(struct file *file, char __user *buf,
 		goto out_unlock;
 	}
 
-	mutex_unlock(&ashmem_mutex);
+	mutex_unlock(&asma->mutex);
 
 	/*
 	 * asma and asma->file are used outside the lock here.  We assume
@@ -244,7 +295,7 @@ static ssize_t ashmem_read(struct file *file, char __user *buf,
 	return ret;
 
 out_unlock:
-	mutex_unlock(&ashmem_mutex);
+	mutex_unlock(&asma->mutex);
 	return ret;
 }
 
@@ -253,7 +304,7 @@ static loff_t ashmem_llseek(struct file *file, loff_t offset, int origin)
 	struct ashmem_area *asma = file->private_data;
 	int ret;
 
-	mutex_lock(&ashmem_mutex);
+	mutex_lock(&asma->mutex);
 
 	if (asma->size == 0) {
 		ret = -EINVAL;
@@ -273,7 +324,7 @@ static loff_t ashmem_llseek(struct file *file, loff_t offset, int origin)
 	file->f_pos = asma->file->f_pos;
 
 out:
-	mutex_unlock(&ashmem_mutex);
+	mutex_unlock(&asma->mutex);
 	return ret;
 }
 
@@ -289,7 +340,7 @@ static int ashmem_mmap(struct file *file, struct vm_area_struct *vma)
 	struct ashmem_area *asma = file->private_data;
 	int ret = 0;
 
-	mutex_lock(&ashmem_mutex);
+	mutex_lock(&asma->mutex);
 
 	/* user needs to SET_SIZE before mapping */
 	if (unlikely(!asma->size)) {
@@ -332,10 +383,30 @@ static int ashmem_mmap(struct file *file, struct vm_area_struct *vma)
 	vma->vm_flags |= VM_CAN_NONLINEAR;
 
 out:
-	mutex_unlock(&ashmem_mutex);
+	mutex_unlock(&asma->mutex);
 	return ret;
 }
 
+struct ashmem_purge {
+	struct ashmem_area *asma;
+	struct file *file;	/* reference held while truncating */
+	loff_t start;
+	loff_t end;
+};
+
+static void ashmem_stat_max(atomic64_t *max, s64 val)
+{
+	s64 old = atomic64_read(max);
+	s64 prev;
+
+	while (val > old) {
+		prev = atomic64_cmpxchg(max, old, val);
+		if (prev == old)
+			break;
+		old = prev;
+	}
+}
+
 /*
  * ashmem_shrink - our cache shrinker, called from mm/vmscan.c :: shrink_slab
  *
@@ -348,12 +419,19 @@ out:
  * proceed without risk of deadlock (due to gfp_mask).
  *
  * We approximate LRU via least-recently-unpinned, jettisoning unpinned partial
- * chunks of ashmem regions LRU-wise one-at-a-time until we hit 'nr_to_scan'
- * pages freed.
+ * chunks of ashmem regions LRU-wise until we hit 'nr_to_scan' pages freed.
+ * Ranges are taken off the LRU up to ASHMEM_PURGE_BATCH at a time and marked
+ * purged under the LRU lock and their area's mutex; the truncation is done
+ * after dropping both.  Areas whose mutex is held are skipped, rather than
+ * making reclaim wait on pin and unpin.
  */
 static int ashmem_shrink(struct shrinker *s, struct shrink_control *sc)
 {
+	struct ashmem_purge batch[ASHMEM_PURGE_BATCH];
 	struct ashmem_range *range, *next;
+	ktime_t start;
+	s64 ns;
+	int i, n;
 
 	/* We might recurse into filesystem code, so bail out if necessary */
 	if (sc->nr_to_scan && !(sc->gfp_mask & __GFP_FS))
@@ -361,21 +439,60 @@ static int ashmem_shrink(struct shrinker *s, struct shrink_control *sc)
 	if (!sc->nr_to_scan)
 		return lru_count;
 
-	mutex_lock(&ashmem_mutex);
-	list_for_each_entry_safe(range, next, &ashmem_lru_list, lru) {
-		struct inode *inode = range->asma->file->f_dentry->d_inode;
-		loff_t start = range->pgstart * PAGE_SIZE;
-		loff_t end = (range->pgend + 1) * PAGE_SIZE - 1;
+	while (sc->nr_to_scan > 0) {
+		unsigned long pages = 0;
 
-		vmtruncate_range(inode, start, end);
-		range->purged = ASHMEM_WAS_PURGED;
-		lru_del(range);
+		n = 0;
+		spin_lock(&ashmem_lru_lock);
+		list_for_each_entry_safe(range, next, &ashmem_lru_list, lru) {
+			struct ashmem_area *asma = range->asma;
+
+			if (!mutex_trylock(&asma->mutex)) {
+				atomic64_inc(&ashmem_stats.purge_busy);
+				continue;
+			}
+
+			batch[n].asma = asma;
+			batch[n].file = asma->file;
+			batch[n].start = range->pgstart * PAGE_SIZE;
+			batch[n].end = (range->pgend + 1) * PAGE_SIZE - 1;
+			get_file(asma->file);
+			atomic_inc(&asma->purge_inflight);
+
+			pages += range_size(range);
+			sc->nr_to_scan -= range_size(range);
 
-		sc->nr_to_scan -= range_size(range);
-		if (sc->nr_to_scan <= 0)
+			range->purged = ASHMEM_WAS_PURGED;
+			__lru_del(range);
+			/* pin may free the range as soon as this is dropped */
+			mutex_unlock(&asma->mutex);
+
+			if (++n == ASHMEM_PURGE_BATCH || sc->nr_to_scan <= 0)
+				break;
+		}
+		spin_unlock(&ashmem_lru_lock);
+
+		if (!n)
 			break;
+
+		start = ktime_get();
+		for (i = 0; i < n; i++) {
+			struct inode *inode = batch[i].file->f_dentry->d_inode;
+
+			vmtruncate_range(inode, batch[i].start, batch[i].end);
+			/* the area may go away once this drops to zero */
+			atomic_dec(&batch[i].asma->purge_inflight);
+			fput(batch[i].file);
+		}
+		wake_up_all(&ashmem_purge_wait);
+		ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+		atomic64_inc(&ashmem_stats.purge_batches);
+		atomic64_add(n, &ashmem_stats.purged_ranges);
+		atomic64_add(pages, &ashmem_stats.purged_pages);
+		atomic64_add(ns, &ashmem_stats.purge_ns);
+		ashmem_stat_max(&ashmem_stats.purge_max_ns, ns);
 	}
-	mutex_unlock(&ashmem_mutex);
 
 	return lru_count;
 }
@@ -389,7 +506,7 @@ static int set_prot_mask(struct ashmem_area *asma, unsigned long prot)
 {
 	int ret = 0;
 
-	mutex_lock(&ashmem_mutex);
+	mutex_lock(&asma->mutex);
 
 	/* the user can only remove, not add, protection bits */
 	if (unlikely((asma->prot_mask & prot) != prot)) {
@@ -404,7 +521,7 @@ static int set_prot_mask(struct ashmem_area *asma, unsigned long prot)
 	asma->prot_mask = prot;
 
 out:
-	mutex_unlock(&ashmem_mutex);
+	mutex_unlock(&asma->mutex);
 	return ret;
 }
 
@@ -419,7 +536,7 @@ static int set_name(struct ashmem_area *asma, void __user *name)
 		return len;
 	if (len == ASHMEM_NAME_LEN)
 		lname[ASHMEM_NAME_LEN - 1] = '\0';
-	mutex_lock(&ashmem_mutex);
+	mutex_lock(&asma->mutex);
 
 	/* cannot change an existing mapping's name */
 	if (unlikely(asma->file))
@@ -427,7 +544,7 @@ static int set_name(struct ashmem_area *asma, void __user *name)
 	else
 		strcpy(asma->name + ASHMEM_NAME_PREFIX_LEN, lname);
 
-	mutex_unlock(&ashmem_mutex);
+	mutex_unlock(&asma->mutex);
 	return ret;
 }
 
@@ -437,7 +554,7 @@ static int get_name(struct ashmem_area *asma, void __user *name)
 	char lname[ASHMEM_NAME_LEN];
 	size_t len;
 
-	mutex_lock(&ashmem_mutex);
+	mutex_lock(&asma->mutex);
 	if (asma->name[ASHMEM_NAME_PREFIX_LEN] != '\0') {
 		/*
 		 * Copying only `len', instead of ASHMEM_NAME_LEN, bytes
@@ -449,7 +566,7 @@ static int get_name(struct ashmem_area *asma, void __user *name)
 		len = strlen(ASHMEM_NAME_DEF) + 1;
 		memcpy(lname, ASHMEM_NAME_DEF, len);
 	}
-	mutex_unlock(&ashmem_mutex);
+	mutex_unlock(&asma->mutex);
 	if (unlikely(copy_to_user(name, lname, len)))
 		ret = -EFAULT;
 	return ret;
@@ -459,7 +576,7 @@ static int get_name(struct ashmem_area *asma, void __user *name)
  * ashmem_pin - pin the given ashmem region, returning whether it was
  * previously purged (ASHMEM_WAS_PURGED) or not (ASHMEM_NOT_PURGED).
  *
- * Caller must hold ashmem_mutex.
+ * Caller must hold asma->mutex.
  */
 static int ashmem_pin(struct ashmem_area *asma, size_t pgstart, size_t pgend)
 {
@@ -525,7 +642,7 @@ static int ashmem_pin(struct ashmem_area *asma, size_t pgstart, size_t pgend)
 /*
  * ashmem_unpin - unpin the given range of pages. Returns zero on success.
  *
- * Caller must hold ashmem_mutex.
+ * Caller must hold asma->mutex.
  */
 static int ashmem_unpin(struct ashmem_area *asma, size_t pgstart, size_t pgend)
 {
@@ -560,7 +677,7 @@ restart:
  * ashmem_get_pin_status - Returns ASHMEM_IS_UNPINNED if _any_ pages in the
  * given interval are unpinned and ASHMEM_IS_PINNED otherwise.
  *
- * Caller must hold ashmem_mutex.
+ * Caller must hold asma->mutex.
  */
 static int ashmem_get_pin_status(struct ashmem_area *asma, size_t pgstart,
 				 size_t pgend)
@@ -580,6 +697,39 @@ static int ashmem_get_pin_status(struct ashmem_area *asma, size_t pgstart,
 	return ret;
 }
 
+/*
+ * ashmem_pin_lock - take the area's mutex for pin and unpin, counting the
+ * times it was contended and how long we waited.  For ASHMEM_PIN, also wait
+ * for the shrinker to finish purging any of the area's ranges, so that the
+ * caller doesn't write to pages that are about to be truncated.
+ */
+static void ashmem_pin_lock(struct ashmem_area *asma, unsigned long cmd)
+{
+	ktime_t start;
+
+	for (;;) {
+		if (!mutex_trylock(&asma->mutex)) {
+			start = ktime_get();
+			mutex_lock(&asma->mutex);
+			atomic64_inc(&ashmem_stats.lock_contended);
+			atomic64_add(ktime_to_ns(ktime_sub(ktime_get(), start)),
+				     &ashmem_stats.lock_wait_ns);
+		}
+
+		/* the shrinker starts purges with the mutex held */
+		if (cmd != ASHMEM_PIN || !atomic_read(&asma->purge_inflight))
+			return;
+		mutex_unlock(&asma->mutex);
+
+		start = ktime_get();
+		wait_event(ashmem_purge_wait,
+			   !atomic_read(&asma->purge_inflight));
+		atomic64_inc(&ashmem_stats.purge_waits);
+		atomic64_add(ktime_to_ns(ktime_sub(ktime_get(), start)),
+			     &ashmem_stats.purge_wait_ns);
+	}
+}
+
 static int ashmem_pin_unpin(struct ashmem_area *asma, unsigned long cmd,
 			    void __user *p)
 {
@@ -609,7 +759,12 @@ static int ashmem_pin_unpin(struct ashmem_area *asma, unsigned long cmd,
 	pgstart = pin.offset / PAGE_SIZE;
 	pgend = pgstart + (pin.len / PAGE_SIZE) - 1;
 
-	mutex_lock(&ashmem_mutex);
+	if (cmd == ASHMEM_PIN)
+		atomic64_inc(&ashmem_stats.pins);
+	else if (cmd == ASHMEM_UNPIN)
+		atomic64_inc(&ashmem_stats.unpins);
+
+	ashmem_pin_lock(asma, cmd);
 
 	switch (cmd) {
 	case ASHMEM_PIN:
@@ -623,7 +778,7 @@ static int ashmem_pin_unpin(struct ashmem_area *asma, unsigned long cmd,
 		break;
 	}
 
-	mutex_unlock(&ashmem_mutex);
+	mutex_unlock(&asma->mutex);
 
 	return ret;
 }
@@ -678,6 +833,54 @@ static long ashmem_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 	return ret;
 }
 
+#ifdef CONFIG_DEBUG_FS
+static struct dentry *ashmem_debugfs;
+
+static int ashmem_stats_show(struct seq_file *m, void *unused)
+{
+	struct ashmem_stats *st = &ashmem_stats;
+	u64 ns = atomic64_read(&st->purge_ns);
+	u64 batches = atomic64_read(&st->purge_batches);
+
+	seq_printf(m, "lru_pages: %lu\n", lru_count);
+	seq_printf(m, "pins: %llu\n", (u64)atomic64_read(&st->pins));
+	seq_printf(m, "unpins: %llu\n", (u64)atomic64_read(&st->unpins));
+	seq_printf(m, "lock_contended: %llu\n",
+		   (u64)atomic64_read(&st->lock_contended));
+	seq_printf(m, "lock_wait_us: %llu\n",
+		   div_u64(atomic64_read(&st->lock_wait_ns), NSEC_PER_USEC));
+	seq_printf(m, "purge_waits: %llu\n",
+		   (u64)atomic64_read(&st->purge_waits));
+	seq_printf(m, "purge_wait_us: %llu\n",
+		   div_u64(atomic64_read(&st->purge_wait_ns), NSEC_PER_USEC));
+	seq_printf(m, "purge_batches: %llu\n", batches);
+	seq_printf(m, "purged_ranges: %llu\n",
+		   (u64)atomic64_read(&st->purged_ranges));
+	seq_printf(m, "purged_pages: %llu\n",
+		   (u64)atomic64_read(&st->purged_pages));
+	seq_printf(m, "purge_busy: %llu\n",
+		   (u64)atomic64_read(&st->purge_busy));
+	seq_printf(m, "purge_us: %llu\n", div_u64(ns, NSEC_PER_USEC));
+	seq_printf(m, "purge_avg_us: %llu\n",
+		   batches ? div_u64(div64_u64(ns, batches), NSEC_PER_USEC) : 0);
+	seq_printf(m, "purge_max_us: %llu\n",
+		   div_u64(atomic64_read(&st->purge_max_ns), NSEC_PER_USEC));
+	return 0;
+}
+
+static int ashmem_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, ashmem_stats_show, inode->i_private);
+}
+
+static const struct file_operations ashmem_stats_fops = {
+	.open = ashmem_stats_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+#endif
+
 static const struct file_operations ashmem_fops = {
 	.owner = THIS_MODULE,
 	.open = ashmem_open,
@@ -723,6 +926,11 @@ static int __init ashmem_init(void)
 
 	register_shrinker(&ashmem_shrinker);
 
+#ifdef CONFIG_DEBUG_FS
+	ashmem_debugfs = debugfs_create_file("ashmem", S_IRUGO, NULL, NULL,
+					     &ashmem_stats_fops);
+#endif
+
 	printk(KERN_INFO "ashmem: initialized\n");
 
 	return 0;
@@ -732,6 +940,9 @@ static void __exit ashmem_exit(void)
 {
 	int ret;
 
+#ifdef CONFIG_DEBUG_FS
+	debugfs_remove(ashmem_debugfs);
+#endif
 	unregister_shrinker(&ashmem_shrinker);
 
 	ret = misc_deregister(&ashmem_misc);
@@ -32,6 +32,7 @@ enum {
 	BINDER_TYPE_HANDLE	= B_PACK_CHARS('s', 'h', '*', B_TYPE_LARGE),
 	BINDER_TYPE_WEAK_HANDLE	= B_PACK_CHARS('w', 'h', '*', B_TYPE_LARGE),
 	BINDER_TYPE_FD		= B_PACK_CHARS('f', 'd', '*', B_TYPE_LARGE),
+	BINDER_TYPE_PTR		= B_PACK_CHARS('p', 't', '*', B_TYPE_LARGE),
 };
 
 enum {
@@ -61,6 +62,32 @@ struct flat_binder_object {
 	void			*cookie;
 };
 
+/*
+ * A buffer in the sender's address space, sent with BC_TRANSACTION_SG or
+ * BC_REPLY_SG.  The driver copies it straight into the target's
+ * transaction buffer, after the offsets, and rewrites 'buffer' to point
+ * at the copy.  This saves flattening large payloads into the main data
+ * buffer first.
+ *
+ * If BINDER_BUFFER_FLAG_HAS_PARENT is set, the driver also stores the new
+ * address at 'parent_offset' bytes into the copy of the buffer object
+ * found at index 'parent' of the offsets array.  That object must come
+ * earlier in the offsets array.  Fixups into the same parent must be
+ * made in increasing offset order.
+ */
+struct binder_buffer_object {
+	unsigned long		type;		/* BINDER_TYPE_PTR */
+	unsigned long		flags;
+	void			*buffer;
+	size_t			length;
+	size_t			parent;
+	size_t			parent_offset;
+};
+
+enum {
+	BINDER_BUFFER_FLAG_HAS_PARENT = 0x01,
+};
+
 /*
  * On 64-bit platforms where user code may run in 32-bits the driver must
  * translate the buffer (and local binder) addresses apropriately.
@@ -147,6 +174,12 @@ struct binder_transaction_data {
 	} data;
 };
 
+struct binder_transaction_data_sg {
+	struct binder_transaction_data transaction_data;
+	/* total size of all BINDER_TYPE_PTR buffers, each 8-byte aligned */
+	size_t		buffers_size;
+};
+
 struct binder_ptr_cookie {
 	void *ptr;
 	void *cookie;
@@ -324,6 +357,13 @@ enum BinderDriverCommandProtocol {
 	/*
 	 * void *: cookie
 	 */
+
+	BC_TRANSACTION_SG = _IOW('c', 17, struct binder_transaction_data_sg),
+	BC_REPLY_SG = _IOW('c', 18, struct binder_transaction_data_sg),
+	/*
+	 * binder_transaction_data_sg: the sent command, whose objects may
+	 * include BINDER_TYPE_PTR buffers.
+	 */
 };
 
 #endif /* _LINUX_BINDER_H */
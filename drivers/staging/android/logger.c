@@ -25,25 +25,52 @@
 #include <linux/poll.h>
 #include <linux/slab.h>
 #include <linux/time.h>
+#include <linux/log2.h>
+#include <linux/pagemap.h>
+#include <linux/percpu.h>
+#include <linux/spinlock.h>
+#include <linux/vmalloc.h>
 #include "logger.h"
 
 #include <asm/ioctls.h>
 
+/* An entry as stored in the log: header plus the largest payload */
+#define LOGGER_ENTRY_MAX_LEN \
+	(sizeof(struct logger_entry) + LOGGER_ENTRY_MAX_PAYLOAD)
+
+/* Smallest per-cpu ring; used if the log split across cpus is smaller */
+#define LOGGER_RING_MIN_SIZE	(16 * 1024)
+
+/*
+ * struct logger_ring - one cpu's share of a log
+ *
+ * Writers append to the ring of the cpu they run on, with preemption
+ * disabled, so the lock is only ever contended by readers.  Positions are
+ * free running byte counts; the offset into 'buffer' is taken modulo the
+ * (power of two) size.  Entries between 'head' and 'w_pos' are intact; a
+ * writer about to overwrite the oldest entries moves 'head' past them,
+ * and readers that find themselves behind 'head' were lapped.
+ */
+struct logger_ring {
+	spinlock_t		lock;	/* protects everything below */
+	unsigned char		*buffer;/* the ring buffer itself */
+	size_t			size;	/* size of the ring */
+	size_t			w_pos;	/* current write position */
+	size_t			head;	/* oldest intact entry */
+} ____cacheline_aligned_in_smp;
+
 /*
  * struct logger_log - represents a specific log, such as 'main' or 'radio'
  *
  * This structure lives from module insertion until module removal, so it does
- * not need additional reference counting. The structure is protected by the
- * mutex 'mutex'.
+ * not need additional reference counting.  The log is split into one ring per
+ * possible cpu, carved out of 'buffer'.
  */
 struct logger_log {
-	unsigned char		*buffer;/* the ring buffer itself */
+	unsigned char		*buffer;/* backing store for the rings */
 	struct miscdevice	misc;	/* misc device representing the log */
 	wait_queue_head_t	wq;	/* wait queue for readers */
-	struct list_head	readers; /* this log's readers */
-	struct mutex		mutex;	/* mutex protecting buffer */
-	size_t			w_off;	/* current write head offset */
-	size_t			head;	/* new readers start here */
+	struct logger_ring __percpu *rings; /* per-cpu rings */
 	size_t			size;	/* size of the log */
 };
 
@@ -51,22 +78,31 @@ struct logger_log {
  * struct logger_reader - a logging device open for reading
  *
  * This object lives from open to release, so we don't need additional
- * reference counting. The structure is protected by log->mutex.
+ * reference counting. The structure is protected by 'mutex'.
+ *
+ * Entries are returned in timestamp order, merged across the rings: each
+ * read takes the oldest entry at the readers' positions in the rings.
  */
 struct logger_reader {
 	struct logger_log	*log;	/* associated log */
-	struct list_head	list;	/* entry in logger_log's list */
-	size_t			r_off;	/* current read head offset */
+	struct mutex		mutex;	/* serializes reads on this file */
+	size_t			*r_pos;	/* read position, per ring */
+	unsigned char		*entry;	/* bounce buffer, one entry */
 	bool			r_all;	/* reader can read all entries */
 	int			r_ver;	/* reader ABI version */
 };
 
-/* logger_offset - returns index 'n' into the log via (optimized) modulus */
-size_t logger_offset(struct logger_log *log, size_t n)
+/* logger_offset - returns index 'n' into the ring via (optimized) modulus */
+static inline size_t logger_offset(struct logger_ring *ring, size_t n)
 {
-	return n & (log->size-1);
+	return n & (ring->size - 1);
 }
 
+/* is position 'a' before position 'b', accounting for wrapping counters */
+static inline bool logger_pos_before(size_t a, size_t b)
+{
+	return (ssize_t)(a - b) < 0;
+}
 
 /*
  * file_get_log - Given a file structure, return the associated log
@@ -92,43 +128,56 @@ static inline struct logger_log *file_get_log(struct file *file)
 }
 
 /*
- * get_entry_header - returns a pointer to the logger_entry header within
- * 'log' starting at offset 'off'. A temporary logger_entry 'scratch' must
+ * ring_read - copies 'len' bytes at position 'pos' of 'ring' to 'buf'.
+ *
+ * Caller needs to hold ring->lock.
+ */
+static void ring_read(struct logger_ring *ring, size_t pos, void *buf,
+		      size_t len)
+{
+	size_t off = logger_offset(ring, pos);
+	size_t n = min(len, ring->size - off);
+
+	memcpy(buf, ring->buffer + off, n);
+	if (len != n)
+		memcpy(buf + n, ring->buffer, len - n);
+}
+
+/*
+ * get_entry_header - returns a pointer to the logger_entry header at
+ * position 'pos' of 'ring'. A temporary logger_entry 'scratch' must
  * be provided. Typically the return value will be a pointer within
- * 'logger->buf'.  However, a pointer to 'scratch' may be returned if
+ * 'ring->buffer'.  However, a pointer to 'scratch' may be returned if
  * the log entry spans the end and beginning of the circular buffer.
+ *
+ * Caller needs to hold ring->lock.
  */
-static struct logger_entry *get_entry_header(struct logger_log *log,
-		size_t off, struct logger_entry *scratch)
+static struct logger_entry *get_entry_header(struct logger_ring *ring,
+		size_t pos, struct logger_entry *scratch)
 {
-	size_t len = min(sizeof(struct logger_entry), log->size - off);
-	if (len != sizeof(struct logger_entry)) {
-		memcpy(((void *) scratch), log->buffer + off, len);
-		memcpy(((void *) scratch) + len, log->buffer,
-			sizeof(struct logger_entry) - len);
+	size_t off = logger_offset(ring, pos);
+
+	if (ring->size - off < sizeof(struct logger_entry)) {
+		ring_read(ring, pos, scratch, sizeof(struct logger_entry));
 		return scratch;
 	}
 
-	return (struct logger_entry *) (log->buffer + off);
+	return (struct logger_entry *) (ring->buffer + off);
 }
 
 /*
- * get_entry_msg_len - Grabs the length of the message of the entry
- * starting from from 'off'.
- *
- * An entry length is 2 bytes (16 bits) in host endian order.
- * In the log, the length does not include the size of the log entry structure.
- * This function returns the size including the log entry structure.
+ * get_entry_len - Grabs the length of the entry at position 'pos',
+ * including the log entry structure.
  *
- * Caller needs to hold log->mutex.
+ * Caller needs to hold ring->lock.
  */
-static __u32 get_entry_msg_len(struct logger_log *log, size_t off)
+static size_t get_entry_len(struct logger_ring *ring, size_t pos)
 {
 	struct logger_entry scratch;
 	struct logger_entry *entry;
 
-	entry = get_entry_header(log, off, &scratch);
-	return entry->len;
+	entry = get_entry_header(ring, pos, &scratch);
+	return sizeof(struct logger_entry) + entry->len;
 }
 
 static size_t get_user_hdr_len(int ver)
@@ -164,79 +213,147 @@ static ssize_t copy_header_to_user(int ver, struct logger_entry *entry,
 }
 
 /*
- * do_read_log_to_user - reads exactly 'count' bytes from 'log' into the
- * user-space buffer 'buf'. Returns 'count' on success.
+ * reader_sync - brings the reader's position 'pos' in 'ring' up to date:
+ * forward to the head if it was lapped, and past entries it may not see.
+ * Returns true if there is an entry to read at the new position.
  *
- * Caller must hold log->mutex.
+ * Caller needs to hold ring->lock.
  */
-static ssize_t do_read_log_to_user(struct logger_log *log,
-				   struct logger_reader *reader,
-				   char __user *buf,
-				   size_t count)
+static bool reader_sync(struct logger_reader *reader, struct logger_ring *ring,
+			size_t *pos)
 {
 	struct logger_entry scratch;
 	struct logger_entry *entry;
-	size_t len;
-	size_t msg_start;
+	uid_t euid = current_euid();
 
-	/*
-	 * First, copy the header to userspace, using the version of
-	 * the header requested
-	 */
-	entry = get_entry_header(log, reader->r_off, &scratch);
-	if (copy_header_to_user(reader->r_ver, entry, buf))
-		return -EFAULT;
+	if (logger_pos_before(*pos, ring->head))
+		*pos = ring->head;
 
-	count -= get_user_hdr_len(reader->r_ver);
-	buf += get_user_hdr_len(reader->r_ver);
-	msg_start = logger_offset(log,
-		reader->r_off + sizeof(struct logger_entry));
+	while (*pos != ring->w_pos) {
+		if (reader->r_all)
+			return true;
 
-	/*
-	 * We read from the msg in two disjoint operations. First, we read from
-	 * the current msg head offset up to 'count' bytes or to the end of
-	 * the log, whichever comes first.
-	 */
-	len = min(count, log->size - msg_start);
-	if (copy_to_user(buf, log->buffer + msg_start, len))
-		return -EFAULT;
+		entry = get_entry_header(ring, *pos, &scratch);
+		if (entry->euid == euid)
+			return true;
 
-	/*
-	 * Second, we read any remaining bytes, starting back at the head of
-	 * the log.
-	 */
-	if (count != len)
-		if (copy_to_user(buf + len, log->buffer, count - len))
-			return -EFAULT;
+		*pos += sizeof(struct logger_entry) + entry->len;
+	}
+
+	return false;
+}
 
-	reader->r_off = logger_offset(log, reader->r_off +
-		sizeof(struct logger_entry) + count);
+/*
+ * reader_peek - if there is an entry at the reader's position in the ring
+ * of 'cpu' and it is older than 'hdr' (or 'any' is set), copies its header
+ * to 'hdr' and returns true.
+ *
+ * Caller needs to hold reader->mutex.
+ */
+static bool reader_peek(struct logger_reader *reader, int cpu,
+			struct logger_entry *hdr, bool any)
+{
+	struct logger_ring *ring = per_cpu_ptr(reader->log->rings, cpu);
+	struct logger_entry scratch;
+	struct logger_entry *entry;
+	bool older = false;
+
+	spin_lock(&ring->lock);
+	if (reader_sync(reader, ring, &reader->r_pos[cpu])) {
+		entry = get_entry_header(ring, reader->r_pos[cpu], &scratch);
+		older = any || entry->sec < hdr->sec ||
+			(entry->sec == hdr->sec && entry->nsec < hdr->nsec);
+		if (older)
+			*hdr = *entry;
+	}
+	spin_unlock(&ring->lock);
 
-	return count + get_user_hdr_len(reader->r_ver);
+	return older;
 }
 
 /*
- * get_next_entry_by_uid - Starting at 'off', returns an offset into
- * 'log->buffer' which contains the first entry readable by 'euid'
+ * reader_next - finds the ring holding the oldest entry readable by
+ * 'reader' and copies that entry's header to 'hdr'. Returns the cpu of
+ * the ring, or -1 if there is nothing to read.
+ *
+ * A ring looked at before the one holding the candidate may since have
+ * had an older entry committed, e.g. by a task that then migrated and
+ * wrote the candidate, so the other rings are looked at again until the
+ * candidate holds up.
+ *
+ * Caller needs to hold reader->mutex.
  */
-static size_t get_next_entry_by_uid(struct logger_log *log,
-		size_t off, uid_t euid)
+static int reader_next(struct logger_reader *reader, struct logger_entry *hdr)
 {
-	while (off != log->w_off) {
-		struct logger_entry *entry;
-		struct logger_entry scratch;
-		size_t next_len;
+	int cpu, best = -1;
+	bool changed;
 
-		entry = get_entry_header(log, off, &scratch);
+	for_each_possible_cpu(cpu)
+		if (reader_peek(reader, cpu, hdr, best < 0))
+			best = cpu;
 
-		if (entry->euid == euid)
-			return off;
+	if (best < 0)
+		return -1;
+
+	do {
+		changed = false;
+		for_each_possible_cpu(cpu) {
+			if (cpu != best && reader_peek(reader, cpu, hdr, false)) {
+				best = cpu;
+				changed = true;
+			}
+		}
+	} while (changed);
+
+	return best;
+}
 
-		next_len = sizeof(struct logger_entry) + entry->len;
-		off = logger_offset(log, off + next_len);
+/*
+ * do_read_log_to_user - reads the entry at the reader's position in the
+ * ring of 'cpu' into the user-space buffer 'buf'. Returns the number of
+ * bytes read, -EINVAL if 'count' is too small for the entry, or 0 if the
+ * entry was overwritten since reader_next() found it.
+ *
+ * Caller must hold reader->mutex.
+ */
+static ssize_t do_read_log_to_user(struct logger_reader *reader, int cpu,
+				   char __user *buf, size_t count)
+{
+	struct logger_ring *ring = per_cpu_ptr(reader->log->rings, cpu);
+	struct logger_entry *entry = (struct logger_entry *) reader->entry;
+	size_t hdr_len = get_user_hdr_len(reader->r_ver);
+	size_t pos = reader->r_pos[cpu];
+	size_t len;
+
+	/*
+	 * Copy the entry out under the lock, so that a writer lapping us
+	 * can't change it underneath copy_to_user().
+	 */
+	spin_lock(&ring->lock);
+	if (logger_pos_before(pos, ring->head)) {
+		spin_unlock(&ring->lock);
+		return 0;
 	}
+	len = get_entry_len(ring, pos);
+	if (count < hdr_len + len - sizeof(struct logger_entry)) {
+		spin_unlock(&ring->lock);
+		return -EINVAL;
+	}
+	ring_read(ring, pos, entry, len);
+	spin_unlock(&ring->lock);
+
+	/*
+	 * Copy the header to userspace, using the version of the header
+	 * requested, followed by the payload.
+	 */
+	if (copy_header_to_user(reader->r_ver, entry, buf))
+		return -EFAULT;
+	if (copy_to_user(buf + hdr_len, entry->msg, entry->len))
+		return -EFAULT;
+
+	reader->r_pos[cpu] = pos + len;
 
-	return off;
+	return hdr_len + entry->len;
 }
 
 /*
@@ -247,6 +364,7 @@ static size_t get_next_entry_by_uid(struct logger_log *log,
  *	- O_NONBLOCK works
  *	- If there are no log entries to read, blocks until log is written to
  *	- Atomically reads exactly one log entry
+ *	- Entries from all cpus come out in timestamp order
  *
  * Will set errno to EINVAL if read
  * buffer is insufficient to hold next entry.
@@ -256,18 +374,20 @@ static ssize_t logger_read(struct file *file, char __user *buf,
 {
 	struct logger_reader *reader = file->private_data;
 	struct logger_log *log = reader->log;
+	struct logger_entry hdr;
 	ssize_t ret;
+	int cpu;
 	DEFINE_WAIT(wait);
 
 start:
 	while (1) {
-		mutex_lock(&log->mutex);
+		mutex_lock(&reader->mutex);
 
 		prepare_to_wait(&log->wq, &wait, TASK_INTERRUPTIBLE);
 
-		ret = (log->w_off == reader->r_off);
-		mutex_unlock(&log->mutex);
-		if (!ret)
+		cpu = reader_next(reader, &hdr);
+		mutex_unlock(&reader->mutex);
+		if (cpu >= 0)
 			break;
 
 		if (file->f_flags & O_NONBLOCK) {
@@ -284,180 +404,114 @@ start:
 	}
 
 	finish_wait(&log->wq, &wait);
-	if (ret)
+	if (cpu < 0)
 		return ret;
 
-	mutex_lock(&log->mutex);
-
-	if (!reader->r_all)
-		reader->r_off = get_next_entry_by_uid(log,
-			reader->r_off, current_euid());
+	mutex_lock(&reader->mutex);
 
 	/* is there still something to read or did we race? */
-	if (unlikely(log->w_off == reader->r_off)) {
-		mutex_unlock(&log->mutex);
+	cpu = reader_next(reader, &hdr);
+	if (unlikely(cpu < 0)) {
+		mutex_unlock(&reader->mutex);
 		goto start;
 	}
 
-	/* get the size of the next entry */
-	ret = get_user_hdr_len(reader->r_ver) +
-		get_entry_msg_len(log, reader->r_off);
-	if (count < ret) {
-		ret = -EINVAL;
-		goto out;
-	}
-
 	/* get exactly one entry from the log */
-	ret = do_read_log_to_user(log, reader, buf, ret);
-
-out:
-	mutex_unlock(&log->mutex);
-
-	return ret;
-}
-
-/*
- * get_next_entry - return the offset of the first valid entry at least 'len'
- * bytes after 'off'.
- *
- * Caller must hold log->mutex.
- */
-static size_t get_next_entry(struct logger_log *log, size_t off, size_t len)
-{
-	size_t count = 0;
+	ret = do_read_log_to_user(reader, cpu, buf, count);
 
-	do {
-		size_t nr = sizeof(struct logger_entry) +
-			get_entry_msg_len(log, off);
-		off = logger_offset(log, off + nr);
-		count += nr;
-	} while (count < len);
-
-	return off;
-}
+	mutex_unlock(&reader->mutex);
 
-/*
- * is_between - is a < c < b, accounting for wrapping of a, b, and c
- *    positions in the buffer
- *
- * That is, if a<b, check for c between a and b
- * and if a>b, check for c outside (not between) a and b
- *
- * |------- a xxxxxxxx b --------|
- *               c^
- *
- * |xxxxx b --------- a xxxxxxxxx|
- *    c^
- *  or                    c^
- */
-static inline int is_between(size_t a, size_t b, size_t c)
-{
-	if (a < b) {
-		/* is c between a and b? */
-		if (a < c && c <= b)
-			return 1;
-	} else {
-		/* is c outside of b through a? */
-		if (c <= b || a < c)
-			return 1;
-	}
+	/* lapped between finding the entry and reading it */
+	if (unlikely(!ret))
+		goto start;
 
-	return 0;
+	return ret;
 }
 
 /*
- * fix_up_readers - walk the list of all readers and "fix up" any who were
- * lapped by the writer; also do the same for the default "start head".
- * We do this by "pulling forward" the readers and start head to the first
- * entry after the new write head.
+ * make_room - moves the head of 'ring' past the entries that an entry of
+ * 'len' bytes at the write position would overwrite. Readers still
+ * pointing at them are pulled forward when they next look at the ring.
  *
- * The caller needs to hold log->mutex.
+ * The caller needs to hold ring->lock.
  */
-static void fix_up_readers(struct logger_log *log, size_t len)
+static void make_room(struct logger_ring *ring, size_t len)
 {
-	size_t old = log->w_off;
-	size_t new = logger_offset(log, old + len);
-	struct logger_reader *reader;
-
-	if (is_between(old, new, log->head))
-		log->head = get_next_entry(log, log->head, len);
-
-	list_for_each_entry(reader, &log->readers, list)
-		if (is_between(old, new, reader->r_off))
-			reader->r_off = get_next_entry(log, reader->r_off, len);
+	while (ring->w_pos + len - ring->head > ring->size)
+		ring->head += get_entry_len(ring, ring->head);
 }
 
 /*
- * do_write_log - writes 'len' bytes from 'buf' to 'log'
+ * do_write_log - writes 'count' bytes from 'buf' to 'ring' at 'pos'
  *
- * The caller needs to hold log->mutex.
+ * The caller needs to hold ring->lock.
  */
-static void do_write_log(struct logger_log *log, const void *buf, size_t count)
+static void do_write_log(struct logger_ring *ring, size_t pos,
+			 const void *buf, size_t count)
 {
+	size_t off = logger_offset(ring, pos);
 	size_t len;
 
-	len = min(count, log->size - log->w_off);
-	memcpy(log->buffer + log->w_off, buf, len);
+	len = min(count, ring->size - off);
+	memcpy(ring->buffer + off, buf, len);
 
 	if (count != len)
-		memcpy(log->buffer, buf + len, count - len);
-
-	log->w_off = logger_offset(log, log->w_off + count);
-
+		memcpy(ring->buffer, buf + len, count - len);
 }
 
 /*
- * do_write_log_user - writes 'len' bytes from the user-space buffer 'buf' to
- * the log 'log'
+ * do_write_log_from_user - writes 'count' bytes from the user-space buffer
+ * 'buf' to 'ring' at 'pos'. Page faults must be disabled, and the buffer
+ * checked with access_ok().
  *
- * The caller needs to hold log->mutex.
+ * The caller needs to hold ring->lock.
  *
- * Returns 'count' on success, negative error code on failure.
+ * Returns zero on success, non-zero if part of 'buf' was not resident.
  */
-static ssize_t do_write_log_from_user(struct logger_log *log,
-				      const void __user *buf, size_t count)
+static size_t do_write_log_from_user(struct logger_ring *ring, size_t pos,
+				     const void __user *buf, size_t count)
 {
+	size_t off = logger_offset(ring, pos);
 	size_t len;
 
-	len = min(count, log->size - log->w_off);
-	if (len && copy_from_user(log->buffer + log->w_off, buf, len))
-		return -EFAULT;
+	len = min(count, ring->size - off);
+	if (len && __copy_from_user_inatomic(ring->buffer + off, buf, len))
+		return len;
 
 	if (count != len)
-		if (copy_from_user(log->buffer, buf + len, count - len))
-			/*
-			 * Note that by not updating w_off, this abandons the
-			 * portion of the new entry that *was* successfully
-			 * copied, just above.  This is intentional to avoid
-			 * message corruption from missing fragments.
-			 */
-			return -EFAULT;
+		return __copy_from_user_inatomic(ring->buffer, buf + len,
+						 count - len);
 
-	log->w_off = logger_offset(log, log->w_off + count);
-
-	return count;
+	return 0;
 }
 
 /*
  * logger_aio_write - our write method, implementing support for write(),
  * writev(), and aio_write(). Writes are our fast path, and we try to optimize
  * them above all else.
+ *
+ * The entry goes to the ring of the cpu we are running on, so writers on
+ * different cpus never touch the same lock or cache lines. The payload is
+ * copied with preemption and page faults disabled, one user page at a time,
+ * making room for each piece just before it is copied; if a page is not
+ * resident, the entry is abandoned, the page faulted in, and the write
+ * retried. Only the entries overwritten by what was copied are lost.
  */
 ssize_t logger_aio_write(struct kiocb *iocb, const struct iovec *iov,
 			 unsigned long nr_segs, loff_t ppos)
 {
 	struct logger_log *log = file_get_log(iocb->ki_filp);
-	size_t orig = log->w_off;
+	struct logger_ring *ring;
 	struct logger_entry header;
+	const struct iovec *seg;
+	const char __user *buf = NULL;
 	struct timespec now;
+	unsigned long n;
+	size_t pos, len, chunk = 0;
 	ssize_t ret = 0;
 
-	now = current_kernel_time();
-
 	header.pid = current->tgid;
 	header.tid = current->pid;
-	header.sec = now.tv_sec;
-	header.nsec = now.tv_nsec;
 	header.euid = current_euid();
 	header.len = min_t(size_t, iocb->ki_left, LOGGER_ENTRY_MAX_PAYLOAD);
 	header.hdr_size = sizeof(struct logger_entry);
@@ -466,41 +520,75 @@ ssize_t logger_aio_write(struct kiocb *iocb, const struct iovec *iov,
 	if (unlikely(!header.len))
 		return 0;
 
-	mutex_lock(&log->mutex);
+	for (seg = iov, n = nr_segs; n && ret < header.len; seg++, n--) {
+		len = min_t(size_t, seg->iov_len, header.len - ret);
+		if (!access_ok(VERIFY_READ, seg->iov_base, len))
+			return -EFAULT;
+		ret += len;
+	}
+
+retry:
+	ring = get_cpu_ptr(log->rings);
+	spin_lock(&ring->lock);
+
+	/* readers merge the rings by timestamp, so it must be fine grained */
+	getnstimeofday(&now);
+	header.sec = now.tv_sec;
+	header.nsec = now.tv_nsec;
 
 	/*
-	 * Fix up any readers, pulling them forward to the first readable
-	 * entry after (what will be) the new write offset. We do this now
-	 * because if we partially fail, we can end up with clobbered log
-	 * entries that encroach on readable buffer.
+	 * Make room before each copy, so that if we partially fail we don't
+	 * leave clobbered entries between head and the write position, but
+	 * never for more than we are about to write.
 	 */
-	fix_up_readers(log, sizeof(struct logger_entry) + header.len);
+	make_room(ring, sizeof(struct logger_entry));
 
-	do_write_log(log, &header, sizeof(struct logger_entry));
-
-	while (nr_segs-- > 0) {
-		size_t len;
-		ssize_t nr;
+	pos = ring->w_pos;
+	do_write_log(ring, pos, &header, sizeof(struct logger_entry));
+	pos += sizeof(struct logger_entry);
 
+	pagefault_disable();
+	for (seg = iov, n = nr_segs, ret = 0; n && ret < header.len;
+	     seg++, n--) {
 		/* figure out how much of this vector we can keep */
-		len = min_t(size_t, iov->iov_len, header.len - ret);
-
-		/* write out this segment's payload */
-		nr = do_write_log_from_user(log, iov->iov_base, len);
-		if (unlikely(nr < 0)) {
-			log->w_off = orig;
-			mutex_unlock(&log->mutex);
-			return nr;
+		len = min_t(size_t, seg->iov_len, header.len - ret);
+
+		/* write out this segment's payload, a user page at a time */
+		for (buf = seg->iov_base; len; buf += chunk, len -= chunk) {
+			chunk = min_t(size_t, len,
+				      PAGE_SIZE - offset_in_page(buf));
+			make_room(ring, pos + chunk - ring->w_pos);
+			if (unlikely(do_write_log_from_user(ring, pos, buf,
+							    chunk)))
+				goto fault;
+
+			pos += chunk;
+			ret += chunk;
 		}
-
-		iov++;
-		ret += nr;
 	}
+fault:
+	pagefault_enable();
+
+	/*
+	 * Note that by not updating w_pos on failure, this abandons the
+	 * portion of the new entry that *was* successfully copied.
+	 */
+	if (likely(ret == header.len))
+		ring->w_pos = pos;
 
-	mutex_unlock(&log->mutex);
+	spin_unlock(&ring->lock);
+	put_cpu_ptr(log->rings);
 
-	/* wake up any blocked readers */
-	wake_up_interruptible(&log->wq);
+	if (unlikely(ret != header.len)) {
+		if (fault_in_pages_readable(buf, chunk))
+			return -EFAULT;
+		goto retry;
+	}
+
+	/* wake up any blocked readers; pairs with prepare_to_wait() */
+	smp_mb();
+	if (waitqueue_active(&log->wq))
+		wake_up_interruptible(&log->wq);
 
 	return ret;
 }
@@ -527,22 +615,35 @@ static int logger_open(struct inode *inode, struct file *file)
 
 	if (file->f_mode & FMODE_READ) {
 		struct logger_reader *reader;
+		int cpu;
 
 		reader = kmalloc(sizeof(struct logger_reader), GFP_KERNEL);
 		if (!reader)
 			return -ENOMEM;
 
+		reader->r_pos = kcalloc(nr_cpu_ids, sizeof(size_t),
+					GFP_KERNEL);
+		reader->entry = kmalloc(LOGGER_ENTRY_MAX_LEN, GFP_KERNEL);
+		if (!reader->r_pos || !reader->entry) {
+			kfree(reader->entry);
+			kfree(reader->r_pos);
+			kfree(reader);
+			return -ENOMEM;
+		}
+
 		reader->log = log;
 		reader->r_ver = 1;
 		reader->r_all = in_egroup_p(inode->i_gid) ||
 			capable(CAP_SYSLOG);
+		mutex_init(&reader->mutex);
 
-		INIT_LIST_HEAD(&reader->list);
+		for_each_possible_cpu(cpu) {
+			struct logger_ring *ring = per_cpu_ptr(log->rings, cpu);
 
-		mutex_lock(&log->mutex);
-		reader->r_off = log->head;
-		list_add_tail(&reader->list, &log->readers);
-		mutex_unlock(&log->mutex);
+			spin_lock(&ring->lock);
+			reader->r_pos[cpu] = ring->head;
+			spin_unlock(&ring->lock);
+		}
 
 		file->private_data = reader;
 	} else
@@ -560,12 +661,9 @@ static int logger_release(struct inode *ignored, struct file *file)
 {
 	if (file->f_mode & FMODE_READ) {
 		struct logger_reader *reader = file->private_data;
-		struct logger_log *log = reader->log;
-
-		mutex_lock(&log->mutex);
-		list_del(&reader->list);
-		mutex_unlock(&log->mutex);
 
+		kfree(reader->entry);
+		kfree(reader->r_pos);
 		kfree(reader);
 	}
 
@@ -585,6 +683,7 @@ static unsigned int logger_poll(struct file *file, poll_table *wait)
 {
 	struct logger_reader *reader;
 	struct logger_log *log;
+	struct logger_entry hdr;
 	unsigned int ret = POLLOUT | POLLWRNORM;
 
 	if (!(file->f_mode & FMODE_READ))
@@ -595,14 +694,10 @@ static unsigned int logger_poll(struct file *file, poll_table *wait)
 
 	poll_wait(file, &log->wq, wait);
 
-	mutex_lock(&log->mutex);
-	if (!reader->r_all)
-		reader->r_off = get_next_entry_by_uid(log,
-			reader->r_off, current_euid());
-
-	if (log->w_off != reader->r_off)
+	mutex_lock(&reader->mutex);
+	if (reader_next(reader, &hdr) >= 0)
 		ret |= POLLIN | POLLRDNORM;
-	mutex_unlock(&log->mutex);
+	mutex_unlock(&reader->mutex);
 
 	return ret;
 }
@@ -623,11 +718,16 @@ static long logger_set_version(struct logger_reader *reader, void __user *arg)
 static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 {
 	struct logger_log *log = file_get_log(file);
-	struct logger_reader *reader;
+	struct logger_reader *reader = NULL;
+	struct logger_entry hdr;
 	long ret = -EINVAL;
 	void __user *argp = (void __user *) arg;
+	int cpu;
 
-	mutex_lock(&log->mutex);
+	if (file->f_mode & FMODE_READ) {
+		reader = file->private_data;
+		mutex_lock(&reader->mutex);
+	}
 
 	switch (cmd) {
 	case LOGGER_GET_LOG_BUF_SIZE:
@@ -638,26 +738,24 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 			ret = -EBADF;
 			break;
 		}
-		reader = file->private_data;
-		if (log->w_off >= reader->r_off)
-			ret = log->w_off - reader->r_off;
-		else
-			ret = (log->size - reader->r_off) + log->w_off;
+		ret = 0;
+		for_each_possible_cpu(cpu) {
+			struct logger_ring *ring = per_cpu_ptr(log->rings, cpu);
+
+			spin_lock(&ring->lock);
+			if (logger_pos_before(reader->r_pos[cpu], ring->head))
+				reader->r_pos[cpu] = ring->head;
+			ret += ring->w_pos - reader->r_pos[cpu];
+			spin_unlock(&ring->lock);
+		}
 		break;
 	case LOGGER_GET_NEXT_ENTRY_LEN:
 		if (!(file->f_mode & FMODE_READ)) {
 			ret = -EBADF;
 			break;
 		}
-		reader = file->private_data;
-
-		if (!reader->r_all)
-			reader->r_off = get_next_entry_by_uid(log,
-				reader->r_off, current_euid());
-
-		if (log->w_off != reader->r_off)
-			ret = get_user_hdr_len(reader->r_ver) +
-				get_entry_msg_len(log, reader->r_off);
+		if (reader_next(reader, &hdr) >= 0)
+			ret = get_user_hdr_len(reader->r_ver) + hdr.len;
 		else
 			ret = 0;
 		break;
@@ -671,9 +769,14 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 			ret = -EPERM;
 			break;
 		}
-		list_for_each_entry(reader, &log->readers, list)
-			reader->r_off = log->w_off;
-		log->head = log->w_off;
+		/* readers catch up with the head the next time they look */
+		for_each_possible_cpu(cpu) {
+			struct logger_ring *ring = per_cpu_ptr(log->rings, cpu);
+
+			spin_lock(&ring->lock);
+			ring->head = ring->w_pos;
+			spin_unlock(&ring->lock);
+		}
 		ret = 0;
 		break;
 	case LOGGER_GET_VERSION:
@@ -681,7 +784,6 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 			ret = -EBADF;
 			break;
 		}
-		reader = file->private_data;
 		ret = reader->r_ver;
 		break;
 	case LOGGER_SET_VERSION:
@@ -689,12 +791,12 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 			ret = -EBADF;
 			break;
 		}
-		reader = file->private_data;
 		ret = logger_set_version(reader, argp);
 		break;
 	}
 
-	mutex_unlock(&log->mutex);
+	if (reader)
+		mutex_unlock(&reader->mutex);
 
 	return ret;
 }
@@ -712,8 +814,9 @@ static const struct file_operations logger_fops = {
 
 /*
  * Defines a log structure with name 'NAME' and a size of 'SIZE' bytes, which
- * must be a power of two, and greater than
- * (LOGGER_ENTRY_MAX_PAYLOAD + sizeof(struct logger_entry)).
+ * must be a power of two. The log is split evenly between the possible cpus;
+ * if that leaves less than LOGGER_RING_MIN_SIZE each, the rings are allocated
+ * separately instead.
  */
 #define DEFINE_LOGGER_DEVICE(VAR, NAME, SIZE) \
 static unsigned char _buf_ ## VAR[SIZE]; \
@@ -726,10 +829,6 @@ static struct logger_log VAR = { \
 		.parent = NULL, \
 	}, \
 	.wq = __WAIT_QUEUE_HEAD_INITIALIZER(VAR .wq), \
-	.readers = LIST_HEAD_INIT(VAR .readers), \
-	.mutex = __MUTEX_INITIALIZER(VAR .mutex), \
-	.w_off = 0, \
-	.head = 0, \
 	.size = SIZE, \
 };
 
@@ -751,10 +850,62 @@ static struct logger_log *get_log_from_minor(int minor)
 	return NULL;
 }
 
+static int __init init_log_rings(struct logger_log *log)
+{
+	unsigned char *buffer = log->buffer;
+	size_t ring_size;
+	int cpu;
+
+	log->rings = alloc_percpu(struct logger_ring);
+	if (!log->rings)
+		return -ENOMEM;
+
+	ring_size = log->size / num_possible_cpus();
+	if (ring_size >= LOGGER_RING_MIN_SIZE) {
+		ring_size = rounddown_pow_of_two(ring_size);
+	} else {
+		ring_size = LOGGER_RING_MIN_SIZE;
+		buffer = NULL;
+	}
+
+	for_each_possible_cpu(cpu) {
+		struct logger_ring *ring = per_cpu_ptr(log->rings, cpu);
+
+		spin_lock_init(&ring->lock);
+		ring->size = ring_size;
+		if (buffer) {
+			ring->buffer = buffer;
+			buffer += ring_size;
+		} else {
+			ring->buffer = vmalloc(ring_size);
+			if (!ring->buffer)
+				goto out_free;
+		}
+	}
+
+	log->size = ring_size * num_possible_cpus();
+	return 0;
+
+out_free:
+	if (!buffer)
+		for_each_possible_cpu(cpu)
+			vfree(per_cpu_ptr(log->rings, cpu)->buffer);
+	free_percpu(log->rings);
+	log->rings = NULL;
+	return -ENOMEM;
+}
+
 static int __init init_log(struct logger_log *log)
 {
 	int ret;
 
+	ret = init_log_rings(log);
+	if (unlikely(ret)) {
+		printk(KERN_ERR "logger: failed to allocate log '%s'!\n",
+		       log->misc.name);
+		return ret;
+	}
+
 	ret = misc_register(&log->misc);
 	if (unlikely(ret)) {
 		printk(KERN_ERR "logger: failed to register misc "
@@ -762,8 +913,9 @@ static int __init init_log(struct logger_log *log)
 		return ret;
 	}
 
-	printk(KERN_INFO "logger: created %luK log '%s'\n",
-	       (unsigned long) log->size >> 10, log->misc.name);
+	printk(KERN_INFO "logger: created %luK log '%s', %luK per cpu\n",
+	       (unsigned long) log->size >> 10, log->misc.name,
+	       (unsigned long) (log->size / num_possible_cpus()) >> 10);
 
 	return 0;
 }
@@ -17,6 +17,11 @@
  * percentage of the cached memory is locked this can be very inaccurate
  * and processes may not get killed until the normal oom killer is triggered.
  *
+ * With CONFIG_ANDROID_LMK_VMPRESSURE kills are decided when global reclaim
+ * reports medium or critical pressure through mm/vmpressure.c, and the
+ * shrinker only reports.  The lowmemorykiller tracepoints give the time
+ * from the start of pressure to the kill and to the victim being freed.
+ *
  * Copyright (C) 2007-2008 Google, Inc.
  *
  * This software is licensed under the terms of the GNU General Public
@@ -34,12 +39,20 @@
 
 #include <linux/module.h>
 #include <linux/kernel.h>
+#include <linux/bitops.h>
+#include <linux/err.h>
+#include <linux/ktime.h>
 #include <linux/mm.h>
 #include <linux/oom.h>
 #include <linux/sched.h>
+#include <linux/spinlock.h>
 #include <linux/swap.h>
 #include <linux/rcupdate.h>
 #include <linux/notifier.h>
+#include <linux/vmpressure.h>
+
+#define CREATE_TRACE_POINTS
+#include <trace/events/lowmemorykiller.h>
 
 static uint32_t lowmem_debug_level = 1;
 static int lowmem_adj[6] = {
@@ -59,58 +72,198 @@ static int lowmem_minfree_size = 4;
 
 static unsigned long lowmem_deathpending_timeout;
 
+#ifdef CONFIG_ANDROID_LMK_VMPRESSURE
+static bool lowmem_vmpressure = true;
+#else
+#define lowmem_vmpressure	false
+#endif
+
+/*
+ * The last victim, until its task_struct is freed, and when pressure
+ * that led to it started; for the lowmem_kill and lowmem_freed
+ * tracepoints.  Times are ktime_get() in ns, 0 meaning unset.
+ */
+static DEFINE_SPINLOCK(lowmem_victim_lock);
+static struct task_struct *lowmem_victim;
+static int lowmem_victim_rss;
+static s64 lowmem_kill_ns;
+static s64 lowmem_onset_ns;
+
 #define lowmem_print(level, x...)			\
 	do {						\
 		if (lowmem_debug_level >= (level))	\
 			pr_info(x);			\
 	} while (0)
 
-static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
+#ifdef CONFIG_ANDROID_LMK_ADJ_INDEX
+/*
+ * Thread group leaders are kept on one list per oom_score_adj value,
+ * biggest rss first, with a bitmap of the non-empty lists.  Finding a
+ * victim is then a find_last_bit() and a look at the head of that list
+ * rather than a walk of every process.  Entries are refiled when
+ * oom_score_adj is written and on fork and exec; rss is only sampled at
+ * those points, so selection rechecks the first LMK_SCAN_MAX entries of
+ * a list and takes the biggest of them.
+ */
+#define LMK_ADJ_BUCKETS	(OOM_SCORE_ADJ_MAX - OOM_SCORE_ADJ_MIN + 1)
+#define LMK_SCAN_MAX	8
+
+static struct hlist_head lowmem_adj_buckets[LMK_ADJ_BUCKETS];
+static DECLARE_BITMAP(lowmem_adj_map, LMK_ADJ_BUCKETS);
+/*
+ * Taken with interrupts off: __unhash_process() calls in under
+ * write_lock_irq(&tasklist_lock), which interrupts read-lock.
+ */
+static DEFINE_SPINLOCK(lowmem_adj_lock);
+
+static void __lowmem_adj_index_del(struct task_struct *p)
+{
+	int bucket = p->lmk_adj - OOM_SCORE_ADJ_MIN;
+
+	if (hlist_unhashed(&p->lmk_adj_node))
+		return;
+	hlist_del_init(&p->lmk_adj_node);
+	if (hlist_empty(&lowmem_adj_buckets[bucket]))
+		__clear_bit(bucket, lowmem_adj_map);
+}
+
+static void __lowmem_adj_index_add(struct task_struct *p, int adj,
+				   unsigned long rss)
+{
+	int bucket = adj - OOM_SCORE_ADJ_MIN;
+	struct hlist_head *head = &lowmem_adj_buckets[bucket];
+	struct hlist_node *pos, *last = NULL;
+	struct task_struct *t;
+
+	p->lmk_adj = adj;
+	p->lmk_rss = rss;
+	hlist_for_each_entry(t, pos, head, lmk_adj_node) {
+		if (t->lmk_rss < rss) {
+			hlist_add_before(&p->lmk_adj_node, pos);
+			goto out;
+		}
+		last = pos;
+	}
+	if (last)
+		hlist_add_after(last, &p->lmk_adj_node);
+	else
+		hlist_add_head(&p->lmk_adj_node, head);
+out:
+	__set_bit(bucket, lowmem_adj_map);
+}
+
+/*
+ * Refile @task's process under its current oom_score_adj.  The caller
+ * holds a reference to @task and no task or sighand locks.
+ */
+void lowmem_adj_index_update(struct task_struct *task)
+{
+	struct task_struct *p = task->group_leader;
+	struct task_struct *t;
+	unsigned long rss = 0, flags;
+	int adj;
+
+	if (p->flags & PF_KTHREAD)
+		return;
+
+	rcu_read_lock();
+	t = find_lock_task_mm(p);
+	if (t) {
+		rss = get_mm_rss(t->mm);
+		task_unlock(t);
+	}
+	rcu_read_unlock();
+	adj = p->signal->oom_score_adj;
+
+	spin_lock_irqsave(&lowmem_adj_lock, flags);
+	__lowmem_adj_index_del(p);
+	/*
+	 * __unhash_process() removes the task after detach_pid(), so once
+	 * it is gone from the pid hash it must not be filed again.
+	 */
+	if (t && pid_alive(p))
+		__lowmem_adj_index_add(p, adj, rss);
+	spin_unlock_irqrestore(&lowmem_adj_lock, flags);
+}
+
+/* Called for every task being released, under tasklist_lock */
+void lowmem_adj_index_del(struct task_struct *task)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&lowmem_adj_lock, flags);
+	__lowmem_adj_index_del(task);
+	spin_unlock_irqrestore(&lowmem_adj_lock, flags);
+}
+
+static struct task_struct *lowmem_select(int min_score_adj, int *tasksize,
+					 int *oom_score_adj)
 {
-	struct task_struct *tsk;
 	struct task_struct *selected = NULL;
-	int rem = 0;
-	int tasksize;
-	int i;
-	int min_score_adj = OOM_SCORE_ADJ_MAX + 1;
-	int minfree = 0;
+	struct task_struct *selected_leader = NULL;
+	struct task_struct *p, *t;
+	struct hlist_node *pos, *n;
+	int min_bucket = min_score_adj - OOM_SCORE_ADJ_MIN;
+	int bucket = LMK_ADJ_BUCKETS;
 	int selected_tasksize = 0;
-	int selected_oom_score_adj;
-	int array_size = ARRAY_SIZE(lowmem_adj);
-	int other_free = global_page_state(NR_FREE_PAGES) - totalreserve_pages;
-	int other_file = global_page_state(NR_FILE_PAGES) -
-						global_page_state(NR_SHMEM);
+	unsigned long flags;
+	int scanned, size;
 
-	if (lowmem_adj_size < array_size)
-		array_size = lowmem_adj_size;
-	if (lowmem_minfree_size < array_size)
-		array_size = lowmem_minfree_size;
-	for (i = 0; i < array_size; i++) {
-		minfree = lowmem_minfree[i];
-		if (other_free < minfree && other_file < minfree) {
-			min_score_adj = lowmem_adj[i];
+	spin_lock_irqsave(&lowmem_adj_lock, flags);
+	rcu_read_lock();
+	while (!selected) {
+		int next = find_last_bit(lowmem_adj_map, bucket);
+
+		if (next >= bucket || next < min_bucket)
 			break;
+		bucket = next;
+
+		scanned = 0;
+		hlist_for_each_entry_safe(p, pos, n, &lowmem_adj_buckets[bucket],
+					  lmk_adj_node) {
+			if (scanned++ == LMK_SCAN_MAX)
+				break;
+			t = find_lock_task_mm(p);
+			if (!t) {
+				/* Exited, waiting to be reaped */
+				__lowmem_adj_index_del(p);
+				continue;
+			}
+			size = get_mm_rss(t->mm);
+			task_unlock(t);
+			p->lmk_rss = size;
+			if (size <= selected_tasksize)
+				continue;
+			selected = t;
+			selected_leader = p;
+			selected_tasksize = size;
 		}
 	}
-	if (sc->nr_to_scan > 0)
-		lowmem_print(3, "lowmem_shrink %lu, %x, ofree %d %d, ma %d\n",
-				sc->nr_to_scan, sc->gfp_mask, other_free,
-				other_file, min_score_adj);
-	rem = global_page_state(NR_ACTIVE_ANON) +
-		global_page_state(NR_ACTIVE_FILE) +
-		global_page_state(NR_INACTIVE_ANON) +
-		global_page_state(NR_INACTIVE_FILE);
-	if (sc->nr_to_scan <= 0 || min_score_adj == OOM_SCORE_ADJ_MAX + 1) {
-		lowmem_print(5, "lowmem_shrink %lu, %x, return %d\n",
-			     sc->nr_to_scan, sc->gfp_mask, rem);
-		return rem;
+	if (selected) {
+		get_task_struct(selected);
+		*tasksize = selected_tasksize;
+		*oom_score_adj = selected_leader->lmk_adj;
+		/* Dying; keep it from being picked again */
+		__lowmem_adj_index_del(selected_leader);
 	}
-	selected_oom_score_adj = min_score_adj;
+	rcu_read_unlock();
+	spin_unlock_irqrestore(&lowmem_adj_lock, flags);
+
+	return selected;
+}
+#else
+static struct task_struct *lowmem_select(int min_score_adj, int *tasksize,
+					 int *oom_score_adj)
+{
+	struct task_struct *tsk;
+	struct task_struct *selected = NULL;
+	int selected_tasksize = 0;
+	int selected_oom_score_adj = min_score_adj;
+	int size, adj;
 
 	rcu_read_lock();
 	for_each_process(tsk) {
 		struct task_struct *p;
-		int oom_score_adj;
 
 		if (tsk->flags & PF_KTHREAD)
 			continue;
@@ -123,51 +276,183 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 		    time_before_eq(jiffies, lowmem_deathpending_timeout)) {
 			task_unlock(p);
 			rcu_read_unlock();
-			return 0;
+			return ERR_PTR(-EBUSY);
 		}
-		oom_score_adj = p->signal->oom_score_adj;
-		if (oom_score_adj < min_score_adj) {
+		adj = p->signal->oom_score_adj;
+		if (adj < min_score_adj) {
 			task_unlock(p);
 			continue;
 		}
-		tasksize = get_mm_rss(p->mm);
+		size = get_mm_rss(p->mm);
 		task_unlock(p);
-		if (tasksize <= 0)
+		if (size <= 0)
 			continue;
 		if (selected) {
-			if (oom_score_adj < selected_oom_score_adj)
+			if (adj < selected_oom_score_adj)
 				continue;
-			if (oom_score_adj == selected_oom_score_adj &&
-			    tasksize <= selected_tasksize)
+			if (adj == selected_oom_score_adj &&
+			    size <= selected_tasksize)
 				continue;
 		}
 		selected = p;
-		selected_tasksize = tasksize;
-		selected_oom_score_adj = oom_score_adj;
+		selected_tasksize = size;
+		selected_oom_score_adj = adj;
 		lowmem_print(2, "select '%s' (%d), adj %d, size %d, to kill\n",
-			     p->comm, p->pid, oom_score_adj, tasksize);
+			     p->comm, p->pid, adj, size);
 	}
 	if (selected) {
-		lowmem_print(1, "Killing '%s' (%d), adj %d,\n" \
-				"   to free %ldkB on behalf of '%s' (%d) because\n" \
-				"   cache %ldkB is below limit %ldkB for oom_score_adj %d\n" \
-				"   Free memory is %ldkB above reserved\n",
-			     selected->comm, selected->pid,
-			     selected_oom_score_adj,
-			     selected_tasksize * (long)(PAGE_SIZE / 1024),
-			     current->comm, current->pid,
-			     other_file * (long)(PAGE_SIZE / 1024),
-			     minfree * (long)(PAGE_SIZE / 1024),
-			     min_score_adj,
-			     other_free * (long)(PAGE_SIZE / 1024));
-		lowmem_deathpending_timeout = jiffies + HZ;
-		send_sig(SIGKILL, selected, 0);
-		set_tsk_thread_flag(selected, TIF_MEMDIE);
-		rem -= selected_tasksize;
+		get_task_struct(selected);
+		*tasksize = selected_tasksize;
+		*oom_score_adj = selected_oom_score_adj;
 	}
+	rcu_read_unlock();
+
+	return selected;
+}
+#endif
+
+static int lowmem_array_size(void)
+{
+	int array_size = ARRAY_SIZE(lowmem_adj);
+
+	if (lowmem_adj_size < array_size)
+		array_size = lowmem_adj_size;
+	if (lowmem_minfree_size < array_size)
+		array_size = lowmem_minfree_size;
+	return array_size;
+}
+
+/*
+ * Returns the lowest oom_score_adj to kill at, or OOM_SCORE_ADJ_MAX + 1
+ * if memory is not low.
+ */
+static int lowmem_min_score_adj(int *minfree, int *other_free,
+				int *other_file)
+{
+	int array_size = lowmem_array_size();
+	int i;
+
+	*other_free = global_page_state(NR_FREE_PAGES) - totalreserve_pages;
+	*other_file = global_page_state(NR_FILE_PAGES) -
+						global_page_state(NR_SHMEM);
+	*minfree = 0;
+
+	for (i = 0; i < array_size; i++) {
+		*minfree = lowmem_minfree[i];
+		if (*other_free < *minfree && *other_file < *minfree)
+			return lowmem_adj[i];
+	}
+	return OOM_SCORE_ADJ_MAX + 1;
+}
+
+/* Memory is low enough to kill; start timing if this is a new episode */
+static void lowmem_note_pressure(int level, int other_free, int other_file,
+				 int min_score_adj)
+{
+	unsigned long flags;
+
+	trace_lowmem_pressure(level, other_free, other_file, min_score_adj);
+
+	spin_lock_irqsave(&lowmem_victim_lock, flags);
+	if (!lowmem_onset_ns)
+		lowmem_onset_ns = ktime_to_ns(ktime_get());
+	spin_unlock_irqrestore(&lowmem_victim_lock, flags);
+}
+
+/*
+ * Kill the biggest process at the highest oom_score_adj no lower than
+ * @min_score_adj.  Returns its rss in pages, 0 if there was none, or -1
+ * if the last victim is still dying.
+ */
+static int lowmem_kill(int min_score_adj, int minfree, int other_free,
+		       int other_file)
+{
+	struct task_struct *selected;
+	int selected_tasksize;
+	int selected_oom_score_adj;
+	unsigned long flags;
+	s64 now, onset;
+
+	if (lowmem_victim &&
+	    time_before_eq(jiffies, lowmem_deathpending_timeout))
+		return -1;
+
+	selected = lowmem_select(min_score_adj, &selected_tasksize,
+				 &selected_oom_score_adj);
+	if (IS_ERR(selected))
+		return -1;
+	if (!selected)
+		return 0;
+
+	lowmem_print(1, "Killing '%s' (%d), adj %d,\n" \
+			"   to free %ldkB on behalf of '%s' (%d) because\n" \
+			"   cache %ldkB is below limit %ldkB for oom_score_adj %d\n" \
+			"   Free memory is %ldkB above reserved\n",
+		     selected->comm, selected->pid,
+		     selected_oom_score_adj,
+		     selected_tasksize * (long)(PAGE_SIZE / 1024),
+		     current->comm, current->pid,
+		     other_file * (long)(PAGE_SIZE / 1024),
+		     minfree * (long)(PAGE_SIZE / 1024),
+		     min_score_adj,
+		     other_free * (long)(PAGE_SIZE / 1024));
+	lowmem_deathpending_timeout = jiffies + HZ;
+	send_sig(SIGKILL, selected, 0);
+	set_tsk_thread_flag(selected, TIF_MEMDIE);
+
+	/* The leader's task_struct goes last, after the mm is released */
+	now = ktime_to_ns(ktime_get());
+	spin_lock_irqsave(&lowmem_victim_lock, flags);
+	lowmem_victim = selected->group_leader;
+	lowmem_victim_rss = selected_tasksize;
+	lowmem_kill_ns = now;
+	if (!lowmem_onset_ns)
+		lowmem_onset_ns = now;
+	onset = lowmem_onset_ns;
+	spin_unlock_irqrestore(&lowmem_victim_lock, flags);
+
+	trace_lowmem_kill(selected, selected_oom_score_adj, selected_tasksize,
+			  now - onset);
+	put_task_struct(selected);
+
+	return selected_tasksize;
+}
+
+static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
+{
+	int rem = 0;
+	int freed;
+	int min_score_adj;
+	int minfree;
+	int other_free;
+	int other_file;
+
+	min_score_adj = lowmem_min_score_adj(&minfree, &other_free,
+					     &other_file);
+	if (sc->nr_to_scan > 0)
+		lowmem_print(3, "lowmem_shrink %lu, %x, ofree %d %d, ma %d\n",
+				sc->nr_to_scan, sc->gfp_mask, other_free,
+				other_file, min_score_adj);
+	rem = global_page_state(NR_ACTIVE_ANON) +
+		global_page_state(NR_ACTIVE_FILE) +
+		global_page_state(NR_INACTIVE_ANON) +
+		global_page_state(NR_INACTIVE_FILE);
+	/* With vmpressure driving kills the shrinker only reports */
+	if (sc->nr_to_scan <= 0 || min_score_adj == OOM_SCORE_ADJ_MAX + 1 ||
+	    lowmem_vmpressure) {
+		lowmem_print(5, "lowmem_shrink %lu, %x, return %d\n",
+			     sc->nr_to_scan, sc->gfp_mask, rem);
+		return rem;
+	}
+
+	lowmem_note_pressure(-1, other_free, other_file, min_score_adj);
+	freed = lowmem_kill(min_score_adj, minfree, other_free, other_file);
+	if (freed < 0)
+		return 0;
+	rem -= freed;
+
 	lowmem_print(4, "lowmem_shrink %lu, %x, return %d\n",
 		     sc->nr_to_scan, sc->gfp_mask, rem);
-	rcu_read_unlock();
 	return rem;
 }
 
@@ -176,15 +461,92 @@ static struct shrinker lowmem_shrinker = {
 	.seeks = DEFAULT_SEEKS * 16
 };
 
+#ifdef CONFIG_ANDROID_LMK_VMPRESSURE
+/*
+ * Medium pressure kills by the minfree table as the shrinker would;
+ * critical pressure kills at least at the highest adj level, since
+ * reclaim is failing even if the free and file counts look fine.
+ */
+static int lowmem_vmpressure_notify(struct notifier_block *nb,
+				    unsigned long level, void *data)
+{
+	int min_score_adj;
+	int minfree;
+	int other_free;
+	int other_file;
+	int array_size;
+
+	if (!lowmem_vmpressure || level < VMPRESSURE_MEDIUM)
+		return NOTIFY_DONE;
+
+	min_score_adj = lowmem_min_score_adj(&minfree, &other_free,
+					     &other_file);
+	array_size = lowmem_array_size();
+	if (min_score_adj == OOM_SCORE_ADJ_MAX + 1 &&
+	    level == VMPRESSURE_CRITICAL && array_size > 0) {
+		min_score_adj = lowmem_adj[array_size - 1];
+		minfree = lowmem_minfree[array_size - 1];
+	}
+	lowmem_print(3, "vmpressure %lu, ofree %d %d, ma %d\n",
+		     level, other_free, other_file, min_score_adj);
+	if (min_score_adj == OOM_SCORE_ADJ_MAX + 1)
+		return NOTIFY_DONE;
+
+	lowmem_note_pressure(level, other_free, other_file, min_score_adj);
+	lowmem_kill(min_score_adj, minfree, other_free, other_file);
+	return NOTIFY_OK;
+}
+
+static struct notifier_block lowmem_vmpressure_nb = {
+	.notifier_call = lowmem_vmpressure_notify,
+};
+#endif
+
+/* Ends the timing started by lowmem_note_pressure() */
+static int lowmem_task_free(struct notifier_block *nb, unsigned long val,
+			    void *data)
+{
+	struct task_struct *task = data;
+	unsigned long flags;
+	s64 now;
+
+	if (task != lowmem_victim)
+		return NOTIFY_OK;
+
+	spin_lock_irqsave(&lowmem_victim_lock, flags);
+	if (task == lowmem_victim) {
+		now = ktime_to_ns(ktime_get());
+		trace_lowmem_freed(task, lowmem_victim_rss,
+				   now - lowmem_kill_ns, now - lowmem_onset_ns);
+		lowmem_victim = NULL;
+		lowmem_onset_ns = 0;
+	}
+	spin_unlock_irqrestore(&lowmem_victim_lock, flags);
+
+	return NOTIFY_OK;
+}
+
+static struct notifier_block lowmem_task_free_nb = {
+	.notifier_call = lowmem_task_free,
+};
+
 static int __init lowmem_init(void)
 {
+	task_free_register(&lowmem_task_free_nb);
 	register_shrinker(&lowmem_shrinker);
+#ifdef CONFIG_ANDROID_LMK_VMPRESSURE
+	vmpressure_notifier_register(&lowmem_vmpressure_nb);
+#endif
 	return 0;
 }
 
 static void __exit lowmem_exit(void)
 {
+#ifdef CONFIG_ANDROID_LMK_VMPRESSURE
+	vmpressure_notifier_unregister(&lowmem_vmpressure_nb);
+#endif
 	unregister_shrinker(&lowmem_shrinker);
+	task_free_unregister(&lowmem_task_free_nb);
 }
 
 #ifdef CONFIG_ANDROID_LOW_MEMORY_KILLER_AUTODETECT_OOM_ADJ_VALUES
@@ -278,6 +640,9 @@ module_param_array_named(adj, lowmem_adj, int, &lowmem_adj_size,
 module_param_array_named(minfree, lowmem_minfree, uint, &lowmem_minfree_size,
 			 S_IRUGO | S_IWUSR);
 module_param_named(debug_level, lowmem_debug_level, uint, S_IRUGO | S_IWUSR);
+#ifdef CONFIG_ANDROID_LMK_VMPRESSURE
+module_param_named(vmpressure, lowmem_vmpressure, bool, S_IRUGO | S_IWUSR);
+#endif
 
 module_init(lowmem_init);
 module_exit(lowmem_exit);
@@ -0,0 +1,200 @@
+/*
+ * Compressed RAM block device
+ *
+ * Compression backends.  Each backend compresses one page into a buffer
+ * of ZRAM_COMP_BUF_SIZE bytes and decompresses back into exactly one
+ * page; the device picks one through its 'comp_algorithm' attribute.
+ *
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/lzo.h>
+#include <linux/lz4.h>
+#include <linux/zlib.h>
+
+#include "zram_drv.h"
+
+static int zram_lzo_compress(const unsigned char *src, unsigned char *dst,
+			     size_t *dst_len, void *workmem)
+{
+	int ret = lzo1x_1_compress(src, PAGE_SIZE, dst, dst_len, workmem);
+
+	return ret == LZO_E_OK ? 0 : ret;
+}
+
+static int zram_lzo_decompress(const unsigned char *src, size_t src_len,
+			       unsigned char *dst, void *workmem)
+{
+	size_t dst_len = PAGE_SIZE;
+	int ret = lzo1x_decompress_safe(src, src_len, dst, &dst_len);
+
+	return ret == LZO_E_OK ? 0 : ret;
+}
+
+static size_t zram_lzo_workmem_size(void)
+{
+	return LZO1X_MEM_COMPRESS;
+}
+
+static const struct zram_backend zram_lzo = {
+	.name		= "lzo",
+	.workmem_size	= zram_lzo_workmem_size,
+	.compress	= zram_lzo_compress,
+	.decompress	= zram_lzo_decompress,
+};
+
+#ifdef CONFIG_ZRAM_LZ4
+static int zram_lz4_compress(const unsigned char *src, unsigned char *dst,
+			     size_t *dst_len, void *workmem)
+{
+	return lz4_compress(src, PAGE_SIZE, dst, dst_len, workmem);
+}
+
+static int zram_lz4_decompress(const unsigned char *src, size_t src_len,
+			       unsigned char *dst, void *workmem)
+{
+	size_t dst_len = PAGE_SIZE;
+
+	if (lz4_decompress_safe(src, src_len, dst, &dst_len) ||
+	    dst_len != PAGE_SIZE)
+		return -EINVAL;
+	return 0;
+}
+
+static size_t zram_lz4_workmem_size(void)
+{
+	return LZ4_MEM_COMPRESS;
+}
+
+static const struct zram_backend zram_lz4 = {
+	.name		= "lz4",
+	.workmem_size	= zram_lz4_workmem_size,
+	.compress	= zram_lz4_compress,
+	.decompress	= zram_lz4_decompress,
+};
+#endif
+
+#ifdef CONFIG_ZRAM_DEFLATE
+/*
+ * Raw deflate at the highest level, for devices that mostly hold cold
+ * pages where ratio matters more than latency.  A window as large as a
+ * page is all a single page can use, and a smaller memLevel keeps the
+ * per-stream workspace small.
+ */
+#define ZRAM_DEFLATE_WBITS	PAGE_SHIFT
+#define ZRAM_DEFLATE_MEMLEVEL	6
+
+static int zram_deflate_compress(const unsigned char *src, unsigned char *dst,
+				 size_t *dst_len, void *workmem)
+{
+	struct z_stream_s stream = { .workspace = workmem };
+	int ret;
+
+	ret = zlib_deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED,
+				-ZRAM_DEFLATE_WBITS, ZRAM_DEFLATE_MEMLEVEL,
+				Z_DEFAULT_STRATEGY);
+	if (ret != Z_OK)
+		return -EINVAL;
+
+	stream.next_in = src;
+	stream.avail_in = PAGE_SIZE;
+	stream.next_out = dst;
+	stream.avail_out = ZRAM_COMP_BUF_SIZE;
+
+	ret = zlib_deflate(&stream, Z_FINISH);
+	zlib_deflateEnd(&stream);
+	if (ret != Z_STREAM_END)
+		return -EINVAL;
+
+	*dst_len = stream.total_out;
+	return 0;
+}
+
+static int zram_deflate_decompress(const unsigned char *src, size_t src_len,
+				   unsigned char *dst, void *workmem)
+{
+	struct z_stream_s stream = { .workspace = workmem };
+	int ret;
+
+	ret = zlib_inflateInit2(&stream, -ZRAM_DEFLATE_WBITS);
+	if (ret != Z_OK)
+		return -EINVAL;
+
+	stream.next_in = src;
+	stream.avail_in = src_len;
+	stream.next_out = dst;
+	stream.avail_out = PAGE_SIZE;
+
+	ret = zlib_inflate(&stream, Z_FINISH);
+	zlib_inflateEnd(&stream);
+	if (ret != Z_STREAM_END || stream.total_out != PAGE_SIZE)
+		return -EINVAL;
+
+	return 0;
+}
+
+/* One workspace serves both directions */
+static size_t zram_deflate_workmem_size(void)
+{
+	return max(zlib_deflate_workspacesize(-ZRAM_DEFLATE_WBITS,
+					      ZRAM_DEFLATE_MEMLEVEL),
+		   zlib_inflate_workspacesize());
+}
+
+static const struct zram_backend zram_deflate = {
+	.name		= "deflate",
+	.workmem_size	= zram_deflate_workmem_size,
+	.decompress_workmem = 1,
+	.compress	= zram_deflate_compress,
+	.decompress	= zram_deflate_decompress,
+};
+#endif
+
+static const struct zram_backend *zram_backends[] = {
+	&zram_lzo,
+#ifdef CONFIG_ZRAM_LZ4
+	&zram_lz4,
+#endif
+#ifdef CONFIG_ZRAM_DEFLATE
+	&zram_deflate,
+#endif
+};
+
+const struct zram_backend *zram_default_backend(void)
+{
+	return zram_backends[0];
+}
+
+/* Look up a backend by name; a trailing newline in @buf is ignored. */
+const struct zram_backend *zram_find_backend(const char *buf)
+{
+	size_t len = strcspn(buf, "\n");
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(zram_backends); i++) {
+		if (strlen(zram_backends[i]->name) == len &&
+		    !strncmp(zram_backends[i]->name, buf, len))
+			return zram_backends[i];
+	}
+
+	return NULL;
+}
+
+/* List the available backends, with @cur in brackets */
+ssize_t zram_show_backends(const struct zram_backend *cur, char *buf)
+{
+	ssize_t sz = 0;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(zram_backends); i++) {
+		if (zram_backends[i] == cur)
+			sz += sprintf(buf + sz, "[%s] ", zram_backends[i]->name);
+		else
+			sz += sprintf(buf + sz, "%s ", zram_backends[i]->name);
+	}
+	sz += sprintf(buf + sz, "\n");
+
+	return sz;
+}
@@ -0,0 +1,137 @@
+/*
+ * Compressed RAM block device
+ *
+ * Deduplication of identical compressed pages.  When enabled, every
+ * compressed object is tracked by a refcounted zram_entry hashed by a
+ * checksum of its compressed bytes.  A write whose compressed output
+ * matches an existing object takes a reference on it instead of
+ * allocating a new one.  Backends are deterministic, so identical pages
+ * compress identically and comparing the compressed bytes is enough.
+ *
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+#include <linux/kernel.h>
+#include <linux/jhash.h>
+#include <linux/log2.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/vmalloc.h>
+
+#include "zram_drv.h"
+
+/* Average number of stored pages per hash bucket */
+#define ZRAM_DEDUP_LOAD		4
+
+static struct hlist_head *zram_dedup_bucket(struct zram *zram, u32 checksum)
+{
+	return &zram->dedup_hash[checksum & (zram->dedup_hash_size - 1)];
+}
+
+int zram_dedup_init(struct zram *zram, size_t num_pages)
+{
+	size_t size;
+
+	size = roundup_pow_of_two(max_t(size_t, num_pages / ZRAM_DEDUP_LOAD,
+					1));
+	zram->dedup_hash = vzalloc(size * sizeof(*zram->dedup_hash));
+	if (!zram->dedup_hash)
+		return -ENOMEM;
+
+	zram->dedup_hash_size = size;
+	atomic64_add(size * sizeof(*zram->dedup_hash),
+		     &zram->stats.meta_data_size);
+	return 0;
+}
+
+void zram_dedup_fini(struct zram *zram)
+{
+	vfree(zram->dedup_hash);
+	zram->dedup_hash = NULL;
+	zram->dedup_hash_size = 0;
+}
+
+/*
+ * Look for a stored object with the same @len compressed bytes as @mem.
+ * Returns it with a reference taken, or NULL.  Either way the checksum
+ * of @mem is left in @checksum for a following zram_dedup_insert().
+ */
+struct zram_entry *zram_dedup_find(struct zram *zram, const void *mem,
+				   size_t len, u32 *checksum)
+{
+	struct zram_entry *entry, *found = NULL;
+	struct hlist_node *pos;
+	void *cmem;
+
+	*checksum = jhash(mem, len, 0);
+
+	spin_lock(&zram->dedup_lock);
+	hlist_for_each_entry(entry, pos, zram_dedup_bucket(zram, *checksum),
+			     node) {
+		if (entry->checksum != *checksum || entry->len != len)
+			continue;
+
+		cmem = zs_map_object(zram->mem_pool, entry->handle);
+		if (!memcmp(cmem + sizeof(struct zobj_header), mem, len))
+			found = entry;
+		zs_unmap_object(zram->mem_pool, entry->handle);
+
+		if (found) {
+			found->refcount++;
+			break;
+		}
+	}
+	spin_unlock(&zram->dedup_lock);
+
+	return found;
+}
+
+/*
+ * Start tracking the newly stored object @handle.  Returns its entry
+ * with one reference, or NULL if no memory, in which case the caller
+ * keeps using the bare handle and the object is simply not shared.
+ */
+struct zram_entry *zram_dedup_insert(struct zram *zram, void *handle,
+				     size_t len, u32 checksum)
+{
+	struct zram_entry *entry;
+
+	entry = kmalloc(sizeof(*entry), GFP_NOIO);
+	if (!entry)
+		return NULL;
+
+	entry->handle = handle;
+	entry->len = len;
+	entry->checksum = checksum;
+	entry->refcount = 1;
+
+	spin_lock(&zram->dedup_lock);
+	hlist_add_head(&entry->node, zram_dedup_bucket(zram, checksum));
+	spin_unlock(&zram->dedup_lock);
+
+	atomic64_add(sizeof(*entry), &zram->stats.meta_data_size);
+	return entry;
+}
+
+/*
+ * Drop a reference on @entry, freeing the object when it was the last.
+ * Returns true if the object was freed.
+ */
+bool zram_dedup_put(struct zram *zram, struct zram_entry *entry)
+{
+	bool last;
+
+	spin_lock(&zram->dedup_lock);
+	last = !--entry->refcount;
+	if (last)
+		hlist_del(&entry->node);
+	spin_unlock(&zram->dedup_lock);
+
+	if (!last)
+		return false;
+
+	zs_free(zram->mem_pool, entry->handle);
+	kfree(entry);
+	atomic64_sub(sizeof(*entry), &zram->stats.meta_data_size);
+	return true;
+}
@@ -28,8 +28,8 @@
 #include <linux/device.h>
 #include <linux/genhd.h>
 #include <linux/highmem.h>
+#include <linux/ktime.h>
 #include <linux/slab.h>
-#include <linux/lzo.h>
 #include <linux/string.h>
 #include <linux/vmalloc.h>
 
@@ -42,35 +42,6 @@ struct zram *zram_devices;
 /* Module params (documentation at end) */
 static unsigned int num_devices;
 
-static void zram_stat_inc(u32 *v)
-{
-	*v = *v + 1;
-}
-
-static void zram_stat_dec(u32 *v)
-{
-	*v = *v - 1;
-}
-
-static void zram_stat64_add(struct zram *zram, u64 *v, u64 inc)
-{
-	spin_lock(&zram->stat64_lock);
-	*v = *v + inc;
-	spin_unlock(&zram->stat64_lock);
-}
-
-static void zram_stat64_sub(struct zram *zram, u64 *v, u64 dec)
-{
-	spin_lock(&zram->stat64_lock);
-	*v = *v - dec;
-	spin_unlock(&zram->stat64_lock);
-}
-
-static void zram_stat64_inc(struct zram *zram, u64 *v)
-{
-	zram_stat64_add(zram, v, 1);
-}
-
 static int zram_test_flag(struct zram *zram, u32 index,
 			enum zram_pageflags flag)
 {
@@ -89,21 +60,41 @@ static void zram_clear_flag(struct zram *zram, u32 index,
 	zram->table[index].flags &= ~BIT(flag);
 }
 
-static int page_zero_filled(void *ptr)
+/*
+ * Check whether the page is one word repeated throughout (zero-filled
+ * pages being the common case) and if so return that word in @element.
+ */
+static int page_same_filled(void *ptr, unsigned long *element)
 {
 	unsigned int pos;
 	unsigned long *page;
 
 	page = (unsigned long *)ptr;
 
-	for (pos = 0; pos != PAGE_SIZE / sizeof(*page); pos++) {
-		if (page[pos])
+	for (pos = 1; pos != PAGE_SIZE / sizeof(*page); pos++) {
+		if (page[pos] != page[0])
 			return 0;
 	}
 
+	*element = page[0];
 	return 1;
 }
 
+static void zram_fill_page(void *ptr, unsigned long element)
+{
+	unsigned int pos;
+	unsigned long *page;
+
+	if (!element) {
+		memset(ptr, 0, PAGE_SIZE);
+		return;
+	}
+
+	page = (unsigned long *)ptr;
+	for (pos = 0; pos != PAGE_SIZE / sizeof(*page); pos++)
+		page[pos] = element;
+}
+
 static void zram_set_disksize(struct zram *zram, size_t totalram_bytes)
 {
 	if (!zram->disksize) {
@@ -136,66 +127,190 @@ static void zram_set_disksize(struct zram *zram, size_t totalram_bytes)
 static void zram_free_page(struct zram *zram, size_t index)
 {
 	void *handle = zram->table[index].handle;
+	size_t size = zram->table[index].size;
 
-	if (unlikely(!handle)) {
-		/*
-		 * No memory is allocated for zero filled pages.
-		 * Simply clear zero page flag.
-		 */
-		if (zram_test_flag(zram, index, ZRAM_ZERO)) {
-			zram_clear_flag(zram, index, ZRAM_ZERO);
-			zram_stat_dec(&zram->stats.pages_zero);
-		}
+	/* Whatever happens to the slot now, a writeback in flight is stale */
+	zram_clear_flag(zram, index, ZRAM_UNDER_WB);
+	zram->table[index].age = 0;
+
+	/*
+	 * No memory is allocated for same filled pages.
+	 * Simply clear the flag and the pattern.
+	 */
+	if (zram_test_flag(zram, index, ZRAM_SAME)) {
+		zram_clear_flag(zram, index, ZRAM_SAME);
+		if (!zram->table[index].element)
+			atomic_dec(&zram->stats.pages_zero);
+		atomic_dec(&zram->stats.pages_same);
+		zram->table[index].element = 0;
+		return;
+	}
+
+	if (zram_test_flag(zram, index, ZRAM_WB)) {
+		zram_clear_flag(zram, index, ZRAM_WB);
+		zram_bdev_free_block(zram, zram->table[index].element);
+		zram->table[index].element = 0;
+		atomic_dec(&zram->stats.pages_stored);
 		return;
 	}
 
+	if (unlikely(!handle))
+		return;
+
 	if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
 		__free_page(handle);
 		zram_clear_flag(zram, index, ZRAM_UNCOMPRESSED);
-		zram_stat_dec(&zram->stats.pages_expand);
+		atomic_dec(&zram->stats.pages_expand);
 		goto out;
 	}
 
-	zs_free(zram->mem_pool, handle);
+	if (zram_test_flag(zram, index, ZRAM_DEDUP)) {
+		zram_clear_flag(zram, index, ZRAM_DEDUP);
+		/* Only the last user's bytes were counted as stored */
+		if (!zram_dedup_put(zram, handle)) {
+			atomic64_sub(size, &zram->stats.dup_data_size);
+			size = 0;
+		}
+	} else {
+		zs_free(zram->mem_pool, handle);
+	}
 
 	if (zram->table[index].size <= PAGE_SIZE / 2)
-		zram_stat_dec(&zram->stats.good_compress);
+		atomic_dec(&zram->stats.good_compress);
 
 out:
-	zram_stat64_sub(zram, &zram->stats.compr_size,
-			zram->table[index].size);
-	zram_stat_dec(&zram->stats.pages_stored);
+	atomic64_sub(size, &zram->stats.compr_size);
+	atomic_dec(&zram->stats.pages_stored);
 
 	zram->table[index].handle = NULL;
 	zram->table[index].size = 0;
 }
 
-static void handle_zero_page(struct bio_vec *bvec)
+static struct zram_stream *zram_stream_alloc(const struct zram_backend *backend,
+					     gfp_t flags)
 {
-	struct page *page = bvec->bv_page;
-	void *user_mem;
+	struct zram_stream *zstrm;
+
+	zstrm = kmalloc(sizeof(*zstrm), flags);
+	if (!zstrm)
+		return NULL;
+
+	zstrm->workmem = kmalloc(backend->workmem_size(), flags);
+	zstrm->buffer = (void *)__get_free_pages(flags | __GFP_ZERO,
+					get_order(ZRAM_COMP_BUF_SIZE));
+	if (!zstrm->workmem || !zstrm->buffer) {
+		kfree(zstrm->workmem);
+		free_pages((unsigned long)zstrm->buffer,
+			   get_order(ZRAM_COMP_BUF_SIZE));
+		kfree(zstrm);
+		return NULL;
+	}
 
-	user_mem = kmap_atomic(page);
-	memset(user_mem + bvec->bv_offset, 0, bvec->bv_len);
-	kunmap_atomic(user_mem);
+	return zstrm;
+}
 
-	flush_dcache_page(page);
+static void zram_stream_free(struct zram_stream *zstrm)
+{
+	kfree(zstrm->workmem);
+	free_pages((unsigned long)zstrm->buffer, get_order(ZRAM_COMP_BUF_SIZE));
+	kfree(zstrm);
 }
 
-static void handle_uncompressed_page(struct zram *zram, struct bio_vec *bvec,
-				     u32 index, int offset)
+/*
+ * Get an idle compression stream.  If none is idle and the pool is
+ * below max_streams, try to allocate a new one; otherwise wait for a
+ * writer to release its stream.  May sleep.
+ */
+static struct zram_stream *zram_stream_get(struct zram *zram)
 {
-	struct page *page = bvec->bv_page;
-	unsigned char *user_mem, *cmem;
+	struct zram_stream *zstrm;
+
+	while (1) {
+		spin_lock(&zram->stream_lock);
+		if (!list_empty(&zram->idle_streams)) {
+			zstrm = list_first_entry(&zram->idle_streams,
+						 struct zram_stream, list);
+			list_del(&zstrm->list);
+			spin_unlock(&zram->stream_lock);
+			return zstrm;
+		}
 
-	user_mem = kmap_atomic(page);
-	cmem = kmap_atomic(zram->table[index].handle);
+		if (zram->avail_streams >= zram->max_streams) {
+			spin_unlock(&zram->stream_lock);
+			/* a stream coming back, or max_comp_streams raised */
+			wait_event(zram->stream_wait,
+				   !list_empty(&zram->idle_streams) ||
+				   zram->avail_streams < zram->max_streams);
+			continue;
+		}
 
-	memcpy(user_mem + bvec->bv_offset, cmem + offset, bvec->bv_len);
-	kunmap_atomic(cmem);
-	kunmap_atomic(user_mem);
+		zram->avail_streams++;
+		spin_unlock(&zram->stream_lock);
 
-	flush_dcache_page(page);
+		zstrm = zram_stream_alloc(zram->backend, GFP_NOIO);
+		if (zstrm)
+			return zstrm;
+
+		/* Out of memory: fall back to waiting for an existing one */
+		spin_lock(&zram->stream_lock);
+		zram->avail_streams--;
+		spin_unlock(&zram->stream_lock);
+		wait_event(zram->stream_wait,
+			   !list_empty(&zram->idle_streams));
+	}
+}
+
+static void zram_stream_put(struct zram *zram, struct zram_stream *zstrm)
+{
+	spin_lock(&zram->stream_lock);
+	if (zram->avail_streams > zram->max_streams) {
+		/* max_comp_streams was lowered while this one was in use */
+		zram->avail_streams--;
+		spin_unlock(&zram->stream_lock);
+		zram_stream_free(zstrm);
+		return;
+	}
+	list_add(&zstrm->list, &zram->idle_streams);
+	spin_unlock(&zram->stream_lock);
+
+	wake_up(&zram->stream_wait);
+}
+
+/* Called with init_lock held for writing, so no stream is in use */
+static void zram_destroy_streams(struct zram *zram)
+{
+	struct zram_stream *zstrm, *tmp;
+
+	list_for_each_entry_safe(zstrm, tmp, &zram->idle_streams, list) {
+		list_del(&zstrm->list);
+		zram_stream_free(zstrm);
+		zram->avail_streams--;
+	}
+	WARN_ON(zram->avail_streams);
+	zram->avail_streams = 0;
+}
+
+/* Called with init_lock held for reading */
+void zram_set_max_streams(struct zram *zram, int num)
+{
+	struct zram_stream *zstrm;
+
+	spin_lock(&zram->stream_lock);
+	zram->max_streams = num;
+	while (zram->avail_streams > num &&
+	       !list_empty(&zram->idle_streams)) {
+		zstrm = list_first_entry(&zram->idle_streams,
+					 struct zram_stream, list);
+		list_del(&zstrm->list);
+		zram->avail_streams--;
+		spin_unlock(&zram->stream_lock);
+		zram_stream_free(zstrm);
+		spin_lock(&zram->stream_lock);
+	}
+	spin_unlock(&zram->stream_lock);
+
+	/* Writers waiting at the old limit may now allocate a stream */
+	wake_up_all(&zram->stream_wait);
 }
 
 static inline int is_partial_io(struct bio_vec *bvec)
@@ -203,110 +318,156 @@ static inline int is_partial_io(struct bio_vec *bvec)
 	return bvec->bv_len != PAGE_SIZE;
 }
 
-static int zram_bvec_read(struct zram *zram, struct bio_vec *bvec,
-			  u32 index, int offset, struct bio *bio)
+/*
+ * Read the page at @blk of the backing device into @mem.  The slot has
+ * been unlocked by then; like any read racing a write of the same
+ * sector, one that races a rewrite of this slot may see either data.
+ */
+static int zram_read_from_bdev(struct zram *zram, unsigned char *mem,
+			       unsigned long blk)
 {
-	int ret;
-	size_t clen;
 	struct page *page;
-	struct zobj_header *zheader;
-	unsigned char *user_mem, *cmem, *uncmem = NULL;
+	void *src;
+	int ret;
 
-	page = bvec->bv_page;
+	page = alloc_page(GFP_NOIO);
+	if (!page)
+		return -ENOMEM;
 
-	if (zram_test_flag(zram, index, ZRAM_ZERO)) {
-		handle_zero_page(bvec);
-		return 0;
+	ret = zram_bdev_rw(zram, page, blk, READ);
+	if (!ret) {
+		src = kmap_atomic(page);
+		memcpy(mem, src, PAGE_SIZE);
+		kunmap_atomic(src);
 	}
+	__free_page(page);
 
-	/* Requested page is not present in compressed area */
-	if (unlikely(!zram->table[index].handle)) {
-		pr_debug("Read before write: sector=%lu, size=%u",
-			 (ulong)(bio->bi_sector), bio->bi_size);
-		handle_zero_page(bvec);
-		return 0;
-	}
+	return ret;
+}
 
-	/* Page is stored uncompressed since it's incompressible */
-	if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
-		handle_uncompressed_page(zram, bvec, index, offset);
-		return 0;
-	}
+/*
+ * Decompress the page at @index into @mem, which must be PAGE_SIZE.
+ * Takes the table lock for reading, so this runs in parallel with
+ * other readers and with writers that are still compressing.  May
+ * sleep, waiting for a stream or reading back from the backing device,
+ * so @mem must not be a kmap_atomic() mapping.
+ */
+static int zram_decompress_page(struct zram *zram, unsigned char *mem,
+				u32 index)
+{
+	const struct zram_backend *backend = zram->backend;
+	struct zram_stream *zstrm = NULL;
+	unsigned char *cmem;
+	void *handle;
+	ktime_t start;
+	int ret = 0;
 
-	if (is_partial_io(bvec)) {
-		/* Use  a temporary buffer to decompress the page */
-		uncmem = kmalloc(PAGE_SIZE, GFP_KERNEL);
-		if (!uncmem) {
-			pr_info("Error allocating temp memory!\n");
-			return -ENOMEM;
-		}
+	might_sleep();
+
+	/* Must not sleep for a stream under the table lock */
+	if (backend->decompress_workmem)
+		zstrm = zram_stream_get(zram);
+
+	read_lock(&zram->tb_lock);
+	handle = zram->table[index].handle;
+	/* Racing readers all store 0; the idle marker takes the lock for writing */
+	zram->table[index].age = 0;
+
+	if (zram_test_flag(zram, index, ZRAM_WB)) {
+		unsigned long blk = zram->table[index].element;
+
+		read_unlock(&zram->tb_lock);
+		ret = zram_read_from_bdev(zram, mem, blk);
+		goto out;
 	}
 
-	user_mem = kmap_atomic(page);
-	if (!is_partial_io(bvec))
-		uncmem = user_mem;
-	clen = PAGE_SIZE;
+	if (zram_test_flag(zram, index, ZRAM_SAME)) {
+		zram_fill_page(mem, zram->table[index].element);
+		read_unlock(&zram->tb_lock);
+		goto out;
+	}
 
-	cmem = zs_map_object(zram->mem_pool, zram->table[index].handle);
+	if (!handle) {
+		read_unlock(&zram->tb_lock);
+		memset(mem, 0, PAGE_SIZE);
+		goto out;
+	}
 
-	ret = lzo1x_decompress_safe(cmem + sizeof(*zheader),
-				    zram->table[index].size,
-				    uncmem, &clen);
+	/* The entry cannot go away while this slot holds a reference */
+	if (zram_test_flag(zram, index, ZRAM_DEDUP))
+		handle = ((struct zram_entry *)handle)->handle;
 
-	if (is_partial_io(bvec)) {
-		memcpy(user_mem + bvec->bv_offset, uncmem + offset,
-		       bvec->bv_len);
-		kfree(uncmem);
+	/* Page is stored uncompressed since it's incompressible */
+	if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
+		cmem = kmap_atomic(handle);
+		memcpy(mem, cmem, PAGE_SIZE);
+		kunmap_atomic(cmem);
+	} else {
+		start = ktime_get();
+		cmem = zs_map_object(zram->mem_pool, handle);
+		ret = backend->decompress(cmem + sizeof(struct zobj_header),
+					  zram->table[index].size, mem,
+					  zstrm ? zstrm->workmem : NULL);
+		zs_unmap_object(zram->mem_pool, handle);
+		atomic64_add(ktime_to_ns(ktime_sub(ktime_get(), start)),
+			     &zram->stats.decompr_ns);
+		atomic64_inc(&zram->stats.num_decompr);
 	}
+	read_unlock(&zram->tb_lock);
 
-	zs_unmap_object(zram->mem_pool, zram->table[index].handle);
-	kunmap_atomic(user_mem);
+out:
+	if (zstrm)
+		zram_stream_put(zram, zstrm);
 
-	/* Should NEVER happen. Return bio error if it does. */
-	if (unlikely(ret != LZO_E_OK)) {
-		pr_err("Decompression failed! err=%d, page=%u\n", ret, index);
-		zram_stat64_inc(zram, &zram->stats.failed_reads);
+	/*
+	 * Should NEVER happen, short of a backing device error.
+	 * Return bio error if it does.
+	 */
+	if (unlikely(ret)) {
+		pr_err("Read failed! err=%d, page=%u\n", ret, index);
+		atomic64_inc(&zram->stats.failed_reads);
 		return ret;
 	}
 
-	flush_dcache_page(page);
-
 	return 0;
 }
 
-static int zram_read_before_write(struct zram *zram, char *mem, u32 index)
+static int zram_bvec_read(struct zram *zram, struct bio_vec *bvec,
+			  u32 index, int offset, struct bio *bio)
 {
 	int ret;
-	size_t clen = PAGE_SIZE;
-	struct zobj_header *zheader;
-	unsigned char *cmem;
+	struct page *page;
+	unsigned char *user_mem, *uncmem = NULL;
 
-	if (zram_test_flag(zram, index, ZRAM_ZERO) ||
-	    !zram->table[index].handle) {
-		memset(mem, 0, PAGE_SIZE);
-		return 0;
+	page = bvec->bv_page;
+
+	if (is_partial_io(bvec)) {
+		/* Use  a temporary buffer to decompress the page */
+		uncmem = kmalloc(PAGE_SIZE, GFP_NOIO);
+		if (!uncmem) {
+			pr_info("Error allocating temp memory!\n");
+			return -ENOMEM;
+		}
 	}
 
-	cmem = zs_map_object(zram->mem_pool, zram->table[index].handle);
+	/* Not kmap_atomic(): zram_decompress_page() may sleep */
+	user_mem = kmap(page);
+	if (!is_partial_io(bvec))
+		uncmem = user_mem;
 
-	/* Page is stored uncompressed since it's incompressible */
-	if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
-		memcpy(mem, cmem, PAGE_SIZE);
-		kunmap_atomic(cmem);
-		return 0;
-	}
+	ret = zram_decompress_page(zram, uncmem, index);
+	if (!ret && is_partial_io(bvec))
+		memcpy(user_mem + bvec->bv_offset, uncmem + offset,
+		       bvec->bv_len);
 
-	ret = lzo1x_decompress_safe(cmem + sizeof(*zheader),
-				    zram->table[index].size,
-				    mem, &clen);
-	zs_unmap_object(zram->mem_pool, zram->table[index].handle);
+	kunmap(page);
+	if (is_partial_io(bvec))
+		kfree(uncmem);
 
-	/* Should NEVER happen. Return bio error if it does. */
-	if (unlikely(ret != LZO_E_OK)) {
-		pr_err("Decompression failed! err=%d, page=%u\n", ret, index);
-		zram_stat64_inc(zram, &zram->stats.failed_reads);
+	if (ret)
 		return ret;
-	}
+
+	flush_dcache_page(page);
 
 	return 0;
 }
@@ -314,72 +475,83 @@ static int zram_read_before_write(struct zram *zram, char *mem, u32 index)
 static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 			   int offset)
 {
-	int ret;
-	u32 store_offset;
+	int ret = 0;
+	ktime_t start;
 	size_t clen;
+	u32 checksum;
 	void *handle;
+	unsigned long element;
+	struct zram_entry *entry = NULL, *new_entry = NULL;
 	struct zobj_header *zheader;
-	struct page *page, *page_store;
-	unsigned char *user_mem, *cmem, *src, *uncmem = NULL;
+	struct page *page;
+	struct zram_stream *zstrm = NULL;
+	unsigned char *user_mem = NULL, *cmem, *src, *uncmem = NULL;
 
 	page = bvec->bv_page;
-	src = zram->compress_buffer;
 
 	if (is_partial_io(bvec)) {
 		/*
 		 * This is a partial IO. We need to read the full page
 		 * before to write the changes.
 		 */
-		uncmem = kmalloc(PAGE_SIZE, GFP_KERNEL);
+		uncmem = kmalloc(PAGE_SIZE, GFP_NOIO);
 		if (!uncmem) {
 			pr_info("Error allocating temp memory!\n");
 			ret = -ENOMEM;
 			goto out;
 		}
-		ret = zram_read_before_write(zram, uncmem, index);
-		if (ret) {
-			kfree(uncmem);
+		ret = zram_decompress_page(zram, uncmem, index);
+		if (ret)
 			goto out;
-		}
 	}
 
-	/*
-	 * System overwrites unused sectors. Free memory associated
-	 * with this sector now.
-	 */
-	if (zram->table[index].handle ||
-	    zram_test_flag(zram, index, ZRAM_ZERO))
-		zram_free_page(zram, index);
+	zstrm = zram_stream_get(zram);
 
 	user_mem = kmap_atomic(page);
-
-	if (is_partial_io(bvec))
+	if (is_partial_io(bvec)) {
 		memcpy(uncmem + offset, user_mem + bvec->bv_offset,
 		       bvec->bv_len);
-	else
+		kunmap_atomic(user_mem);
+		user_mem = NULL;
+	} else {
 		uncmem = user_mem;
+	}
 
-	if (page_zero_filled(uncmem)) {
-		kunmap_atomic(user_mem);
-		if (is_partial_io(bvec))
-			kfree(uncmem);
-		zram_stat_inc(&zram->stats.pages_zero);
-		zram_set_flag(zram, index, ZRAM_ZERO);
-		ret = 0;
+	if (page_same_filled(uncmem, &element)) {
+		if (user_mem)
+			kunmap_atomic(user_mem);
+		/*
+		 * System overwrites unused sectors. Free memory
+		 * associated with this sector now.
+		 */
+		write_lock(&zram->tb_lock);
+		zram_free_page(zram, index);
+		zram_set_flag(zram, index, ZRAM_SAME);
+		zram->table[index].element = element;
+		write_unlock(&zram->tb_lock);
+		if (!element)
+			atomic_inc(&zram->stats.pages_zero);
+		atomic_inc(&zram->stats.pages_same);
 		goto out;
 	}
 
-	ret = lzo1x_1_compress(uncmem, PAGE_SIZE, src, &clen,
-			       zram->compress_workmem);
+	start = ktime_get();
+	ret = zram->backend->compress(uncmem, zstrm->buffer, &clen,
+				      zstrm->workmem);
+	atomic64_add(ktime_to_ns(ktime_sub(ktime_get(), start)),
+		     &zram->stats.compr_ns);
 
-	kunmap_atomic(user_mem);
-	if (is_partial_io(bvec))
-			kfree(uncmem);
+	if (user_mem) {
+		kunmap_atomic(user_mem);
+		uncmem = NULL;
+	}
 
-	if (unlikely(ret != LZO_E_OK)) {
+	if (unlikely(ret)) {
 		pr_err("Compression failed! err=%d\n", ret);
 		goto out;
 	}
+	atomic64_inc(&zram->stats.num_compr);
+	atomic64_add(clen, &zram->stats.compr_out);
 
 	/*
 	 * Page is incompressible. Store it as-is (uncompressed)
@@ -388,84 +560,97 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 	 */
 	if (unlikely(clen > max_zpage_size)) {
 		clen = PAGE_SIZE;
-		page_store = alloc_page(GFP_NOIO | __GFP_HIGHMEM);
-		if (unlikely(!page_store)) {
+		handle = alloc_page(GFP_NOIO | __GFP_HIGHMEM);
+		if (unlikely(!handle)) {
 			pr_info("Error allocating memory for "
 				"incompressible page: %u\n", index);
 			ret = -ENOMEM;
 			goto out;
 		}
 
-		store_offset = 0;
-		zram_set_flag(zram, index, ZRAM_UNCOMPRESSED);
-		zram_stat_inc(&zram->stats.pages_expand);
-		handle = page_store;
-		src = kmap_atomic(page);
-		cmem = kmap_atomic(page_store);
-		goto memstore;
-	}
-
-	handle = zs_malloc(zram->mem_pool, clen + sizeof(*zheader));
-	if (!handle) {
-		pr_info("Error allocating memory for compressed "
-			"page: %u, size=%zu\n", index, clen);
-		ret = -ENOMEM;
-		goto out;
-	}
-	cmem = zs_map_object(zram->mem_pool, handle);
-
-memstore:
+		cmem = kmap_atomic(handle);
+		src = uncmem ? uncmem : kmap_atomic(page);
+		memcpy(cmem, src, PAGE_SIZE);
+		if (!uncmem)
+			kunmap_atomic(src);
+		kunmap_atomic(cmem);
+	} else if (zram->dedup &&
+		   (entry = zram_dedup_find(zram, zstrm->buffer, clen,
+					    &checksum))) {
+		/* Identical data is already stored: share it */
+		handle = entry;
+	} else {
+		handle = zs_malloc(zram->mem_pool, clen + sizeof(*zheader));
+		if (!handle) {
+			pr_info("Error allocating memory for compressed "
+				"page: %u, size=%zu\n", index, clen);
+			ret = -ENOMEM;
+			goto out;
+		}
+		cmem = zs_map_object(zram->mem_pool, handle);
 #if 0
-	/* Back-reference needed for memory defragmentation */
-	if (!zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)) {
+		/* Back-reference needed for memory defragmentation */
 		zheader = (struct zobj_header *)cmem;
 		zheader->table_idx = index;
 		cmem += sizeof(*zheader);
-	}
 #endif
-
-	memcpy(cmem, src, clen);
-
-	if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
-		kunmap_atomic(cmem);
-		kunmap_atomic(src);
-	} else {
+		memcpy(cmem, zstrm->buffer, clen);
 		zs_unmap_object(zram->mem_pool, handle);
+
+		if (zram->dedup) {
+			new_entry = zram_dedup_insert(zram, handle, clen,
+						      checksum);
+			if (new_entry)
+				handle = new_entry;
+		}
 	}
 
+	/* The compressed data is stored; let another writer have the stream */
+	zram_stream_put(zram, zstrm);
+	zstrm = NULL;
+
+	/*
+	 * Free the previous contents of this sector and install the new
+	 * object atomically with respect to readers of the same index.
+	 */
+	write_lock(&zram->tb_lock);
+	zram_free_page(zram, index);
 	zram->table[index].handle = handle;
 	zram->table[index].size = clen;
+	if (clen == PAGE_SIZE)
+		zram_set_flag(zram, index, ZRAM_UNCOMPRESSED);
+	else if (entry || new_entry)
+		zram_set_flag(zram, index, ZRAM_DEDUP);
+	write_unlock(&zram->tb_lock);
 
 	/* Update stats */
-	zram_stat64_add(zram, &zram->stats.compr_size, clen);
-	zram_stat_inc(&zram->stats.pages_stored);
-	if (clen <= PAGE_SIZE / 2)
-		zram_stat_inc(&zram->stats.good_compress);
-
-	return 0;
+	if (entry)
+		atomic64_add(clen, &zram->stats.dup_data_size);
+	else
+		atomic64_add(clen, &zram->stats.compr_size);
+	atomic_inc(&zram->stats.pages_stored);
+	if (clen == PAGE_SIZE)
+		atomic_inc(&zram->stats.pages_expand);
+	else if (clen <= PAGE_SIZE / 2)
+		atomic_inc(&zram->stats.good_compress);
 
 out:
+	if (zstrm)
+		zram_stream_put(zram, zstrm);
+	if (is_partial_io(bvec))
+		kfree(uncmem);
 	if (ret)
-		zram_stat64_inc(zram, &zram->stats.failed_writes);
+		atomic64_inc(&zram->stats.failed_writes);
 	return ret;
 }
 
 static int zram_bvec_rw(struct zram *zram, struct bio_vec *bvec, u32 index,
 			int offset, struct bio *bio, int rw)
 {
-	int ret;
-
-	if (rw == READ) {
-		down_read(&zram->lock);
-		ret = zram_bvec_read(zram, bvec, index, offset, bio);
-		up_read(&zram->lock);
-	} else {
-		down_write(&zram->lock);
-		ret = zram_bvec_write(zram, bvec, index, offset);
-		up_write(&zram->lock);
-	}
+	if (rw == READ)
+		return zram_bvec_read(zram, bvec, index, offset, bio);
 
-	return ret;
+	return zram_bvec_write(zram, bvec, index, offset);
 }
 
 static void update_position(u32 *index, int *offset, struct bio_vec *bvec)
@@ -483,10 +668,10 @@ static void __zram_make_request(struct zram *zram, struct bio *bio, int rw)
 
 	switch (rw) {
 	case READ:
-		zram_stat64_inc(zram, &zram->stats.num_reads);
+		atomic64_inc(&zram->stats.num_reads);
 		break;
 	case WRITE:
-		zram_stat64_inc(zram, &zram->stats.num_writes);
+		atomic64_inc(&zram->stats.num_writes);
 		break;
 	}
 
@@ -562,7 +747,7 @@ static void zram_make_request(struct request_queue *queue, struct bio *bio)
 		goto error_unlock;
 
 	if (!valid_io_request(zram, bio)) {
-		zram_stat64_inc(zram, &zram->stats.invalid_io);
+		atomic64_inc(&zram->stats.invalid_io);
 		goto error_unlock;
 	}
 
@@ -577,34 +762,141 @@ error:
 	bio_io_error(bio);
 }
 
-void __zram_reset_device(struct zram *zram)
+#ifdef CONFIG_ZRAM_WRITEBACK
+/*
+ * Age every stored slot by one idle period.  Any access to a slot
+ * resets its age, so after n calls a slot aged n has not been touched
+ * since the first of them.
+ */
+void zram_mark_idle(struct zram *zram)
 {
 	size_t index;
 
-	zram->init_done = 0;
+	for (index = 0; index < zram->disksize >> PAGE_SHIFT; index++) {
+		write_lock(&zram->tb_lock);
+		if (zram->table[index].handle &&
+		    zram->table[index].age < 0xff)
+			zram->table[index].age++;
+		write_unlock(&zram->tb_lock);
+
+		/* A large device has millions of slots */
+		if ((index & 1023) == 1023)
+			cond_resched();
+	}
+}
 
-	/* Free various per-device buffers */
-	kfree(zram->compress_workmem);
-	free_pages((unsigned long)zram->compress_buffer, 1);
+static bool zram_can_writeback(struct zram *zram, size_t index, int mode,
+			       unsigned int min_age)
+{
+	struct table *slot = &zram->table[index];
+
+	if (!slot->handle || slot->flags & (BIT(ZRAM_SAME) | BIT(ZRAM_WB) |
+					    BIT(ZRAM_UNDER_WB)))
+		return false;
+	if ((mode & ZRAM_WB_HUGE) && !(slot->flags & BIT(ZRAM_UNCOMPRESSED)))
+		return false;
+	if ((mode & ZRAM_WB_IDLE) && slot->age < min_age)
+		return false;
+	return true;
+}
 
-	zram->compress_workmem = NULL;
-	zram->compress_buffer = NULL;
+/*
+ * Move the slots selected by @mode to the backing device, one page at
+ * a time.  The slot stays readable from memory while its page is being
+ * written; if it is rewritten or freed meanwhile, the block is dropped
+ * and the new contents are kept.  Called with init_lock held for
+ * reading.  Returns 0 or the first error, -ENOSPC once the backing
+ * device is full.
+ */
+int zram_writeback(struct zram *zram, int mode, unsigned int min_age)
+{
+	size_t index;
+	unsigned long blk;
+	struct page *page;
+	void *mem;
+	int ret = 0;
+
+	if (!zram->bdev)
+		return -ENODEV;
+
+	page = alloc_page(GFP_KERNEL);
+	if (!page)
+		return -ENOMEM;
 
-	/* Free all pages that are still in this zram device */
 	for (index = 0; index < zram->disksize >> PAGE_SHIFT; index++) {
-		void *handle = zram->table[index].handle;
-		if (!handle)
+		write_lock(&zram->tb_lock);
+		if (!zram_can_writeback(zram, index, mode, min_age)) {
+			write_unlock(&zram->tb_lock);
+			continue;
+		}
+		zram_set_flag(zram, index, ZRAM_UNDER_WB);
+		write_unlock(&zram->tb_lock);
+
+		blk = zram_bdev_alloc_block(zram);
+		if (!blk) {
+			ret = -ENOSPC;
+			goto abort;
+		}
+
+		mem = kmap(page);
+		ret = zram_decompress_page(zram, mem, index);
+		kunmap(page);
+		if (!ret)
+			ret = zram_bdev_rw(zram, page, blk, WRITE);
+		if (ret) {
+			zram_bdev_free_block(zram, blk);
+			goto abort;
+		}
+
+		write_lock(&zram->tb_lock);
+		if (!zram_test_flag(zram, index, ZRAM_UNDER_WB)) {
+			/* Rewritten or freed while we were at it */
+			write_unlock(&zram->tb_lock);
+			zram_bdev_free_block(zram, blk);
 			continue;
+		}
+		zram_free_page(zram, index);
+		zram_set_flag(zram, index, ZRAM_WB);
+		zram->table[index].element = blk;
+		atomic_inc(&zram->stats.pages_stored);
+		write_unlock(&zram->tb_lock);
 
-		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)))
-			__free_page(handle);
-		else
-			zs_free(zram->mem_pool, handle);
+		cond_resched();
 	}
 
+	__free_page(page);
+	return 0;
+
+abort:
+	write_lock(&zram->tb_lock);
+	zram_clear_flag(zram, index, ZRAM_UNDER_WB);
+	write_unlock(&zram->tb_lock);
+	__free_page(page);
+	return ret;
+}
+#endif
+
+void __zram_reset_device(struct zram *zram)
+{
+	size_t index;
+
+	zram->init_done = 0;
+
+	/* Free various per-device buffers */
+	zram_destroy_streams(zram);
+
+	/* Free all pages that are still in this zram device */
+	for (index = 0; index < zram->disksize >> PAGE_SHIFT; index++)
+		zram_free_page(zram, index);
+
 	vfree(zram->table);
 	zram->table = NULL;
 
+	/* Like disksize, the backing device has to be set up again */
+	zram_reset_backing_dev(zram);
+
+	zram_dedup_fini(zram);
+
 	zs_destroy_pool(zram->mem_pool);
 	zram->mem_pool = NULL;
 
@@ -625,6 +917,7 @@ int zram_init_device(struct zram *zram)
 {
 	int ret;
 	size_t num_pages;
+	struct zram_stream *zstrm;
 
 	down_write(&zram->init_lock);
 
@@ -635,20 +928,19 @@ int zram_init_device(struct zram *zram)
 
 	zram_set_disksize(zram, totalram_pages << PAGE_SHIFT);
 
-	zram->compress_workmem = kzalloc(LZO1X_MEM_COMPRESS, GFP_KERNEL);
-	if (!zram->compress_workmem) {
-		pr_err("Error allocating compressor working memory!\n");
-		ret = -ENOMEM;
-		goto fail_no_table;
-	}
-
-	zram->compress_buffer =
-		(void *)__get_free_pages(GFP_KERNEL | __GFP_ZERO, 1);
-	if (!zram->compress_buffer) {
-		pr_err("Error allocating compressor buffer space\n");
+	/*
+	 * Allocate the first compression stream up front so that a
+	 * device that cannot compress at all fails here rather than on
+	 * its first write.  The rest are created on demand.
+	 */
+	zstrm = zram_stream_alloc(zram->backend, GFP_KERNEL);
+	if (!zstrm) {
+		pr_err("Error allocating compression stream\n");
 		ret = -ENOMEM;
 		goto fail_no_table;
 	}
+	zram->avail_streams = 1;
+	list_add(&zstrm->list, &zram->idle_streams);
 
 	num_pages = zram->disksize >> PAGE_SHIFT;
 	zram->table = vzalloc(num_pages * sizeof(*zram->table));
@@ -658,12 +950,20 @@ int zram_init_device(struct zram *zram)
 		goto fail_no_table;
 	}
 
+	if (zram->dedup && zram_dedup_init(zram, num_pages)) {
+		pr_err("Error allocating deduplication index\n");
+		ret = -ENOMEM;
+		goto fail;
+	}
+
 	set_capacity(zram->disk, zram->disksize >> SECTOR_SHIFT);
 
 	/* zram devices sort of resembles non-rotational disks */
 	queue_flag_set_unlocked(QUEUE_FLAG_NONROT, zram->disk->queue);
 
-	zram->mem_pool = zs_create_pool("zram", GFP_NOIO | __GFP_HIGHMEM);
+	/* Named after the disk so each device gets its own pool stats */
+	zram->mem_pool = zs_create_pool(zram->disk->disk_name,
+					GFP_NOIO | __GFP_HIGHMEM);
 	if (!zram->mem_pool) {
 		pr_err("Error creating memory pool\n");
 		ret = -ENOMEM;
@@ -692,8 +992,10 @@ static void zram_slot_free_notify(struct block_device *bdev,
 	struct zram *zram;
 
 	zram = bdev->bd_disk->private_data;
+	write_lock(&zram->tb_lock);
 	zram_free_page(zram, index);
-	zram_stat64_inc(zram, &zram->stats.notify_free);
+	write_unlock(&zram->tb_lock);
+	atomic64_inc(&zram->stats.notify_free);
 }
 
 static const struct block_device_operations zram_devops = {
@@ -705,9 +1007,14 @@ static int create_device(struct zram *zram, int device_id)
 {
 	int ret = 0;
 
-	init_rwsem(&zram->lock);
 	init_rwsem(&zram->init_lock);
-	spin_lock_init(&zram->stat64_lock);
+	rwlock_init(&zram->tb_lock);
+	spin_lock_init(&zram->stream_lock);
+	spin_lock_init(&zram->dedup_lock);
+	INIT_LIST_HEAD(&zram->idle_streams);
+	init_waitqueue_head(&zram->stream_wait);
+	zram->max_streams = num_online_cpus();
+	zram->backend = zram_default_backend();
 
 	zram->queue = blk_alloc_queue(GFP_KERNEL);
 	if (!zram->queue) {
@@ -17,6 +17,8 @@
 
 #include <linux/spinlock.h>
 #include <linux/mutex.h>
+#include <linux/rwsem.h>
+#include <linux/wait.h>
 
 #include "../zsmalloc/zsmalloc.h"
 
@@ -71,8 +73,20 @@ enum zram_pageflags {
 	/* Page is stored uncompressed */
 	ZRAM_UNCOMPRESSED,
 
-	/* Page consists entirely of zeros */
-	ZRAM_ZERO,
+	/*
+	 * Page consists entirely of one repeated word, kept in
+	 * table[].element; nothing is allocated for it
+	 */
+	ZRAM_SAME,
+
+	/* Compressed object is shared: handle is a struct zram_entry */
+	ZRAM_DEDUP,
+
+	/* Page lives on the backing device, at block table[].element */
+	ZRAM_WB,
+
+	/* Page is being written back; cleared if the slot changes */
+	ZRAM_UNDER_WB,
 
 	__NR_ZRAM_PAGEFLAGS,
 };
@@ -81,34 +95,109 @@ enum zram_pageflags {
 
 /* Allocated for each disk page */
 struct table {
-	void *handle;
+	union {
+		void *handle;
+		unsigned long element;	/* ZRAM_SAME, ZRAM_WB */
+	};
 	u16 size;	/* object size (excluding header) */
-	u8 count;	/* object ref count (not yet used) */
+	u8 age;		/* idle periods since last access, saturating */
 	u8 flags;
 } __attribute__((aligned(4)));
 
 struct zram_stats {
-	u64 compr_size;		/* compressed size of pages stored */
-	u64 num_reads;		/* failed + successful */
-	u64 num_writes;		/* --do-- */
-	u64 failed_reads;	/* should NEVER! happen */
-	u64 failed_writes;	/* can happen when memory is too low */
-	u64 invalid_io;		/* non-page-aligned I/O requests */
-	u64 notify_free;	/* no. of swap slot free notifications */
-	u32 pages_zero;		/* no. of zero filled pages */
-	u32 pages_stored;	/* no. of pages currently stored */
-	u32 good_compress;	/* % of pages with compression ratio<=50% */
-	u32 pages_expand;	/* % of incompressible pages */
+	atomic64_t compr_size;	/* compressed size of pages stored */
+	atomic64_t num_reads;	/* failed + successful */
+	atomic64_t num_writes;	/* --do-- */
+	atomic64_t failed_reads;	/* should NEVER! happen */
+	atomic64_t failed_writes;	/* can happen when memory is too low */
+	atomic64_t invalid_io;	/* non-page-aligned I/O requests */
+	atomic64_t notify_free;	/* no. of swap slot free notifications */
+	atomic_t pages_zero;	/* no. of zero filled pages */
+	atomic_t pages_same;	/* no. of same filled pages, zero included */
+	atomic_t pages_stored;	/* no. of pages currently stored */
+	atomic_t good_compress;	/* % of pages with compression ratio<=50% */
+	atomic_t pages_expand;	/* % of incompressible pages */
+	/* Cost of the compression backend */
+	atomic64_t num_compr;	/* pages run through the compressor */
+	atomic64_t compr_out;	/* bytes it produced for them */
+	atomic64_t compr_ns;	/* time spent compressing */
+	atomic64_t num_decompr;	/* pages decompressed */
+	atomic64_t decompr_ns;	/* time spent decompressing */
+	/* Deduplication */
+	atomic64_t dup_data_size;	/* compressed bytes shared, not stored */
+	atomic64_t meta_data_size;	/* memory used to track sharing */
+	/* Writeback */
+	atomic_t bd_count;	/* pages currently on the backing device */
+	atomic64_t bd_reads;	/* pages read back from it */
+	atomic64_t bd_writes;	/* pages written to it */
+};
+
+/* A compressed object that may be shared by several table entries */
+struct zram_entry {
+	struct hlist_node node;	/* in zram->dedup_hash */
+	void *handle;		/* zsmalloc object */
+	size_t len;		/* compressed size */
+	u32 checksum;
+	int refcount;		/* protected by zram->dedup_lock */
+};
+
+/* Compressor output buffer; large enough for any backend's worst case */
+#define ZRAM_COMP_BUF_SIZE	(2 * PAGE_SIZE)
+
+/*
+ * A compression algorithm.  compress() takes one page and returns 0 and
+ * the output length, or an error; decompress() must produce exactly one
+ * page.  workmem is a stream's working area of workmem_size() bytes; it
+ * is passed to decompress() only if decompress_workmem is set, in which
+ * case readers take a stream too.
+ */
+struct zram_backend {
+	const char *name;
+	size_t (*workmem_size)(void);
+	int decompress_workmem;
+	int (*compress)(const unsigned char *src, unsigned char *dst,
+			size_t *dst_len, void *workmem);
+	int (*decompress)(const unsigned char *src, size_t src_len,
+			  unsigned char *dst, void *workmem);
+};
+
+/*
+ * Compression workspace.  Writers take one from the device's pool for
+ * the duration of a compression, so up to max_streams pages can be
+ * compressed in parallel.
+ */
+struct zram_stream {
+	void *workmem;
+	void *buffer;		/* compressed output, ZRAM_COMP_BUF_SIZE */
+	struct list_head list;
 };
 
 struct zram {
 	struct zs_pool *mem_pool;
-	void *compress_workmem;
-	void *compress_buffer;
+	const struct zram_backend *backend;
 	struct table *table;
-	spinlock_t stat64_lock;	/* protect 64-bit stats */
-	struct rw_semaphore lock; /* protect compression buffers and table
-				   * against concurrent read and writes */
+	rwlock_t tb_lock;	/* protect table entries */
+
+	spinlock_t stream_lock;	/* protect the stream pool below */
+	struct list_head idle_streams;
+	wait_queue_head_t stream_wait;
+	int avail_streams;	/* streams allocated, idle or in use */
+	int max_streams;
+
+	/* Content index for deduplication, if enabled */
+	int dedup;
+	spinlock_t dedup_lock;
+	struct hlist_head *dedup_hash;
+	size_t dedup_hash_size;
+
+#ifdef CONFIG_ZRAM_WRITEBACK
+	/* Backing device for writeback, if one was set */
+	char *backing_dev;
+	struct block_device *bdev;
+	unsigned long *bd_bitmap;	/* blocks in use */
+	unsigned long bd_nr_pages;
+#endif
+
 	struct request_queue *queue;
 	struct gendisk *disk;
 	int init_done;
@@ -131,5 +220,42 @@ extern struct attribute_group zram_disk_attr_group;
 
 extern int zram_init_device(struct zram *zram);
 extern void __zram_reset_device(struct zram *zram);
+extern void zram_set_max_streams(struct zram *zram, int num);
+
+extern const struct zram_backend *zram_default_backend(void);
+extern const struct zram_backend *zram_find_backend(const char *buf);
+extern ssize_t zram_show_backends(const struct zram_backend *cur, char *buf);
+
+extern int zram_dedup_init(struct zram *zram, size_t num_pages);
+extern void zram_dedup_fini(struct zram *zram);
+extern struct zram_entry *zram_dedup_find(struct zram *zram, const void *mem,
+					  size_t len, u32 *checksum);
+extern struct zram_entry *zram_dedup_insert(struct zram *zram, void *handle,
+					    size_t len, u32 checksum);
+extern bool zram_dedup_put(struct zram *zram, struct zram_entry *entry);
+
+/* What zram_writeback() writes out */
+#define ZRAM_WB_IDLE	(1 << 0)	/* slots idle for min_age periods */
+#define ZRAM_WB_HUGE	(1 << 1)	/* slots stored uncompressed */
+
+#ifdef CONFIG_ZRAM_WRITEBACK
+extern void zram_mark_idle(struct zram *zram);
+extern int zram_writeback(struct zram *zram, int mode, unsigned int min_age);
+extern int zram_set_backing_dev(struct zram *zram, const char *path);
+extern void zram_reset_backing_dev(struct zram *zram);
+extern unsigned long zram_bdev_alloc_block(struct zram *zram);
+extern void zram_bdev_free_block(struct zram *zram, unsigned long blk);
+extern int zram_bdev_rw(struct zram *zram, struct page *page,
+			unsigned long blk, int rw);
+#else
+static inline void zram_reset_backing_dev(struct zram *zram) {}
+static inline void zram_bdev_free_block(struct zram *zram,
+					unsigned long blk) {}
+static inline int zram_bdev_rw(struct zram *zram, struct page *page,
+			       unsigned long blk, int rw)
+{
+	return -EIO;
+}
+#endif
 
 #endif
@@ -0,0 +1,203 @@
+/*
+ * Compressed RAM block device
+ *
+ * Backing device for writeback.  Slots that are cold or do not compress
+ * can be written out, one page per block, to a block device named by
+ * the user; the table entry then holds the block index instead of a
+ * handle and reads fetch the page back synchronously, from a work item
+ * when called under generic_make_request().  Blocks are
+ * allocated from a bitmap; block 0 is never used so that 0 can mean
+ * "none".
+ *
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+#define KMSG_COMPONENT "zram"
+#define pr_fmt(fmt) KMSG_COMPONENT ": " fmt
+
+#include <linux/kernel.h>
+#include <linux/bio.h>
+#include <linux/bitops.h>
+#include <linux/blkdev.h>
+#include <linux/completion.h>
+#include <linux/fs.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/vmalloc.h>
+#include <linux/workqueue.h>
+
+#include "zram_drv.h"
+
+#define ZRAM_BDEV_MODE	(FMODE_READ | FMODE_WRITE | FMODE_EXCL)
+
+/*
+ * Open @path as the backing device.  The device must not be initialized
+ * yet; called with init_lock held for writing.
+ */
+int zram_set_backing_dev(struct zram *zram, const char *path)
+{
+	struct block_device *bdev;
+	unsigned long nr_pages, *bitmap;
+	char *name;
+
+	name = kstrdup(path, GFP_KERNEL);
+	if (!name)
+		return -ENOMEM;
+
+	bdev = blkdev_get_by_path(name, ZRAM_BDEV_MODE, zram);
+	if (IS_ERR(bdev)) {
+		kfree(name);
+		return PTR_ERR(bdev);
+	}
+
+	nr_pages = i_size_read(bdev->bd_inode) >> PAGE_SHIFT;
+	if (nr_pages < 2) {
+		blkdev_put(bdev, ZRAM_BDEV_MODE);
+		kfree(name);
+		return -EINVAL;
+	}
+
+	bitmap = vzalloc(BITS_TO_LONGS(nr_pages) * sizeof(long));
+	if (!bitmap) {
+		blkdev_put(bdev, ZRAM_BDEV_MODE);
+		kfree(name);
+		return -ENOMEM;
+	}
+	/* Block 0 stands for "no block" */
+	set_bit(0, bitmap);
+
+	zram_reset_backing_dev(zram);
+	zram->backing_dev = name;
+	zram->bdev = bdev;
+	zram->bd_bitmap = bitmap;
+	zram->bd_nr_pages = nr_pages;
+
+	pr_info("%s: backing device %s, %lu pages\n",
+		zram->disk->disk_name, name, nr_pages - 1);
+	return 0;
+}
+
+void zram_reset_backing_dev(struct zram *zram)
+{
+	if (!zram->bdev)
+		return;
+
+	blkdev_put(zram->bdev, ZRAM_BDEV_MODE);
+	vfree(zram->bd_bitmap);
+	kfree(zram->backing_dev);
+	zram->bdev = NULL;
+	zram->bd_bitmap = NULL;
+	zram->bd_nr_pages = 0;
+	zram->backing_dev = NULL;
+}
+
+/* Returns a free block, or 0 if the backing device is full */
+unsigned long zram_bdev_alloc_block(struct zram *zram)
+{
+	unsigned long blk;
+
+	do {
+		blk = find_next_zero_bit(zram->bd_bitmap, zram->bd_nr_pages, 1);
+		if (blk >= zram->bd_nr_pages)
+			return 0;
+	} while (test_and_set_bit(blk, zram->bd_bitmap));
+
+	atomic_inc(&zram->stats.bd_count);
+	return blk;
+}
+
+void zram_bdev_free_block(struct zram *zram, unsigned long blk)
+{
+	WARN_ON(!test_and_clear_bit(blk, zram->bd_bitmap));
+	atomic_dec(&zram->stats.bd_count);
+}
+
+static void zram_bdev_end_io(struct bio *bio, int err)
+{
+	complete(bio->bi_private);
+}
+
+static int __zram_bdev_rw(struct zram *zram, struct page *page,
+			  unsigned long blk, int rw)
+{
+	DECLARE_COMPLETION_ONSTACK(done);
+	struct bio *bio;
+	int ret = 0;
+
+	bio = bio_alloc(GFP_NOIO, 1);
+	if (!bio)
+		return -ENOMEM;
+
+	bio->bi_sector = (sector_t)blk << SECTORS_PER_PAGE_SHIFT;
+	bio->bi_bdev = zram->bdev;
+	bio->bi_end_io = zram_bdev_end_io;
+	bio->bi_private = &done;
+	if (!bio_add_page(bio, page, PAGE_SIZE, 0)) {
+		bio_put(bio);
+		return -EIO;
+	}
+
+	submit_bio(rw | REQ_SYNC, bio);
+	wait_for_completion(&done);
+
+	if (!test_bit(BIO_UPTODATE, &bio->bi_flags))
+		ret = -EIO;
+	bio_put(bio);
+
+	if (ret)
+		pr_err("%s: backing device %s failed, block %lu\n",
+		       zram->disk->disk_name, rw & WRITE ? "write" : "read",
+		       blk);
+	else if (rw & WRITE)
+		atomic64_inc(&zram->stats.bd_writes);
+	else
+		atomic64_inc(&zram->stats.bd_reads);
+
+	return ret;
+}
+
+struct zram_bdev_work {
+	struct work_struct work;
+	struct zram *zram;
+	struct page *page;
+	unsigned long blk;
+	int rw;
+	int ret;
+};
+
+static void zram_bdev_rw_work(struct work_struct *work)
+{
+	struct zram_bdev_work *zw = container_of(work, struct zram_bdev_work,
+						 work);
+
+	zw->ret = __zram_bdev_rw(zw->zram, zw->page, zw->blk, zw->rw);
+}
+
+/*
+ * Synchronously read or write (@rw) one page at block @blk.
+ *
+ * Reads come from zram_make_request(), inside generic_make_request(),
+ * where a submitted bio is only queued on current->bio_list until the
+ * caller returns: waiting for it there would never end.  In that case
+ * the I/O is issued from a work item, which has no bio_list, instead.
+ */
+int zram_bdev_rw(struct zram *zram, struct page *page, unsigned long blk,
+		 int rw)
+{
+	struct zram_bdev_work zw;
+
+	if (!current->bio_list)
+		return __zram_bdev_rw(zram, page, blk, rw);
+
+	zw.zram = zram;
+	zw.page = page;
+	zw.blk = blk;
+	zw.rw = rw;
+	INIT_WORK_ONSTACK(&zw.work, zram_bdev_rw_work);
+	queue_work(system_unbound_wq, &zw.work);
+	flush_work(&zw.work);
+	destroy_work_on_stack(&zw.work);
+
+	return zw.ret;
+}
@@ -1116,6 +1116,7 @@ int flush_old_exec(struct linux_binprm * bprm)
 	set_fs(USER_DS);
 	current->flags &=
 		~(PF_RANDOMIZE | PF_FORKNOEXEC | PF_KTHREAD | PF_NOFREEZE);
+	lowmem_adj_index_update(current);
 	flush_thread();
 	current->personality &= ~bprm->per_clear;
 
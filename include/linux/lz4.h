@@ -0,0 +1,52 @@
+#ifndef __LZ4_H__
+#define __LZ4_H__
+/*
+ *  LZ4 Public Kernel Interface
+ *
+ *  LZ4 is an LZ77-type byte-oriented compressor: a block is a sequence
+ *  of (literal run, back-reference) pairs with no entropy coding, which
+ *  makes decompression a little faster than LZO at a similar ratio.
+ *  The block format is that of the reference implementation,
+ *  http://code.google.com/p/lz4/, so data is interchangeable with it.
+ */
+
+#define LZ4_HASH_LOG		12
+#define LZ4_MEM_COMPRESS	((1 << LZ4_HASH_LOG) * sizeof(u32))
+
+/* Hash table, 64 KiB of chain links and two pointers */
+#define LZ4HC_MEM_COMPRESS	((1 << 15) * sizeof(u32) + \
+				 (1 << 16) * sizeof(u16) + \
+				 2 * sizeof(void *))
+
+/* Largest input the block format can describe */
+#define LZ4_MAX_INPUT_SIZE	0x7E000000
+
+/* Worst-case output size of lz4_compress() for @isize bytes of input */
+#define lz4_compressbound(isize)	((isize) + ((isize) / 255) + 16)
+
+/*
+ * Compress @src_len bytes of @src into @dst, which must have room for
+ * lz4_compressbound(src_len) bytes.  @wrkmem must be LZ4_MEM_COMPRESS
+ * bytes.  On success stores the compressed length in @dst_len and
+ * returns 0.
+ */
+int lz4_compress(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len, void *wrkmem);
+
+/*
+ * As lz4_compress(), but searching much harder for matches: slower,
+ * with a better ratio.  @wrkmem must be LZ4HC_MEM_COMPRESS bytes.
+ */
+int lz4hc_compress(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len, void *wrkmem);
+
+/*
+ * Safe decompression: never reads past @src + @src_len nor writes past
+ * @dst + *@dst_len, whatever the input.  On entry @dst_len holds the
+ * size of @dst, on success it holds the decompressed length.
+ * Returns 0 on success, or -1 if the input is corrupt or does not fit.
+ */
+int lz4_decompress_safe(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len);
+
+#endif
@@ -1134,6 +1134,7 @@ struct sched_class {
 
 #ifdef CONFIG_SMP
 	int  (*select_task_rq)(struct task_struct *p, int sd_flag, int flags);
+	void (*migrate_task_rq)(struct task_struct *p, int next_cpu);
 
 	void (*pre_schedule) (struct rq *this_rq, struct task_struct *task);
 	void (*post_schedule) (struct rq *this_rq);
@@ -1168,6 +1169,23 @@ struct load_weight {
 	unsigned long weight, inv_weight;
 };
 
+/*
+ * Per-entity load tracking.  Time is counted in 1024ns units and split
+ * into 1024-unit periods; the runnable time in each past period is
+ * decayed by y^n, n periods on, where y^32 = 1/2.
+ */
+struct sched_avg {
+	/*
+	 * These sums represent an infinite geometric series and so are bound
+	 * above by 1024/(1-y).  Thus we only need a u32 to store them for all
+	 * choices of y < 1-2^(-32)*1024.
+	 */
+	u32 runnable_avg_sum, runnable_avg_period;
+	u64 last_runnable_update;
+	s64 decay_count;
+	unsigned long load_avg_contrib;
+};
+
 #ifdef CONFIG_SCHEDSTATS
 struct sched_statistics {
 	u64			wait_start;
@@ -1204,6 +1222,20 @@ struct sched_statistics {
 };
 #endif
 
+#ifdef CONFIG_CPU_FREQ
+/*
+ * Recent CPU demand of a task, in kHz: the speed-weighted time it ran in
+ * each window of TASK_DEMAND_WINDOW, averaged over past windows.  It
+ * moves with the task, so a CPU knows what a task needs on arrival.
+ */
+struct task_demand {
+	u64 window_start;	/* rq clock at the start of this window */
+	u64 work;		/* ns * kHz run in this window */
+	unsigned int demand;
+	int cpu;		/* CPU last enqueued on, or -1 */
+};
+#endif
+
 struct sched_entity {
 	struct load_weight	load;		/* for load-balancing */
 	struct rb_node		run_node;
@@ -1221,6 +1253,11 @@ struct sched_entity {
 	struct sched_statistics statistics;
 #endif
 
+#ifdef CONFIG_SMP
+	/* Per-entity load tracking */
+	struct sched_avg	avg;
+#endif
+
 #ifdef CONFIG_FAIR_GROUP_SCHED
 	struct sched_entity	*parent;
 	/* rq on which this entity is (to be) queued: */
@@ -1282,6 +1319,9 @@ struct task_struct {
 #ifdef CONFIG_CGROUP_SCHED
 	struct task_group *sched_task_group;
 #endif
+#ifdef CONFIG_CPU_FREQ
+	struct task_demand demand;
+#endif
 
 #ifdef CONFIG_PREEMPT_NOTIFIERS
 	/* list of struct preempt_notifier: */
@@ -1386,6 +1426,13 @@ struct task_struct {
 	struct list_head ptraced;
 	struct list_head ptrace_entry;
 
+#ifdef CONFIG_ANDROID_LMK_ADJ_INDEX
+	/* lowmemorykiller candidate list; group leaders only */
+	struct hlist_node lmk_adj_node;
+	int lmk_adj;			/* bucket the task is filed under */
+	unsigned long lmk_rss;		/* rss when last filed or looked at */
+#endif
+
 	/* PID/PID hash table linkage. */
 	struct pid_link pids[PIDTYPE_MAX];
 	struct list_head thread_group;
@@ -2057,7 +2104,6 @@ extern unsigned int sysctl_sched_migration_cost;
 extern unsigned int sysctl_sched_nr_migrate;
 extern unsigned int sysctl_sched_time_avg;
 extern unsigned int sysctl_timer_migration;
-extern unsigned int sysctl_sched_shares_window;
 
 int sched_proc_update_handler(struct ctl_table *table, int write,
 		void __user *buffer, size_t *length,
@@ -2843,6 +2889,26 @@ static inline unsigned long rlimit_max(unsigned int limit)
 	return task_rlimit_max(current, limit);
 }
 
+#ifdef CONFIG_CPU_FREQ
+/*
+ * Scheduler hook for cpufreq governors.  func() is called with the
+ * runqueue of the CPU locked whenever a fair task is enqueued on or
+ * dequeued from it and on every scheduler tick for a fair task; @time
+ * is the runqueue clock in nanoseconds and @nr_running the number of
+ * tasks now runnable there.  It must not sleep or wake tasks.
+ */
+struct update_util_data {
+	void (*func)(struct update_util_data *data, u64 time,
+		     unsigned int nr_running);
+};
+
+void cpufreq_add_update_util_hook(int cpu, struct update_util_data *data,
+			void (*func)(struct update_util_data *data, u64 time,
+				     unsigned int nr_running));
+void cpufreq_remove_update_util_hook(int cpu);
+unsigned int sched_cpu_demand(int cpu, unsigned int *in, unsigned int *out);
+#endif /* CONFIG_CPU_FREQ */
+
 #endif /* __KERNEL__ */
 
 #endif
@@ -0,0 +1,92 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM lowmemorykiller
+
+#if !defined(_TRACE_LOWMEMORYKILLER_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_LOWMEMORYKILLER_H
+
+#include <linux/tracepoint.h>
+
+/* level is the vmpressure level, or -1 when called from the shrinker */
+TRACE_EVENT(lowmem_pressure,
+
+	TP_PROTO(int level, int other_free, int other_file, int min_adj),
+
+	TP_ARGS(level, other_free, other_file, min_adj),
+
+	TP_STRUCT__entry(
+		__field(	int,	level		)
+		__field(	int,	other_free	)
+		__field(	int,	other_file	)
+		__field(	int,	min_adj		)
+	),
+
+	TP_fast_assign(
+		__entry->level		= level;
+		__entry->other_free	= other_free;
+		__entry->other_file	= other_file;
+		__entry->min_adj	= min_adj;
+	),
+
+	TP_printk("level=%d free=%d file=%d min_adj=%d",
+		__entry->level, __entry->other_free, __entry->other_file,
+		__entry->min_adj)
+);
+
+TRACE_EVENT(lowmem_kill,
+
+	TP_PROTO(struct task_struct *task, int adj, int rss, s64 onset_ns),
+
+	TP_ARGS(task, adj, rss, onset_ns),
+
+	TP_STRUCT__entry(
+		__field(	pid_t,	pid			)
+		__array(	char,	comm,	TASK_COMM_LEN	)
+		__field(	int,	adj			)
+		__field(	int,	rss			)
+		__field(	s64,	onset_ns		)
+	),
+
+	TP_fast_assign(
+		__entry->pid		= task->pid;
+		memcpy(__entry->comm, task->comm, TASK_COMM_LEN);
+		__entry->adj		= adj;
+		__entry->rss		= rss;
+		__entry->onset_ns	= onset_ns;
+	),
+
+	TP_printk("pid=%d comm=%s adj=%d rss=%d since_onset=%lld",
+		__entry->pid, __entry->comm, __entry->adj, __entry->rss,
+		__entry->onset_ns)
+);
+
+TRACE_EVENT(lowmem_freed,
+
+	TP_PROTO(struct task_struct *task, int rss, s64 kill_ns, s64 onset_ns),
+
+	TP_ARGS(task, rss, kill_ns, onset_ns),
+
+	TP_STRUCT__entry(
+		__field(	pid_t,	pid			)
+		__array(	char,	comm,	TASK_COMM_LEN	)
+		__field(	int,	rss			)
+		__field(	s64,	kill_ns			)
+		__field(	s64,	onset_ns		)
+	),
+
+	TP_fast_assign(
+		__entry->pid		= task->pid;
+		memcpy(__entry->comm, task->comm, TASK_COMM_LEN);
+		__entry->rss		= rss;
+		__entry->kill_ns	= kill_ns;
+		__entry->onset_ns	= onset_ns;
+	),
+
+	TP_printk("pid=%d comm=%s rss=%d since_kill=%lld since_onset=%lld",
+		__entry->pid, __entry->comm, __entry->rss, __entry->kill_ns,
+		__entry->onset_ns)
+);
+
+#endif /* _TRACE_LOWMEMORYKILLER_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
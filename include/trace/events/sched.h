@@ -426,6 +426,68 @@ TRACE_EVENT(sched_pi_setprio,
 			__entry->oldprio, __entry->newprio)
 );
 
+#ifdef CONFIG_SMP
+/*
+ * Tracepoint for a task's runnable average, whenever its load
+ * contribution is recomputed.
+ */
+TRACE_EVENT(sched_task_load_contrib,
+
+	TP_PROTO(struct task_struct *tsk),
+
+	TP_ARGS(tsk),
+
+	TP_STRUCT__entry(
+		__array( char,		comm,	TASK_COMM_LEN	)
+		__field( pid_t,		pid			)
+		__field( int,		cpu			)
+		__field( u32,		runnable_sum		)
+		__field( u32,		runnable_period		)
+		__field( unsigned long,	load_contrib		)
+	),
+
+	TP_fast_assign(
+		memcpy(__entry->comm, tsk->comm, TASK_COMM_LEN);
+		__entry->pid		= tsk->pid;
+		__entry->cpu		= task_cpu(tsk);
+		__entry->runnable_sum	= tsk->se.avg.runnable_avg_sum;
+		__entry->runnable_period = tsk->se.avg.runnable_avg_period;
+		__entry->load_contrib	= tsk->se.avg.load_avg_contrib;
+	),
+
+	TP_printk("comm=%s pid=%d cpu=%d runnable_sum=%u runnable_period=%u load_contrib=%lu",
+			__entry->comm, __entry->pid, __entry->cpu,
+			__entry->runnable_sum, __entry->runnable_period,
+			__entry->load_contrib)
+);
+
+/*
+ * Tracepoint for the runnable and blocked load averages of a cpu's
+ * root cfs_rq.
+ */
+TRACE_EVENT(sched_cfs_rq_load_avg,
+
+	TP_PROTO(int cpu, unsigned long runnable, unsigned long blocked),
+
+	TP_ARGS(cpu, runnable, blocked),
+
+	TP_STRUCT__entry(
+		__field( int,		cpu			)
+		__field( unsigned long,	runnable		)
+		__field( unsigned long,	blocked			)
+	),
+
+	TP_fast_assign(
+		__entry->cpu		= cpu;
+		__entry->runnable	= runnable;
+		__entry->blocked	= blocked;
+	),
+
+	TP_printk("cpu=%d runnable=%lu blocked=%lu",
+			__entry->cpu, __entry->runnable, __entry->blocked)
+);
+#endif /* CONFIG_SMP */
+
 #endif /* _TRACE_SCHED_H */
 
 /* This part must be outside protection */
@@ -65,6 +65,8 @@ static void __unhash_process(struct task_struct *p, bool group_dead)
 {
 	nr_threads--;
 	detach_pid(p, PIDTYPE_PID);
+	/* After detach_pid(): the index only files tasks that pid_alive() */
+	lowmem_adj_index_del(p);
 	if (group_dead) {
 		detach_pid(p, PIDTYPE_PGID);
 		detach_pid(p, PIDTYPE_SID);
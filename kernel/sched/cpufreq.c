@@ -0,0 +1,188 @@
+/*
+ * Scheduler code and data structures related to cpufreq.
+ *
+ * Lets a cpufreq governor follow runnable load as the scheduler sees it,
+ * instead of sampling idle time from a timer.  A governor registers one
+ * hook per CPU; the scheduler calls it from enqueue, dequeue and tick with
+ * the runqueue locked, see cpufreq_update_util().
+ *
+ * It also keeps the recent demand of each task, which moves with the task
+ * between CPUs, so that a governor can set the speed of a CPU for the
+ * tasks that are runnable there now rather than for the ones that ran
+ * there recently.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/cpufreq.h>
+#include <linux/export.h>
+
+#include "sched.h"
+
+DEFINE_PER_CPU(struct update_util_data __rcu *, cpufreq_update_util_data);
+
+/**
+ * cpufreq_add_update_util_hook - install a scheduler callback for @cpu
+ * @cpu: CPU whose runqueue events are to be reported
+ * @data: governor data, passed back to @func
+ * @func: callback, called with the runqueue locked and interrupts off
+ *
+ * Only one hook can be installed per CPU.  @data must stay valid until
+ * cpufreq_remove_update_util_hook() and a following synchronize_sched().
+ */
+void cpufreq_add_update_util_hook(int cpu, struct update_util_data *data,
+			void (*func)(struct update_util_data *data, u64 time,
+				     unsigned int nr_running))
+{
+	if (WARN_ON(!data || !func))
+		return;
+
+	if (WARN_ON(per_cpu(cpufreq_update_util_data, cpu)))
+		return;
+
+	data->func = func;
+	rcu_assign_pointer(per_cpu(cpufreq_update_util_data, cpu), data);
+}
+EXPORT_SYMBOL_GPL(cpufreq_add_update_util_hook);
+
+/**
+ * cpufreq_remove_update_util_hook - remove the scheduler callback for @cpu
+ * @cpu: CPU to stop reporting
+ *
+ * The callback may still be running on another CPU when this returns;
+ * callers must synchronize_sched() before freeing its data.
+ */
+void cpufreq_remove_update_util_hook(int cpu)
+{
+	rcu_assign_pointer(per_cpu(cpufreq_update_util_data, cpu), NULL);
+}
+EXPORT_SYMBOL_GPL(cpufreq_remove_update_util_hook);
+
+/* Current speed of each CPU in kHz, 0 until cpufreq reports it */
+static DEFINE_PER_CPU(unsigned int, sched_cur_freq);
+
+/*
+ * Close the task's demand window if it has ended.  Windows in which the
+ * task did not run at all, because it slept, halve its demand.  @counted
+ * says whether rq->demand holds the task's old demand and must follow.
+ */
+static void task_demand_roll(struct rq *rq, struct task_struct *p,
+			     int counted)
+{
+	struct task_demand *d = &p->demand;
+	u64 now = rq->clock_task;
+	unsigned int demand;
+	u64 nr;
+
+	if (now < d->window_start + TASK_DEMAND_WINDOW)
+		return;
+
+	demand = (d->demand +
+		  (unsigned int)div64_u64(d->work, TASK_DEMAND_WINDOW)) / 2;
+	nr = div64_u64(now - d->window_start, TASK_DEMAND_WINDOW);
+	if (nr > 1)
+		demand = nr > 32 ? 0 : demand >> (nr - 1);
+
+	d->window_start += nr * TASK_DEMAND_WINDOW;
+	d->work = 0;
+
+	if (counted)
+		rq->demand += demand - d->demand;
+	d->demand = demand;
+}
+
+/* @p ran for @delta_exec ns on @rq; called with rq->lock held */
+void task_demand_account(struct rq *rq, struct task_struct *p,
+			 u64 delta_exec)
+{
+	task_demand_roll(rq, p, p->se.on_rq);
+	p->demand.work += delta_exec * per_cpu(sched_cur_freq, cpu_of(rq));
+}
+
+void task_demand_enqueue(struct rq *rq, struct task_struct *p)
+{
+	struct task_demand *d = &p->demand;
+	int cpu = cpu_of(rq);
+
+	/* se.on_rq is already set, but rq->demand does not hold p yet */
+	task_demand_roll(rq, p, 0);
+	rq->demand += d->demand;
+	rq->demand_nr++;
+
+	if (d->cpu != cpu) {
+		if (d->cpu >= 0 && d->demand) {
+			atomic_add(d->demand, &rq->demand_in);
+			atomic_add(d->demand, &cpu_rq(d->cpu)->demand_out);
+		}
+		d->cpu = cpu;
+	}
+}
+
+void task_demand_dequeue(struct rq *rq, struct task_struct *p)
+{
+	rq->demand -= p->demand.demand;
+
+	/* Nothing is counted any more, so every demand must be taken back */
+	if (!--rq->demand_nr && WARN_ON_ONCE(rq->demand))
+		rq->demand = 0;
+}
+
+/**
+ * sched_cpu_demand - demand of the tasks runnable on @cpu, in kHz
+ * @cpu: CPU to look at
+ * @in: set to the demand that arrived from other CPUs since the last call
+ * @out: set to the demand that left for other CPUs since the last call
+ *
+ * The result is a snapshot taken without the runqueue lock.
+ */
+unsigned int sched_cpu_demand(int cpu, unsigned int *in, unsigned int *out)
+{
+	struct rq *rq = cpu_rq(cpu);
+
+	*in = atomic_xchg(&rq->demand_in, 0);
+	*out = atomic_xchg(&rq->demand_out, 0);
+	return ACCESS_ONCE(rq->demand);
+}
+EXPORT_SYMBOL_GPL(sched_cpu_demand);
+
+static int sched_cpufreq_transition(struct notifier_block *nb,
+				    unsigned long val, void *data)
+{
+	struct cpufreq_freqs *freq = data;
+
+	if (val == CPUFREQ_POSTCHANGE)
+		per_cpu(sched_cur_freq, freq->cpu) = freq->new;
+	return 0;
+}
+
+static int sched_cpufreq_policy(struct notifier_block *nb,
+				unsigned long val, void *data)
+{
+	struct cpufreq_policy *policy = data;
+	int cpu;
+
+	if (val == CPUFREQ_NOTIFY && policy->cur)
+		for_each_cpu(cpu, policy->cpus)
+			per_cpu(sched_cur_freq, cpu) = policy->cur;
+	return 0;
+}
+
+static struct notifier_block sched_cpufreq_transition_nb = {
+	.notifier_call = sched_cpufreq_transition,
+};
+
+static struct notifier_block sched_cpufreq_policy_nb = {
+	.notifier_call = sched_cpufreq_policy,
+};
+
+static int __init sched_cpufreq_init(void)
+{
+	cpufreq_register_notifier(&sched_cpufreq_transition_nb,
+				  CPUFREQ_TRANSITION_NOTIFIER);
+	cpufreq_register_notifier(&sched_cpufreq_policy_nb,
+				  CPUFREQ_POLICY_NOTIFIER);
+	return 0;
+}
+core_initcall(sched_cpufreq_init);
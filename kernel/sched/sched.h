@@ -111,7 +111,11 @@ struct task_group {
 	struct cfs_rq **cfs_rq;
 	unsigned long shares;
 
-	atomic_t load_weight;
+#ifdef CONFIG_SMP
+	/* Sum of the cfs_rq tg_load_contrib and tg_runnable_contrib */
+	atomic64_t load_avg;
+	atomic_t runnable_avg;
+#endif
 #endif
 
 #ifdef CONFIG_RT_GROUP_SCHED
@@ -222,6 +226,19 @@ struct cfs_rq {
 	unsigned int nr_spread_over;
 #endif
 
+#ifdef CONFIG_SMP
+	/*
+	 * Per-entity load tracking: runnable_load_avg is the sum of the
+	 * load_avg_contrib of the queued entities, blocked_load_avg that of
+	 * the sleeping ones, decayed in step with them through decay_counter.
+	 * removed_load collects the contributions of blocked entities that
+	 * migrated away, to be subtracted under rq->lock.
+	 */
+	unsigned long runnable_load_avg, blocked_load_avg;
+	atomic64_t decay_counter, removed_load;
+	u64 last_decay;
+#endif /* CONFIG_SMP */
+
 #ifdef CONFIG_FAIR_GROUP_SCHED
 	struct rq *rq;	/* cpu runqueue to which this cfs_rq is attached */
 
@@ -246,18 +263,9 @@ struct cfs_rq {
 	 */
 	unsigned long h_load;
 
-	/*
-	 * Maintaining per-cpu shares distribution for group scheduling
-	 *
-	 * load_stamp is the last time we updated the load average
-	 * load_last is the last time we updated the load average and saw load
-	 * load_unacc_exec_time is currently unaccounted execution time
-	 */
-	u64 load_avg;
-	u64 load_period;
-	u64 load_stamp, load_last, load_unacc_exec_time;
-
-	unsigned long load_contribution;
+	/* This cfs_rq's share of its group's load_avg and runnable_avg */
+	u32 tg_runnable_contrib;
+	u64 tg_load_contrib;
 #endif /* CONFIG_SMP */
 #ifdef CONFIG_CFS_BANDWIDTH
 	int runtime_enabled;
@@ -265,6 +273,8 @@ struct cfs_rq {
 	s64 runtime_remaining;
 
 	u64 throttled_timestamp;
+	/* clock_task when throttled, and the time spent throttled so far */
+	u64 throttled_clock_task, throttled_clock_task_time;
 	int throttled, throttle_count;
 	struct list_head throttled_list;
 #endif /* CONFIG_CFS_BANDWIDTH */
@@ -371,6 +381,17 @@ struct rq {
 	struct cfs_rq cfs;
 	struct rt_rq rt;
 
+#ifdef CONFIG_CPU_FREQ
+	/*
+	 * Sum of the demand of the runnable fair tasks, and the demand of
+	 * tasks that arrived here from, or left for, another CPU since
+	 * cpufreq last asked, and the number of tasks counted in demand:
+	 */
+	unsigned int demand;
+	unsigned int demand_nr;
+	atomic_t demand_in, demand_out;
+#endif
+
 #ifdef CONFIG_FAIR_GROUP_SCHED
 	/* list of leaf cfs_rq on this cpu: */
 	struct list_head leaf_cfs_rq_list;
@@ -474,6 +495,40 @@ static inline int cpu_of(struct rq *rq)
 #endif
 }
 
+#ifdef CONFIG_CPU_FREQ
+DECLARE_PER_CPU(struct update_util_data __rcu *, cpufreq_update_util_data);
+
+/*
+ * Tell the cpufreq governor, if it asked, that the runnable load of @rq
+ * may have changed.  Called with rq->lock held.
+ */
+static inline void cpufreq_update_util(struct rq *rq)
+{
+	struct update_util_data *data;
+
+	data = rcu_dereference_sched(per_cpu(cpufreq_update_util_data,
+					     cpu_of(rq)));
+	if (data)
+		data->func(data, rq->clock, rq->nr_running);
+}
+
+/* Task demand is measured over windows of this length */
+#define TASK_DEMAND_WINDOW	(20 * NSEC_PER_MSEC)
+
+extern void task_demand_account(struct rq *rq, struct task_struct *p,
+				u64 delta_exec);
+extern void task_demand_enqueue(struct rq *rq, struct task_struct *p);
+extern void task_demand_dequeue(struct rq *rq, struct task_struct *p);
+#else
+static inline void cpufreq_update_util(struct rq *rq) { }
+static inline void task_demand_account(struct rq *rq, struct task_struct *p,
+				       u64 delta_exec) { }
+static inline void task_demand_enqueue(struct rq *rq,
+				       struct task_struct *p) { }
+static inline void task_demand_dequeue(struct rq *rq,
+				       struct task_struct *p) { }
+#endif
+
 DECLARE_PER_CPU(struct rq, runqueues);
 
 #define cpu_rq(cpu)		(&per_cpu(runqueues, (cpu)))
@@ -875,6 +930,12 @@ extern void init_rt_bandwidth(struct rt_bandwidth *rt_b, u64 period, u64 runtime
 
 extern void update_cpu_load(struct rq *this_rq);
 
+#ifdef CONFIG_SMP
+extern void init_task_runnable_average(struct task_struct *p);
+#else
+static inline void init_task_runnable_average(struct task_struct *p) { }
+#endif
+
 #ifdef CONFIG_CGROUP_CPUACCT
 #include <linux/cgroup.h>
 /* track cpu usage of a group of tasks and its child groups */
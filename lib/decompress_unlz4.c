@@ -0,0 +1,163 @@
+/*
+ * LZ4 decompressor for the Linux kernel, for compressed kernel images
+ * and initramfs.
+ *
+ * The input is the legacy LZ4 stream written by "lz4c -l": a 32-bit
+ * little-endian magic number followed by blocks, each a 32-bit
+ * little-endian compressed size and then an independent LZ4 block that
+ * decompresses to at most LZ4_BLOCK_SIZE bytes.  Streams may be
+ * concatenated, so the magic number may reappear between blocks.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifdef STATIC
+#include "lz4/lz4_decompress.c"
+#else
+#include <linux/decompress/unlz4.h>
+#endif
+
+#include <linux/types.h>
+#include <linux/lz4.h>
+#include <linux/decompress/mm.h>
+
+#include <linux/compiler.h>
+#include <asm/unaligned.h>
+
+#define LZ4_LEGACY_MAGIC	0x184C2102
+#define LZ4_BLOCK_SIZE		(8 << 20)
+
+STATIC inline int INIT unlz4(u8 *input, int in_len,
+				int (*fill) (void *, unsigned int),
+				int (*flush) (void *, unsigned int),
+				u8 *output, int *posp,
+				void (*error) (char *x))
+{
+	u32 src_len;
+	size_t dst_len;
+	u8 *in_buf, *out_buf;
+	int size;
+	int ret = -1;
+
+	if (output) {
+		out_buf = output;
+	} else if (!flush) {
+		error("NULL output pointer and no flush function provided");
+		goto exit;
+	} else {
+		out_buf = large_malloc(LZ4_BLOCK_SIZE);
+		if (!out_buf) {
+			error("Could not allocate output buffer");
+			goto exit;
+		}
+	}
+
+	if (input && fill) {
+		error("Both input pointer and fill function provided, don't know what to do");
+		goto exit_1;
+	} else if (input) {
+		in_buf = input;
+	} else if (!fill) {
+		error("NULL input pointer and missing fill function");
+		goto exit_1;
+	} else {
+		in_buf = large_malloc(lz4_compressbound(LZ4_BLOCK_SIZE));
+		if (!in_buf) {
+			error("Could not allocate input buffer");
+			goto exit_1;
+		}
+	}
+	size = in_len;
+
+	if (posp)
+		*posp = 0;
+
+	if (fill)
+		size = fill(in_buf, 4);
+	if (size < 4 || get_unaligned_le32(in_buf) != LZ4_LEGACY_MAGIC) {
+		error("invalid header");
+		goto exit_2;
+	}
+	if (!fill) {
+		in_buf += 4;
+		size -= 4;
+	}
+	if (posp)
+		*posp += 4;
+
+	for (;;) {
+		/*
+		 * A stream has no end marker.  When the input is all in
+		 * memory it may be followed by the 4-byte uncompressed size
+		 * that the kernel build appends, or by zero padding; neither
+		 * is a block and neither is consumed.
+		 */
+		if (fill) {
+			size = fill(in_buf, 4);
+			if (size == 0)
+				break;
+		} else if (size <= 4) {
+			break;
+		}
+		if (size < 4) {
+			error("file corrupted");
+			goto exit_2;
+		}
+		src_len = get_unaligned_le32(in_buf);
+		if (!src_len)
+			break;
+		if (!fill) {
+			in_buf += 4;
+			size -= 4;
+		}
+		if (posp)
+			*posp += 4;
+
+		if (src_len == LZ4_LEGACY_MAGIC)
+			continue;
+
+		if (src_len > lz4_compressbound(LZ4_BLOCK_SIZE)) {
+			error("block size is too large");
+			goto exit_2;
+		}
+
+		if (fill)
+			size = fill(in_buf, src_len);
+		if (size < 0 || src_len > (u32)size) {
+			error("file corrupted");
+			goto exit_2;
+		}
+
+		dst_len = LZ4_BLOCK_SIZE;
+		if (lz4_decompress_safe(in_buf, src_len, out_buf, &dst_len)) {
+			error("Compressed data violation");
+			goto exit_2;
+		}
+
+		if (flush && flush(out_buf, dst_len) != dst_len)
+			goto exit_2;
+		if (output)
+			out_buf += dst_len;
+		if (posp)
+			*posp += src_len;
+
+		if (!fill) {
+			in_buf += src_len;
+			size -= src_len;
+		}
+	}
+
+	ret = 0;
+exit_2:
+	if (!input)
+		large_free(in_buf);
+exit_1:
+	if (!output)
+		large_free(out_buf);
+exit:
+	return ret;
+}
+
+#define decompress unlz4
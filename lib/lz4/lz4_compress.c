@@ -0,0 +1,95 @@
+/*
+ *  LZ4 block compressor
+ *
+ *  An implementation of the LZ4 block format described at
+ *  http://code.google.com/p/lz4/ for kernel use: a single-probe hash
+ *  table of 32-bit positions, matches extended a word at a time.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/lz4.h>
+#include <asm/unaligned.h>
+#include "lz4defs.h"
+
+static inline u32 lz4_hash(const unsigned char *p)
+{
+	return (get_unaligned((const u32 *)p) * 2654435761U) >>
+		(32 - LZ4_HASH_LOG);
+}
+
+int lz4_compress(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len, void *wrkmem)
+{
+	const unsigned char * const iend = src + src_len;
+	const unsigned char * const mflimit = iend - LZ4_MFLIMIT;
+	const unsigned char * const matchlimit = iend - LZ4_LAST_LITERALS;
+	const unsigned char *ip = src, *anchor = src, *match;
+	unsigned char *op = dst, *token;
+	u32 *table = wrkmem;
+	size_t len;
+
+	if (src_len > LZ4_MAX_INPUT_SIZE)
+		return -1;
+
+	memset(table, 0, LZ4_MEM_COMPRESS);
+	if (src_len < LZ4_MFLIMIT + 1)
+		goto last_literals;
+
+	table[lz4_hash(ip)] = 0;
+	ip++;
+
+	for (;;) {
+		unsigned int attempts = 1 << LZ4_SKIP_TRIGGER;
+		unsigned int step = 1;
+
+		/* Find a 4-byte match within LZ4_MAX_DISTANCE */
+		for (;;) {
+			u32 h;
+
+			if (unlikely(ip > mflimit))
+				goto last_literals;
+
+			h = lz4_hash(ip);
+			match = src + table[h];
+			table[h] = ip - src;
+			if (ip - match <= LZ4_MAX_DISTANCE &&
+			    get_unaligned((const u32 *)match) ==
+			    get_unaligned((const u32 *)ip))
+				break;
+
+			ip += step;
+			step = attempts++ >> LZ4_SKIP_TRIGGER;
+		}
+
+		/* Extend it backwards over pending literals */
+		while (ip > anchor && match > src && ip[-1] == match[-1]) {
+			ip--;
+			match--;
+		}
+
+		/* Extend it forwards, a word at a time */
+		len = LZ4_MIN_MATCH + lz4_count(ip + LZ4_MIN_MATCH,
+						match + LZ4_MIN_MATCH, matchlimit);
+		op = lz4_put_literals(op, anchor, ip - anchor, &token);
+		op = lz4_put_match(op, token, ip - match, len);
+
+		ip += len;
+		anchor = ip;
+		if (unlikely(ip > mflimit))
+			break;
+
+		/* Index a position inside the match to help the next search */
+		table[lz4_hash(ip - 2)] = ip - 2 - src;
+	}
+
+last_literals:
+	op = lz4_put_literals(op, anchor, iend - anchor, &token);
+	*dst_len = op - dst;
+	return 0;
+}
+EXPORT_SYMBOL_GPL(lz4_compress);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("LZ4 Compressor");
@@ -0,0 +1,105 @@
+/*
+ *  LZ4 block decompressor
+ *
+ *  Every length read from the input is checked against both the input
+ *  and the output bounds before it is used, so corrupt or hostile data
+ *  can fail to decompress but cannot overrun either buffer.
+ */
+
+#ifndef STATIC
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#endif
+
+#include <linux/lz4.h>
+#include <asm/unaligned.h>
+#include "lz4defs.h"
+
+/* Read the 255-continued extension of a length nibble */
+static inline int lz4_get_length(const unsigned char **ip,
+		const unsigned char *iend, size_t *len)
+{
+	unsigned int s;
+
+	do {
+		if (unlikely(*ip >= iend))
+			return -1;
+		s = *(*ip)++;
+		*len += s;
+	} while (s == 255);
+
+	return 0;
+}
+
+int lz4_decompress_safe(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len)
+{
+	const unsigned char *ip = src, * const iend = src + src_len;
+	unsigned char *op = dst, * const oend = dst + *dst_len;
+
+	for (;;) {
+		const unsigned char *match;
+		unsigned int token;
+		size_t len, offset;
+
+		if (unlikely(ip >= iend))
+			return -1;
+		token = *ip++;
+
+		len = token >> LZ4_ML_BITS;
+		if (len == LZ4_RUN_MASK && lz4_get_length(&ip, iend, &len))
+			return -1;
+		if (unlikely(len > (size_t)(iend - ip) ||
+			     len > (size_t)(oend - op)))
+			return -1;
+		memcpy(op, ip, len);
+		op += len;
+		ip += len;
+
+		/* The last sequence carries literals only */
+		if (ip == iend)
+			break;
+
+		if (unlikely(iend - ip < 2))
+			return -1;
+		offset = get_unaligned_le16(ip);
+		ip += 2;
+		if (unlikely(!offset || offset > (size_t)(op - dst)))
+			return -1;
+		match = op - offset;
+
+		len = token & LZ4_ML_MASK;
+		if (len == LZ4_ML_MASK && lz4_get_length(&ip, iend, &len))
+			return -1;
+		len += LZ4_MIN_MATCH;
+		if (unlikely(len > (size_t)(oend - op)))
+			return -1;
+
+		/*
+		 * Source and destination overlap when offset < len.  Word
+		 * copies are still correct as long as each word is read
+		 * before any byte of it is written, i.e. offset >= 8.
+		 */
+		if (offset >= 8) {
+			for (; len >= 8; len -= 8) {
+				put_unaligned(get_unaligned((const u64 *)match),
+					      (u64 *)op);
+				op += 8;
+				match += 8;
+			}
+		}
+		while (len--)
+			*op++ = *match++;
+	}
+
+	*dst_len = op - dst;
+	return 0;
+}
+#ifndef STATIC
+EXPORT_SYMBOL_GPL(lz4_decompress_safe);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("LZ4 Decompressor");
+
+#endif
@@ -0,0 +1,113 @@
+/*
+ *  lz4defs.h -- definitions shared by the LZ4 compressor and decompressor
+ *
+ *  The sequence format: a token byte whose high nibble is the literal
+ *  run length and low nibble the match length minus LZ4_MIN_MATCH, with
+ *  a value of 15 in either nibble meaning "add the following bytes until
+ *  one is not 255"; then the literals; then a 16-bit little-endian match
+ *  offset.  The last sequence of a block has literals only.
+ */
+
+#define LZ4_MIN_MATCH		4
+#define LZ4_MAX_DISTANCE	65535
+
+/* The last match must start this far before the end of the input... */
+#define LZ4_MFLIMIT		12
+/* ...and the last LZ4_LAST_LITERALS bytes are always literals */
+#define LZ4_LAST_LITERALS	5
+
+#define LZ4_ML_BITS		4
+#define LZ4_ML_MASK		((1U << LZ4_ML_BITS) - 1)
+#define LZ4_RUN_MASK		((1U << (8 - LZ4_ML_BITS)) - 1)
+
+/*
+ * Once this many probes in a row have found no match the compressor
+ * starts skipping ahead, one more byte per 2^LZ4_SKIP_TRIGGER misses,
+ * so incompressible data is passed over quickly.
+ */
+#define LZ4_SKIP_TRIGGER	6
+
+/* Hash chain compressor: positions are chained per 64 KiB window slot */
+#define LZ4HC_HASH_LOG		15
+#define LZ4HC_DICT_SIZE		(1U << 16)
+#define LZ4HC_MAX_ATTEMPTS	256
+
+/*
+ * Helpers shared by the compressors.  The boot decompressor (STATIC)
+ * includes this file for the format constants only.
+ */
+#ifndef STATIC
+
+/* Number of leading bytes that are equal, given the xor of two words */
+static inline unsigned int lz4_common_bytes(unsigned long diff)
+{
+#ifdef __LITTLE_ENDIAN
+	return __ffs(diff) >> 3;
+#else
+	return (BITS_PER_LONG - 1 - __fls(diff)) >> 3;
+#endif
+}
+
+/* Length of the common prefix of @ip and @match, stopping at @limit */
+static inline size_t lz4_count(const unsigned char *ip,
+		const unsigned char *match, const unsigned char *limit)
+{
+	const unsigned char *start = ip;
+
+	while (ip < limit - (sizeof(unsigned long) - 1)) {
+		unsigned long diff;
+
+		diff = get_unaligned((const unsigned long *)ip) ^
+		       get_unaligned((const unsigned long *)match);
+		if (diff)
+			return ip - start + lz4_common_bytes(diff);
+		ip += sizeof(unsigned long);
+		match += sizeof(unsigned long);
+	}
+	while (ip < limit && *ip == *match) {
+		ip++;
+		match++;
+	}
+	return ip - start;
+}
+
+static inline unsigned char *lz4_put_length(unsigned char *op, size_t len)
+{
+	for (; len >= 255; len -= 255)
+		*op++ = 255;
+	*op++ = len;
+	return op;
+}
+
+static inline unsigned char *lz4_put_literals(unsigned char *op,
+		const unsigned char *anchor, size_t len, unsigned char **token)
+{
+	*token = op++;
+	if (len >= LZ4_RUN_MASK) {
+		**token = LZ4_RUN_MASK << LZ4_ML_BITS;
+		op = lz4_put_length(op, len - LZ4_RUN_MASK);
+	} else {
+		**token = len << LZ4_ML_BITS;
+	}
+	memcpy(op, anchor, len);
+	return op + len;
+}
+
+/* Finish the sequence started by lz4_put_literals() with a match */
+static inline unsigned char *lz4_put_match(unsigned char *op,
+		unsigned char *token, size_t offset, size_t len)
+{
+	put_unaligned_le16(offset, op);
+	op += 2;
+
+	len -= LZ4_MIN_MATCH;
+	if (len >= LZ4_ML_MASK) {
+		*token |= LZ4_ML_MASK;
+		op = lz4_put_length(op, len - LZ4_ML_MASK);
+	} else {
+		*token |= len;
+	}
+	return op;
+}
+
+#endif /* STATIC */
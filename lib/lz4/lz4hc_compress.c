@@ -0,0 +1,155 @@
+/*
+ *  LZ4 HC block compressor
+ *
+ *  Produces the same block format as lz4_compress(), and so is read by
+ *  the same decompressor, but spends far more time looking for matches:
+ *  every position is entered in a hash chain covering the 64 KiB window,
+ *  up to LZ4HC_MAX_ATTEMPTS candidates are compared at each step, and a
+ *  match is deferred by one byte when the next position has a longer one.
+ *  Meant for data that is compressed once and read many times.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/lz4.h>
+#include <asm/unaligned.h>
+#include "lz4defs.h"
+
+struct lz4hc_ctx {
+	u32 hash_table[1 << LZ4HC_HASH_LOG];
+	/* Distance to the previous position with the same hash, or 0 */
+	u16 chain_table[LZ4HC_DICT_SIZE];
+	const unsigned char *base;
+	const unsigned char *next_to_update;
+};
+
+static inline u32 lz4hc_hash(const unsigned char *p)
+{
+	return (get_unaligned((const u32 *)p) * 2654435761U) >>
+		(32 - LZ4HC_HASH_LOG);
+}
+
+/* Enter every position before @ip into the hash chains */
+static inline void lz4hc_insert(struct lz4hc_ctx *ctx, const unsigned char *ip)
+{
+	const unsigned char *p = ctx->next_to_update;
+
+	while (p < ip) {
+		u32 pos = p - ctx->base;
+		u32 h = lz4hc_hash(p);
+		u32 delta = pos - ctx->hash_table[h];
+
+		if (delta > LZ4_MAX_DISTANCE)
+			delta = LZ4_MAX_DISTANCE;
+		ctx->chain_table[pos & (LZ4HC_DICT_SIZE - 1)] = delta;
+		ctx->hash_table[h] = pos;
+		p++;
+	}
+	ctx->next_to_update = ip;
+}
+
+/*
+ * Longest match for @ip that starts within the window and ends before
+ * @matchlimit; returns its length, or 0 if there is none of at least
+ * LZ4_MIN_MATCH bytes, and stores its start in @matchpos.
+ */
+static size_t lz4hc_find_longest_match(struct lz4hc_ctx *ctx,
+		const unsigned char *ip, const unsigned char *matchlimit,
+		const unsigned char **matchpos)
+{
+	const unsigned char *base = ctx->base;
+	unsigned int attempts = LZ4HC_MAX_ATTEMPTS;
+	u32 pos = ip - base;
+	u32 ref;
+	size_t best = 0;
+
+	lz4hc_insert(ctx, ip);
+
+	ref = ctx->hash_table[lz4hc_hash(ip)];
+	while (ref < pos && pos - ref <= LZ4_MAX_DISTANCE && attempts--) {
+		const unsigned char *match = base + ref;
+		u32 delta;
+
+		/* Cheap reject: a longer match must agree at byte @best */
+		if (match[best] == ip[best] &&
+		    get_unaligned((const u32 *)match) ==
+		    get_unaligned((const u32 *)ip)) {
+			size_t len = LZ4_MIN_MATCH +
+				lz4_count(ip + LZ4_MIN_MATCH,
+					  match + LZ4_MIN_MATCH, matchlimit);
+
+			if (len > best) {
+				best = len;
+				*matchpos = match;
+				if (ip + len == matchlimit)
+					break;
+			}
+		}
+
+		delta = ctx->chain_table[ref & (LZ4HC_DICT_SIZE - 1)];
+		if (!delta)
+			break;
+		ref -= delta;
+	}
+
+	return best;
+}
+
+int lz4hc_compress(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len, void *wrkmem)
+{
+	const unsigned char * const iend = src + src_len;
+	const unsigned char * const mflimit = iend - LZ4_MFLIMIT;
+	const unsigned char * const matchlimit = iend - LZ4_LAST_LITERALS;
+	const unsigned char *ip = src, *anchor = src;
+	const unsigned char *match = NULL, *match2 = NULL;
+	unsigned char *op = dst, *token;
+	struct lz4hc_ctx *ctx = wrkmem;
+	size_t len, len2;
+
+	BUILD_BUG_ON(sizeof(struct lz4hc_ctx) > LZ4HC_MEM_COMPRESS);
+
+	if (src_len > LZ4_MAX_INPUT_SIZE)
+		return -1;
+
+	memset(ctx->hash_table, 0, sizeof(ctx->hash_table));
+	ctx->base = src;
+	ctx->next_to_update = src;
+	if (src_len < LZ4_MFLIMIT + 1)
+		goto last_literals;
+
+	while (ip <= mflimit) {
+		len = lz4hc_find_longest_match(ctx, ip, matchlimit, &match);
+		if (!len) {
+			ip++;
+			continue;
+		}
+
+		/* Lazy evaluation: prefer a longer match one byte later */
+		while (ip + 1 <= mflimit) {
+			len2 = lz4hc_find_longest_match(ctx, ip + 1, matchlimit,
+							&match2);
+			if (len2 <= len)
+				break;
+			ip++;
+			len = len2;
+			match = match2;
+		}
+
+		op = lz4_put_literals(op, anchor, ip - anchor, &token);
+		op = lz4_put_match(op, token, ip - match, len);
+
+		ip += len;
+		anchor = ip;
+	}
+
+last_literals:
+	op = lz4_put_literals(op, anchor, iend - anchor, &token);
+	*dst_len = op - dst;
+	return 0;
+}
+EXPORT_SYMBOL_GPL(lz4hc_compress);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("LZ4 HC Compressor");
@@ -0,0 +1,189 @@
+/*
+ * Compare LZO, LZ4 and LZ4 HC, as built for the kernel, on the block
+ * sizes the kernel compresses: 4 KiB pages (zram, swap) and filesystem
+ * blocks.  Every file named on the command line is cut into blocks,
+ * each block is compressed and decompressed on its own, and the total
+ * ratio and throughput are reported.  As zram does, a block that does
+ * not shrink is counted at its original size.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <linux/kernel.h>
+#include <linux/lzo.h>
+#include <linux/lz4.h>
+
+/* Run each pass until it has taken at least this long */
+#define MIN_NSEC	500000000LL
+
+struct codec {
+	const char *name;
+	size_t wrkmem;
+	int (*compress)(const unsigned char *src, size_t src_len,
+			unsigned char *dst, size_t *dst_len, void *wrkmem);
+	int (*decompress)(const unsigned char *src, size_t src_len,
+			  unsigned char *dst, size_t *dst_len);
+};
+
+static const struct codec codecs[] = {
+	{ "lzo", LZO1X_1_MEM_COMPRESS, lzo1x_1_compress,
+	  lzo1x_decompress_safe },
+	{ "lz4", LZ4_MEM_COMPRESS, lz4_compress, lz4_decompress_safe },
+	{ "lz4hc", LZ4HC_MEM_COMPRESS, lz4hc_compress, lz4_decompress_safe },
+};
+
+static long long now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void *xmalloc(size_t size)
+{
+	void *p = malloc(size);
+
+	if (!p) {
+		perror("malloc");
+		exit(1);
+	}
+	return p;
+}
+
+static unsigned char *read_file(const char *path, size_t *len)
+{
+	unsigned char *buf = NULL;
+	size_t size = 0, n;
+	FILE *f = fopen(path, "rb");
+
+	if (!f) {
+		perror(path);
+		exit(1);
+	}
+	*len = 0;
+	do {
+		if (*len == size) {
+			size = size ? 2 * size : 1 << 20;
+			buf = realloc(buf, size);
+			if (!buf) {
+				perror("realloc");
+				exit(1);
+			}
+		}
+		n = fread(buf + *len, 1, size - *len, f);
+		*len += n;
+	} while (n);
+	fclose(f);
+	return buf;
+}
+
+static void bench(const struct codec *c, const unsigned char *data,
+		  size_t len, size_t bsize)
+{
+	size_t nblocks = len / bsize, i;
+	size_t bound = lzo1x_worst_compress(bsize) > lz4_compressbound(bsize) ?
+		lzo1x_worst_compress(bsize) : lz4_compressbound(bsize);
+	unsigned char *out = xmalloc(nblocks * bound);
+	size_t *clen = xmalloc(nblocks * sizeof(*clen));
+	unsigned char *back = xmalloc(bsize);
+	void *wrkmem = xmalloc(c->wrkmem);
+	unsigned long long stored = 0, loops;
+	long long t, ctime, dtime;
+	size_t dlen;
+
+	loops = 0;
+	t = now();
+	do {
+		for (i = 0; i < nblocks; i++) {
+			if (c->compress(data + i * bsize, bsize, out + i * bound,
+					&clen[i], wrkmem)) {
+				fprintf(stderr, "%s: compress failed\n", c->name);
+				exit(1);
+			}
+		}
+		loops++;
+	} while ((ctime = now() - t) < MIN_NSEC);
+	ctime /= loops;
+
+	loops = 0;
+	t = now();
+	do {
+		for (i = 0; i < nblocks; i++) {
+			dlen = bsize;
+			if (c->decompress(out + i * bound, clen[i], back,
+					  &dlen) || dlen != bsize) {
+				fprintf(stderr, "%s: decompress failed\n",
+					c->name);
+				exit(1);
+			}
+		}
+		loops++;
+	} while ((dtime = now() - t) < MIN_NSEC);
+	dtime /= loops;
+
+	for (i = 0; i < nblocks; i++) {
+		dlen = bsize;
+		c->decompress(out + i * bound, clen[i], back, &dlen);
+		if (memcmp(back, data + i * bsize, bsize)) {
+			fprintf(stderr, "%s: block %zu differs\n", c->name, i);
+			exit(1);
+		}
+		stored += clen[i] < bsize ? clen[i] : bsize;
+	}
+
+	printf("%-6s %7zu %6.1f%% %9.1f %9.1f\n", c->name, bsize,
+	       100.0 * stored / (nblocks * bsize),
+	       (double)nblocks * bsize * 1000 / ctime,
+	       (double)nblocks * bsize * 1000 / dtime);
+
+	free(wrkmem);
+	free(back);
+	free(clen);
+	free(out);
+}
+
+int main(int argc, char **argv)
+{
+	static const size_t bsizes[] = { 4096, 65536, 131072 };
+	unsigned char *data = NULL;
+	size_t len = 0;
+	int i, j;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s file...\n", argv[0]);
+		return 1;
+	}
+
+	/* Concatenate the inputs so every block size sees the same data */
+	for (i = 1; i < argc; i++) {
+		size_t flen;
+		unsigned char *f = read_file(argv[i], &flen);
+
+		data = realloc(data, len + flen);
+		if (!data) {
+			perror("realloc");
+			return 1;
+		}
+		memcpy(data + len, f, flen);
+		len += flen;
+		free(f);
+	}
+
+	printf("%-6s %7s %7s %9s %9s\n", "codec", "block", "size",
+	       "comp MB/s", "dec MB/s");
+	for (i = 0; i < (int)(sizeof(bsizes) / sizeof(bsizes[0])); i++) {
+		if (len < bsizes[i])
+			continue;
+		for (j = 0; j < (int)(sizeof(codecs) / sizeof(codecs[0])); j++)
+			bench(&codecs[j], data, len, bsizes[i]);
+	}
+	return 0;
+}
@@ -0,0 +1,60 @@
+/*
+ * Just enough of the kernel environment to build lib/lz4 and lib/lzo
+ * in userspace.
+ */
+#ifndef _LZ4_TEST_KERNEL_H
+#define _LZ4_TEST_KERNEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <endian.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+
+/* The kernel defines only the one that applies; libc defines both */
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+#undef __BIG_ENDIAN
+#else
+#undef __LITTLE_ENDIAN
+#endif
+
+#define BITS_PER_LONG		(8 * (int)sizeof(long))
+
+#define noinline		__attribute__((noinline))
+#define likely(x)		__builtin_expect(!!(x), 1)
+#define unlikely(x)		__builtin_expect(!!(x), 0)
+#define BUILD_BUG_ON(c)		((void)sizeof(char[1 - 2 * !!(c)]))
+
+#define __ffs(x)		((unsigned long)__builtin_ctzl(x))
+#define __fls(x)		((unsigned long)(BITS_PER_LONG - 1 - \
+						 __builtin_clzl(x)))
+
+#define EXPORT_SYMBOL_GPL(s)
+#define MODULE_LICENSE(s)
+#define MODULE_DESCRIPTION(s)
+
+#define __packed_ptr(p) \
+	((struct { __typeof__(*(p)) v; } __attribute__((packed)) *)(p))
+#define get_unaligned(p)	(__packed_ptr(p)->v)
+#define put_unaligned(val, p)	(__packed_ptr(p)->v = (val))
+
+static inline u16 get_unaligned_le16(const void *p)
+{
+	const u8 *b = p;
+
+	return b[0] | b[1] << 8;
+}
+
+static inline void put_unaligned_le16(u16 v, void *p)
+{
+	u8 *b = p;
+
+	b[0] = v;
+	b[1] = v >> 8;
+}
+
+#endif
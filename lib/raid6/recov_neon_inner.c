@@ -0,0 +1,115 @@
+/* -*- linux-c -*- ------------------------------------------------------- *
+ *
+ *   recov_neon_inner.c - RAID-6 recovery inner loops using ARM NEON
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, Inc., 53 Temple Place Ste 330,
+ *   Boston MA 02111-1307, USA; either version 2 of the License, or
+ *   (at your option) any later version; incorporated herein by reference.
+ *
+ * ----------------------------------------------------------------------- */
+
+/*
+ * Multiplication by a constant in GF(2^8) is linear, so c * x is the xor
+ * of c * (x & 0x0f) and c * (x & 0xf0).  Both halves come from a
+ * 16-entry table in raid6_vgfmul[c] and are looked up sixteen bytes at a
+ * time with VTBL.
+ *
+ * Built with -mfpu=neon and without kernel headers, like neon.uc; only
+ * call these between kernel_neon_begin() and kernel_neon_end().
+ */
+
+#include <arm_neon.h>
+
+void __raid6_2data_recov_neon(int bytes, uint8_t *p, uint8_t *q, uint8_t *dp,
+			      uint8_t *dq, const uint8_t *pbmul,
+			      const uint8_t *qmul);
+void __raid6_datap_recov_neon(int bytes, uint8_t *p, uint8_t *q, uint8_t *dq,
+			      const uint8_t *qmul);
+
+/* VTBL only looks up eight bytes at a time from a two-register table */
+static inline uint8x16_t vtbl16(uint8x8x2_t tbl, uint8x16_t idx)
+{
+	return vcombine_u8(vtbl2_u8(tbl, vget_low_u8(idx)),
+			   vtbl2_u8(tbl, vget_high_u8(idx)));
+}
+
+static inline uint8x8x2_t vld_tbl(const uint8_t *tbl)
+{
+	uint8x8x2_t r;
+
+	r.val[0] = vld1_u8(tbl);
+	r.val[1] = vld1_u8(tbl + 8);
+	return r;
+}
+
+/* c * x, given the low and high nibble product tables for c */
+static inline uint8x16_t gfmul16(uint8x8x2_t lo, uint8x8x2_t hi,
+				 uint8x16_t x)
+{
+	const uint8x16_t x0f = vdupq_n_u8(0x0f);
+
+	return veorq_u8(vtbl16(lo, vandq_u8(x, x0f)),
+			vtbl16(hi, vshrq_n_u8(x, 4)));
+}
+
+void __raid6_2data_recov_neon(int bytes, uint8_t *p, uint8_t *q, uint8_t *dp,
+			      uint8_t *dq, const uint8_t *pbmul,
+			      const uint8_t *qmul)
+{
+	uint8x8x2_t pm0 = vld_tbl(pbmul), pm1 = vld_tbl(pbmul + 16);
+	uint8x8x2_t qm0 = vld_tbl(qmul), qm1 = vld_tbl(qmul + 16);
+
+	/*
+	 * while ( bytes-- ) {
+	 *	px    = *p ^ *dp;
+	 *	qx    = qmul[*q ^ *dq];
+	 *	*dq++ = db = pbmul[px] ^ qx;
+	 *	*dp++ = db ^ px;
+	 *	p++; q++;
+	 * }
+	 */
+	while (bytes) {
+		uint8x16_t px, qx, db;
+
+		px = veorq_u8(vld1q_u8(p), vld1q_u8(dp));
+		qx = gfmul16(qm0, qm1, veorq_u8(vld1q_u8(q), vld1q_u8(dq)));
+		db = veorq_u8(gfmul16(pm0, pm1, px), qx);
+
+		vst1q_u8(dq, db);
+		vst1q_u8(dp, veorq_u8(db, px));
+
+		bytes -= 16;
+		p += 16;
+		q += 16;
+		dp += 16;
+		dq += 16;
+	}
+}
+
+void __raid6_datap_recov_neon(int bytes, uint8_t *p, uint8_t *q, uint8_t *dq,
+			      const uint8_t *qmul)
+{
+	uint8x8x2_t qm0 = vld_tbl(qmul), qm1 = vld_tbl(qmul + 16);
+
+	/*
+	 * while ( bytes-- ) {
+	 *	*p++ ^= *dq = qmul[*q ^ *dq];
+	 *	q++; dq++;
+	 * }
+	 */
+	while (bytes) {
+		uint8x16_t vx;
+
+		vx = gfmul16(qm0, qm1, veorq_u8(vld1q_u8(q), vld1q_u8(dq)));
+
+		vst1q_u8(dq, vx);
+		vst1q_u8(p, veorq_u8(vx, vld1q_u8(p)));
+
+		bytes -= 16;
+		p += 16;
+		q += 16;
+		dq += 16;
+	}
+}
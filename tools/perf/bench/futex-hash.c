@@ -0,0 +1,194 @@
+/*
+ *
+ * futex-hash.c
+ *
+ * hash: Benchmark for the futex hash table
+ *
+ * Every thread keeps calling FUTEX_WAIT on its own futexes with a value
+ * that does not match, so each call looks up and locks a hash bucket and
+ * returns at once.  Threads share no futexes; any slowdown as threads are
+ * added comes from collisions on the kernel's hash buckets.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+#include "futex.h"
+
+#include <err.h>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+static unsigned int nthreads;
+static unsigned int nfutexes = 1024;
+static unsigned int runtime = 10;
+static bool fshared;
+
+static volatile int done;
+static int futex_flag;
+
+static unsigned int threads_starting;
+static pthread_mutex_t thread_lock;
+static pthread_cond_t thread_parent, thread_worker;
+
+struct worker {
+	pthread_t thread;
+	u_int32_t *futex;
+	unsigned long ops;
+};
+
+static const struct option options[] = {
+	OPT_UINTEGER('t', "threads", &nthreads,
+		     "Specify number of threads (default: online cpus)"),
+	OPT_UINTEGER('f', "futexes", &nfutexes,
+		     "Specify number of futexes per thread"),
+	OPT_UINTEGER('r', "runtime", &runtime,
+		     "Specify runtime in seconds"),
+	OPT_BOOLEAN('S', "shared", &fshared,
+		    "Use shared futexes instead of private ones"),
+	OPT_END()
+};
+
+static const char * const bench_futex_hash_usage[] = {
+	"perf bench futex hash <options>",
+	NULL
+};
+
+static void *workerfn(void *arg)
+{
+	struct worker *w = arg;
+	unsigned int i;
+	int ret;
+
+	pthread_mutex_lock(&thread_lock);
+	if (!--threads_starting)
+		pthread_cond_signal(&thread_parent);
+	pthread_cond_wait(&thread_worker, &thread_lock);
+	pthread_mutex_unlock(&thread_lock);
+
+	do {
+		for (i = 0; i < nfutexes; i++, w->ops++) {
+			/* The futex holds 0; this returns EWOULDBLOCK */
+			ret = futex_wait(&w->futex[i], 1234, NULL, futex_flag);
+			if (!done && ret && errno != EAGAIN)
+				warn("futex_wait");
+		}
+	} while (!done);
+
+	return NULL;
+}
+
+static void toggle_done(int sig __used)
+{
+	done = 1;
+}
+
+int bench_futex_hash(int argc, const char **argv,
+		     const char *prefix __used)
+{
+	struct worker *worker;
+	struct timeval start, stop, diff;
+	unsigned long long total = 0;
+	unsigned long avg;
+	unsigned int i;
+
+	argc = parse_options(argc, argv, options, bench_futex_hash_usage, 0);
+	if (argc) {
+		usage_with_options(bench_futex_hash_usage, options);
+		exit(EXIT_FAILURE);
+	}
+
+	if (!nthreads)
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (!nfutexes)
+		nfutexes = 1;
+	if (!fshared)
+		futex_flag = FUTEX_PRIVATE_FLAG;
+
+	worker = calloc(nthreads, sizeof(*worker));
+	if (!worker)
+		err(EXIT_FAILURE, "calloc");
+
+	signal(SIGINT, toggle_done);
+
+	if (bench_format == BENCH_FORMAT_DEFAULT)
+		printf("# %u threads operating on %u %s futexes each for %u secs\n\n",
+		       nthreads, nfutexes, fshared ? "shared" : "private",
+		       runtime);
+
+	pthread_mutex_init(&thread_lock, NULL);
+	pthread_cond_init(&thread_parent, NULL);
+	pthread_cond_init(&thread_worker, NULL);
+
+	threads_starting = nthreads;
+	for (i = 0; i < nthreads; i++) {
+		worker[i].futex = calloc(nfutexes, sizeof(*worker[i].futex));
+		if (!worker[i].futex)
+			err(EXIT_FAILURE, "calloc");
+		if (pthread_create(&worker[i].thread, NULL, workerfn,
+				   &worker[i]))
+			err(EXIT_FAILURE, "pthread_create");
+	}
+
+	pthread_mutex_lock(&thread_lock);
+	while (threads_starting)
+		pthread_cond_wait(&thread_parent, &thread_lock);
+	gettimeofday(&start, NULL);
+	pthread_cond_broadcast(&thread_worker);
+	pthread_mutex_unlock(&thread_lock);
+
+	sleep(runtime);
+	toggle_done(0);
+
+	for (i = 0; i < nthreads; i++) {
+		if (pthread_join(worker[i].thread, NULL))
+			err(EXIT_FAILURE, "pthread_join");
+		total += worker[i].ops;
+	}
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+
+	avg = total / ((double)diff.tv_sec + diff.tv_usec / 1000000.0);
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		for (i = 0; i < nthreads; i++)
+			printf(" [thread %3u] futexes: %p ... %p [ %lu ops ]\n",
+			       i, worker[i].futex,
+			       &worker[i].futex[nfutexes - 1], worker[i].ops);
+
+		printf("\n %14s: %lu.%03lu [sec]\n", "Total time",
+		       diff.tv_sec, (unsigned long)(diff.tv_usec / 1000));
+		printf(" %14lu ops/sec\n", avg);
+		printf(" %14lu ops/sec per thread\n", avg / nthreads);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%lu\n", avg);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	for (i = 0; i < nthreads; i++)
+		free(worker[i].futex);
+	free(worker);
+	pthread_cond_destroy(&thread_worker);
+	pthread_cond_destroy(&thread_parent);
+	pthread_mutex_destroy(&thread_lock);
+
+	return 0;
+}
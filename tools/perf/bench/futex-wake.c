@@ -0,0 +1,180 @@
+/*
+ *
+ * futex-wake.c
+ *
+ * wake: Benchmark for FUTEX_WAKE
+ *
+ * Blocks a number of threads on a single futex and times how long it
+ * takes to wake them all, a few at a time.  Then times FUTEX_WAKE on a
+ * futex nobody waits on, the common case of an uncontended unlock.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+#include "futex.h"
+
+#include <err.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+static unsigned int nthreads;
+static unsigned int nwakes = 1;
+static unsigned int nrepeat = 10;
+static unsigned int nloops = 1000000;
+static bool fshared;
+
+static u_int32_t futex1;
+static int futex_flag;
+
+static unsigned int threads_starting;
+static pthread_mutex_t thread_lock;
+static pthread_cond_t thread_parent;
+
+static const struct option options[] = {
+	OPT_UINTEGER('t', "threads", &nthreads,
+		     "Specify number of threads (default: online cpus)"),
+	OPT_UINTEGER('w', "nwakes", &nwakes,
+		     "Specify number of threads to wake up per call"),
+	OPT_UINTEGER('r', "repeat", &nrepeat,
+		     "Specify number of times to repeat the wakeups"),
+	OPT_UINTEGER('l', "loop", &nloops,
+		     "Specify number of wakeups without waiters"),
+	OPT_BOOLEAN('S', "shared", &fshared,
+		    "Use a shared futex instead of a private one"),
+	OPT_END()
+};
+
+static const char * const bench_futex_wake_usage[] = {
+	"perf bench futex wake <options>",
+	NULL
+};
+
+static void *workerfn(void *arg __used)
+{
+	pthread_mutex_lock(&thread_lock);
+	if (!--threads_starting)
+		pthread_cond_signal(&thread_parent);
+	pthread_mutex_unlock(&thread_lock);
+
+	futex_wait(&futex1, 0, NULL, futex_flag);
+	return NULL;
+}
+
+static void block_threads(pthread_t *worker)
+{
+	unsigned int i;
+
+	threads_starting = nthreads;
+	for (i = 0; i < nthreads; i++)
+		if (pthread_create(&worker[i], NULL, workerfn, NULL))
+			err(EXIT_FAILURE, "pthread_create");
+
+	pthread_mutex_lock(&thread_lock);
+	while (threads_starting)
+		pthread_cond_wait(&thread_parent, &thread_lock);
+	pthread_mutex_unlock(&thread_lock);
+
+	/* Let the last of them get into the kernel */
+	usleep(100000);
+}
+
+static unsigned long long timeval_usec(struct timeval *tv)
+{
+	return tv->tv_sec * 1000000ULL + tv->tv_usec;
+}
+
+int bench_futex_wake(int argc, const char **argv,
+		     const char *prefix __used)
+{
+	struct timeval start, stop, diff;
+	unsigned long long wake_usec = 0, empty_usec;
+	unsigned int i, j, nwoken;
+	pthread_t *worker;
+
+	argc = parse_options(argc, argv, options, bench_futex_wake_usage, 0);
+	if (argc) {
+		usage_with_options(bench_futex_wake_usage, options);
+		exit(EXIT_FAILURE);
+	}
+
+	if (!nthreads)
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (!nwakes)
+		nwakes = 1;
+	if (!nrepeat)
+		nrepeat = 1;
+	if (!nloops)
+		nloops = 1;
+	if (!fshared)
+		futex_flag = FUTEX_PRIVATE_FLAG;
+
+	worker = calloc(nthreads, sizeof(*worker));
+	if (!worker)
+		err(EXIT_FAILURE, "calloc");
+
+	pthread_mutex_init(&thread_lock, NULL);
+	pthread_cond_init(&thread_parent, NULL);
+
+	if (bench_format == BENCH_FORMAT_DEFAULT)
+		printf("# Waking %u threads on a %s futex, %u per call, %u times\n\n",
+		       nthreads, fshared ? "shared" : "private", nwakes,
+		       nrepeat);
+
+	for (j = 0; j < nrepeat; j++) {
+		block_threads(worker);
+
+		gettimeofday(&start, NULL);
+		for (nwoken = 0; nwoken < nthreads; )
+			nwoken += futex_wake(&futex1, nwakes, futex_flag);
+		gettimeofday(&stop, NULL);
+		timersub(&stop, &start, &diff);
+		wake_usec += timeval_usec(&diff);
+
+		for (i = 0; i < nthreads; i++)
+			if (pthread_join(worker[i], NULL))
+				err(EXIT_FAILURE, "pthread_join");
+	}
+
+	/* Nobody waits now: the kernel should not even lock the bucket */
+	gettimeofday(&start, NULL);
+	for (i = 0; i < nloops; i++)
+		futex_wake(&futex1, nwakes, futex_flag);
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+	empty_usec = timeval_usec(&diff);
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf(" %14s: %.4f [msec]\n", "Wake all",
+		       (double)wake_usec / nrepeat / 1000.0);
+		printf(" %14lf usecs/thread woken\n",
+		       (double)wake_usec / ((double)nrepeat * nthreads));
+		printf(" %14lf usecs/op without waiters\n",
+		       (double)empty_usec / nloops);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%.4f\n", (double)wake_usec / nrepeat / 1000.0);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	free(worker);
+	pthread_cond_destroy(&thread_parent);
+	pthread_mutex_destroy(&thread_lock);
+
+	return 0;
+}
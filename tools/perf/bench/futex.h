@@ -0,0 +1,50 @@
+/*
+ *
+ * futex.h
+ *
+ * Wrappers for the futex(2) operations used by the futex benchmarks;
+ * glibc does not provide any.
+ *
+ */
+
+#ifndef _FUTEX_H
+#define _FUTEX_H
+
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <linux/futex.h>
+
+/* As for __NR_perf_event_open, x86 headers here lack the numbers */
+#ifndef __NR_futex
+# if defined(__i386__)
+#  define __NR_futex 240
+# elif defined(__x86_64__)
+#  define __NR_futex 202
+# endif
+#endif
+
+static inline int
+futex(u_int32_t *uaddr, int op, u_int32_t val, struct timespec *timeout,
+      u_int32_t *uaddr2, int val3, int opflags)
+{
+	return syscall(__NR_futex, uaddr, op | opflags, val, timeout, uaddr2,
+		       val3);
+}
+
+/* Sleep on @uaddr as long as it holds @val, or until @timeout */
+static inline int
+futex_wait(u_int32_t *uaddr, u_int32_t val, struct timespec *timeout,
+	   int opflags)
+{
+	return futex(uaddr, FUTEX_WAIT, val, timeout, NULL, 0, opflags);
+}
+
+/* Wake up to @nr_wake tasks sleeping on @uaddr, returns the number woken */
+static inline int
+futex_wake(u_int32_t *uaddr, int nr_wake, int opflags)
+{
+	return futex(uaddr, FUTEX_WAKE, nr_wake, NULL, NULL, 0, opflags);
+}
+
+#endif /* _FUTEX_H */
@@ -0,0 +1,285 @@
+/*
+ * binder_latency: compare round trip latency of binder transactions
+ * across payload sizes, sending the payload either flattened into the
+ * data buffer (BC_TRANSACTION, the way a Parcel does it today) or as a
+ * BINDER_TYPE_PTR buffer with BC_TRANSACTION_SG, which the driver copies
+ * straight from where it lives.
+ *
+ * The parent becomes the context manager and replies to everything; the
+ * child sends.  Run as root with servicemanager stopped.
+ *
+ * Usage: binder_latency [-i iterations] [-m max_size]
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "binder.h"
+
+#define BINDER_DEV	"/dev/binder"
+#define MAP_SIZE	(2 * 1024 * 1024)
+
+static int binder_open_map(void)
+{
+	int fd = open(BINDER_DEV, O_RDWR);
+
+	if (fd < 0) {
+		perror("open " BINDER_DEV);
+		exit(1);
+	}
+	if (mmap(NULL, MAP_SIZE, PROT_READ, MAP_PRIVATE, fd, 0) ==
+	    MAP_FAILED) {
+		perror("mmap");
+		exit(1);
+	}
+	return fd;
+}
+
+static int binder_write_read(int fd, void *wbuf, size_t wsize,
+			     void *rbuf, size_t rsize, size_t *consumed)
+{
+	struct binder_write_read bwr;
+	int ret;
+
+	memset(&bwr, 0, sizeof(bwr));
+	bwr.write_size = wsize;
+	bwr.write_buffer = (unsigned long)wbuf;
+	bwr.read_size = rsize;
+	bwr.read_buffer = (unsigned long)rbuf;
+	do {
+		ret = ioctl(fd, BINDER_WRITE_READ, &bwr);
+	} while (ret < 0 && errno == EINTR);
+	if (consumed)
+		*consumed = bwr.read_consumed;
+	return ret;
+}
+
+/* returns the transaction data of the first @want found, or NULL */
+static struct binder_transaction_data *binder_find(uint32_t *ptr,
+						   size_t consumed,
+						   uint32_t want)
+{
+	uint32_t *end = (uint32_t *)((char *)ptr + consumed);
+
+	while (ptr < end) {
+		uint32_t cmd = *ptr++;
+
+		switch (cmd) {
+		case BR_NOOP:
+		case BR_TRANSACTION_COMPLETE:
+		case BR_SPAWN_LOOPER:
+			break;
+		case BR_TRANSACTION:
+		case BR_REPLY:
+			if (cmd == want)
+				return (struct binder_transaction_data *)ptr;
+			ptr += sizeof(struct binder_transaction_data) /
+			       sizeof(*ptr);
+			break;
+		default:
+			fprintf(stderr, "binder: unexpected return %08x\n",
+				cmd);
+			exit(1);
+		}
+	}
+	return NULL;
+}
+
+static void server(int fd)
+{
+	uint32_t rbuf[64];
+	uint32_t cmd = BC_ENTER_LOOPER;
+	struct binder_transaction_data *txn;
+	struct {
+		uint32_t free_cmd;
+		const void *free_ptr;
+		uint32_t reply_cmd;
+		struct binder_transaction_data reply;
+	} __attribute__((packed)) out;
+	size_t consumed;
+
+	binder_write_read(fd, &cmd, sizeof(cmd), NULL, 0, NULL);
+	for (;;) {
+		if (binder_write_read(fd, NULL, 0, rbuf, sizeof(rbuf),
+				      &consumed) < 0) {
+			perror("server: BINDER_WRITE_READ");
+			exit(1);
+		}
+		txn = binder_find(rbuf, consumed, BR_TRANSACTION);
+		if (!txn)
+			continue;
+		memset(&out, 0, sizeof(out));
+		out.free_cmd = BC_FREE_BUFFER;
+		out.free_ptr = txn->data.ptr.buffer;
+		out.reply_cmd = BC_REPLY;
+		binder_write_read(fd, &out, sizeof(out), NULL, 0, NULL);
+	}
+}
+
+static void round_trip(int fd, void *cmd, size_t cmd_size)
+{
+	uint32_t rbuf[32];
+	struct binder_transaction_data *txn = NULL;
+	struct {
+		uint32_t cmd;
+		const void *ptr;
+	} __attribute__((packed)) fb;
+	size_t consumed;
+
+	while (!txn) {
+		if (binder_write_read(fd, cmd, cmd_size, rbuf, sizeof(rbuf),
+				      &consumed) < 0) {
+			perror("client: BINDER_WRITE_READ");
+			exit(1);
+		}
+		cmd_size = 0;
+		txn = binder_find(rbuf, consumed, BR_REPLY);
+	}
+	fb.cmd = BC_FREE_BUFFER;
+	fb.ptr = txn->data.ptr.buffer;
+	binder_write_read(fd, &fb, sizeof(fb), NULL, 0, NULL);
+}
+
+static double now_us(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000000.0 + tv.tv_usec;
+}
+
+/* average round trip in microseconds, payload flattened into the data */
+static double bench_copy(int fd, const char *payload, size_t size,
+			 char *parcel, int iterations)
+{
+	struct {
+		uint32_t cmd;
+		struct binder_transaction_data tr;
+	} __attribute__((packed)) out;
+	double start;
+	int i;
+
+	memset(&out, 0, sizeof(out));
+	out.cmd = BC_TRANSACTION;
+	out.tr.data_size = size;
+	out.tr.data.ptr.buffer = parcel;
+
+	start = now_us();
+	for (i = 0; i < iterations; i++) {
+		memcpy(parcel, payload, size);
+		round_trip(fd, &out, sizeof(out));
+	}
+	return (now_us() - start) / iterations;
+}
+
+/* average round trip in microseconds, payload as a BINDER_TYPE_PTR */
+static double bench_sg(int fd, const char *payload, size_t size,
+		       int iterations)
+{
+	struct binder_buffer_object obj;
+	size_t offset = 0;
+	struct {
+		uint32_t cmd;
+		struct binder_transaction_data_sg tr;
+	} __attribute__((packed)) out;
+	double start;
+	int i;
+
+	memset(&obj, 0, sizeof(obj));
+	obj.type = BINDER_TYPE_PTR;
+	obj.buffer = (void *)payload;
+	obj.length = size;
+
+	memset(&out, 0, sizeof(out));
+	out.cmd = BC_TRANSACTION_SG;
+	out.tr.transaction_data.data_size = sizeof(obj);
+	out.tr.transaction_data.offsets_size = sizeof(offset);
+	out.tr.transaction_data.data.ptr.buffer = &obj;
+	out.tr.transaction_data.data.ptr.offsets = &offset;
+	out.tr.buffers_size = (size + 7) & ~(size_t)7;
+
+	start = now_us();
+	for (i = 0; i < iterations; i++)
+		round_trip(fd, &out, sizeof(out));
+	return (now_us() - start) / iterations;
+}
+
+int main(int argc, char **argv)
+{
+	int iterations = 2000;
+	size_t max_size = 256 * 1024;
+	size_t size;
+	char *payload, *parcel;
+	pid_t pid;
+	int fd, opt, status;
+
+	while ((opt = getopt(argc, argv, "i:m:")) != -1) {
+		switch (opt) {
+		case 'i':
+			iterations = atoi(optarg);
+			break;
+		case 'm':
+			max_size = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			fprintf(stderr,
+				"usage: %s [-i iterations] [-m max_size]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+	if (iterations < 1 || max_size > MAP_SIZE / 4) {
+		fprintf(stderr, "bad iterations or max_size\n");
+		return 1;
+	}
+
+	fd = binder_open_map();
+	if (ioctl(fd, BINDER_SET_CONTEXT_MGR, 0) < 0) {
+		perror("BINDER_SET_CONTEXT_MGR (is servicemanager running?)");
+		return 1;
+	}
+
+	pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		return 1;
+	}
+	if (pid > 0) {
+		server(fd);
+		return 0;
+	}
+
+	close(fd);
+	fd = binder_open_map();
+	payload = malloc(max_size);
+	parcel = malloc(max_size);
+	if (!payload || !parcel) {
+		perror("malloc");
+		return 1;
+	}
+	memset(payload, 0x5a, max_size);
+
+	printf("%10s %12s %12s\n", "size", "copy (us)", "sg (us)");
+	for (size = 64; size <= max_size; size *= 4) {
+		double copy = bench_copy(fd, payload, size, parcel,
+					 iterations);
+		double sg = bench_sg(fd, payload, size, iterations);
+
+		printf("%10zu %12.2f %12.2f\n", size, copy, sg);
+	}
+
+	kill(getppid(), SIGTERM);
+	wait(&status);
+	return 0;
+}
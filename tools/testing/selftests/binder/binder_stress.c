@@ -0,0 +1,325 @@
+/*
+ * binder_stress: measure binder round trips per second as the number of
+ * concurrent clients grows.
+ *
+ * The parent becomes the context manager and serves handle 0 from one
+ * looper thread per client; each client is a separate process issuing
+ * synchronous BC_TRANSACTIONs back to back.  Run as root with
+ * servicemanager stopped, since there can only be one context manager
+ * and the driver remembers the uid of the first one.
+ *
+ * Usage: binder_stress [-n max_clients] [-t seconds]
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "binder.h"
+
+#define BINDER_DEV	"/dev/binder"
+#define MAP_SIZE	(128 * 1024)
+
+struct binder_conn {
+	int fd;
+	void *map;
+};
+
+static volatile unsigned long *counts;
+static volatile int *stop;
+
+static int binder_conn_open(struct binder_conn *bc)
+{
+	struct binder_version vers;
+
+	bc->fd = open(BINDER_DEV, O_RDWR);
+	if (bc->fd < 0) {
+		perror("open " BINDER_DEV);
+		return -1;
+	}
+	if (ioctl(bc->fd, BINDER_VERSION, &vers) < 0 ||
+	    vers.protocol_version != BINDER_CURRENT_PROTOCOL_VERSION) {
+		fprintf(stderr, "binder: protocol version mismatch\n");
+		close(bc->fd);
+		return -1;
+	}
+	bc->map = mmap(NULL, MAP_SIZE, PROT_READ, MAP_PRIVATE, bc->fd, 0);
+	if (bc->map == MAP_FAILED) {
+		perror("mmap");
+		close(bc->fd);
+		return -1;
+	}
+	return 0;
+}
+
+static int binder_write(int fd, void *data, size_t len)
+{
+	struct binder_write_read bwr;
+
+	memset(&bwr, 0, sizeof(bwr));
+	bwr.write_size = len;
+	bwr.write_buffer = (unsigned long)data;
+	return ioctl(fd, BINDER_WRITE_READ, &bwr);
+}
+
+/*
+ * Scan a read buffer for @want, handing back the transaction data that
+ * comes with it.  Returns 1 if found, 0 if not, -1 on an error reply.
+ */
+static int binder_parse(uint32_t *ptr, uint32_t *end, uint32_t want,
+			struct binder_transaction_data *txn)
+{
+	int found = 0;
+
+	while (ptr < end) {
+		uint32_t cmd = *ptr++;
+
+		switch (cmd) {
+		case BR_NOOP:
+		case BR_TRANSACTION_COMPLETE:
+		case BR_SPAWN_LOOPER:
+			break;
+		case BR_INCREFS:
+		case BR_ACQUIRE:
+		case BR_RELEASE:
+		case BR_DECREFS:
+			ptr += sizeof(struct binder_ptr_cookie) / sizeof(*ptr);
+			break;
+		case BR_TRANSACTION:
+		case BR_REPLY:
+			memcpy(txn, ptr, sizeof(*txn));
+			ptr += sizeof(*txn) / sizeof(*ptr);
+			if (cmd == want)
+				found = 1;
+			break;
+		case BR_DEAD_REPLY:
+		case BR_FAILED_REPLY:
+			return -1;
+		default:
+			fprintf(stderr, "binder: unexpected return %08x\n", cmd);
+			return -1;
+		}
+	}
+	return found;
+}
+
+static void *server_thread(void *arg)
+{
+	int fd = *(int *)arg;
+	uint32_t rbuf[64];
+	struct binder_write_read bwr;
+	struct binder_transaction_data txn;
+	struct {
+		uint32_t free_cmd;
+		void *free_ptr;
+		uint32_t reply_cmd;
+		struct binder_transaction_data reply;
+	} __attribute__((packed)) out;
+	uint32_t cmd = BC_ENTER_LOOPER;
+	uint32_t result = 0;
+
+	binder_write(fd, &cmd, sizeof(cmd));
+	for (;;) {
+		int ret;
+
+		memset(&bwr, 0, sizeof(bwr));
+		bwr.read_size = sizeof(rbuf);
+		bwr.read_buffer = (unsigned long)rbuf;
+		if (ioctl(fd, BINDER_WRITE_READ, &bwr) < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("server: BINDER_WRITE_READ");
+			return NULL;
+		}
+		ret = binder_parse(rbuf, rbuf + bwr.read_consumed /
+				   sizeof(uint32_t), BR_TRANSACTION, &txn);
+		if (ret <= 0)
+			continue;
+
+		memset(&out, 0, sizeof(out));
+		out.free_cmd = BC_FREE_BUFFER;
+		out.free_ptr = (void *)txn.data.ptr.buffer;
+		out.reply_cmd = BC_REPLY;
+		out.reply.data_size = sizeof(result);
+		out.reply.data.ptr.buffer = &result;
+		binder_write(fd, &out, sizeof(out));
+	}
+	return NULL;
+}
+
+static unsigned long client(int id)
+{
+	struct binder_conn bc;
+	uint32_t rbuf[32];
+	uint32_t payload = id;
+	struct binder_write_read bwr;
+	struct binder_transaction_data txn;
+	struct {
+		uint32_t cmd;
+		struct binder_transaction_data tr;
+	} __attribute__((packed)) out;
+	struct {
+		uint32_t cmd;
+		void *ptr;
+	} __attribute__((packed)) fb;
+	unsigned long n = 0;
+
+	if (binder_conn_open(&bc))
+		exit(1);
+
+	memset(&out, 0, sizeof(out));
+	out.cmd = BC_TRANSACTION;
+	out.tr.target.handle = 0;
+	out.tr.data_size = sizeof(payload);
+	out.tr.data.ptr.buffer = &payload;
+
+	while (!*stop) {
+		int ret = 0;
+
+		memset(&bwr, 0, sizeof(bwr));
+		bwr.write_size = sizeof(out);
+		bwr.write_buffer = (unsigned long)&out;
+		do {
+			bwr.read_size = sizeof(rbuf);
+			bwr.read_buffer = (unsigned long)rbuf;
+			bwr.read_consumed = 0;
+			if (ioctl(bc.fd, BINDER_WRITE_READ, &bwr) < 0) {
+				if (errno == EINTR)
+					continue;
+				perror("client: BINDER_WRITE_READ");
+				exit(1);
+			}
+			bwr.write_size = 0;
+			ret = binder_parse(rbuf, rbuf + bwr.read_consumed /
+					   sizeof(uint32_t), BR_REPLY, &txn);
+			if (ret < 0) {
+				fprintf(stderr, "client %d: failed reply\n",
+					id);
+				exit(1);
+			}
+		} while (!ret);
+
+		fb.cmd = BC_FREE_BUFFER;
+		fb.ptr = (void *)txn.data.ptr.buffer;
+		binder_write(bc.fd, &fb, sizeof(fb));
+		n++;
+	}
+	return n;
+}
+
+static double run_round(int nr_clients, int seconds)
+{
+	pid_t *pids;
+	unsigned long total = 0;
+	struct timeval start, end;
+	double elapsed;
+	int i;
+
+	pids = calloc(nr_clients, sizeof(*pids));
+	if (!pids)
+		return -1;
+	*stop = 0;
+	gettimeofday(&start, NULL);
+	for (i = 0; i < nr_clients; i++) {
+		pids[i] = fork();
+		if (pids[i] < 0) {
+			perror("fork");
+			exit(1);
+		}
+		if (pids[i] == 0) {
+			counts[i] = client(i);
+			exit(0);
+		}
+	}
+	sleep(seconds);
+	*stop = 1;
+	for (i = 0; i < nr_clients; i++) {
+		waitpid(pids[i], NULL, 0);
+		total += counts[i];
+	}
+	gettimeofday(&end, NULL);
+	free(pids);
+
+	elapsed = (end.tv_sec - start.tv_sec) +
+		  (end.tv_usec - start.tv_usec) / 1000000.0;
+	return total / elapsed;
+}
+
+int main(int argc, char **argv)
+{
+	struct binder_conn server;
+	int max_clients = sysconf(_SC_NPROCESSORS_ONLN);
+	int seconds = 5;
+	double base = 0;
+	void *shared;
+	int opt, n, i;
+
+	while ((opt = getopt(argc, argv, "n:t:")) != -1) {
+		switch (opt) {
+		case 'n':
+			max_clients = atoi(optarg);
+			break;
+		case 't':
+			seconds = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr,
+				"usage: %s [-n max_clients] [-t seconds]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+	if (max_clients < 1)
+		max_clients = 1;
+
+	shared = mmap(NULL, sizeof(long) + max_clients * sizeof(*counts),
+		      PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS,
+		      -1, 0);
+	if (shared == MAP_FAILED) {
+		perror("mmap shared");
+		return 1;
+	}
+	stop = shared;
+	counts = (void *)((char *)shared + sizeof(long));
+
+	if (binder_conn_open(&server))
+		return 1;
+	if (ioctl(server.fd, BINDER_SET_CONTEXT_MGR, 0) < 0) {
+		perror("BINDER_SET_CONTEXT_MGR (is servicemanager running?)");
+		return 1;
+	}
+	for (i = 0; i < max_clients; i++) {
+		pthread_t tid;
+
+		if (pthread_create(&tid, NULL, server_thread, &server.fd)) {
+			perror("pthread_create");
+			return 1;
+		}
+	}
+
+	printf("clients   tx/sec      scaling\n");
+	for (n = 1; ; n = n * 2 > max_clients ? max_clients : n * 2) {
+		double rate = run_round(n, seconds);
+
+		if (rate < 0)
+			return 1;
+		if (n == 1)
+			base = rate;
+		printf("%7d   %-10.0f  %.2fx\n", n, rate,
+		       base ? rate / base : 0);
+		if (n == max_clients)
+			break;
+	}
+	return 0;
+}
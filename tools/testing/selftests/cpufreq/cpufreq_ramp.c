@@ -0,0 +1,250 @@
+/*
+ * cpufreq_ramp: measure how long the interactive governor takes to raise
+ * the speed of an idle CPU once a burst of work starts on it.
+ *
+ * The program pins itself to one CPU, sleeps long enough for the speed to
+ * drop, writes a marker to trace_marker and spins.  The ramp latency of a
+ * burst is the time from its marker to the first
+ * cpufreq_interactive_setspeed event for that CPU reporting a speed above
+ * the one it ran at when the marker was written.  Bursts that end without
+ * a ramp are counted as missed.  With -m the governor's sched_driven
+ * tunable is set for the run (or both settings are run in turn) and
+ * restored afterwards.  Needs debugfs mounted and root.
+ *
+ * Usage: cpufreq_ramp [-c cpu] [-n bursts] [-i idle_ms] [-b burst_ms]
+ *                     [-m timer|sched|both]
+ */
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TRACING		"/sys/kernel/debug/tracing"
+#define INTERACTIVE	"/sys/devices/system/cpu/cpufreq/interactive"
+#define SETSPEED	"cpufreq_interactive/cpufreq_interactive_setspeed"
+
+static int cpu;
+static int bursts = 20;
+static int idle_ms = 500;
+static int burst_ms = 100;
+
+static int write_file(const char *path, const char *val)
+{
+	int fd, ret;
+
+	fd = open(path, O_WRONLY | O_TRUNC);
+	if (fd < 0) {
+		perror(path);
+		return -1;
+	}
+	ret = write(fd, val, strlen(val));
+	if (ret < 0)
+		perror(path);
+	close(fd);
+	return ret < 0 ? -1 : 0;
+}
+
+static int read_file(const char *path, char *buf, size_t len)
+{
+	int fd, ret;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -1;
+	ret = read(fd, buf, len - 1);
+	close(fd);
+	if (ret < 0)
+		return -1;
+	buf[ret] = '\0';
+	return 0;
+}
+
+static unsigned long cur_freq(void)
+{
+	char path[128], buf[32];
+
+	snprintf(path, sizeof(path),
+		 "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_cur_freq", cpu);
+	if (read_file(path, buf, sizeof(buf)))
+		return 0;
+	return strtoul(buf, NULL, 10);
+}
+
+static double now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void spin(int ms)
+{
+	double end = now_ms() + ms;
+
+	while (now_ms() < end)
+		;
+}
+
+/* Timestamp of the trace line whose event name starts at @ev */
+static double trace_ts(const char *line, const char *ev)
+{
+	const char *p = ev;
+
+	/* ev points at ": event:", the timestamp ends just before it */
+	while (p > line && p[-1] != ' ')
+		p--;
+	return strtod(p, NULL);
+}
+
+static int run(const char *mode)
+{
+	char marker[64], line[512];
+	double start = 0, lat, sum = 0, min = 0, max = 0;
+	unsigned long from = 0, actual;
+	unsigned int ecpu;
+	int i, fd, burst = -1, ramped = 0, nramped = 0;
+	FILE *trace;
+	char *p;
+
+	write_file(TRACING "/tracing_on", "0");
+	write_file(TRACING "/trace", "");
+	if (write_file(TRACING "/events/" SETSPEED "/enable", "1"))
+		return -1;
+	write_file(TRACING "/tracing_on", "1");
+
+	fd = open(TRACING "/trace_marker", O_WRONLY);
+	if (fd < 0) {
+		perror("trace_marker");
+		return -1;
+	}
+
+	for (i = 0; i < bursts; i++) {
+		usleep(idle_ms * 1000);
+		snprintf(marker, sizeof(marker), "cpufreq_ramp start %d %lu\n",
+			 i, cur_freq());
+		if (write(fd, marker, strlen(marker)) < 0) {
+			perror("trace_marker");
+			break;
+		}
+		spin(burst_ms);
+	}
+	close(fd);
+
+	write_file(TRACING "/tracing_on", "0");
+	write_file(TRACING "/events/" SETSPEED "/enable", "0");
+
+	trace = fopen(TRACING "/trace", "r");
+	if (!trace) {
+		perror("trace");
+		return -1;
+	}
+
+	while (fgets(line, sizeof(line), trace)) {
+		if ((p = strstr(line, ": tracing_mark_write: cpufreq_ramp"))) {
+			if (sscanf(strstr(p, "start"), "start %d %lu",
+				   &burst, &from) != 2)
+				continue;
+			start = trace_ts(line, p);
+			ramped = 0;
+		} else if ((p = strstr(line, ": cpufreq_interactive_setspeed:"))) {
+			if (burst < 0 || ramped)
+				continue;
+			if (sscanf(strstr(p, "cpu="), "cpu=%u targ=%*u actual=%lu",
+				   &ecpu, &actual) != 2)
+				continue;
+			if ((int)ecpu != cpu || actual <= from)
+				continue;
+
+			lat = (trace_ts(line, p) - start) * 1e3;
+			/* The burst ended before this: not its ramp */
+			if (lat > burst_ms)
+				continue;
+			if (!nramped || lat < min)
+				min = lat;
+			if (lat > max)
+				max = lat;
+			sum += lat;
+			nramped++;
+			ramped = 1;
+		}
+	}
+	fclose(trace);
+
+	if (nramped)
+		printf("%-6s cpu %d: %d/%d bursts ramped, latency ms "
+		       "min %.2f avg %.2f max %.2f\n", mode, cpu, nramped,
+		       bursts, min, sum / nramped, max);
+	else
+		printf("%-6s cpu %d: 0/%d bursts ramped\n", mode, cpu, bursts);
+	return 0;
+}
+
+static int run_mode(const char *mode)
+{
+	if (write_file(INTERACTIVE "/sched_driven",
+		       strcmp(mode, "sched") ? "0" : "1"))
+		return -1;
+	return run(mode);
+}
+
+int main(int argc, char *argv[])
+{
+	char saved[16] = "";
+	const char *mode = NULL;
+	cpu_set_t set;
+	int opt, ret;
+
+	while ((opt = getopt(argc, argv, "c:n:i:b:m:")) != -1) {
+		switch (opt) {
+		case 'c':
+			cpu = atoi(optarg);
+			break;
+		case 'n':
+			bursts = atoi(optarg);
+			break;
+		case 'i':
+			idle_ms = atoi(optarg);
+			break;
+		case 'b':
+			burst_ms = atoi(optarg);
+			break;
+		case 'm':
+			mode = optarg;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-c cpu] [-n bursts] "
+				"[-i idle_ms] [-b burst_ms] "
+				"[-m timer|sched|both]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	if (sched_setaffinity(0, sizeof(set), &set)) {
+		perror("sched_setaffinity");
+		return 1;
+	}
+
+	if (!mode)
+		return run("current") ? 1 : 0;
+
+	if (read_file(INTERACTIVE "/sched_driven", saved, sizeof(saved))) {
+		perror(INTERACTIVE "/sched_driven");
+		return 1;
+	}
+
+	if (!strcmp(mode, "both"))
+		ret = run_mode("timer") || run_mode("sched");
+	else
+		ret = run_mode(mode);
+
+	write_file(INTERACTIVE "/sched_driven", saved);
+	return ret ? 1 : 0;
+}
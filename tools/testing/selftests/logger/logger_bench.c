@@ -0,0 +1,248 @@
+/*
+ * logger_bench: measure how many entries per second the Android logger
+ * accepts as the number of concurrent writer threads grows.
+ *
+ * Each writer logs short entries laid out the way liblog does (priority,
+ * tag, message) with writev().  A reader drains the log at the same time.
+ * It fails the run if a writer's entries come back in a different order
+ * than they were written, and counts entries with a timestamp older than
+ * the one before; writers racing each other can cause a few of those.
+ * Entries lost to the reader being lapped are not an error.  The log is
+ * flushed before each run, so there is no default: name a log device
+ * whose contents can be thrown away.
+ *
+ * Usage: logger_bench -d device [-n max_threads] [-t seconds]
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+
+#include "logger.h"
+
+#define MAX_THREADS	256
+
+static const char *log_path;
+static volatile int stop;
+
+struct writer {
+	pthread_t thread;
+	unsigned long long done;
+	int fd;
+	int idx;
+};
+
+struct reader {
+	pthread_t thread;
+	unsigned long long entries;
+	unsigned long long misordered;	/* timestamp went backwards */
+	unsigned long long reordered;	/* a writer's own entries swapped */
+	unsigned long long seq[MAX_THREADS];
+	int fd;
+};
+
+static void *writer_fn(void *arg)
+{
+	struct writer *w = arg;
+	char prio = 4;			/* ANDROID_LOG_INFO */
+	static const char tag[] = "logger_bench";
+	char msg[64];
+	struct iovec vec[3];
+
+	vec[0].iov_base = &prio;
+	vec[0].iov_len = 1;
+	vec[1].iov_base = (void *)tag;
+	vec[1].iov_len = sizeof(tag);
+	vec[2].iov_base = msg;
+
+	while (!stop) {
+		vec[2].iov_len = snprintf(msg, sizeof(msg), "%d %llu", w->idx,
+					  w->done + 1) + 1;
+		if (writev(w->fd, vec, 3) < 0) {
+			perror("writev");
+			break;
+		}
+		w->done++;
+	}
+
+	return NULL;
+}
+
+static void check_entry(struct reader *r, struct logger_entry *e,
+			struct logger_entry *last)
+{
+	unsigned long long seq;
+	const char *msg;
+	int idx;
+
+	if (e->sec < last->sec ||
+	    (e->sec == last->sec && e->nsec < last->nsec))
+		r->misordered++;
+	*last = *e;
+
+	/* priority byte, tag, then our "<writer> <seq>" message */
+	msg = e->msg + 1;
+	if (e->len < 2 || strcmp(msg, "logger_bench"))
+		return;
+	msg += strlen(msg) + 1;
+	if (sscanf(msg, "%d %llu", &idx, &seq) != 2 ||
+	    idx < 0 || idx >= MAX_THREADS)
+		return;
+	if (seq <= r->seq[idx])
+		r->reordered++;
+	r->seq[idx] = seq;
+}
+
+static void *reader_fn(void *arg)
+{
+	struct reader *r = arg;
+	struct logger_entry last;
+	union {
+		struct logger_entry e;
+		char buf[LOGGER_ENTRY_MAX_PAYLOAD + sizeof(struct logger_entry)];
+	} u;
+	struct pollfd pfd = { .fd = r->fd, .events = POLLIN };
+
+	memset(&last, 0, sizeof(last));
+	for (;;) {
+		ssize_t n = read(r->fd, &u, sizeof(u));
+
+		if (n < 0 && errno == EAGAIN) {
+			if (stop)
+				break;
+			poll(&pfd, 1, 10);
+			continue;
+		}
+		if (n < 0) {
+			perror("read");
+			break;
+		}
+		r->entries++;
+		check_entry(r, &u.e, &last);
+	}
+
+	return NULL;
+}
+
+static int open_reader(void)
+{
+	int fd = open(log_path, O_RDONLY | O_NONBLOCK);
+	int ver = 2;
+
+	if (fd < 0 || ioctl(fd, LOGGER_SET_VERSION, &ver) < 0) {
+		perror(log_path);
+		exit(1);
+	}
+	return fd;
+}
+
+/* Returns entries written per second */
+static double run(int nr_threads, int seconds, struct reader *r)
+{
+	struct writer *w;
+	struct timeval start, end;
+	unsigned long long total = 0;
+	double secs;
+	int i, fd;
+
+	fd = open(log_path, O_WRONLY);
+	if (fd < 0 || ioctl(fd, LOGGER_FLUSH_LOG) < 0) {
+		perror("flush");
+		exit(1);
+	}
+	close(fd);
+
+	w = calloc(nr_threads, sizeof(*w));
+	if (!w)
+		exit(1);
+
+	memset(r, 0, sizeof(*r));
+	r->fd = open_reader();
+
+	stop = 0;
+	pthread_create(&r->thread, NULL, reader_fn, r);
+	gettimeofday(&start, NULL);
+	for (i = 0; i < nr_threads; i++) {
+		w[i].idx = i;
+		w[i].fd = open(log_path, O_WRONLY);
+		if (w[i].fd < 0) {
+			perror(log_path);
+			exit(1);
+		}
+		pthread_create(&w[i].thread, NULL, writer_fn, &w[i]);
+	}
+
+	sleep(seconds);
+	stop = 1;
+
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(w[i].thread, NULL);
+		close(w[i].fd);
+		total += w[i].done;
+	}
+	gettimeofday(&end, NULL);
+	pthread_join(r->thread, NULL);
+	close(r->fd);
+	free(w);
+
+	secs = (end.tv_sec - start.tv_sec) +
+	       (end.tv_usec - start.tv_usec) / 1e6;
+	return total / secs;
+}
+
+int main(int argc, char *argv[])
+{
+	int max_threads = sysconf(_SC_NPROCESSORS_ONLN) * 2;
+	int seconds = 5;
+	int opt, n, ret = 0;
+	struct reader r;
+
+	while ((opt = getopt(argc, argv, "d:n:t:")) != -1) {
+		switch (opt) {
+		case 'd':
+			log_path = optarg;
+			break;
+		case 'n':
+			max_threads = atoi(optarg);
+			break;
+		case 't':
+			seconds = atoi(optarg);
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (!log_path)
+		goto usage;
+	if (max_threads > MAX_THREADS)
+		max_threads = MAX_THREADS;
+
+	printf("%8s %14s %14s %10s %10s\n", "writers", "entries/s",
+	       "read/s", "misorder", "reorder");
+	for (n = 1; n <= max_threads; n *= 2) {
+		double rate = run(n, seconds, &r);
+
+		printf("%8d %14.0f %14.0f %10llu %10llu\n", n, rate,
+		       r.entries / (double)seconds, r.misordered,
+		       r.reordered);
+		if (r.reordered)
+			ret = 1;
+	}
+
+	return ret;
+
+usage:
+	fprintf(stderr, "usage: %s -d device [-n max_threads] [-t seconds]\n"
+		"The log on device is flushed before each run.\n", argv[0]);
+	return 1;
+}
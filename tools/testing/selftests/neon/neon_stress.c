@@ -0,0 +1,208 @@
+/*
+ * neon_stress: check that user NEON state survives kernel mode NEON.
+ *
+ * On every online CPU, two user threads keep a pattern of their own in
+ * all NEON registers, spin, and check that the pattern is still there;
+ * sharing the CPU forces the lazy VFP switching to save and restore them.
+ * A third thread on each CPU keeps writing to <debugfs>/neon_test, so the
+ * neon_test module (CONFIG_KERNEL_MODE_NEON_TEST) clobbers the NEON
+ * registers from that thread's context and from timer softirqs that land
+ * on top of the user threads.  The run fails if any user thread, or the
+ * module itself, saw a corrupted register.
+ *
+ * Usage: neon_stress [-t seconds]
+ */
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define NEON_TEST	"/sys/kernel/debug/neon_test"
+#define USERS_PER_CPU	2
+#define MAX_CPUS	32
+
+static volatile int stop;
+
+struct worker {
+	pthread_t thread;
+	int cpu;
+	unsigned int id;
+	unsigned long long rounds;
+	unsigned long long errors;
+};
+
+#ifdef __arm__
+static void pin(int cpu)
+{
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	sched_setaffinity(0, sizeof(set), &set);
+}
+
+/* Fill q0-q15 with @pat, spin, and store d0-d31 into @regs */
+static void neon_round(unsigned int pat, unsigned int spin, unsigned int *regs)
+{
+	asm volatile(
+	"	.fpu	neon\n"
+	"	vdup.32	q0, %2\n"
+	"	vmov	q1, q0\n"
+	"	vmov	q2, q0\n"
+	"	vmov	q3, q0\n"
+	"	vmov	q4, q0\n"
+	"	vmov	q5, q0\n"
+	"	vmov	q6, q0\n"
+	"	vmov	q7, q0\n"
+	"	vmov	q8, q0\n"
+	"	vmov	q9, q0\n"
+	"	vmov	q10, q0\n"
+	"	vmov	q11, q0\n"
+	"	vmov	q12, q0\n"
+	"	vmov	q13, q0\n"
+	"	vmov	q14, q0\n"
+	"	vmov	q15, q0\n"
+	"1:	subs	%1, %1, #1\n"
+	"	bne	1b\n"
+	"	vstmia	%0!, {d0-d15}\n"
+	"	vstmia	%0!, {d16-d31}\n"
+	: "+r" (regs), "+r" (spin)
+	: "r" (pat)
+	: "cc", "memory",
+	  "d0", "d1", "d2", "d3", "d4", "d5", "d6", "d7",
+	  "d8", "d9", "d10", "d11", "d12", "d13", "d14", "d15",
+	  "d16", "d17", "d18", "d19", "d20", "d21", "d22", "d23",
+	  "d24", "d25", "d26", "d27", "d28", "d29", "d30", "d31");
+}
+
+static void *user_fn(void *arg)
+{
+	struct worker *w = arg;
+	unsigned int regs[64], pat;
+	int i;
+
+	pin(w->cpu);
+	while (!stop) {
+		pat = (w->id << 20) | (w->rounds & 0xfffff);
+		neon_round(pat, 200000, regs);
+		for (i = 0; i < 64; i++) {
+			if (regs[i] != pat) {
+				w->errors++;
+				break;
+			}
+		}
+		w->rounds++;
+		if (!(w->rounds & 15))
+			sched_yield();
+	}
+	return NULL;
+}
+
+static void *kernel_fn(void *arg)
+{
+	struct worker *w = arg;
+	int fd;
+
+	pin(w->cpu);
+	fd = open(NEON_TEST, O_WRONLY);
+	if (fd < 0) {
+		perror(NEON_TEST);
+		return NULL;
+	}
+	while (!stop) {
+		if (write(fd, "200", 3) < 0) {
+			perror(NEON_TEST);
+			break;
+		}
+		w->rounds += 200;
+	}
+	close(fd);
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	struct worker users[MAX_CPUS * USERS_PER_CPU], kernels[MAX_CPUS];
+	unsigned long long rounds = 0, errors = 0;
+	long task, softirq, kerrors;
+	int seconds = 10, ncpus, n, i, opt;
+	char buf[128];
+	FILE *f;
+
+	while ((opt = getopt(argc, argv, "t:")) != -1) {
+		switch (opt) {
+		case 't':
+			seconds = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-t seconds]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (access(NEON_TEST, W_OK)) {
+		perror(NEON_TEST);
+		return 1;
+	}
+
+	ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (ncpus > MAX_CPUS)
+		ncpus = MAX_CPUS;
+
+	memset(users, 0, sizeof(users));
+	memset(kernels, 0, sizeof(kernels));
+	n = ncpus * USERS_PER_CPU;
+	for (i = 0; i < n; i++) {
+		users[i].cpu = i / USERS_PER_CPU;
+		users[i].id = i + 1;
+		pthread_create(&users[i].thread, NULL, user_fn, &users[i]);
+	}
+	for (i = 0; i < ncpus; i++) {
+		kernels[i].cpu = i;
+		pthread_create(&kernels[i].thread, NULL, kernel_fn,
+			       &kernels[i]);
+	}
+
+	sleep(seconds);
+	stop = 1;
+
+	for (i = 0; i < n; i++) {
+		pthread_join(users[i].thread, NULL);
+		rounds += users[i].rounds;
+		errors += users[i].errors;
+	}
+	for (i = 0; i < ncpus; i++)
+		pthread_join(kernels[i].thread, NULL);
+
+	f = fopen(NEON_TEST, "r");
+	if (!f || !fgets(buf, sizeof(buf), f) ||
+	    sscanf(buf, "task %ld softirq %ld errors %ld",
+		   &task, &softirq, &kerrors) != 3) {
+		fprintf(stderr, "%s: cannot read results\n", NEON_TEST);
+		return 1;
+	}
+	fclose(f);
+
+	printf("user: %llu rounds, %llu corrupted\n", rounds, errors);
+	printf("kernel: %ld task rounds, %ld softirq rounds, %ld corrupted\n",
+	       task, softirq, kerrors);
+
+	if (errors || kerrors) {
+		printf("neon_stress: FAIL\n");
+		return 1;
+	}
+	printf("neon_stress: PASS\n");
+	return 0;
+}
+#else
+int main(void)
+{
+	printf("neon_stress: not an ARM system, skipped\n");
+	return 0;
+}
+#endif
@@ -0,0 +1,202 @@
+/*
+ * zram_stress: measure zram write throughput as the number of concurrent
+ * writers grows, with a single compression stream and with one stream
+ * per writer.
+ *
+ * Each writer thread owns a disjoint slice of the device and rewrites it
+ * page by page with O_DIRECT, so every write goes through the driver's
+ * compression path the same way swap-out does.  The page contents are
+ * roughly 2:1 compressible.  The device must be initialized (disksize
+ * set) and must not be in use; its contents are destroyed.
+ *
+ * Usage: zram_stress [-d zram<id>] [-n max_threads] [-t seconds]
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mount.h>
+#include <sys/time.h>
+
+#define PAGE_SZ		4096
+
+static char dev_path[64] = "/dev/zram0";
+static char streams_path[96] = "/sys/block/zram0/max_comp_streams";
+static unsigned long long dev_pages;
+static volatile int stop;
+
+struct writer {
+	pthread_t thread;
+	unsigned long long first, nr;	/* slice of the device, in pages */
+	unsigned long long done;
+	int fd;
+};
+
+static void fill_page(char *p, unsigned int seed)
+{
+	static const char words[][8] = {
+		"zram ", "swap ", "page ", "lzo ", "anon ", "block ",
+		"cpu ", "write ",
+	};
+	int i = 0;
+
+	while (i < PAGE_SZ) {
+		const char *w;
+		int len;
+
+		seed = seed * 1103515245 + 12345;
+		if ((seed >> 16) & 1) {
+			/* random byte to keep the ratio near 2:1 */
+			p[i++] = seed >> 24;
+			continue;
+		}
+		w = words[(seed >> 20) & 7];
+		len = strlen(w);
+		if (i + len > PAGE_SZ)
+			len = PAGE_SZ - i;
+		memcpy(p + i, w, len);
+		i += len;
+	}
+}
+
+static void *writer_fn(void *arg)
+{
+	struct writer *w = arg;
+	unsigned long long pg = 0;
+	char *buf;
+
+	if (posix_memalign((void **)&buf, PAGE_SZ, PAGE_SZ))
+		return NULL;
+
+	while (!stop) {
+		fill_page(buf, (unsigned int)(w->first + pg + w->done));
+		if (pwrite(w->fd, buf, PAGE_SZ,
+			   (off_t)(w->first + pg) * PAGE_SZ) != PAGE_SZ) {
+			perror("pwrite");
+			break;
+		}
+		w->done++;
+		if (++pg == w->nr)
+			pg = 0;
+	}
+
+	free(buf);
+	return NULL;
+}
+
+static int set_streams(int n)
+{
+	FILE *f = fopen(streams_path, "w");
+
+	if (!f) {
+		perror(streams_path);
+		return -1;
+	}
+	fprintf(f, "%d\n", n);
+	return fclose(f);
+}
+
+/* Returns throughput in MB/s, or a negative value on error */
+static double run(int nr_threads, int streams, int seconds)
+{
+	struct writer *w;
+	struct timeval start, end;
+	unsigned long long total = 0;
+	double secs;
+	int i;
+
+	if (set_streams(streams))
+		return -1;
+
+	w = calloc(nr_threads, sizeof(*w));
+	if (!w)
+		return -1;
+
+	stop = 0;
+	gettimeofday(&start, NULL);
+	for (i = 0; i < nr_threads; i++) {
+		w[i].nr = dev_pages / nr_threads;
+		w[i].first = i * w[i].nr;
+		w[i].fd = open(dev_path, O_WRONLY | O_DIRECT);
+		if (w[i].fd < 0) {
+			perror(dev_path);
+			exit(1);
+		}
+		pthread_create(&w[i].thread, NULL, writer_fn, &w[i]);
+	}
+
+	sleep(seconds);
+	stop = 1;
+
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(w[i].thread, NULL);
+		close(w[i].fd);
+		total += w[i].done;
+	}
+	gettimeofday(&end, NULL);
+	free(w);
+
+	secs = (end.tv_sec - start.tv_sec) +
+	       (end.tv_usec - start.tv_usec) / 1e6;
+	return total * (double)PAGE_SZ / (1024 * 1024) / secs;
+}
+
+int main(int argc, char *argv[])
+{
+	int max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	int seconds = 5;
+	unsigned long long bytes;
+	int opt, n, fd;
+
+	while ((opt = getopt(argc, argv, "d:n:t:")) != -1) {
+		switch (opt) {
+		case 'd':
+			snprintf(dev_path, sizeof(dev_path), "/dev/%s", optarg);
+			snprintf(streams_path, sizeof(streams_path),
+				 "/sys/block/%s/max_comp_streams", optarg);
+			break;
+		case 'n':
+			max_threads = atoi(optarg);
+			break;
+		case 't':
+			seconds = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-d zram<id>] "
+				"[-n max_threads] [-t seconds]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	fd = open(dev_path, O_RDONLY);
+	if (fd < 0 || ioctl(fd, BLKGETSIZE64, &bytes) < 0) {
+		perror(dev_path);
+		return 1;
+	}
+	close(fd);
+	dev_pages = bytes / PAGE_SZ;
+	if (dev_pages < (unsigned long long)max_threads) {
+		fprintf(stderr, "%s: device too small\n", dev_path);
+		return 1;
+	}
+
+	printf("%8s %14s %14s %8s\n", "writers", "1 stream MB/s",
+	       "N streams MB/s", "speedup");
+	for (n = 1; n <= max_threads; n *= 2) {
+		double one = run(n, 1, seconds);
+		double many = run(n, n, seconds);
+
+		if (one < 0 || many < 0)
+			return 1;
+		printf("%8d %14.1f %14.1f %7.2fx\n", n, one, many, many / one);
+	}
+
+	set_streams(max_threads);
+	return 0;
+}